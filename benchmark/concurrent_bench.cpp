@@ -0,0 +1,647 @@
+// Measures how knn_search throughput scales with threads and how concurrent
+// writes affect search latency.
+//
+// Every connection that opens a vectorlite table holds its own copy of the
+// index, so readers only see the writes of other threads if they share the
+// writers' connection. Hence three scenarios are run:
+// 1. Read scaling: each reader thread opens its own connection and loads its
+//    own copy of the table from an index file.
+// 2. Mixed load: reader and writer threads share a single connection in
+//    serialized mode, readers searching while writers insert and delete rows.
+// 3. Separate connections: each writer inserts on its own connection and
+//    saves the index file by reopening it every --publish_ms, while readers
+//    reopen their connection to see the saved rows. Reports how old the
+//    newest rows the readers see are, and how often a writer's last save is
+//    lost because another writer saved its own copy of the index over it.
+//
+// Usage: concurrent-bench [--rows=20000] [--dim=64] [--k=10] [--ef=64]
+//          [--seconds=2] [--max_readers=<hardware threads>] [--writers=4]
+//          [--mixed_readers=2] [--publish_ms=50]
+//          [--trace=<path of a trace file>]
+// ctest runs it with a small table, which catches data races when vectorlite
+// is built with OPTION_ENABLE_TSAN.
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+
+// Defined by the vectorlite library.
+extern "C" int sqlite3_extension_init(sqlite3* db, char** pzErrMsg,
+                                      const sqlite3_api_routines* pApi);
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Writers delete the rows they inserted once they inserted kLiveRows more.
+constexpr sqlite3_int64 kLiveRows = 500;
+
+struct Options {
+  size_t rows = 20000;
+  size_t dim = 64;
+  size_t k = 10;
+  size_t ef = 64;
+  double seconds = 2;
+  size_t max_readers = std::max(std::thread::hardware_concurrency(), 1u);
+  size_t writers = 4;
+  size_t mixed_readers = 2;
+  // How often writers on separate connections save the index file.
+  size_t publish_ms = 50;
+  // Traces the run with vectorlite_trace() if not empty.
+  std::string trace;
+};
+
+bool ParseFlag(std::string_view arg, std::string_view name, size_t* value) {
+  std::string prefix = absl::StrFormat("--%s=", name);
+  if (!absl::StartsWith(arg, prefix)) {
+    return false;
+  }
+  if (!absl::SimpleAtoi(arg.substr(prefix.size()), value)) {
+    std::fprintf(stderr, "Invalid value of --%s\n", std::string(name).c_str());
+    std::exit(1);
+  }
+  return true;
+}
+
+Options ParseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (absl::StartsWith(arg, "--seconds=")) {
+      if (!absl::SimpleAtod(arg.substr(10), &options.seconds)) {
+        std::fprintf(stderr, "Invalid value of --seconds\n");
+        std::exit(1);
+      }
+    } else if (absl::StartsWith(arg, "--trace=")) {
+      options.trace = arg.substr(8);
+    } else if (!ParseFlag(arg, "rows", &options.rows) &&
+               !ParseFlag(arg, "dim", &options.dim) &&
+               !ParseFlag(arg, "k", &options.k) &&
+               !ParseFlag(arg, "ef", &options.ef) &&
+               !ParseFlag(arg, "max_readers", &options.max_readers) &&
+               !ParseFlag(arg, "writers", &options.writers) &&
+               !ParseFlag(arg, "mixed_readers", &options.mixed_readers) &&
+               !ParseFlag(arg, "publish_ms", &options.publish_ms)) {
+      std::fprintf(stderr, "Unknown flag %s\n", argv[i]);
+      std::exit(1);
+    }
+  }
+  return options;
+}
+
+// The benchmark can't do anything useful after an error, so it exits.
+void Check(int rc, sqlite3* db, std::string_view what) {
+  if (rc != SQLITE_OK && rc != SQLITE_ROW && rc != SQLITE_DONE) {
+    std::fprintf(stderr, "%s failed: %s\n", std::string(what).c_str(),
+                 db ? sqlite3_errmsg(db) : sqlite3_errstr(rc));
+    std::exit(1);
+  }
+}
+
+sqlite3* Open() {
+  sqlite3* db = nullptr;
+  int rc = sqlite3_open_v2(
+      ":memory:", &db,
+      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX,
+      nullptr);
+  Check(rc, db, "sqlite3_open_v2");
+  return db;
+}
+
+void Exec(sqlite3* db, const std::string& sql) {
+  Check(sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr), db, sql);
+}
+
+// A statement prepared on a connection, which may be shared by threads.
+class Statement {
+ public:
+  Statement(sqlite3* db, const std::string& sql) : db_(db) {
+    Check(sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt_, nullptr), db, sql);
+  }
+
+  ~Statement() { sqlite3_finalize(stmt_); }
+
+  Statement(const Statement&) = delete;
+  Statement& operator=(const Statement&) = delete;
+
+  void BindBlob(int index, const std::vector<float>& vector) {
+    Check(sqlite3_bind_blob(stmt_, index, vector.data(),
+                            vector.size() * sizeof(float), SQLITE_STATIC),
+          db_, "sqlite3_bind_blob");
+  }
+
+  void BindText(int index, const std::string& text) {
+    Check(sqlite3_bind_text(stmt_, index, text.c_str(), -1, SQLITE_STATIC), db_,
+          "sqlite3_bind_text");
+  }
+
+  void BindInt64(int index, sqlite3_int64 value) {
+    Check(sqlite3_bind_int64(stmt_, index, value), db_, "sqlite3_bind_int64");
+  }
+
+  // Steps through all result rows and returns their number.
+  size_t Run() {
+    size_t num_rows = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt_)) == SQLITE_ROW) {
+      num_rows++;
+    }
+    Check(rc, db_, sqlite3_sql(stmt_));
+    sqlite3_reset(stmt_);
+    return num_rows;
+  }
+
+ private:
+  sqlite3* db_;
+  sqlite3_stmt* stmt_ = nullptr;
+};
+
+std::vector<float> RandomVector(size_t dim, std::mt19937& rng) {
+  std::uniform_real_distribution<float> uniform;
+  std::vector<float> vector(dim);
+  for (auto& x : vector) {
+    x = uniform(rng);
+  }
+  return vector;
+}
+
+std::string CreateTableSql(const Options& options,
+                           const std::filesystem::path& index_file) {
+  // Leaves room for the rows the writers insert before deleting them.
+  size_t max_elements = options.rows + 1000 * (options.writers + 1);
+  return absl::StrFormat(
+      "create virtual table x using vectorlite(v float32[%d] l2, "
+      "hnsw(max_elements=%d), '%s')",
+      options.dim, max_elements, index_file.string());
+}
+
+// Builds the table in index_file, which is saved when the connection closes.
+void BuildIndexFile(const Options& options,
+                    const std::filesystem::path& index_file) {
+  sqlite3* db = Open();
+  Exec(db, CreateTableSql(options, index_file));
+  std::mt19937 rng(42);
+  std::vector<sqlite3_int64> rowids(options.rows);
+  std::vector<float> vectors;
+  vectors.reserve(options.rows * options.dim);
+  for (size_t i = 0; i < options.rows; i++) {
+    rowids[i] = static_cast<sqlite3_int64>(i);
+    auto vector = RandomVector(options.dim, rng);
+    vectors.insert(vectors.end(), vector.begin(), vector.end());
+  }
+  sqlite3_stmt* stmt = nullptr;
+  Check(sqlite3_prepare_v2(db, "select vectorlite_bulk_insert('x', ?, ?)", -1,
+                           &stmt, nullptr),
+        db, "prepare vectorlite_bulk_insert");
+  sqlite3_bind_blob(stmt, 1, rowids.data(),
+                    rowids.size() * sizeof(sqlite3_int64), SQLITE_STATIC);
+  sqlite3_bind_blob(stmt, 2, vectors.data(), vectors.size() * sizeof(float),
+                    SQLITE_STATIC);
+  Check(sqlite3_step(stmt), db, "vectorlite_bulk_insert");
+  sqlite3_finalize(stmt);
+  Check(sqlite3_close(db), nullptr, "sqlite3_close");
+}
+
+// Latencies in microseconds.
+struct Latencies {
+  std::vector<double> samples;
+
+  void Merge(const Latencies& other) {
+    samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+  }
+
+  // q in [0, 1]. Sorts the samples.
+  double Percentile(double q) {
+    if (samples.empty()) {
+      return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t i = std::min(samples.size() - 1,
+                        static_cast<size_t>(q * samples.size()));
+    return samples[i];
+  }
+};
+
+// Starts threads together once they are all ready and stops them after the
+// configured duration.
+class Run {
+ public:
+  explicit Run(size_t num_threads) : num_threads_(num_threads) {}
+
+  // Called by each thread once it's ready to go.
+  void WaitForStart() {
+    ready_.fetch_add(1);
+    while (!started_.load()) {
+      std::this_thread::yield();
+    }
+  }
+
+  bool stopped() const { return stopped_.load(std::memory_order_relaxed); }
+
+  // Returns the seconds that passed between start and stop.
+  double StartAndStopAfter(double seconds) {
+    while (ready_.load() < num_threads_) {
+      std::this_thread::yield();
+    }
+    auto start = Clock::now();
+    started_.store(true);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stopped_.store(true);
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+ private:
+  size_t num_threads_;
+  std::atomic<size_t> ready_{0};
+  std::atomic<bool> started_{false};
+  std::atomic<bool> stopped_{false};
+};
+
+std::string SearchSql(const Options& options) {
+  return absl::StrFormat(
+      "select rowid, distance from x where knn_search(v, knn_param(?, %d, "
+      "%d))",
+      options.k, options.ef);
+}
+
+// Searches db until run stops, recording the latency of each search.
+void Search(const Options& options, sqlite3* db, uint32_t seed, Run& run,
+            Latencies& latencies) {
+  Statement search(db, SearchSql(options));
+  std::mt19937 rng(seed);
+  std::vector<std::vector<float>> queries;
+  for (int i = 0; i < 64; i++) {
+    queries.push_back(RandomVector(options.dim, rng));
+  }
+  run.WaitForStart();
+  for (size_t i = 0; !run.stopped(); i++) {
+    search.BindBlob(1, queries[i % queries.size()]);
+    auto start = Clock::now();
+    if (search.Run() != options.k) {
+      std::fprintf(stderr, "knn_search returned too few rows\n");
+      std::exit(1);
+    }
+    latencies.samples.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count());
+  }
+}
+
+// Inserts rows above the rowids of the table and deletes them again, keeping
+// at most kLiveRows of them, until run stops.
+void Write(const Options& options, sqlite3* db, size_t writer, Run& run,
+           Latencies& latencies) {
+  Statement insert(db, "insert into x(rowid, v) values (?, ?)");
+  Statement remove(db, "delete from x where rowid = ?");
+  std::mt19937 rng(1000 + writer);
+  auto vector = RandomVector(options.dim, rng);
+  sqlite3_int64 base = options.rows + writer * 1000000;
+  run.WaitForStart();
+  for (sqlite3_int64 i = 0; !run.stopped(); i++) {
+    auto start = Clock::now();
+    if (i >= kLiveRows) {
+      remove.BindInt64(1, base + i - kLiveRows);
+      remove.Run();
+    }
+    insert.BindInt64(1, base + i);
+    vector[i % options.dim] = std::uniform_real_distribution<float>()(rng);
+    insert.BindBlob(2, vector);
+    insert.Run();
+    latencies.samples.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count());
+  }
+}
+
+void RunReadScaling(const Options& options,
+                    const std::filesystem::path& index_file) {
+  std::printf("\nRead scaling: one connection per reader\n");
+  std::printf("%8s %10s %8s %10s %10s %10s\n", "readers", "qps", "speedup",
+              "p50(us)", "p99(us)", "p99.9(us)");
+  std::vector<size_t> reader_counts;
+  for (size_t n = 1; n < options.max_readers; n *= 2) {
+    reader_counts.push_back(n);
+  }
+  reader_counts.push_back(options.max_readers);
+
+  double single_thread_qps = 0;
+  for (size_t num_readers : reader_counts) {
+    // Connections save the index when they close, so each reader loads its
+    // own copy of the index file.
+    std::vector<std::filesystem::path> copies;
+    std::vector<sqlite3*> dbs;
+    for (size_t i = 0; i < num_readers; i++) {
+      copies.push_back(index_file.string() + std::to_string(i));
+      std::filesystem::copy_file(
+          index_file, copies.back(),
+          std::filesystem::copy_options::overwrite_existing);
+      dbs.push_back(Open());
+      Exec(dbs.back(), CreateTableSql(options, copies.back()));
+    }
+
+    Run run(num_readers);
+    std::vector<Latencies> latencies(num_readers);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < num_readers; i++) {
+      readers.emplace_back(Search, std::cref(options), dbs[i], i, std::ref(run),
+                           std::ref(latencies[i]));
+    }
+    double seconds = run.StartAndStopAfter(options.seconds);
+    for (auto& reader : readers) {
+      reader.join();
+    }
+
+    Latencies all;
+    for (auto& l : latencies) {
+      all.Merge(l);
+    }
+    double qps = all.samples.size() / seconds;
+    if (num_readers == 1) {
+      single_thread_qps = qps;
+    }
+    std::printf("%8zu %10.0f %8.2f %10.1f %10.1f %10.1f\n", num_readers, qps,
+                qps / single_thread_qps, all.Percentile(0.5),
+                all.Percentile(0.99), all.Percentile(0.999));
+    for (size_t i = 0; i < num_readers; i++) {
+      Check(sqlite3_close(dbs[i]), nullptr, "sqlite3_close");
+      std::filesystem::remove(copies[i]);
+    }
+  }
+}
+
+void RunMixedLoad(const Options& options,
+                  const std::filesystem::path& index_file) {
+  std::printf("\nMixed load: %zu readers and the writers share a connection\n",
+              options.mixed_readers);
+  std::printf("%8s %10s %10s %10s %10s %10s %12s\n", "writers", "qps",
+              "p50(us)", "p99(us)", "p99.9(us)", "writes/s",
+              "write p99(us)");
+  for (size_t num_writers = 0; num_writers <= options.writers; num_writers++) {
+    auto copy = index_file.string() + "mixed";
+    std::filesystem::copy_file(
+        index_file, copy, std::filesystem::copy_options::overwrite_existing);
+    sqlite3* db = Open();
+    Exec(db, CreateTableSql(options, copy));
+
+    Run run(options.mixed_readers + num_writers);
+    std::vector<Latencies> search_latencies(options.mixed_readers);
+    std::vector<Latencies> write_latencies(num_writers);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < options.mixed_readers; i++) {
+      threads.emplace_back(Search, std::cref(options), db, i, std::ref(run),
+                           std::ref(search_latencies[i]));
+    }
+    for (size_t i = 0; i < num_writers; i++) {
+      threads.emplace_back(Write, std::cref(options), db, i, std::ref(run),
+                           std::ref(write_latencies[i]));
+    }
+    double seconds = run.StartAndStopAfter(options.seconds);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    Latencies searches;
+    for (auto& l : search_latencies) {
+      searches.Merge(l);
+    }
+    Latencies writes;
+    for (auto& l : write_latencies) {
+      writes.Merge(l);
+    }
+    std::printf("%8zu %10.0f %10.1f %10.1f %10.1f %10.0f %12.1f\n",
+                num_writers, searches.samples.size() / seconds,
+                searches.Percentile(0.5), searches.Percentile(0.99),
+                searches.Percentile(0.999), writes.samples.size() / seconds,
+                writes.Percentile(0.99));
+    Check(sqlite3_close(db), nullptr, "sqlite3_close");
+    std::filesystem::remove(copy);
+  }
+}
+
+// The index file shared by the connections of the separate connections
+// scenario. Loading an index file while another connection saves it could
+// read a partly written file, so connections open and close while holding
+// mutex.
+struct SharedIndexFile {
+  std::filesystem::path path;
+  std::mutex mutex;
+  // For each save of each writer, the rowid the writer inserted last before
+  // it and when.
+  std::vector<std::vector<std::pair<sqlite3_int64, Clock::time_point>>> saves;
+};
+
+// Like Write(), but on a connection of its own that is reopened every
+// --publish_ms to save the index file.
+void WriteAndSave(const Options& options, SharedIndexFile& file, size_t writer,
+                  Run& run, size_t& num_writes) {
+  sqlite3* db = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(file.mutex);
+    db = Open();
+    Exec(db, CreateTableSql(options, file.path));
+  }
+  std::mt19937 rng(1000 + writer);
+  auto vector = RandomVector(options.dim, rng);
+  sqlite3_int64 base = options.rows + writer * 1000000;
+  sqlite3_int64 i = 0;
+  Clock::time_point last_insert;
+  run.WaitForStart();
+  while (true) {
+    {
+      // Statements must be finalized before their connection closes.
+      Statement insert(db, "insert into x(rowid, v) values (?, ?)");
+      Statement remove(db, "delete from x where rowid = ?");
+      auto save_at =
+          Clock::now() + std::chrono::milliseconds(options.publish_ms);
+      for (; !run.stopped() && Clock::now() < save_at; i++) {
+        if (i >= kLiveRows) {
+          remove.BindInt64(1, base + i - kLiveRows);
+          remove.Run();
+        }
+        insert.BindInt64(1, base + i);
+        vector[i % options.dim] = std::uniform_real_distribution<float>()(rng);
+        insert.BindBlob(2, vector);
+        insert.Run();
+        last_insert = Clock::now();
+      }
+    }
+    std::lock_guard<std::mutex> lock(file.mutex);
+    Check(sqlite3_close(db), nullptr, "sqlite3_close");
+    if (i > 0) {
+      file.saves[writer].emplace_back(base + i - 1, last_insert);
+    }
+    if (run.stopped()) {
+      break;
+    }
+    db = Open();
+    Exec(db, CreateTableSql(options, file.path));
+  }
+  num_writes = i;
+}
+
+// Reopens a connection on a copy of the shared index file every --publish_ms
+// until run stops. After each reopen, looks up the rows each writer inserted
+// last before its latest saves, newest first. Counts how often the latest
+// one is visible and records the age of the newest visible one in
+// milliseconds.
+void RefreshAndLookUp(const Options& options, SharedIndexFile& file,
+                      size_t reader, Run& run, Latencies& staleness,
+                      size_t& num_lookups, size_t& num_visible) {
+  // Rows of older saves may have been deleted by their writer.
+  constexpr size_t kMaxSavesLookedUp = 16;
+  // The reader's connection saves its copy when it closes, which must not
+  // overwrite the writers' rows. It's closed before the copy is refreshed.
+  std::filesystem::path copy =
+      file.path.string() + "reader" + std::to_string(reader);
+  sqlite3* db = nullptr;
+  run.WaitForStart();
+  while (!run.stopped()) {
+    if (db != nullptr) {
+      Check(sqlite3_close(db), nullptr, "sqlite3_close");
+    }
+    std::vector<std::vector<std::pair<sqlite3_int64, Clock::time_point>>>
+        saves;
+    {
+      std::lock_guard<std::mutex> lock(file.mutex);
+      std::filesystem::copy_file(
+          file.path, copy, std::filesystem::copy_options::overwrite_existing);
+      saves = file.saves;
+    }
+    db = Open();
+    Exec(db, CreateTableSql(options, copy));
+    auto now = Clock::now();
+    {
+      Statement lookup(db, "select rowid from x where rowid = ?");
+      for (const auto& writer_saves : saves) {
+        if (writer_saves.empty()) {
+          continue;
+        }
+        num_lookups++;
+        for (size_t j = 0;
+             j < std::min(writer_saves.size(), kMaxSavesLookedUp); j++) {
+          const auto& [rowid, inserted] = writer_saves.rbegin()[j];
+          lookup.BindInt64(1, rowid);
+          if (lookup.Run() == 1) {
+            num_visible += j == 0;
+            staleness.samples.push_back(
+                std::chrono::duration<double, std::milli>(now - inserted)
+                    .count());
+            break;
+          }
+        }
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.publish_ms));
+  }
+  if (db != nullptr) {
+    Check(sqlite3_close(db), nullptr, "sqlite3_close");
+  }
+  std::filesystem::remove(copy);
+}
+
+void RunSeparateConnections(const Options& options,
+                            const std::filesystem::path& index_file) {
+  std::printf(
+      "\nSeparate connections: %zu readers, writers save every %zums\n",
+      options.mixed_readers, options.publish_ms);
+  std::printf("%8s %10s %10s %14s %14s\n", "writers", "writes/s",
+              "visible(%)", "stale p50(ms)", "stale p99(ms)");
+  for (size_t num_writers = 1; num_writers <= options.writers; num_writers++) {
+    SharedIndexFile file;
+    file.path = index_file.string() + "shared";
+    file.saves.resize(num_writers);
+    std::filesystem::copy_file(
+        index_file, file.path,
+        std::filesystem::copy_options::overwrite_existing);
+
+    Run run(options.mixed_readers + num_writers);
+    std::vector<Latencies> staleness(options.mixed_readers);
+    std::vector<size_t> num_lookups(options.mixed_readers, 0);
+    std::vector<size_t> num_visible(options.mixed_readers, 0);
+    std::vector<size_t> num_writes(num_writers, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < options.mixed_readers; i++) {
+      threads.emplace_back(RefreshAndLookUp, std::cref(options),
+                           std::ref(file), i, std::ref(run),
+                           std::ref(staleness[i]), std::ref(num_lookups[i]),
+                           std::ref(num_visible[i]));
+    }
+    for (size_t i = 0; i < num_writers; i++) {
+      threads.emplace_back(WriteAndSave, std::cref(options), std::ref(file), i,
+                           std::ref(run), std::ref(num_writes[i]));
+    }
+    double seconds = run.StartAndStopAfter(options.seconds);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    Latencies all;
+    size_t lookups = 0;
+    size_t visible = 0;
+    for (size_t i = 0; i < options.mixed_readers; i++) {
+      all.Merge(staleness[i]);
+      lookups += num_lookups[i];
+      visible += num_visible[i];
+    }
+    size_t writes = 0;
+    for (size_t n : num_writes) {
+      writes += n;
+    }
+    std::printf("%8zu %10.0f %10.1f %14.1f %14.1f\n", num_writers,
+                writes / seconds, lookups > 0 ? 100.0 * visible / lookups : 0,
+                all.Percentile(0.5), all.Percentile(0.99));
+    std::filesystem::remove(file.path);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options = ParseOptions(argc, argv);
+  if (sqlite3_threadsafe() == 0) {
+    std::fprintf(stderr, "sqlite3 is built without thread safety\n");
+    return 1;
+  }
+  Check(sqlite3_auto_extension(
+            reinterpret_cast<void (*)()>(sqlite3_extension_init)),
+        nullptr, "sqlite3_auto_extension");
+
+  auto index_file = std::filesystem::temp_directory_path() /
+                    absl::StrFormat("vectorlite_concurrent_bench_%d.bin",
+                                    static_cast<int>(std::random_device()()));
+  BuildIndexFile(options, index_file);
+  // Tracing is process-wide, so any connection can turn it on and off.
+  sqlite3* db = Open();
+  if (!options.trace.empty()) {
+    Statement trace(db, "select vectorlite_trace(?)");
+    trace.BindText(1, options.trace);
+    trace.Run();
+  }
+  std::printf("rows=%zu dim=%zu k=%zu ef=%zu seconds=%.1f\n", options.rows,
+              options.dim, options.k, options.ef, options.seconds);
+  RunReadScaling(options, index_file);
+  RunMixedLoad(options, index_file);
+  RunSeparateConnections(options, index_file);
+  if (!options.trace.empty()) {
+    Exec(db, "select vectorlite_trace(null)");
+  }
+  Check(sqlite3_close(db), nullptr, "sqlite3_close");
+  std::filesystem::remove(index_file);
+  return 0;
+}
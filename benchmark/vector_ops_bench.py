@@ -0,0 +1,90 @@
+import os
+import random
+import sqlite3
+import sys
+import timeit
+from array import array
+"""
+Compares the vector arithmetic SQL functions, e.g. vector_sub(a, b), with fetching the vector BLOBs and computing the
+result in Python, with NumPy if it's installed and with plain Python otherwise or in addition.
+
+Usage: USE_LOCAL_VECTORLITE=<path of vectorlite.so> python3 vector_ops_bench.py [num_rows] [dim]
+Without USE_LOCAL_VECTORLITE, the vectorlite_py package is used.
+"""
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+use_local_vectorlite = os.environ.get('USE_LOCAL_VECTORLITE')
+
+if not use_local_vectorlite:
+    import vectorlite_py
+
+NUM_ROWS = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+DIM = int(sys.argv[2]) if len(sys.argv) > 2 else 768
+REPEAT = 5
+
+conn = sqlite3.connect(':memory:')
+conn.enable_load_extension(True)
+conn.load_extension(use_local_vectorlite if use_local_vectorlite else vectorlite_py.vectorlite_path())
+cur = conn.cursor()
+
+random.seed(42)
+def random_vector():
+    return array('f', (random.random() for _ in range(DIM))).tobytes()
+
+cur.execute('create table t(id integer primary key, a blob, b blob)')
+cur.executemany('insert into t values (?, ?, ?)', [(i, random_vector(), random_vector()) for i in range(NUM_ROWS)])
+
+def fetch_pairs():
+    return cur.execute('select a, b from t').fetchall()
+
+def python_sub(a, b):
+    return array('f', (x - y for x, y in zip(array('f', a), array('f', b)))).tobytes()
+
+def python_dot(a, b):
+    return sum(x * y for x, y in zip(array('f', a), array('f', b)))
+
+def python_concat(a, b):
+    return (array('f', a) + array('f', b)).tobytes()
+
+def numpy_sub(a, b):
+    return (np.frombuffer(a, dtype=np.float32) - np.frombuffer(b, dtype=np.float32)).tobytes()
+
+def numpy_dot(a, b):
+    return float(np.dot(np.frombuffer(a, dtype=np.float32), np.frombuffer(b, dtype=np.float32)))
+
+def numpy_concat(a, b):
+    return np.concatenate((np.frombuffer(a, dtype=np.float32), np.frombuffer(b, dtype=np.float32))).tobytes()
+
+# Each case is (name, SQL computing the result, Python round trip, NumPy round trip).
+cases = [
+    ('vector_sub', 'select vector_sub(a, b) from t', python_sub, numpy_sub),
+    ('vector_dot', 'select vector_dot(a, b) from t', python_dot, numpy_dot),
+    ('vector_concat', 'select vector_concat(a, b) from t', python_concat, numpy_concat),
+]
+
+def best_ms(fn):
+    return min(timeit.repeat(fn, number=1, repeat=REPEAT)) * 1000
+
+print(f'{NUM_ROWS} rows of {DIM}-dim pairs, best of {REPEAT} runs')
+if np is None:
+    print('NumPy is not installed, skipping the NumPy round trip.')
+print(f'{"function":>14} {"sql(ms)":>10} {"python(ms)":>11} {"numpy(ms)":>10}')
+for name, sql, python_fn, numpy_fn in cases:
+    # The SQL results must match the round trips, up to float rounding of dot.
+    sql_results = [row[0] for row in cur.execute(sql).fetchall()]
+    python_results = [python_fn(a, b) for a, b in fetch_pairs()]
+    if name == 'vector_dot':
+        assert all(abs(x - y) <= 1e-3 * abs(y) for x, y in zip(sql_results, python_results))
+    else:
+        assert sql_results == python_results
+
+    sql_ms = best_ms(lambda: cur.execute(sql).fetchall())
+    python_ms = best_ms(lambda: [python_fn(a, b) for a, b in fetch_pairs()])
+    numpy_ms = best_ms(lambda: [numpy_fn(a, b) for a, b in fetch_pairs()]) if np is not None else float('nan')
+    print(f'{name:>14} {sql_ms:>10.1f} {python_ms:>11.1f} {numpy_ms:>10.1f}')
+
+conn.close()
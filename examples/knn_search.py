@@ -88,7 +88,9 @@ print(f'time taken for calculating recall rate: {time_taken} seconds')
 # It can be achieved by passing ef to the 3rd argument of knn_param.
 # For more info on ef, please check https://github.com/nmslib/hnswlib/blob/v0.8.0/ALGO_PARAMS.md
 # The default value of ef is 10. In this example, we set ef to 32. 
-# Note: ef is not part of the index, modifying it is an imperative operation. If it is not set in later queries, it will always be 32.
+# Note: ef only applies to the query that sets it. Later queries without ef still use the default value.
+# Optionally, a time budget in milliseconds can be passed as the 4th argument of knn_param, e.g. knn_param(?, ?, ?, 50).
+# Once the search runs longer than that, it returns the best results found so far. ef can be NULL if only the time budget is needed.
 time_taken = timeit.timeit(lambda: test_recall('x', 'my_embedding', 32), number=1)
 print(f'time taken for calculating recall rate with ef=32: {time_taken} seconds')
 
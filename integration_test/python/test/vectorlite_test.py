@@ -7,8 +7,8 @@ import tempfile
 import os
 import platform
 
-def get_connection():
-    conn = apsw.Connection(':memory:')
+def get_connection(path=':memory:'):
+    conn = apsw.Connection(path)
     conn.enable_load_extension(True)
     conn.load_extension(vectorlite_py.vectorlite_path())
     return conn
@@ -69,6 +69,607 @@ def test_virtual_table_happy_path(conn, random_vectors):
     for space in spaces:
         test_with_space(space)
 
+def test_knn_param_with_timeout(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+    # timeout_ms is the 4th param of knn_param. ef can be NULL if only timeout is needed.
+    result = cur.execute('select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?, NULL, ?))', (random_vectors[0].tobytes(), 10, 10000)).fetchall()
+    assert len(result) == 10 and result[0][0] == 0
+
+    result = cur.execute('select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?, ?, ?))', (random_vectors[0].tobytes(), 10, 32, 10000)).fetchall()
+    assert len(result) == 10 and result[0][0] == 0
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute('select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?, NULL, ?))', (random_vectors[0].tobytes(), 10, 0)).fetchall()
+
+    cur.execute('drop table x')
+
+def test_prefix_search(conn, random_vectors):
+    cur = conn.cursor()
+    # The index is traversed using the first DIM/4 elements of vectors, results are reranked using all elements.
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}:{DIM // 4}], hnsw(max_elements={NUM_ELEMENTS}))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+    result = cur.execute('select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?, ?))', (random_vectors[0].tobytes(), 10, 100)).fetchall()
+    assert len(result) == 10 and result[0][0] == 0
+    distances = [distance for _, distance in result]
+    assert distances == sorted(distances)
+
+    result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?)) and rowid in (1, 2, 3)', (random_vectors[0].tobytes(), 10)).fetchall()
+    assert sorted(rowid for (rowid,) in result) == [1, 2, 3]
+
+    cur.execute('drop table x')
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}:{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+
+def test_result_cache(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS + 1}, result_cache_size=16))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+    query = 'select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?))'
+    first = cur.execute(query, (random_vectors[1].tobytes(), 10)).fetchall()
+    second = cur.execute(query, (random_vectors[1].tobytes(), 10)).fetchall()
+    assert first == second
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+    assert stats['vector_count'] == NUM_ELEMENTS
+    assert stats['result_cache']['hits'] == 1 and stats['result_cache']['misses'] == 1
+
+    # Writes invalidate cached results.
+    cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (NUM_ELEMENTS, random_vectors[1].tobytes()))
+    result = cur.execute(query, (random_vectors[1].tobytes(), 10)).fetchall()
+    assert NUM_ELEMENTS in [rowid for rowid, _ in result]
+    stats = json.loads(cur.execute("select vectorlite_stats('main.x')").fetchone()[0])
+    assert stats['result_cache']['hits'] == 1 and stats['result_cache']['misses'] == 2
+
+    cur.execute('drop table x')
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_stats('x')")
+
+def test_semantic_cache(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}, semantic_cache_size=8, semantic_cache_epsilon=0.001))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+    query = 'select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?))'
+    expected = cur.execute(query, (random_vectors[1].tobytes(), 10)).fetchall()
+    # A query vector within epsilon of a cached one is served from the cache.
+    nearby = random_vectors[1] + np.float32(0.001)
+    assert cur.execute(query, (nearby.tobytes(), 10)).fetchall() == expected
+    # Different parameters don't hit the cache.
+    assert len(cur.execute(query, (nearby.tobytes(), 5)).fetchall()) == 5
+
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])['semantic_cache']
+    assert stats['hits'] == 1 and stats['misses'] == 2
+    assert stats['saved_distance_computations'] > 0
+
+    cur.execute('drop table x')
+
+def test_search_stats(conn, random_vectors):
+    cur = conn.cursor()
+    for space in ['l2', 'cosine']:
+        cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}] {space}, hnsw(max_elements={NUM_ELEMENTS}))')
+        for i in range(NUM_ELEMENTS):
+            cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+        for i in range(10):
+            result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[i].tobytes(), 10)).fetchall()
+            assert result[0][0] == i
+
+        stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])['search']
+        assert stats['searches'] == 10
+        assert stats['distance_computations'] > 0
+        assert stats['distance_flops'] > 0 and stats['distance_flops_saved'] >= 0
+        cur.execute('drop table x')
+
+def test_parallel_search(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS},search_threads=4))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+    for i in range(10):
+        # A large ef splits the graph search across threads.
+        result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?, ?))', (random_vectors[i].tobytes(), 10, 600)).fetchall()
+        assert len(result) == 10 and result[0][0] == i
+
+        # ef covering the whole table scans it exhaustively, which is exact.
+        result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?, ?))', (random_vectors[i].tobytes(), 10, NUM_ELEMENTS)).fetchall()
+        distances = np.sum((random_vectors - random_vectors[i]) ** 2, axis=1)
+        assert [r[0] for r in result] == list(np.argsort(distances)[:10])
+
+    # A rowid filter allowing at most ef rows is scanned exhaustively as well.
+    result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?)) and rowid in (1, 2, 3)', (random_vectors[2].tobytes(), 10)).fetchall()
+    assert sorted(r[0] for r in result) == [1, 2, 3] and result[0][0] == 2
+
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])['search']
+    assert stats['threads'] == 4
+    assert stats['searches'] == 21
+    assert stats['parallel_searches'] == 10
+    assert stats['exact_searches'] == 11
+    cur.execute('drop table x')
+
+def test_knn_search_batch(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+    # 10 queries, which is not a multiple of the group size.
+    queries = random_vectors[:10]
+    result = json.loads(cur.execute("select knn_search_batch('x', ?, ?)", (queries.tobytes(), 10)).fetchone()[0])
+    assert len(result) == 10
+    for i, neighbors in enumerate(result):
+        expected = cur.execute('select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?))', (queries[i].tobytes(), 10)).fetchall()
+        assert [n['rowid'] for n in neighbors] == [r[0] for r in expected]
+        assert np.allclose([n['distance'] for n in neighbors], [r[1] for r in expected], atol=1e-5)
+
+    # ef covering the whole table scans it exhaustively, which is exact.
+    result = json.loads(cur.execute("select knn_search_batch('x', ?, ?, ?)", (queries.tobytes(), 10, NUM_ELEMENTS)).fetchone()[0])
+    for i, neighbors in enumerate(result):
+        distances = np.sum((random_vectors - queries[i]) ** 2, axis=1)
+        assert [n['rowid'] for n in neighbors] == list(np.argsort(distances)[:10])
+
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])['search']
+    assert stats['searches'] == 30
+    assert stats['batch_searches'] == 20
+    assert stats['exact_searches'] == 10
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select knn_search_batch('x', ?, ?)", (queries.tobytes()[:-1], 10))
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select knn_search_batch('x', ?, ?)", (queries.tobytes(), 0))
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select knn_search_batch('y', ?, ?)", (queries.tobytes(), 10))
+    cur.execute('drop table x')
+
+def test_bulk_insert(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+    rowids = np.arange(NUM_ELEMENTS, dtype=np.int64)
+    result = cur.execute("select vectorlite_bulk_insert('x', ?, ?, 4)", (rowids.tobytes(), random_vectors.tobytes())).fetchone()[0]
+    assert result == NUM_ELEMENTS
+    assert cur.execute('select count(*) from x').fetchone()[0] == NUM_ELEMENTS
+
+    for i in range(10):
+        result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[i].tobytes(), 10)).fetchall()
+        assert len(result) == 10 and result[0][0] == i
+        vector = cur.execute('select my_embedding from x where rowid = ?', (i,)).fetchone()[0]
+        assert np.allclose(random_vectors[i], np.frombuffer(vector, dtype=np.float32))
+
+    # Rows take the place of deleted rows first.
+    cur.execute('delete from x where rowid in (1, 2)')
+    result = cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (rowids[1:3].tobytes(), random_vectors[1:3].tobytes())).fetchone()[0]
+    assert result == 2
+    result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[2].tobytes(), 1)).fetchall()
+    assert result[0][0] == 2
+
+    # Existing rows
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (rowids[:1].tobytes(), random_vectors[:1].tobytes()))
+    # Vectors don't match rowids
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (np.array([NUM_ELEMENTS], dtype=np.int64).tobytes(), random_vectors[:2].tobytes()))
+    cur.execute('drop table x')
+
+def test_bulk_update(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+    rowids = np.arange(NUM_ELEMENTS, dtype=np.int64)
+    cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (rowids.tobytes(), random_vectors.tobytes()))
+
+    # Swap the vectors of the first and second half of the rows.
+    half = NUM_ELEMENTS // 2
+    new_vectors = np.roll(random_vectors, half, axis=0)
+    result = cur.execute("select vectorlite_bulk_update('x', ?, ?, 4)", (rowids.tobytes(), new_vectors.tobytes())).fetchone()[0]
+    assert result == NUM_ELEMENTS
+    assert cur.execute('select count(*) from x').fetchone()[0] == NUM_ELEMENTS
+
+    for i in range(10):
+        result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[i].tobytes(), 10)).fetchall()
+        assert len(result) == 10 and result[0][0] == i + half
+        vector = cur.execute('select my_embedding from x where rowid = ?', (i,)).fetchone()[0]
+        assert np.allclose(new_vectors[i], np.frombuffer(vector, dtype=np.float32))
+
+    # Deleted rows
+    cur.execute('delete from x where rowid = 1')
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_bulk_update('x', ?, ?)", (rowids[1:2].tobytes(), random_vectors[:1].tobytes()))
+    # Rows updated more than once
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_bulk_update('x', ?, ?)", (np.array([2, 2], dtype=np.int64).tobytes(), random_vectors[:2].tobytes()))
+    cur.execute('drop table x')
+
+def test_bulk_update_recall(conn, random_vectors):
+    cur = conn.cursor()
+    rowids = np.arange(NUM_ELEMENTS, dtype=np.int64)
+    for table in ['x', 'y']:
+        cur.execute(f'create virtual table {table} using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS},M=8,ef_construction=32))')
+        cur.execute(f"select vectorlite_bulk_insert('{table}', ?, ?)", (rowids.tobytes(), random_vectors.tobytes()))
+
+    # Every other row gets a new vector, row by row in x and at once in y.
+    updated = rowids[::2].copy()
+    new_vectors = np.float32(np.random.random((len(updated), DIM)))
+    vectors = random_vectors.copy()
+    vectors[updated] = new_vectors
+    for rowid, vector in zip(updated, new_vectors):
+        cur.execute('update x set my_embedding = ? where rowid = ?', (vector.tobytes(), int(rowid)))
+    assert cur.execute("select vectorlite_bulk_update('y', ?, ?)", (updated.tobytes(), new_vectors.tobytes())).fetchone()[0] == len(updated)
+
+    def recall(table):
+        found = 0
+        for i in range(100):
+            result = cur.execute(f'select rowid from {table} where knn_search(my_embedding, knn_param(?, 10, 10))', (vectors[i].tobytes(),)).fetchall()
+            distances = np.sum((vectors - vectors[i]) ** 2, axis=1)
+            found += len(set(r[0] for r in result) & set(np.argsort(distances)[:10]))
+        return found / 1000
+
+    assert recall('y') >= recall('x') - 0.05
+    cur.execute('drop table x')
+    cur.execute('drop table y')
+
+def test_optimize(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS},M=4,ef_construction=4))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+
+    def recall():
+        found = 0
+        for i in range(100):
+            result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?, ?))', (random_vectors[i].tobytes(), 10, 10)).fetchall()
+            distances = np.sum((random_vectors - random_vectors[i]) ** 2, axis=1)
+            found += len(set(r[0] for r in result) & set(np.argsort(distances)[:10]))
+        return found / 1000
+
+    recall_before = recall()
+    num_changed = cur.execute("select vectorlite_optimize('x', 100, 4)").fetchone()[0]
+    assert 0 < num_changed <= NUM_ELEMENTS
+    assert recall() > recall_before
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_optimize('x', 0)")
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_optimize('y', 100)")
+    cur.execute('drop table x')
+
+def test_interrupt_bulk_functions(random_vectors):
+    conn = get_connection()
+    # Interrupts the statement calling it, before the next function runs.
+    conn.createscalarfunction('interrupt', lambda: conn.interrupt(), 0)
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+    rowids = np.arange(NUM_ELEMENTS, dtype=np.int64)
+    def count():
+        return json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])['vector_count']
+
+    # Rows inserted before the interrupt are kept.
+    with pytest.raises(apsw.InterruptError):
+        cur.execute("select interrupt(), vectorlite_bulk_insert('x', ?, ?)", (rowids.tobytes(), random_vectors.tobytes()))
+    num_inserted = count()
+    assert num_inserted < NUM_ELEMENTS
+    cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (rowids[num_inserted:].tobytes(), random_vectors[num_inserted:].tobytes()))
+    assert count() == NUM_ELEMENTS
+
+    with pytest.raises(apsw.InterruptError):
+        cur.execute("select interrupt(), vectorlite_bulk_update('x', ?, ?, 1)", (rowids.tobytes(), random_vectors[::-1].copy().tobytes()))
+    # Only the first chunk of rows is updated.
+    result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[NUM_ELEMENTS // 2].tobytes(), 1)).fetchall()
+    assert result[0][0] == NUM_ELEMENTS // 2
+
+    # An interrupted compaction leaves the table unchanged.
+    cur.execute("select vectorlite_delete_range('x', 0, 99)")
+    with pytest.raises(apsw.InterruptError):
+        cur.execute("select interrupt(), vectorlite_compact('x')")
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+    assert stats['vector_count'] == NUM_ELEMENTS - 100 and stats['deleted_count'] == 100
+    conn.close()
+
+def test_update_and_reinsert(conn, random_vectors):
+    for allow_replace_deleted in ['true', 'false']:
+        cur = conn.cursor()
+        cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS * 2},allow_replace_deleted={allow_replace_deleted}))')
+        for i in range(NUM_ELEMENTS):
+            cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+        cur.execute('delete from x where rowid in (1, 2, 3)')
+
+        # Deleted rows can be inserted again, and stay unique once updated.
+        cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (1, random_vectors[1].tobytes()))
+        cur.execute('update x set my_embedding = ? where rowid = 1', (random_vectors[5].tobytes(),))
+        result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[5].tobytes(), NUM_ELEMENTS)).fetchall()
+        rowids = [r[0] for r in result]
+        assert len(rowids) == NUM_ELEMENTS - 2 and len(set(rowids)) == len(rowids)
+        assert set(rowids[:2]) == {1, 5}
+        assert 2 not in rowids and 3 not in rowids
+
+        result = cur.execute('select rowid from x where rowid in (1, 2, 3, 4)').fetchall()
+        assert sorted(r[0] for r in result) == [1, 4]
+        cur.execute('drop table x')
+
+def test_delete_range_and_compact(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+    rowids = np.arange(NUM_ELEMENTS, dtype=np.int64)
+    cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (rowids.tobytes(), random_vectors.tobytes()))
+
+    # Rows whose rowid is in [0, 499] expire.
+    result = cur.execute("select vectorlite_delete_range('x', -10, 499)").fetchone()[0]
+    assert result == 500
+    result = cur.execute("select vectorlite_delete_range('x', 0, 499)").fetchone()[0]
+    assert result == 0
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+    assert stats['vector_count'] == 500 and stats['deleted_count'] == 500
+
+    result = cur.execute("select vectorlite_compact('x', 2)").fetchone()[0]
+    assert result == 500
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+    assert stats['vector_count'] == 500 and stats['deleted_count'] == 0
+    assert cur.execute("select vectorlite_compact('x')").fetchone()[0] == 0
+
+    for i in range(500, 510):
+        result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[i].tobytes(), 10)).fetchall()
+        assert len(result) == 10 and result[0][0] == i and all(r[0] >= 500 for r in result)
+    assert cur.execute('select my_embedding from x where rowid = 1').fetchone() is None
+    vector = cur.execute('select my_embedding from x where rowid = 600').fetchone()[0]
+    assert np.allclose(random_vectors[600], np.frombuffer(vector, dtype=np.float32))
+
+    # Space freed by compaction is reused.
+    cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (rowids[:500].tobytes(), random_vectors[:500].tobytes()))
+    assert cur.execute('select count(*) from x where rowid in (0, 1, 999)').fetchone()[0] == 3
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_delete_range('y', 0, 1)")
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_compact('x', -1)")
+    cur.execute('drop table x')
+
+def test_attribute_filter(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], category integer, price integer, hnsw(max_elements={NUM_ELEMENTS + 1}))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x(rowid, my_embedding, category, price) values (?, ?, ?, ?)', (i, random_vectors[i].tobytes(), i % 10, i))
+
+    def brute_force(query, predicate, k):
+        rowids = [i for i in range(NUM_ELEMENTS) if predicate(i)]
+        distances = np.linalg.norm(random_vectors[rowids] - query, axis=1)
+        return [rowids[j] for j in np.argsort(distances)[:k]]
+
+    query = random_vectors[7]
+    result = cur.execute('select rowid, category from x where knn_search(my_embedding, knn_param(?, 10)) and category = 3', (query.tobytes(),)).fetchall()
+    assert len(result) == 10 and all(r[1] == 3 for r in result)
+
+    # ef covering the whole table makes the search exact.
+    result = cur.execute(f'select rowid from x where knn_search(my_embedding, knn_param(?, 10, {NUM_ELEMENTS})) and category in (1, 2) and price >= 200 and price < 600', (query.tobytes(),)).fetchall()
+    assert [r[0] for r in result] == brute_force(query, lambda i: i % 10 in (1, 2) and 200 <= i < 600, 10)
+
+    result = cur.execute('select rowid from x where category = 4 and price < 100').fetchall()
+    assert sorted(r[0] for r in result) == [i for i in range(100) if i % 10 == 4]
+    result = cur.execute('select rowid from x where rowid in (1, 3, 13) and category = 3').fetchall()
+    assert sorted(r[0] for r in result) == [3, 13]
+
+    # Updating attributes keeps the vector.
+    cur.execute('update x set category = 42 where rowid = 5')
+    result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, 3)) and category = 42', (random_vectors[5].tobytes(),)).fetchall()
+    assert result == [(5,)]
+
+    # NULL satisfies no comparison, but is read back as NULL.
+    cur.execute('update x set category = null where rowid = 0')
+    cur.execute('insert into x(rowid, my_embedding) values (?, ?)', (NUM_ELEMENTS, random_vectors[0].tobytes()))
+    assert cur.execute(f'select category, price from x where rowid in (0, {NUM_ELEMENTS})').fetchall() == [(None, 0), (None, None)]
+    for predicate in ['category = 0', 'category != 5', 'category < 1', 'category in (0, 5)', 'price < 1']:
+        result = cur.execute(f'select rowid from x where knn_search(my_embedding, knn_param(?, 5, {NUM_ELEMENTS})) and {predicate}', (random_vectors[0].tobytes(),)).fetchall()
+        assert NUM_ELEMENTS not in [r[0] for r in result]
+        if predicate != 'price < 1':
+            assert 0 not in [r[0] for r in result]
+    result = cur.execute(f'select rowid from x where rowid in (0, 1, {NUM_ELEMENTS}) and category is null').fetchall()
+    assert sorted(r[0] for r in result) == [0, NUM_ELEMENTS]
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute("update x set category = 'a' where rowid = 5")
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select rowid from x where category = 'a'").fetchall()
+    with pytest.raises(apsw.SQLError):
+        cur.execute(f'create virtual table y using vectorlite(my_embedding float32[{DIM}], name text, hnsw(max_elements=10))')
+    cur.execute('drop table x')
+
+def test_filter_gamma(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], category integer, hnsw(max_elements={NUM_ELEMENTS}, M=8, filter_gamma=4))')
+    for i in range(NUM_ELEMENTS):
+        cur.execute('insert into x(rowid, my_embedding, category) values (?, ?, ?)', (i, random_vectors[i].tobytes(), i % 100))
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+    assert stats['M'] == 8 and stats['filter_gamma'] == 4
+
+    # Only 1% of rows match, the search expands through rejected neighbors.
+    query = random_vectors[7]
+    result = cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, 5)) and category = 7', (query.tobytes(),)).fetchall()
+    rowids = [i for i in range(NUM_ELEMENTS) if i % 100 == 7]
+    distances = np.linalg.norm(random_vectors[rowids] - query, axis=1)
+    assert result[0] == (7,)
+    assert len(set(r[0] for r in result) & set(rowids[j] for j in np.argsort(distances)[:5])) >= 4
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute(f'create virtual table y using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements=10, filter_gamma=0))')
+    cur.execute('drop table x')
+
+def test_multi_vector(conn):
+    cur = conn.cursor()
+    num_rows = 200
+    docs = [np.float32(np.random.random((np.random.randint(1, 8), DIM))) for _ in range(num_rows)]
+    cur.execute(f'create virtual table x using vectorlite(tokens float32[{DIM}] multi, category integer, hnsw(max_elements={num_rows * 8}))')
+    for i, doc in enumerate(docs):
+        cur.execute('insert into x(rowid, tokens, category) values (?, ?, ?)', (i, doc.tobytes(), i % 2))
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+    assert stats['multi_vector'] and stats['vector_count'] == sum(len(doc) for doc in docs)
+
+    def max_sim(query, doc):
+        # Sum over query vectors of the L2 distance to the nearest vector of the row.
+        return sum(np.min(np.sum((doc - q) ** 2, axis=1)) for q in query)
+
+    query = docs[3][:2]
+    # ef covering the whole table makes the search exact.
+    result = cur.execute(f'select rowid, distance from x where knn_search(tokens, knn_param(?, 10, {num_rows * 8}))', (query.tobytes(),)).fetchall()
+    expected = sorted(range(num_rows), key=lambda i: max_sim(query, docs[i]))[:10]
+    assert [r[0] for r in result] == expected
+    assert np.isclose(result[1][1], max_sim(query, docs[expected[1]]), rtol=1e-4)
+
+    # Each row is returned once.
+    result = cur.execute('select rowid, category from x where knn_search(tokens, knn_param(?, 5)) and category = 1', (query.tobytes(),)).fetchall()
+    assert len(set(r[0] for r in result)) == 5 and all(r[1] == 1 for r in result)
+    assert sorted(r[0] for r in cur.execute('select rowid from x where category = 0').fetchall()) == list(range(0, num_rows, 2))
+
+    assert cur.execute('select tokens from x where rowid = 3').fetchone()[0] == docs[3].tobytes()
+    cur.execute('update x set tokens = ? where rowid = 3', (docs[4].tobytes(),))
+    assert cur.execute('select tokens from x where rowid = 3').fetchone()[0] == docs[4].tobytes()
+    cur.execute('delete from x where rowid = 4')
+    result = cur.execute(f'select rowid from x where knn_search(tokens, knn_param(?, 1, {num_rows * 8}))', (docs[4].tobytes(),)).fetchall()
+    assert result == [(3,)]
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute('insert into x(rowid, tokens) values (?, ?)', (1000, np.float32(np.random.random(DIM + 1)).tobytes()))
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select knn_search_batch('x', ?, 1)", (docs[0].tobytes(),))
+    cur.execute('drop table x')
+
+def test_group_by(conn):
+    cur = conn.cursor()
+    num_rows = 1000
+    data = np.float32(np.random.random((num_rows, DIM)))
+    cur.execute(f'create virtual table x using vectorlite(v float32[{DIM}], doc integer, hnsw(max_elements={num_rows}))')
+    for i in range(num_rows):
+        cur.execute('insert into x(rowid, v, doc) values (?, ?, ?)', (i, data[i].tobytes(), i // 10))
+
+    def brute_force(query, k, limit, group):
+        result = []
+        sizes = {}
+        for i in np.argsort(np.sum((data - query) ** 2, axis=1)):
+            if sizes.get(group(i), 0) < limit:
+                result.append(i)
+                sizes[group(i)] = sizes.get(group(i), 0) + 1
+            if len(result) == k:
+                break
+        return result
+
+    query = data[0]
+    # ef covering the whole table makes the search exact.
+    for group_by, group in [('doc', lambda i: i // 10), ('rowid / 100', lambda i: i // 100)]:
+        for limit in [1, 2]:
+            result = cur.execute(f'select rowid from x where knn_search(v, knn_group_by(knn_param(?, 10, {num_rows}), ?, ?))', (query.tobytes(), group_by, limit)).fetchall()
+            assert [r[0] for r in result] == brute_force(query, 10, limit, group)
+    result = cur.execute("select rowid from x where knn_search(v, knn_group_by(knn_param(?, 10), 'doc'))", (query.tobytes(),)).fetchall()
+    assert len(result) == 10 and len(set(r[0] // 10 for r in result)) == 10
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select rowid from x where knn_search(v, knn_group_by(knn_param(?, 10), 'price'))", (query.tobytes(),)).fetchall()
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select rowid from x where knn_search(v, knn_group_by(knn_param(?, 10), 'rowid / 0'))", (query.tobytes(),)).fetchall()
+    cur.execute('drop table x')
+
+def test_weighted_query(conn):
+    cur = conn.cursor()
+    num_rows = 1000
+    data = np.float32(np.random.random((num_rows, DIM)))
+    queries = np.float32(np.random.random((2, DIM)))
+    for distance_type in ['l2', 'ip']:
+        cur.execute(f'create virtual table x using vectorlite(v float32[{DIM}] {distance_type}, hnsw(max_elements={num_rows}))')
+        for i in range(num_rows):
+            cur.execute('insert into x(rowid, v) values (?, ?)', (i, data[i].tobytes()))
+        for weights in [[1, 1], [1, -0.5], [1, -2]]:
+            if distance_type == 'l2':
+                distances = np.stack([np.sum((data - q) ** 2, axis=1) for q in queries])
+            else:
+                distances = np.stack([1 - data @ q for q in queries])
+            scores = np.float32(weights) @ distances
+            # ef covering the whole table makes the search exact.
+            result = cur.execute(f'select rowid, distance from x where knn_search(v, knn_weighted(knn_param(?, 10, {num_rows}), ?))', (queries.tobytes(), np.float32(weights).tobytes())).fetchall()
+            assert [r[0] for r in result] == list(np.argsort(scores)[:10])
+            assert np.allclose([r[1] for r in result], np.sort(scores)[:10], rtol=1e-3, atol=1e-3)
+        stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+        assert stats['search']['weighted_searches'] == 3
+        with pytest.raises(apsw.SQLError):
+            cur.execute('select rowid from x where knn_search(v, knn_weighted(knn_param(?, 10), ?))', (queries.tobytes(), np.float32([1, 1, 1]).tobytes())).fetchall()
+        cur.execute('drop table x')
+
+def test_knn_param_rowid(conn):
+    cur = conn.cursor()
+    num_rows = 1000
+    data = np.float32(np.random.random((num_rows, DIM)))
+    cur.execute(f'create virtual table x using vectorlite(v float32[{DIM}], hnsw(max_elements={num_rows}))')
+    for i in range(num_rows):
+        cur.execute('insert into x(rowid, v) values (?, ?)', (i, data[i].tobytes()))
+
+    expected = cur.execute('select rowid, distance from x where knn_search(v, knn_param(?, 5, 100))', (data[7].tobytes(),)).fetchall()
+    assert expected[0][0] == 7
+    result = cur.execute('select rowid, distance from x where knn_search(v, knn_param_rowid(7, 5, 100))').fetchall()
+    assert result == expected
+    # The source row is excluded.
+    result = cur.execute('select rowid from x where knn_search(v, knn_param_rowid(7, 4, 100, 1))').fetchall()
+    assert [r[0] for r in result] == [r[0] for r in expected[1:]]
+
+    # Several rows are searched for like knn_weighted() with weights of 1.
+    rowids = np.int64([3, 5])
+    result = cur.execute(f'select rowid from x where knn_search(v, knn_param_rowid(?, 10, {num_rows}))', (rowids.tobytes(),)).fetchall()
+    scores = np.sum((data - data[3]) ** 2, axis=1) + np.sum((data - data[5]) ** 2, axis=1)
+    assert [r[0] for r in result] == list(np.argsort(scores)[:10])
+    result = cur.execute('select rowid from x where knn_search(v, knn_weighted(knn_param_rowid(?, 10, 100, 1), ?))', (rowids.tobytes(), np.float32([1, -0.5]).tobytes())).fetchall()
+    assert len(result) == 10 and 3 not in [r[0] for r in result] and 5 not in [r[0] for r in result]
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute('select rowid from x where knn_search(v, knn_param_rowid(?, 10))', (num_rows,)).fetchall()
+    cur.execute('drop table x')
+
+def test_train_transform(conn):
+    cur = conn.cursor()
+    num_rows = 1000
+    reduced_dim = 16
+    # Rows lie close to a subspace of reduced_dim dimensions, which PCA finds.
+    basis = np.random.random((reduced_dim, DIM))
+    data = np.float32(np.random.normal(size=(num_rows, reduced_dim)) @ basis + np.random.normal(scale=1e-3, size=(num_rows, DIM)))
+    cur.execute(f'create virtual table x using vectorlite(v float32[{DIM}->{reduced_dim}], hnsw(max_elements={num_rows}))')
+    # The transform must be trained before rows are inserted.
+    with pytest.raises(apsw.SQLError):
+        cur.execute('insert into x(rowid, v) values (0, ?)', (data[0].tobytes(),))
+
+    cur.execute('create table samples(v blob)')
+    cur.executemany('insert into samples(v) values (?)', [(v.tobytes(),) for v in data[:200]])
+    assert cur.execute("select vectorlite_train_transform('x', 'select v from samples')").fetchone()[0] == 200
+    for i in range(num_rows):
+        cur.execute('insert into x(rowid, v) values (?, ?)', (i, data[i].tobytes()))
+    stats = json.loads(cur.execute("select vectorlite_stats('x')").fetchone()[0])
+    assert stats['dimension'] == reduced_dim and stats['input_dimension'] == DIM
+    # The vector column holds the reduced vectors.
+    vector = cur.execute('select v from x where rowid = 0').fetchone()[0]
+    assert len(vector) == reduced_dim * 4
+
+    # Reduced distances match the full ones.
+    result = cur.execute(f'select rowid, distance from x where knn_search(v, knn_param(?, 10, {num_rows}))', (data[7].tobytes(),)).fetchall()
+    distances = np.sum((data - data[7]) ** 2, axis=1)
+    assert [r[0] for r in result] == list(np.argsort(distances)[:10])
+    assert np.allclose([r[1] for r in result], np.sort(distances)[:10], rtol=1e-2, atol=1e-2)
+
+    # The table must be empty to be trained again.
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_train_transform('x', 'select v from samples')")
+    cur.execute('drop table x')
+
+    cur.execute(f'create virtual table x using vectorlite(v float32[{DIM}->{reduced_dim}] cosine, hnsw(max_elements={num_rows}))')
+    assert cur.execute("select vectorlite_train_transform('x', null, 'random')").fetchone()[0] == 0
+    cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (np.arange(num_rows, dtype=np.int64).tobytes(), data.tobytes()))
+    result = cur.execute('select rowid from x where knn_search(v, knn_param(?, 1))', (data[3].tobytes(),)).fetchall()
+    assert result[0][0] == 3
+    with pytest.raises(apsw.SQLError):
+        cur.execute("select vectorlite_train_transform('x', null, 'svd')")
+    cur.execute('drop table x')
+    cur.execute('drop table samples')
+
 def test_json_happy_path(conn):
     cur = conn.cursor()
     vector = np.float32(np.random.random(DIM))
@@ -78,6 +679,28 @@ def test_json_happy_path(conn):
     vec = cur.execute('select vector_from_json(?)', (json.dumps(vector.tolist()),)).fetchone()[0]
     assert np.allclose(vector, np.frombuffer(vec, dtype=np.float32))
 
+def test_vector_arithmetic(conn):
+    cur = conn.cursor()
+    a = np.float32(np.random.random(DIM))
+    b = np.float32(np.random.random(DIM))
+
+    def vector(sql, *args):
+        return np.frombuffer(cur.execute(sql, args).fetchone()[0], dtype=np.float32)
+
+    assert np.allclose(vector('select vector_add(?, ?)', a.tobytes(), b.tobytes()), a + b)
+    assert np.allclose(vector('select vector_sub(?, ?)', a.tobytes(), b.tobytes()), a - b)
+    assert np.allclose(vector('select vector_scale(?, ?)', a.tobytes(), 2.5), a * 2.5)
+    assert np.isclose(cur.execute('select vector_dot(?, ?)', (a.tobytes(), b.tobytes())).fetchone()[0], np.dot(a, b), rtol=1e-5)
+    assert np.isclose(cur.execute('select vector_norm(?)', (a.tobytes(),)).fetchone()[0], np.linalg.norm(a), rtol=1e-5)
+    assert np.array_equal(vector('select vector_slice(?, 2, 5)', a.tobytes()), a[2:5])
+    assert np.array_equal(vector('select vector_slice(?, 2)', a.tobytes()), a[2:])
+    assert np.array_equal(vector('select vector_concat(?, ?, ?)', a.tobytes(), b.tobytes(), a.tobytes()), np.concatenate([a, b, a]))
+
+    with pytest.raises(apsw.SQLError):
+        cur.execute('select vector_add(?, ?)', (a.tobytes(), b[:2].tobytes()))
+    with pytest.raises(apsw.SQLError):
+        cur.execute('select vector_slice(?, 3, 2)', (a.tobytes(),))
+
 def test_vector_distance(conn):
     vec1 = np.float32(np.random.random(DIM))
     vec2 = np.float32(np.random.random(DIM))
@@ -97,6 +720,72 @@ def test_vector_distance(conn):
     # hnswlib doesn't calculate sqaure root of l2 distance
     assert np.isclose(math.sqrt(result), l2_distance)
 
+def test_trace(conn, random_vectors):
+    cur = conn.cursor()
+    cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS}))')
+    with tempfile.TemporaryDirectory() as tempdir:
+        trace_path = os.path.join(tempdir, 'trace.json')
+        assert cur.execute('select vectorlite_trace(?)', (trace_path,)).fetchone()[0] == 0
+        for i in range(10):
+            cur.execute('insert into x (rowid, my_embedding) values (?, ?)', (i, random_vectors[i].tobytes()))
+        cur.execute('select rowid, distance from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[0].tobytes(), 5)).fetchall()
+        num_spans = cur.execute('select vectorlite_trace(null)').fetchone()[0]
+
+        with open(trace_path) as f:
+            events = json.load(f)
+        assert len(events) == num_spans
+        names = [e['name'] for e in events]
+        assert names.count('Update') == 10
+        for name in ['Filter', 'MaterializeConstraints', 'Search', 'Column']:
+            assert name in names
+        assert all(e['ph'] == 'X' and e['dur'] >= 0 for e in events)
+        # Stopped traces are not written to.
+        cur.execute('select rowid from x where knn_search(my_embedding, knn_param(?, ?))', (random_vectors[0].tobytes(), 5)).fetchall()
+        assert cur.execute('select vectorlite_trace(null)').fetchone()[0] == 0
+
+        with pytest.raises(apsw.SQLError):
+            cur.execute('select vectorlite_trace(?)', (os.path.join(tempdir, 'missing', 'trace.json'),))
+    cur.execute('drop table x')
+
+def test_functions_after_reopen(random_vectors):
+    # Tables of a reopened database are only connected once a statement uses them, which the functions must do themselves.
+    rowids = np.arange(NUM_ELEMENTS, dtype=np.int64)
+    calls = [
+        ("select vectorlite_stats('x')", ()),
+        ("select vectorlite_stats('main.x')", ()),
+        ("select vectorlite_bulk_insert('x', ?, ?)", (np.array([NUM_ELEMENTS], dtype=np.int64).tobytes(), random_vectors[:1].tobytes())),
+        ("select vectorlite_bulk_update('x', ?, ?)", (rowids[:10].tobytes(), random_vectors[10:20].tobytes())),
+        ("select vectorlite_optimize('main.x', 10)", ()),
+        ("select vectorlite_delete_range('x', 0, 9)", ()),
+        ("select vectorlite_compact('x')", ()),
+        ("select vectorlite_train_transform('y', null, 'random')", ()),
+    ]
+    with tempfile.TemporaryDirectory() as tempdir:
+        db_path = os.path.join(tempdir, 'db.sqlite')
+        index_path = os.path.join(tempdir, 'index.bin')
+        conn = get_connection(db_path)
+        cur = conn.cursor()
+        cur.execute(f'create virtual table x using vectorlite(my_embedding float32[{DIM}], hnsw(max_elements={NUM_ELEMENTS * 2}), "{index_path}")')
+        cur.execute(f'create virtual table y using vectorlite(v float32[{DIM}->16], hnsw(max_elements={NUM_ELEMENTS}))')
+        cur.execute("select vectorlite_bulk_insert('x', ?, ?)", (rowids.tobytes(), random_vectors.tobytes()))
+        conn.close()
+
+        for sql, params in calls:
+            conn = get_connection(db_path)
+            cur = conn.cursor()
+            assert cur.execute(sql, params).fetchone()[0] is not None
+            conn.close()
+
+        conn = get_connection(db_path)
+        cur = conn.cursor()
+        with pytest.raises(apsw.SQLError):
+            cur.execute("select vectorlite_stats('temp.x')")
+        with pytest.raises(apsw.SQLError):
+            cur.execute("select vectorlite_stats('z')")
+        cur.execute('drop table x')
+        cur.execute('drop table y')
+        conn.close()
+
 def test_index_file(random_vectors):
     def remove_quote(s: str):
         return s.strip('\'').strip('\"')
@@ -0,0 +1,196 @@
+#include "attribute_store.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_format.h"
+#include "crc_stream.h"
+#include "re2/re2.h"
+#include "util.h"
+
+namespace vectorlite {
+
+namespace {
+
+// The file holds, in order: kMagic, kFormatVersion, the number of attributes,
+// the number of elements, the length and bytes of each name, the values of
+// each attribute, the null bitmap of each attribute and a crc32c of
+// everything before it. Version 1 files have no null bitmaps, their values
+// are all non-NULL.
+constexpr char kMagic[8] = {'V', 'L', 'A', 'T', 'T', 'R', 'S', '\0'};
+constexpr uint32_t kFormatVersion = 2;
+constexpr uint32_t kFormatVersionWithoutNulls = 1;
+
+size_t NumWords(size_t num_elements) { return (num_elements + 63) / 64; }
+
+}  // namespace
+
+AttributeStore::AttributeStore(std::vector<std::string> names,
+                               size_t capacity)
+    : names_(std::move(names)),
+      values_(names_.size()),
+      nulls_(names_.size()) {
+  Reserve(capacity);
+}
+
+absl::StatusOr<std::string> AttributeStore::ParseColumn(
+    std::string_view declaration) {
+  static const re2::RE2 reg("^\\s*(\\w+)\\s+(\\w+)\\s*$");
+  std::string name;
+  std::string type;
+  if (!re2::RE2::FullMatch(declaration, reg, &name, &type)) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Invalid attribute column: %s", declaration));
+  }
+  if (!IsValidColumnName(name)) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Invalid attribute name: %s", name));
+  }
+  type = absl::AsciiStrToLower(type);
+  if (type != "integer" && type != "int") {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Invalid attribute type: %s. Only integer is supported", type));
+  }
+  return name;
+}
+
+void AttributeStore::Clear(hnswlib::tableint id) {
+  for (size_t i = 0; i < values_.size(); i++) {
+    SetNull(i, id);
+  }
+}
+
+void AttributeStore::Reserve(size_t capacity) {
+  for (size_t i = 0; i < values_.size(); i++) {
+    if (values_[i].size() < capacity) {
+      values_[i].resize(capacity);
+      nulls_[i].resize(NumWords(capacity), ~uint64_t{0});
+    }
+  }
+}
+
+void AttributeStore::Compact(const hnswlib::HierarchicalNSW<float>& index) {
+  for (size_t i = 0; i < values_.size(); i++) {
+    auto& values = values_[i];
+    hnswlib::tableint num_kept = 0;
+    for (hnswlib::tableint id = 0; id < index.cur_element_count; id++) {
+      if (index.isMarkedDeleted(id)) {
+        continue;
+      }
+      // num_kept <= id, so the bit of id is read before it's overwritten.
+      if (IsNull(i, id)) {
+        SetNull(i, num_kept);
+      } else {
+        Set(i, num_kept, values[id]);
+      }
+      num_kept++;
+    }
+    for (hnswlib::tableint id = num_kept; id < values.size(); id++) {
+      SetNull(i, id);
+    }
+  }
+}
+
+absl::Status AttributeStore::Save(const std::filesystem::path& path,
+                                  size_t num_elements) const {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", path.string()));
+  }
+  CrcWriter writer(file);
+  writer.Write(kMagic, sizeof(kMagic));
+  writer.Write(kFormatVersion);
+  writer.Write(static_cast<uint32_t>(names_.size()));
+  writer.Write(static_cast<uint64_t>(num_elements));
+  for (const auto& name : names_) {
+    writer.Write(static_cast<uint32_t>(name.size()));
+    writer.Write(name.data(), name.size());
+  }
+  for (const auto& values : values_) {
+    writer.Write(values.data(), num_elements * sizeof(int64_t));
+  }
+  for (const auto& nulls : nulls_) {
+    writer.Write(nulls.data(), NumWords(num_elements) * sizeof(uint64_t));
+  }
+  uint32_t crc = static_cast<uint32_t>(writer.crc());
+  file.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+  if (!file.flush()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to write %s", path.string()));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status AttributeStore::Load(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return absl::NotFoundError(
+        absl::StrFormat("Failed to open %s", path.string()));
+  }
+  CrcReader reader(file);
+  char magic[sizeof(kMagic)];
+  uint32_t version = 0;
+  uint32_t num_attributes = 0;
+  uint64_t num_elements = 0;
+  if (!reader.Read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), kMagic) ||
+      !reader.Read(version) ||
+      (version != kFormatVersion && version != kFormatVersionWithoutNulls) ||
+      !reader.Read(num_attributes) || !reader.Read(num_elements)) {
+    return absl::DataLossError(
+        absl::StrFormat("%s is not a valid attribute file", path.string()));
+  }
+  if (num_attributes != names_.size()) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s holds %d attributes, but the table has %d", path.string(),
+        num_attributes, names_.size()));
+  }
+  for (const auto& name : names_) {
+    uint32_t size = 0;
+    std::string file_name;
+    if (reader.Read(size) && size <= 1024) {
+      file_name.resize(size);
+      if (!reader.Read(file_name.data(), size)) {
+        file_name.clear();
+      }
+    }
+    if (file_name != name) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Attribute %s of the table doesn't match %s in %s", name, file_name,
+          path.string()));
+    }
+  }
+
+  Reserve(num_elements);
+  for (auto& values : values_) {
+    if (!reader.Read(values.data(), num_elements * sizeof(int64_t))) {
+      return absl::DataLossError(
+          absl::StrFormat("%s is truncated", path.string()));
+    }
+  }
+  for (auto& nulls : nulls_) {
+    if (version == kFormatVersionWithoutNulls) {
+      for (size_t id = 0; id < num_elements; id++) {
+        nulls[id / 64] &= ~(uint64_t{1} << (id % 64));
+      }
+    } else if (!reader.Read(nulls.data(),
+                            NumWords(num_elements) * sizeof(uint64_t))) {
+      return absl::DataLossError(
+          absl::StrFormat("%s is truncated", path.string()));
+    }
+  }
+  uint32_t crc = 0;
+  if (!file.read(reinterpret_cast<char*>(&crc), sizeof(crc)) ||
+      crc != static_cast<uint32_t>(reader.crc())) {
+    return absl::DataLossError(
+        absl::StrFormat("Checksum mismatch in %s", path.string()));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace vectorlite
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+// Integer attributes of the rows of a vectorlite table, e.g. a category, an
+// enum or a bitmask, declared as "name integer" columns in the vectorlite(...)
+// schema. Values are stored attribute by attribute and indexed by the internal
+// ids of the hnswlib index, so that filters can check the elements reached
+// while traversing the graph without looking their rowids up.
+// Attributes are nullable: each attribute also has a bitmap of the elements
+// whose value is NULL, which no comparison accepts. Elements get NULL for all
+// attributes until they are set.
+class AttributeStore {
+ public:
+  // Attribute columns can be referred to by a single character in idxStr.
+  static constexpr size_t kMaxAttributes = 26;
+
+  // names are the names of the attributes. capacity is the max number of
+  // elements of the index.
+  AttributeStore(std::vector<std::string> names, size_t capacity);
+
+  // Parses an attribute column declaration, e.g. "category integer", and
+  // returns the name of the column.
+  static absl::StatusOr<std::string> ParseColumn(std::string_view declaration);
+
+  // Number of attributes.
+  size_t size() const { return names_.size(); }
+  const std::vector<std::string>& names() const { return names_; }
+
+  // Values of attribute, indexed by internal id. The value of a NULL is 0.
+  const int64_t* values(size_t attribute) const {
+    return values_[attribute].data();
+  }
+  // Bitmap of the elements whose attribute is NULL, read with IsNullIn().
+  const uint64_t* nulls(size_t attribute) const {
+    return nulls_[attribute].data();
+  }
+  static bool IsNullIn(const uint64_t* nulls, hnswlib::tableint id) {
+    return (nulls[id / 64] >> (id % 64)) & 1;
+  }
+
+  bool IsNull(size_t attribute, hnswlib::tableint id) const {
+    return IsNullIn(nulls(attribute), id);
+  }
+  int64_t Get(size_t attribute, hnswlib::tableint id) const {
+    return values_[attribute][id];
+  }
+  void Set(size_t attribute, hnswlib::tableint id, int64_t value) {
+    values_[attribute][id] = value;
+    nulls_[attribute][id / 64] &= ~(uint64_t{1} << (id % 64));
+  }
+  void SetNull(size_t attribute, hnswlib::tableint id) {
+    values_[attribute][id] = 0;
+    nulls_[attribute][id / 64] |= uint64_t{1} << (id % 64);
+  }
+
+  // Resets all attributes of id to NULL.
+  void Clear(hnswlib::tableint id);
+
+  // Grows the capacity, e.g. if an index file holds more elements.
+  void Reserve(size_t capacity);
+
+  // Keeps the attributes of the elements of index that are not deleted, in
+  // the order of their ids. The values of the other elements are reset. Used
+  // along with CompactInto(), which assigns ids the same way.
+  void Compact(const hnswlib::HierarchicalNSW<float>& index);
+
+  // Saves the attributes of the first num_elements elements to path.
+  absl::Status Save(const std::filesystem::path& path,
+                    size_t num_elements) const;
+
+  // Loads attributes saved by Save(). The attributes in the file must have
+  // the same names in the same order.
+  absl::Status Load(const std::filesystem::path& path);
+
+ private:
+  std::vector<std::string> names_;
+  std::vector<std::vector<int64_t>> values_;
+  // One bit per element, set if its value is NULL. Bits past the capacity are
+  // set too, so that growing keeps new elements NULL.
+  std::vector<std::vector<uint64_t>> nulls_;
+};
+
+}  // namespace vectorlite
@@ -0,0 +1,128 @@
+#include "attribute_store.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "gtest/gtest.h"
+#include "hnswlib/hnswlib.h"
+
+namespace {
+
+constexpr size_t kCapacity = 100;
+
+class AttributeStoreTest : public testing::Test {
+ protected:
+  AttributeStoreTest() : store_({"category", "price"}, kCapacity) {}
+
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path() /
+            "vectorlite_attribute_store_test.attrs";
+  }
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  std::filesystem::path path_;
+  vectorlite::AttributeStore store_;
+};
+
+}  // namespace
+
+TEST(AttributeStore, ParseColumnShouldAcceptIntegerColumns) {
+  auto name = vectorlite::AttributeStore::ParseColumn("category integer");
+  ASSERT_TRUE(name.ok());
+  EXPECT_EQ("category", *name);
+  name = vectorlite::AttributeStore::ParseColumn(" price INT ");
+  ASSERT_TRUE(name.ok());
+  EXPECT_EQ("price", *name);
+  EXPECT_FALSE(vectorlite::AttributeStore::ParseColumn("name text").ok());
+  EXPECT_FALSE(vectorlite::AttributeStore::ParseColumn("category").ok());
+  EXPECT_FALSE(
+      vectorlite::AttributeStore::ParseColumn("1category integer").ok());
+}
+
+TEST_F(AttributeStoreTest, NewElementsShouldHaveNullAttributes) {
+  store_.Set(0, 3, 7);
+  store_.Set(1, 3, -1);
+  EXPECT_EQ(7, store_.Get(0, 3));
+  EXPECT_EQ(-1, store_.values(1)[3]);
+  EXPECT_FALSE(store_.IsNull(0, 3));
+  EXPECT_TRUE(store_.IsNull(0, 4));
+  EXPECT_EQ(0, store_.Get(0, 4));
+
+  store_.SetNull(1, 3);
+  EXPECT_FALSE(store_.IsNull(0, 3));
+  EXPECT_TRUE(store_.IsNull(1, 3));
+  store_.Clear(3);
+  EXPECT_TRUE(store_.IsNull(0, 3));
+  EXPECT_EQ(0, store_.Get(0, 3));
+
+  // Elements added by growing are NULL too.
+  store_.Reserve(kCapacity * 2);
+  EXPECT_TRUE(store_.IsNull(0, kCapacity * 2 - 1));
+}
+
+TEST_F(AttributeStoreTest, CompactShouldKeepLiveElementsInOrder) {
+  hnswlib::L2Space space(2);
+  hnswlib::HierarchicalNSW<float> index(&space, kCapacity);
+  for (hnswlib::tableint id = 0; id < 10; id++) {
+    float data[2] = {static_cast<float>(id), 0};
+    index.addPoint(data, id);
+    store_.Set(0, id, id * 10);
+  }
+  store_.SetNull(0, 3);
+  index.markDelete(0);
+  index.markDelete(5);
+
+  store_.Compact(index);
+  std::vector<int64_t> expected = {10, 20, 0, 40, 60, 70, 80, 90, 0, 0};
+  std::vector<bool> expected_nulls = {false, false, true,  false, false,
+                                      false, false, false, true,  true};
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i], store_.Get(0, i));
+    EXPECT_EQ(expected_nulls[i], store_.IsNull(0, i));
+  }
+}
+
+TEST_F(AttributeStoreTest, LoadShouldRestoreSavedAttributes) {
+  for (hnswlib::tableint id = 0; id < 10; id++) {
+    store_.Set(0, id, id);
+    store_.Set(1, id, -static_cast<int64_t>(id));
+  }
+  store_.SetNull(1, 7);
+  ASSERT_TRUE(store_.Save(path_, 10).ok());
+
+  vectorlite::AttributeStore loaded({"category", "price"}, kCapacity);
+  ASSERT_TRUE(loaded.Load(path_).ok());
+  for (hnswlib::tableint id = 0; id < 10; id++) {
+    EXPECT_EQ(id, loaded.Get(0, id));
+    EXPECT_FALSE(loaded.IsNull(0, id));
+    if (id != 7) {
+      EXPECT_EQ(-static_cast<int64_t>(id), loaded.Get(1, id));
+    }
+  }
+  EXPECT_TRUE(loaded.IsNull(1, 7));
+  EXPECT_TRUE(loaded.IsNull(0, 10));
+
+  vectorlite::AttributeStore renamed({"category", "cost"}, kCapacity);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            renamed.Load(path_).code());
+  vectorlite::AttributeStore fewer({"category"}, kCapacity);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, fewer.Load(path_).code());
+}
+
+TEST_F(AttributeStoreTest, LoadShouldRejectCorruptedFiles) {
+  store_.Set(0, 1, 42);
+  ASSERT_TRUE(store_.Save(path_, 10).ok());
+  {
+    std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(-8, std::ios::end);
+    file.put('\x7f');
+  }
+  EXPECT_EQ(absl::StatusCode::kDataLoss, store_.Load(path_).code());
+
+  std::filesystem::resize_file(path_, 20);
+  EXPECT_EQ(absl::StatusCode::kDataLoss, store_.Load(path_).code());
+}
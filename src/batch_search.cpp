@@ -0,0 +1,125 @@
+#include "batch_search.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "deadline.h"
+#include "early_abandon.h"
+#include "hnsw_search.h"
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+namespace {
+
+// Stored vectors are scanned in blocks of about this size, which fit in L2
+// cache.
+constexpr size_t kScanBlockBytes = 256 * 1024;
+
+// Partial sums are accumulated in independent lanes, so that the loops can be
+// vectorized without reassociating floating point additions.
+constexpr size_t kLanes = 8;
+
+template <bool kL2>
+void GroupDistancesImpl(const float* const* queries, const float* vector,
+                        size_t dim, float* distances) {
+  float lanes[kQueryGroupSize][kLanes] = {};
+  size_t i = 0;
+  for (; i + kLanes <= dim; i += kLanes) {
+    for (size_t q = 0; q < kQueryGroupSize; q++) {
+      const float* query = queries[q];
+      for (size_t j = 0; j < kLanes; j++) {
+        if constexpr (kL2) {
+          float diff = query[i + j] - vector[i + j];
+          lanes[q][j] += diff * diff;
+        } else {
+          lanes[q][j] += query[i + j] * vector[i + j];
+        }
+      }
+    }
+  }
+  for (size_t q = 0; q < kQueryGroupSize; q++) {
+    const float* query = queries[q];
+    float sum = 0;
+    for (size_t j = i; j < dim; j++) {
+      if constexpr (kL2) {
+        float diff = query[j] - vector[j];
+        sum += diff * diff;
+      } else {
+        sum += query[j] * vector[j];
+      }
+    }
+    for (size_t j = 0; j < kLanes; j++) {
+      sum += lanes[q][j];
+    }
+    distances[q] = kL2 ? sum : 1.0f - sum;
+  }
+}
+
+}  // namespace
+
+void GroupDistances(const EarlyAbandonSpace& space, const float* const* queries,
+                    const float* vector, float* distances) {
+  if (space.is_l2()) {
+    GroupDistancesImpl<true>(queries, vector, space.dimension(), distances);
+  } else {
+    GroupDistancesImpl<false>(queries, vector, space.dimension(), distances);
+  }
+}
+
+void BatchScan(const hnswlib::HierarchicalNSW<float>& index,
+               const EarlyAbandonSpace& space,
+               const std::vector<const float*>& queries, size_t k,
+               Deadline& deadline, BatchSearchBuffers& buffers) {
+  size_t num_queries = queries.size();
+  if (buffers.search.size() < num_queries) {
+    buffers.search.resize(num_queries);
+  }
+  for (size_t i = 0; i < num_queries; i++) {
+    buffers.search[i].top_candidates.Reset(k);
+    buffers.search[i].distance_computations = 0;
+  }
+
+  size_t num_elements = index.cur_element_count;
+  size_t block_size =
+      std::max<size_t>(kScanBlockBytes / index.size_data_per_element_, 1);
+  for (size_t begin = 0; begin < num_elements && k > 0 && !deadline.Expired();
+       begin += block_size) {
+    size_t end = std::min(begin + block_size, num_elements);
+    for (size_t group = 0; group < num_queries; group += kQueryGroupSize) {
+      // The last group is padded by repeating its last query.
+      size_t group_size = std::min(kQueryGroupSize, num_queries - group);
+      const float* group_queries[kQueryGroupSize];
+      for (size_t i = 0; i < kQueryGroupSize; i++) {
+        group_queries[i] = queries[group + std::min(i, group_size - 1)];
+      }
+
+      float distances[kQueryGroupSize];
+      for (size_t id = begin; id < end; id++) {
+        if (index.isMarkedDeleted(id)) {
+          continue;
+        }
+        GroupDistances(
+            space, group_queries,
+            reinterpret_cast<const float*>(index.getDataByInternalId(id)),
+            distances);
+        for (size_t i = 0; i < group_size; i++) {
+          buffers.search[group + i].top_candidates.Insert(
+              {distances[i], static_cast<hnswlib::tableint>(id)});
+        }
+      }
+    }
+    for (size_t i = 0; i < num_queries; i++) {
+      buffers.search[i].distance_computations += end - begin;
+    }
+  }
+
+  for (size_t i = 0; i < num_queries; i++) {
+    auto& result = buffers.search[i].top_candidates.candidates();
+    std::reverse(result.begin(), result.end());
+  }
+}
+
+}  // namespace vectorlite
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "deadline.h"
+#include "early_abandon.h"
+#include "hnsw_search.h"
+#include "hnswlib/hnswlib.h"
+#include "macros.h"
+
+// Searches for the nearest neighbors of many queries at once. Searching
+// queries one by one loads the same hot vectors into cache again and again.
+// Batch searches share each vector loaded among multiple queries instead.
+
+namespace vectorlite {
+
+// Number of queries whose distances to a stored vector are computed at once by
+// GroupDistances(), and number of graph searches interleaved by
+// InterleavedSearchWithDistance().
+constexpr size_t kQueryGroupSize = 4;
+
+// Buffers used by batch searches. They keep their capacity between batches.
+struct BatchSearchBuffers {
+  // One element per query of a group for graph search, or per query of the
+  // batch for exact search.
+  std::vector<SearchBuffers> search;
+  // One element per query of a group.
+  std::vector<internal::VisitedTable> visited;
+  std::vector<std::vector<float>> query_suffix_norms;
+};
+
+// Computes the distances from queries[0..kQueryGroupSize) to vector in space
+// into distances. Each element of vector is loaded once for all queries.
+void GroupDistances(const EarlyAbandonSpace& space, const float* const* queries,
+                    const float* vector, float* distances);
+
+// Exact search for the k nearest neighbors of each of queries among all
+// elements of index that are not deleted. Stored vectors are scanned in
+// blocks small enough to stay in cache, and every query scans a block before
+// the next block is loaded. Within a block, distances are computed for groups
+// of kQueryGroupSize queries with GroupDistances().
+// The candidates found for queries[i] are stored in buffers.search[i],
+// sorted by distance in ascending order. Distances are computed without early
+// abandoning, as the queries of a group have different bounds.
+// If the deadline expires, the best candidates found so far are returned.
+void BatchScan(const hnswlib::HierarchicalNSW<float>& index,
+               const EarlyAbandonSpace& space,
+               const std::vector<const float*>& queries, size_t k,
+               Deadline& deadline, BatchSearchBuffers& buffers);
+
+// Like SearchWithDistance(), but searches for the neighbors of a group of up
+// to kQueryGroupSize queries at once, distances[i] computing the distances to
+// the i-th query. Expansions of the searches are interleaved: all searches
+// collect the neighbors to evaluate and prefetch their vectors first, then
+// compute their distances, so that the vectors needed by a search are loaded
+// while the others compute.
+// The candidates found for the i-th query are stored in buffers.search[i],
+// sorted by distance in ascending order.
+template <typename Distance, typename Filter>
+void InterleavedSearchWithDistance(
+    const hnswlib::HierarchicalNSW<float>& index,
+    std::vector<Distance>& distances, size_t ef, const Filter& filter,
+    Deadline& deadline, BatchSearchBuffers& buffers) {
+  using Search = internal::BaseLayerSearch<Distance, Filter,
+                                           internal::VisitedTable,
+                                           internal::NoSharedBound>;
+  size_t n = distances.size();
+  VECTORLITE_ASSERT(n <= kQueryGroupSize);
+  if (buffers.search.size() < n) {
+    buffers.search.resize(n);
+  }
+  if (buffers.visited.size() < n) {
+    buffers.visited.resize(n);
+  }
+  internal::NoSharedBound no_shared_bound;
+  std::vector<Search> searches;
+  searches.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    SearchBuffers& search_buffers = buffers.search[i];
+    search_buffers.distance_computations = 0;
+    searches.emplace_back(index, distances[i], ef, filter, buffers.visited[i],
+                          no_shared_bound, search_buffers);
+    if (index.cur_element_count == 0) {
+      continue;
+    }
+    hnswlib::tableint entry_point = internal::SearchUpperLayers(
+        index, distances[i], search_buffers.distance_computations);
+    buffers.visited[i].Reset(index.cur_element_count);
+    buffers.visited[i].Visit(entry_point);
+    searches[i].Start(&entry_point, 1);
+  }
+
+  bool expanded[kQueryGroupSize] = {};
+  bool running = index.cur_element_count > 0;
+  while (running && !deadline.Expired()) {
+    running = false;
+    for (size_t i = 0; i < n; i++) {
+      expanded[i] = searches[i].Expand();
+      running = running || expanded[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (expanded[i]) {
+        searches[i].Evaluate();
+      }
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    auto& result = buffers.search[i].top_candidates.candidates();
+    std::reverse(result.begin(), result.end());
+  }
+}
+
+}  // namespace vectorlite
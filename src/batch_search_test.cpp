@@ -0,0 +1,131 @@
+#include "batch_search.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "deadline.h"
+#include "early_abandon.h"
+#include "gtest/gtest.h"
+#include "hnsw_search.h"
+#include "hnswlib/hnswlib.h"
+
+namespace {
+
+class BatchSearchTest : public testing::Test {
+ protected:
+  // Not a multiple of the lanes of GroupDistances().
+  static constexpr size_t kDim = 21;
+  static constexpr size_t kNumElements = 1000;
+
+  BatchSearchTest()
+      : space_(kDim),
+        index_(&space_, kNumElements),
+        data_(kNumElements),
+        early_abandon_space_(vectorlite::DistanceType::L2, kDim) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist;
+    for (size_t i = 0; i < kNumElements; i++) {
+      data_[i].resize(kDim);
+      for (auto& v : data_[i]) {
+        v = dist(rng);
+      }
+      index_.addPoint(data_[i].data(), i);
+    }
+  }
+
+  std::vector<hnswlib::labeltype> BruteForce(const std::vector<float>& query,
+                                             size_t k) {
+    std::vector<std::pair<float, hnswlib::labeltype>> all;
+    for (size_t i = 0; i < kNumElements; i++) {
+      if (!index_.isMarkedDeleted(i)) {
+        all.emplace_back(space_.get_dist_func()(query.data(), data_[i].data(),
+                                                space_.get_dist_func_param()),
+                         i);
+      }
+    }
+    std::sort(all.begin(), all.end());
+    std::vector<hnswlib::labeltype> labels;
+    for (size_t i = 0; i < std::min(k, all.size()); i++) {
+      labels.push_back(all[i].second);
+    }
+    return labels;
+  }
+
+  std::vector<hnswlib::labeltype> Labels(size_t i, size_t k) {
+    const auto& candidates = buffers_.search[i].top_candidates.candidates();
+    EXPECT_TRUE(std::is_sorted(candidates.begin(), candidates.end()));
+    std::vector<hnswlib::labeltype> labels;
+    for (size_t j = 0; j < std::min(k, candidates.size()); j++) {
+      labels.push_back(index_.getExternalLabel(candidates[j].second));
+    }
+    return labels;
+  }
+
+  hnswlib::L2Space space_;
+  hnswlib::HierarchicalNSW<float> index_;
+  std::vector<std::vector<float>> data_;
+  vectorlite::EarlyAbandonSpace early_abandon_space_;
+  vectorlite::BatchSearchBuffers buffers_;
+};
+
+}  // namespace
+
+TEST_F(BatchSearchTest, GroupDistancesShouldMatchDistance) {
+  for (auto distance_type :
+       {vectorlite::DistanceType::L2, vectorlite::DistanceType::InnerProduct}) {
+    vectorlite::EarlyAbandonSpace space(distance_type, kDim);
+    const float* queries[vectorlite::kQueryGroupSize];
+    for (size_t i = 0; i < vectorlite::kQueryGroupSize; i++) {
+      queries[i] = data_[i].data();
+    }
+    float distances[vectorlite::kQueryGroupSize];
+    vectorlite::GroupDistances(space, queries, data_[10].data(), distances);
+    std::vector<float> query_norms;
+    for (size_t i = 0; i < vectorlite::kQueryGroupSize; i++) {
+      vectorlite::EarlyAbandonDistance distance(space, queries[i],
+                                                query_norms);
+      EXPECT_NEAR(distance(data_[10].data()), distances[i], 1e-5);
+    }
+  }
+}
+
+TEST_F(BatchSearchTest, ScanShouldFindExactNearestNeighbors) {
+  index_.markDelete(3);
+  // Not a multiple of kQueryGroupSize.
+  std::vector<const float*> queries;
+  for (size_t i = 0; i < 7; i++) {
+    queries.push_back(data_[i].data());
+  }
+  vectorlite::Deadline deadline;
+  vectorlite::BatchScan(index_, early_abandon_space_, queries, 10, deadline,
+                        buffers_);
+  for (size_t i = 0; i < queries.size(); i++) {
+    EXPECT_EQ(BruteForce(data_[i], 10), Labels(i, 10));
+    EXPECT_EQ(kNumElements, buffers_.search[i].distance_computations);
+  }
+}
+
+TEST_F(BatchSearchTest, InterleavedSearchShouldMatchSearch) {
+  std::vector<std::vector<float>> query_norms(vectorlite::kQueryGroupSize);
+  std::vector<vectorlite::EarlyAbandonDistance> distances;
+  for (size_t i = 0; i < vectorlite::kQueryGroupSize; i++) {
+    distances.emplace_back(early_abandon_space_, data_[i].data(),
+                           query_norms[i]);
+  }
+  vectorlite::Deadline deadline;
+  vectorlite::InterleavedSearchWithDistance(
+      index_, distances, 64, vectorlite::NoFilter(), deadline, buffers_);
+
+  // Interleaving searches doesn't change what each of them finds.
+  vectorlite::SearchBuffers search_buffers;
+  for (size_t i = 0; i < vectorlite::kQueryGroupSize; i++) {
+    std::vector<float> norms;
+    vectorlite::EarlyAbandonDistance distance(early_abandon_space_,
+                                              data_[i].data(), norms);
+    const auto& expected = vectorlite::SearchWithDistance(
+        index_, distance, 64, vectorlite::NoFilter(), deadline,
+        search_buffers);
+    EXPECT_EQ(expected, buffers_.search[i].top_candidates.candidates());
+  }
+}
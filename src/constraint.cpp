@@ -2,22 +2,67 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <memory>
-#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 #include "absl/base/optimization.h"
 #include "absl/functional/overload.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "attribute_store.h"
+#include "deadline.h"
+#include "early_abandon.h"
+#include "hnsw_search.h"
 #include "hnswlib/hnswlib.h"
+#include "linear_transform.h"
 #include "macros.h"
+#include "parallel_search.h"
+#include "result_cache.h"
+#include "semantic_cache.h"
 #include "sqlite3ext.h"
-#include "util.h"
+#include "vector_ops.h"
 
 namespace vectorlite {
 
+absl::StatusOr<KnnGroupBy> KnnGroupBy::FromString(std::string_view group_by,
+                                                  uint32_t limit) {
+  KnnGroupBy result;
+  result.limit = limit;
+  std::vector<std::string_view> parts = absl::StrSplit(group_by, '/');
+  std::string_view name = absl::StripAsciiWhitespace(parts[0]);
+  if (parts.size() > 2 || name.empty()) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("Invalid group_by: %s", group_by));
+  }
+  if (parts.size() == 2) {
+    if (!absl::EqualsIgnoreCase(name, "rowid")) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Only rowid can be divided in group_by: %s", group_by));
+    }
+    if (!absl::SimpleAtoi(absl::StripAsciiWhitespace(parts[1]),
+                          &result.rowid_divisor) ||
+        result.rowid_divisor == 0) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "rowid divisor of group_by should be a positive integer: %s",
+          group_by));
+    }
+  } else if (!absl::EqualsIgnoreCase(name, "rowid")) {
+    result.attribute = std::string(name);
+  }
+  return result;
+}
+
 absl::Status RowIdEquals::DoMaterialize(const sqlite3_api_routines* sqlite3_api,
                                         sqlite3_value* arg) {
   VECTORLITE_ASSERT(sqlite3_api != nullptr);
@@ -68,6 +113,140 @@ absl::Status KnnSearchConstraint::DoMaterialize(
   return absl::OkStatus();
 }
 
+std::string AttributeConstraint::ShortName(size_t attribute, Op op) {
+  VECTORLITE_ASSERT(attribute < AttributeStore::kMaxAttributes);
+  return std::string({static_cast<char>('A' + attribute),
+                      static_cast<char>(op)});
+}
+
+std::unique_ptr<AttributeConstraint> AttributeConstraint::FromShortName(
+    std::string_view short_name) {
+  if (short_name.size() != 2 || short_name[0] < 'A' ||
+      static_cast<size_t>(short_name[0] - 'A') >=
+          AttributeStore::kMaxAttributes) {
+    return nullptr;
+  }
+  Op op = static_cast<Op>(short_name[1]);
+  switch (op) {
+    case Op::kEq:
+    case Op::kIn:
+    case Op::kNe:
+    case Op::kLt:
+    case Op::kLe:
+    case Op::kGt:
+    case Op::kGe:
+      return std::make_unique<AttributeConstraint>(short_name[0] - 'A', op);
+  }
+  return nullptr;
+}
+
+absl::Status AttributeConstraint::DoMaterialize(
+    const sqlite3_api_routines* sqlite3_api, sqlite3_value* arg) {
+  VECTORLITE_ASSERT(sqlite3_api != nullptr);
+  VECTORLITE_ASSERT(arg != nullptr);
+  if (op_ != Op::kIn) {
+    if (sqlite3_value_type(arg) != SQLITE_INTEGER) {
+      return absl::InvalidArgumentError("attribute must be of type INTEGER");
+    }
+    value_ = sqlite3_value_int64(arg);
+    return absl::OkStatus();
+  }
+
+  int rc = SQLITE_OK;
+  sqlite3_value* value = nullptr;
+  for (rc = sqlite3_vtab_in_first(arg, &value); rc == SQLITE_OK;
+       rc = sqlite3_vtab_in_next(arg, &value)) {
+    if (ABSL_PREDICT_FALSE(sqlite3_value_type(value) != SQLITE_INTEGER)) {
+      return absl::InvalidArgumentError("attribute must be of type INTEGER");
+    }
+    values_.insert(sqlite3_value_int64(value));
+  }
+  return absl::OkStatus();
+}
+
+std::string AttributeConstraint::ToDebugString() const {
+  if (op_ == Op::kIn) {
+    if (materialized()) {
+      return absl::StrFormat("attribute %d in (%d values...)", attribute_,
+                             values_.size());
+    }
+    return absl::StrFormat("attribute %d in (?)", attribute_);
+  }
+
+  std::string_view op;
+  switch (op_) {
+    case Op::kEq:
+      op = "=";
+      break;
+    case Op::kNe:
+      op = "!=";
+      break;
+    case Op::kLt:
+      op = "<";
+      break;
+    case Op::kLe:
+      op = "<=";
+      break;
+    case Op::kGt:
+      op = ">";
+      break;
+    default:
+      op = ">=";
+      break;
+  }
+  if (materialized()) {
+    return absl::StrFormat("attribute %d %s %d", attribute_, op, value_);
+  }
+  return absl::StrFormat("attribute %d %s ?", attribute_, op);
+}
+
+void AttributeFilter::Add(const int64_t* values, const uint64_t* nulls,
+                          const AttributeConstraint& constraint) {
+  Predicate predicate;
+  predicate.values = values;
+  predicate.nulls = nulls;
+  int64_t value = constraint.value();
+  constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  switch (constraint.op()) {
+    case AttributeConstraint::Op::kEq:
+      predicate.min = value;
+      predicate.max = value;
+      break;
+    case AttributeConstraint::Op::kIn:
+      predicate.in = &constraint.values();
+      break;
+    case AttributeConstraint::Op::kNe:
+      predicate.has_excluded = true;
+      predicate.excluded = value;
+      break;
+    case AttributeConstraint::Op::kLt:
+      // Nothing is less than the min value, which makes an empty range.
+      if (value == kMin) {
+        predicate.min = kMax;
+        predicate.max = kMin;
+      } else {
+        predicate.max = value - 1;
+      }
+      break;
+    case AttributeConstraint::Op::kLe:
+      predicate.max = value;
+      break;
+    case AttributeConstraint::Op::kGt:
+      if (value == kMax) {
+        predicate.min = kMax;
+        predicate.max = kMin;
+      } else {
+        predicate.min = value + 1;
+      }
+      break;
+    case AttributeConstraint::Op::kGe:
+      predicate.min = value;
+      break;
+  }
+  predicates_.push_back(predicate);
+}
+
 void QueryExecutor::Visit(const KnnSearchConstraint& constraint) {
   if (!constraint.materialized()) {
     status_ = absl::FailedPreconditionError("knn_search not materialized");
@@ -122,106 +301,1035 @@ void QueryExecutor::Visit(const RowIdEquals& constraint) {
   rowid_constraint_ = &constraint;
 }
 
-namespace {
+void QueryExecutor::Visit(const AttributeConstraint& constraint) {
+  if (!constraint.materialized()) {
+    status_ = absl::FailedPreconditionError("attribute not materialized");
+    return;
+  }
+  if (!status_.ok()) {
+    return;
+  }
 
-class RowidInFilter : public hnswlib::BaseFilterFunctor {
- public:
-  explicit RowidInFilter(
-      const absl::flat_hash_set<hnswlib::labeltype>& rowid_in)
-      : rowid_in_(rowid_in) {}
-  virtual bool operator()(hnswlib::labeltype id) override {
-    return rowid_in_.contains(id);
+  if (!context_.attributes ||
+      constraint.attribute() >= context_.attributes->size()) {
+    status_ = absl::InvalidArgumentError(
+        absl::StrFormat("attribute %d doesn't exist", constraint.attribute()));
+    return;
   }
 
- private:
-  const absl::flat_hash_set<hnswlib::labeltype>& rowid_in_;
-};
+  attribute_constraints_.push_back(&constraint);
+}
+
+namespace {
 
-class RowidEqualsFilter : public hnswlib::BaseFilterFunctor {
- public:
-  explicit RowidEqualsFilter(hnswlib::labeltype rowid) : rowid_(rowid) {}
-  virtual bool operator()(hnswlib::labeltype id) override {
-    return id == rowid_;
+// Calls fn with a functor that accepts the internal ids of the elements
+// satisfying the rowid constraint, or NoFilter if there is no rowid constraint.
+// Filters are passed by their concrete types, so that search routines can be
+// instantiated for each of them instead of calling filters virtually.
+template <typename Fn>
+void VisitRowidFilter(
+    const hnswlib::HierarchicalNSW<float>& index,
+    const std::optional<absl::variant<const RowIdIn*, const RowIdEquals*>>&
+        rowid_constraint,
+    Fn&& fn) {
+  if (!rowid_constraint) {
+    fn(NoFilter());
+    return;
   }
+  absl::visit(absl::Overload(
+                  [&](const RowIdIn* rowid_in) {
+                    const auto& rowids = rowid_in->get_rowids();
+                    fn([&](hnswlib::tableint id) {
+                      return rowids.contains(index.getExternalLabel(id));
+                    });
+                  },
+                  [&](const RowIdEquals* rowid_equals) {
+                    hnswlib::labeltype rowid = rowid_equals->rowid();
+                    fn([&index, rowid](hnswlib::tableint id) {
+                      return index.getExternalLabel(id) == rowid;
+                    });
+                  }),
+              *rowid_constraint);
+}
 
- private:
-  hnswlib::labeltype rowid_;
-};
+// Like VisitRowidFilter(), but the filter passed to fn also requires elements
+// to be accepted by attribute_filter if it's not nullptr. Attributes are
+// checked first as they are read directly by id.
+template <typename Fn>
+void VisitFilter(
+    const hnswlib::HierarchicalNSW<float>& index,
+    const std::optional<absl::variant<const RowIdIn*, const RowIdEquals*>>&
+        rowid_constraint,
+    const AttributeFilter* attribute_filter, Fn&& fn) {
+  VisitRowidFilter(index, rowid_constraint, [&](const auto& rowid_filter) {
+    using RowidFilter = std::decay_t<decltype(rowid_filter)>;
+    if (!attribute_filter) {
+      fn(rowid_filter);
+    } else if constexpr (std::is_same_v<RowidFilter, NoFilter>) {
+      fn(*attribute_filter);
+    } else {
+      fn([&](hnswlib::tableint id) {
+        return (*attribute_filter)(id) && rowid_filter(id);
+      });
+    }
+  });
+}
 
-std::unique_ptr<hnswlib::BaseFilterFunctor> MakeRowidFilter(
-    std::optional<absl::variant<const RowIdIn*, const RowIdEquals*>>
-        row_id_constraint) {
-  if (!row_id_constraint) {
+}  // namespace
+
+const AttributeFilter* QueryExecutor::BuildAttributeFilter(
+    QueryScratch& scratch) const {
+  if (attribute_constraints_.empty()) {
     return nullptr;
   }
+  VECTORLITE_ASSERT(context_.attributes != nullptr);
+  AttributeFilter& filter = scratch.attribute_filter;
+  filter.Clear();
+  for (const AttributeConstraint* constraint : attribute_constraints_) {
+    size_t attribute = constraint->attribute();
+    filter.Add(context_.attributes->values(attribute),
+               context_.attributes->nulls(attribute), *constraint);
+  }
+  return &filter;
+}
+
+void QueryExecutor::BuildCacheParams(const KnnParam& knn_param, size_t ef,
+                                     QueryScratch& scratch) const {
+  std::string& key = scratch.cache_key;
+  key.clear();
+  auto append = [&key](const auto& value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+
+  append(knn_param.k);
+  append(static_cast<uint64_t>(ef));
+  if (knn_param.group_by) {
+    const KnnGroupBy& group_by = *knn_param.group_by;
+    key.push_back('g');
+    append(group_by.limit);
+    append(group_by.rowid_divisor);
+    append(static_cast<uint64_t>(group_by.attribute.size()));
+    key.append(group_by.attribute);
+  }
+  if (!knn_param.weights.empty()) {
+    key.push_back('w');
+    append(static_cast<uint64_t>(knn_param.weights.size()));
+    key.append(reinterpret_cast<const char*>(knn_param.weights.data()),
+               knn_param.weights.size() * sizeof(float));
+  }
+  // The vectors of query rows are appended like query vectors, only excluded
+  // rows change the results.
+  if (knn_param.exclude_query_rows) {
+    key.push_back('x');
+    append(static_cast<uint64_t>(knn_param.query_rowids.size()));
+    key.append(reinterpret_cast<const char*>(knn_param.query_rowids.data()),
+               knn_param.query_rowids.size() * sizeof(hnswlib::labeltype));
+  }
+  if (rowid_constraint_) {
+    absl::visit(
+        absl::Overload(
+            [&](const RowIdIn* rowid_in) {
+              auto& rowids = scratch.sorted_rowids;
+              rowids.assign(rowid_in->get_rowids().begin(),
+                            rowid_in->get_rowids().end());
+              std::sort(rowids.begin(), rowids.end());
+              key.push_back('i');
+              append(static_cast<uint64_t>(rowids.size()));
+              key.append(reinterpret_cast<const char*>(rowids.data()),
+                         rowids.size() * sizeof(hnswlib::labeltype));
+            },
+            [&](const RowIdEquals* rowid_equals) {
+              key.push_back('e');
+              append(rowid_equals->rowid());
+            }),
+        *rowid_constraint_);
+  } else {
+    key.push_back('n');
+  }
+  for (const AttributeConstraint* constraint : attribute_constraints_) {
+    key.push_back('a');
+    append(static_cast<uint8_t>(constraint->attribute()));
+    key.push_back(static_cast<char>(constraint->op()));
+    if (constraint->op() == AttributeConstraint::Op::kIn) {
+      auto& values = scratch.sorted_values;
+      values.assign(constraint->values().begin(), constraint->values().end());
+      std::sort(values.begin(), values.end());
+      append(static_cast<uint64_t>(values.size()));
+      key.append(reinterpret_cast<const char*>(values.data()),
+                 values.size() * sizeof(int64_t));
+    } else {
+      append(constraint->value());
+    }
+  }
+}
+
+namespace {
+
+// Splitting a search across threads pays off only if each thread gets at
+// least this much work, as handing it to pool threads and merging their
+// results has a fixed cost.
+constexpr size_t kMinEfPerSearchThread = 256;
+constexpr size_t kMinScanSizePerSearchThread = 8192;
+
+// Accumulates the work done by distance computations in space into stats.
+void AddDistanceStats(const EarlyAbandonSpace& space,
+                      uint64_t distance_computations,
+                      uint64_t dimensions_computed, SearchStats& stats) {
+  // Dimensions that would be computed without early abandoning.
+  uint64_t dimensions = distance_computations * space.dimension();
+  stats.distance_computations += distance_computations;
+  stats.distance_flops += dimensions_computed * space.flops_per_dimension();
+  stats.distance_flops_saved +=
+      (dimensions - dimensions_computed) * space.flops_per_dimension();
+}
+
+// Creates one distance functor per thread in distances. Each thread gets its
+// own buffer from scratch.
+void MakeThreadDistances(const EarlyAbandonSpace& space, const float* query,
+                         size_t num_threads, QueryScratch& scratch,
+                         std::vector<EarlyAbandonDistance>& distances) {
+  if (scratch.thread_query_suffix_norms.size() < num_threads) {
+    scratch.thread_query_suffix_norms.resize(num_threads);
+  }
+  if (scratch.thread_search.size() < num_threads) {
+    scratch.thread_search.resize(num_threads);
+  }
+  distances.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; i++) {
+    distances.emplace_back(space, query, scratch.thread_query_suffix_norms[i]);
+  }
+}
+
+uint64_t SumDimensionsComputed(
+    const std::vector<EarlyAbandonDistance>& distances) {
+  uint64_t dimensions_computed = 0;
+  for (const auto& distance : distances) {
+    dimensions_computed += distance.dimensions_computed();
+  }
+  return dimensions_computed;
+}
 
-  return absl::visit(
-      absl::Overload(
-          [](const RowIdIn* rowid_in)
-              -> std::unique_ptr<hnswlib::BaseFilterFunctor> {
-            return std::make_unique<RowidInFilter>(rowid_in->get_rowids());
-          },
-          [](const RowIdEquals* rowid_equals)
-              -> std::unique_ptr<hnswlib::BaseFilterFunctor> {
-            return std::make_unique<RowidEqualsFilter>(rowid_equals->rowid());
-          }),
-      *row_id_constraint);
+uint64_t SumDistanceComputations(const std::vector<SearchBuffers>& buffers,
+                                 size_t num_threads) {
+  uint64_t distance_computations = 0;
+  for (size_t i = 0; i < num_threads; i++) {
+    distance_computations += buffers[i].distance_computations;
+  }
+  return distance_computations;
 }
 
 }  // namespace
 
-absl::StatusOr<QueryExecutor::QueryResult> QueryExecutor::Execute() const {
+size_t QueryExecutor::NumSearchThreads(size_t work,
+                                       size_t min_work_per_thread) const {
+  return std::max<size_t>(
+      std::min(context_.search_threads, work / min_work_per_thread), 1);
+}
+
+absl::Status QueryExecutor::MakeGrouping(const KnnGroupBy& group_by,
+                                        Grouping& grouping) const {
+  grouping = Grouping();
+  grouping.limit = group_by.limit;
+  grouping.index = &index_;
+  grouping.rowid_divisor = group_by.rowid_divisor;
+  if (group_by.attribute.empty()) {
+    return absl::OkStatus();
+  }
+  if (context_.attributes) {
+    const auto& names = context_.attributes->names();
+    for (size_t i = 0; i < names.size(); i++) {
+      if (absl::EqualsIgnoreCase(names[i], group_by.attribute)) {
+        grouping.values = context_.attributes->values(i);
+        grouping.nulls = context_.attributes->nulls(i);
+        return absl::OkStatus();
+      }
+    }
+  }
+  return absl::InvalidArgumentError(absl::StrFormat(
+      "group_by attribute %s doesn't exist", group_by.attribute));
+}
+
+bool QueryExecutor::CollectRowidConstraintIds(
+    size_t max_rows, std::vector<hnswlib::tableint>& ids) const {
+  if (!rowid_constraint_) {
+    return false;
+  }
+  VECTORLITE_ASSERT(context_.rowid_map != nullptr);
+  ids.clear();
+  auto collect = [&](hnswlib::labeltype rowid) {
+    auto id = context_.rowid_map->FindLive(index_, rowid);
+    if (id) {
+      ids.push_back(*id);
+    }
+  };
+  return absl::visit(absl::Overload(
+                         [&](const RowIdIn* rowid_in) {
+                           const auto& rowids = rowid_in->get_rowids();
+                           if (rowids.size() > max_rows) {
+                             return false;
+                           }
+                           for (hnswlib::labeltype rowid : rowids) {
+                             collect(rowid);
+                           }
+                           return true;
+                         },
+                         [&](const RowIdEquals* rowid_equals) {
+                           if (max_rows < 1) {
+                             return false;
+                           }
+                           collect(rowid_equals->rowid());
+                           return true;
+                         }),
+                     *rowid_constraint_);
+}
+
+absl::Status QueryExecutor::SearchGraph(
+    const float* query, size_t k, size_t ef,
+    const AttributeFilter* attribute_filter, Deadline& deadline,
+    QueryResult& result, QueryScratch& scratch, SearchStats& stats) const {
+  // Traverse the graph comparing only vector prefixes if prefix search is
+  // enabled, then rerank the ef candidates found using full vectors.
+  const EarlyAbandonSpace* search_space =
+      space_.prefix_space ? context_.early_abandon_prefix_space
+                          : context_.early_abandon_space;
+  VECTORLITE_ASSERT(search_space != nullptr);
+  // Merging the candidates of several threads would ignore groups, so grouped
+  // searches run on one thread.
+  size_t num_threads = scratch.search.grouping.enabled()
+                           ? 1
+                           : NumSearchThreads(ef, kMinEfPerSearchThread);
+  const std::vector<SearchCandidate>* candidates = nullptr;
+  absl::Status status;
+  // Calls search with the filter of the query.
+  auto visit_filter = [&](const auto& search) {
+    VisitFilter(index_, rowid_constraint_, attribute_filter,
+                [&](const auto& filter) {
+                  using Filter = std::decay_t<decltype(filter)>;
+                  if constexpr (!std::is_same_v<Filter, NoFilter>) {
+                    if (context_.expand_through_rejected) {
+                      search(ExpandThroughRejected<Filter>{filter});
+                      return;
+                    }
+                  }
+                  search(filter);
+                });
+  };
+  if (num_threads > 1) {
+    std::vector<EarlyAbandonDistance> distances;
+    MakeThreadDistances(*search_space, query, num_threads, scratch, distances);
+    visit_filter([&](const auto& filter) {
+      status = ParallelSearchWithDistance(
+          index_, distances, ef, filter, deadline, scratch.thread_visited,
+          scratch.thread_search, scratch.candidates);
+    });
+    AddDistanceStats(
+        *search_space,
+        SumDistanceComputations(scratch.thread_search, num_threads),
+        SumDimensionsComputed(distances), stats);
+    stats.parallel_searches++;
+    candidates = &scratch.candidates;
+  } else {
+    EarlyAbandonDistance search_distance(*search_space, query,
+                                         scratch.query_suffix_norms);
+    visit_filter([&](const auto& filter) {
+      candidates = &SearchWithDistance(index_, search_distance, ef, filter,
+                                       deadline, scratch.search);
+    });
+    AddDistanceStats(*search_space, scratch.search.distance_computations,
+                     search_distance.dimensions_computed(), stats);
+  }
+  if (!status.ok()) {
+    return status;
+  }
+
+  if (space_.prefix_space) {
+    VECTORLITE_ASSERT(context_.early_abandon_space != nullptr);
+    EarlyAbandonDistance rerank_distance(*context_.early_abandon_space, query,
+                                         scratch.query_suffix_norms);
+    Rerank(index_, rerank_distance, *candidates, k, result);
+    AddDistanceStats(*context_.early_abandon_space, candidates->size(),
+                     rerank_distance.dimensions_computed(), stats);
+  } else {
+    size_t n = std::min<size_t>(k, candidates->size());
+    for (size_t i = 0; i < n; i++) {
+      result.emplace_back((*candidates)[i].first,
+                          index_.getExternalLabel((*candidates)[i].second));
+    }
+  }
+  return absl::OkStatus();
+}
+
+template <typename Ids>
+absl::Status QueryExecutor::SearchExact(
+    const float* query, size_t k, const Ids& ids,
+    const AttributeFilter* attribute_filter, Deadline& deadline,
+    QueryResult& result, QueryScratch& scratch, SearchStats& stats) const {
+  // Full vectors are compared even if prefix search is enabled, as there is
+  // nothing to rerank.
+  VECTORLITE_ASSERT(context_.early_abandon_space != nullptr);
+  const EarlyAbandonSpace& space = *context_.early_abandon_space;
+  size_t num_threads =
+      scratch.search.grouping.enabled()
+          ? 1
+          : NumSearchThreads(ids.size(), kMinScanSizePerSearchThread);
+  const std::vector<SearchCandidate>* candidates = nullptr;
+  absl::Status status;
+  if (num_threads > 1) {
+    std::vector<EarlyAbandonDistance> distances;
+    MakeThreadDistances(space, query, num_threads, scratch, distances);
+    // ids already satisfy the rowid constraint, if any.
+    VisitFilter(index_, std::nullopt, attribute_filter,
+                [&](const auto& filter) {
+                  status = ParallelScanWithDistance(
+                      index_, distances, ids, k, filter, deadline,
+                      scratch.thread_search, scratch.candidates);
+                });
+    AddDistanceStats(
+        space, SumDistanceComputations(scratch.thread_search, num_threads),
+        SumDimensionsComputed(distances), stats);
+    stats.parallel_searches++;
+    candidates = &scratch.candidates;
+  } else {
+    EarlyAbandonDistance distance(space, query, scratch.query_suffix_norms);
+    VisitFilter(index_, std::nullopt, attribute_filter,
+                [&](const auto& filter) {
+                  candidates =
+                      &ScanWithDistance(index_, distance, ids, 0, ids.size(),
+                                        k, filter, deadline, scratch.search);
+                });
+    AddDistanceStats(space, scratch.search.distance_computations,
+                     distance.dimensions_computed(), stats);
+  }
+  stats.exact_searches++;
+  if (!status.ok()) {
+    return status;
+  }
+
+  for (const auto& [distance, id] : *candidates) {
+    result.emplace_back(distance, index_.getExternalLabel(id));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status QueryExecutor::ReadQueryRows(
+    const std::vector<hnswlib::labeltype>& rowids,
+    std::vector<float>& query) const {
+  VECTORLITE_ASSERT(context_.rowid_map != nullptr);
+  size_t dim = space_.dimension();
+  query.clear();
+  for (hnswlib::labeltype rowid : rowids) {
+    auto id = context_.rowid_map->FindLive(index_, rowid);
+    if (!id) {
+      return absl::NotFoundError(
+          absl::StrFormat("rowid %lld not found", static_cast<int64_t>(rowid)));
+    }
+    size_t num_vectors =
+        space_.multi_vector ? RowidMap::CountRowElements(index_, *id) : 1;
+    for (hnswlib::tableint i = *id; i < *id + num_vectors; i++) {
+      const float* vector =
+          reinterpret_cast<const float*>(index_.getDataByInternalId(i));
+      query.insert(query.end(), vector, vector + dim);
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status QueryExecutor::SearchVector(
+    const float* query, size_t k, size_t ef,
+    const AttributeFilter* attribute_filter, Deadline& deadline,
+    QueryResult& result, QueryScratch& scratch, SearchStats& stats) const {
+  // Traversing the graph is pointless if it would evaluate every candidate
+  // anyway, i.e. the rowid constraint allows at most ef rows or ef covers
+  // the whole index. Scanning the candidates instead is exact and cheaper.
+  if (CollectRowidConstraintIds(ef, scratch.ids)) {
+    return SearchExact(query, k, scratch.ids, attribute_filter, deadline,
+                       result, scratch, stats);
+  }
+  if (!rowid_constraint_ && ef >= index_.cur_element_count) {
+    return SearchExact(query, k, AllElements(index_), attribute_filter,
+                       deadline, result, scratch, stats);
+  }
+  return SearchGraph(query, k, ef, attribute_filter, deadline, result,
+                     scratch, stats);
+}
+
+absl::Status QueryExecutor::SearchWeighted(
+    const float* queries, const std::vector<float>& weights, size_t k,
+    size_t ef, const AttributeFilter* attribute_filter, Deadline& deadline,
+    QueryResult& result, QueryScratch& scratch, SearchStats& stats) const {
+  size_t dim = space_.dimension();
+  bool l2 = space_.distance_type == DistanceType::L2;
+  float total_weight = 0.0f;
+  float positive_weight = 0.0f;
+  for (float weight : weights) {
+    total_weight += weight;
+    positive_weight += std::max(weight, 0.0f);
+  }
+  auto squared_norm = [dim](const float* v) {
+    float norm = 0.0f;
+    for (size_t j = 0; j < dim; j++) {
+      norm += v[j] * v[j];
+    }
+    return norm;
+  };
+  auto& combined = scratch.combined_query;
+  combined.assign(dim, 0.0f);
+  stats.weighted_searches++;
+
+  if (!l2 || total_weight > 0.0f) {
+    // sum(w_i * (1 - q_i.x)) = sum(w_i) - (sum(w_i * q_i)).x, so the weighted
+    // inner product distance ranks rows like the inner product distance to
+    // sum(w_i * q_i). Likewise, if W = sum(w_i) > 0, the weighted L2 distance
+    // is W * |c - x|^2 + sum(w_i * |q_i|^2) - W * |c|^2 with the centroid
+    // c = sum(w_i * q_i) / W. Searching for the combined vector is exact.
+    for (size_t i = 0; i < weights.size(); i++) {
+      for (size_t j = 0; j < dim; j++) {
+        combined[j] += weights[i] * queries[i * dim + j];
+      }
+    }
+    float scale = 1.0f;
+    float offset = total_weight - 1.0f;
+    if (l2) {
+      for (float& v : combined) {
+        v /= total_weight;
+      }
+      scale = total_weight;
+      offset = -total_weight * squared_norm(combined.data());
+      for (size_t i = 0; i < weights.size(); i++) {
+        offset += weights[i] * squared_norm(queries + i * dim);
+      }
+    }
+    auto status = SearchVector(combined.data(), k, ef, attribute_filter,
+                               deadline, result, scratch, stats);
+    for (auto& [distance, rowid] : result) {
+      distance = distance * scale + offset;
+    }
+    return status;
+  }
+
+  // Negative weights dominate the L2 distance, which has no such equivalent.
+  // Candidates are then the ef nearest neighbors of the centroid of the
+  // positive query vectors, reranked exactly.
+  if (positive_weight <= 0.0f) {
+    return absl::InvalidArgumentError(
+        "weighted l2 queries need at least one positive weight");
+  }
+  for (size_t i = 0; i < weights.size(); i++) {
+    if (weights[i] > 0.0f) {
+      for (size_t j = 0; j < dim; j++) {
+        combined[j] += weights[i] / positive_weight * queries[i * dim + j];
+      }
+    }
+  }
+  auto& candidates = scratch.vector_neighbors;
+  candidates.clear();
+  auto status = SearchVector(combined.data(), ef, ef, attribute_filter,
+                             deadline, candidates, scratch, stats);
+  if (!status.ok()) {
+    return status;
+  }
+  VECTORLITE_ASSERT(context_.rowid_map != nullptr);
+  VECTORLITE_ASSERT(context_.early_abandon_space != nullptr);
+  auto dist_func = space_.space->get_dist_func();
+  void* dist_func_param = space_.space->get_dist_func_param();
+  for (const auto& [_, rowid] : candidates) {
+    auto id = context_.rowid_map->Find(rowid);
+    VECTORLITE_ASSERT(id.has_value());
+    const void* vector = index_.getDataByInternalId(*id);
+    float score = 0.0f;
+    for (size_t i = 0; i < weights.size(); i++) {
+      score += weights[i] * dist_func(queries + i * dim, vector,
+                                      dist_func_param);
+    }
+    result.emplace_back(score, rowid);
+  }
+  uint64_t distance_computations = candidates.size() * weights.size();
+  AddDistanceStats(*context_.early_abandon_space, distance_computations,
+                   distance_computations * dim, stats);
+  size_t n = std::min<size_t>(k, result.size());
+  std::partial_sort(result.begin(), result.begin() + n, result.end());
+  result.resize(n);
+  return absl::OkStatus();
+}
+
+absl::Status QueryExecutor::SearchMultiVector(
+    const float* queries, size_t num_queries, size_t k, size_t ef,
+    const AttributeFilter* attribute_filter, const Grouping& grouping,
+    Deadline& deadline, QueryResult& result, QueryScratch& scratch,
+    SearchStats& stats) const {
+  VECTORLITE_ASSERT(context_.rowid_map != nullptr);
+  VECTORLITE_ASSERT(context_.early_abandon_space != nullptr);
+  const RowidMap& rowid_map = *context_.rowid_map;
+  const EarlyAbandonSpace& space = *context_.early_abandon_space;
+  size_t dim = space_.dimension();
+  auto& rowids = scratch.candidate_rowids;
+  rowids.clear();
+  if (CollectRowidConstraintIds(ef, scratch.ids)) {
+    for (hnswlib::tableint id : scratch.ids) {
+      if (!attribute_filter || (*attribute_filter)(id)) {
+        rowids.push_back(index_.getExternalLabel(id));
+      }
+    }
+    stats.exact_searches++;
+  } else if (!rowid_constraint_ && ef >= index_.cur_element_count) {
+    // Every row is a candidate, each one is collected from its first element.
+    for (hnswlib::tableint id = 0; id < index_.cur_element_count; id++) {
+      hnswlib::labeltype rowid = index_.getExternalLabel(id);
+      if (!index_.isMarkedDeleted(id) && rowid_map.Find(rowid) == id &&
+          (!attribute_filter || (*attribute_filter)(id))) {
+        rowids.push_back(rowid);
+      }
+    }
+    stats.exact_searches++;
+  } else {
+    // Vectors are labeled with the rowid of their row.
+    for (size_t i = 0; i < num_queries; i++) {
+      scratch.vector_neighbors.clear();
+      auto status = SearchGraph(queries + i * dim, ef, ef, attribute_filter,
+                                deadline, scratch.vector_neighbors, scratch,
+                                stats);
+      if (!status.ok()) {
+        return status;
+      }
+      for (const auto& [distance, rowid] : scratch.vector_neighbors) {
+        rowids.push_back(rowid);
+      }
+    }
+    std::sort(rowids.begin(), rowids.end());
+    rowids.erase(std::unique(rowids.begin(), rowids.end()), rowids.end());
+  }
+
+  // Each vector of a candidate row is loaded once and compared to groups of
+  // kQueryGroupSize query vectors at a time by GroupDistances(). The last
+  // group is padded by repeating its last query vector.
+  auto& min_distances = scratch.min_distances;
+  auto& row_scores = scratch.row_scores;
+  row_scores.clear();
+  const float* group[kQueryGroupSize];
+  float distances[kQueryGroupSize];
+  uint64_t distance_computations = 0;
+  for (hnswlib::labeltype rowid : rowids) {
+    if (deadline.Expired()) {
+      break;
+    }
+    auto first = rowid_map.FindLive(index_, rowid);
+    if (!first) {
+      continue;
+    }
+    size_t num_vectors = RowidMap::CountRowElements(index_, *first);
+    min_distances.assign(num_queries, std::numeric_limits<float>::max());
+    for (hnswlib::tableint id = *first; id < *first + num_vectors; id++) {
+      const float* vector =
+          reinterpret_cast<const float*>(index_.getDataByInternalId(id));
+      for (size_t begin = 0; begin < num_queries; begin += kQueryGroupSize) {
+        size_t group_size = std::min(kQueryGroupSize, num_queries - begin);
+        for (size_t i = 0; i < kQueryGroupSize; i++) {
+          group[i] = queries + (begin + std::min(i, group_size - 1)) * dim;
+        }
+        GroupDistances(space, group, vector, distances);
+        for (size_t i = 0; i < group_size; i++) {
+          min_distances[begin + i] =
+              std::min(min_distances[begin + i], distances[i]);
+        }
+      }
+    }
+    distance_computations += num_vectors * num_queries;
+    float score = 0.0f;
+    for (float distance : min_distances) {
+      score += distance;
+    }
+    row_scores.emplace_back(score, rowid);
+  }
+  AddDistanceStats(space, distance_computations, distance_computations * dim,
+                   stats);
+  stats.multi_vector_searches++;
+
+  if (!grouping.enabled()) {
+    size_t n = std::min<size_t>(k, row_scores.size());
+    std::partial_sort(row_scores.begin(), row_scores.begin() + n,
+                      row_scores.end());
+    result.assign(row_scores.begin(), row_scores.begin() + n);
+    return absl::OkStatus();
+  }
+  // Rows are picked in order of score, skipping those whose group is full.
+  // The group of a row is the group of its first element.
+  std::sort(row_scores.begin(), row_scores.end());
+  auto& group_sizes = scratch.group_sizes;
+  group_sizes.clear();
+  for (const auto& [score, rowid] : row_scores) {
+    if (result.size() >= k) {
+      break;
+    }
+    auto first = rowid_map.Find(rowid);
+    VECTORLITE_ASSERT(first.has_value());
+    if (group_sizes[grouping.GroupOf(*first)]++ < grouping.limit) {
+      result.emplace_back(score, rowid);
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status QueryExecutor::TransformQuery(const std::vector<float>& query,
+                                           std::vector<float>& reduced) const {
+  const LinearTransform& transform = *context_.transform;
+  if (!transform.trained()) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "The transform of %s isn't trained yet, see "
+        "vectorlite_train_transform()",
+        space_.vector_name));
+  }
+  size_t input_dim = transform.input_dim();
+  if (query.empty() || query.size() % input_dim != 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "query vector's dimension(%d) doesn't match %s's dimension: %d",
+        query.size(), space_.vector_name, input_dim));
+  }
+  size_t dim = space_.dimension();
+  size_t num_vectors = query.size() / input_dim;
+  reduced.resize(num_vectors * dim);
+  for (size_t i = 0; i < num_vectors; i++) {
+    float* vector = reduced.data() + i * dim;
+    transform.Apply(query.data() + i * input_dim, vector);
+    if (space_.normalize) {
+      // Same as Vector::NormalizeTo().
+      ScaleVector(vector, 1.0f / (L2Norm(vector, dim) + 1e-30f), dim, vector);
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status QueryExecutor::Execute(QueryResult& result,
+                                    QueryScratch& scratch) const {
   if (!status_.ok()) {
     return status_;
   }
 
+  result.clear();
   if (vector_constraint_) {
     // we are doing a vector search
     const KnnParam* knn_param = vector_constraint_->knn_param();
     VECTORLITE_ASSERT(knn_param != nullptr);
 
-    if (space_.dimension() != knn_param->query_vector.dim()) {
+    // A query by rowid reads the vectors of its rows from the index, several
+    // rows of a table with one vector per row being weighted by 1 unless
+    // weights are given.
+    const auto& query_rowids = knn_param->query_rowids;
+    const std::vector<float>* query_vector = &knn_param->query_vector.data();
+    bool weight_rows = query_rowids.size() > 1 &&
+                       knn_param->weights.empty() && !space_.multi_vector;
+    if (!query_rowids.empty()) {
+      auto status = ReadQueryRows(query_rowids, scratch.rowid_query);
+      if (!status.ok()) {
+        return status;
+      }
+      query_vector = &scratch.rowid_query;
+      if (weight_rows) {
+        scratch.rowid_weights.assign(query_rowids.size(), 1.0f);
+      }
+    }
+    const std::vector<float>& weights =
+        weight_rows ? scratch.rowid_weights : knn_param->weights;
+
+    // Query vectors are reduced like the vectors of rows, unlike vectors read
+    // from the index.
+    bool reduced = context_.transform && query_rowids.empty();
+    if (reduced) {
+      auto status = TransformQuery(*query_vector, scratch.reduced_query);
+      if (!status.ok()) {
+        return status;
+      }
+      query_vector = &scratch.reduced_query;
+    }
+
+    // The query of a multi-vector table or a weighted query holds several
+    // vectors back to back.
+    size_t query_dim = query_vector->size();
+    if (!weights.empty()) {
+      if (space_.multi_vector) {
+        return absl::InvalidArgumentError(
+            "weighted queries aren't supported by multi-vector tables");
+      }
+      if (query_dim != weights.size() * space_.dimension()) {
+        std::string error = absl::StrFormat(
+            "query vectors' dimension(%d) doesn't match %d weights of %s's "
+            "dimension: %d",
+            query_dim, weights.size(), space_.vector_name, space_.dimension());
+        return absl::InvalidArgumentError(error);
+      }
+    } else if (space_.multi_vector) {
+      if (query_dim == 0 || query_dim % space_.dimension() != 0) {
+        std::string error = absl::StrFormat(
+            "query vectors' dimension(%d) isn't a multiple of %s's "
+            "dimension: %d",
+            query_dim, space_.vector_name, space_.dimension());
+        return absl::InvalidArgumentError(error);
+      }
+    } else if (space_.dimension() != query_dim) {
       std::string error = absl::StrFormat(
           "query vector's dimension(%d) doesn't match %s's dimension: %d",
-          knn_param->query_vector.dim(), space_.vector_name,
-          space_.dimension());
+          query_dim, space_.vector_name, space_.dimension());
       return absl::InvalidArgumentError(error);
     }
 
-    auto rowid_filter = MakeRowidFilter(rowid_constraint_);
-    if (knn_param->ef_search.has_value()) {
-      index_.setEf(*knn_param->ef_search);
+    // Excluded query rows may be among the results, which are then cut to k.
+    size_t k = knn_param->k;
+    if (knn_param->exclude_query_rows) {
+      k += query_rowids.size();
+    }
+    // ef only applies to the current query, so that concurrent queries with
+    // different ef don't interfere with each other.
+    size_t ef =
+        std::max<size_t>(knn_param->ef_search.value_or(index_.ef_), k);
+    Grouping grouping;
+    if (knn_param->group_by) {
+      auto status = MakeGrouping(*knn_param->group_by, grouping);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    ResultCache* result_cache = context_.result_cache;
+    // The semantic cache compares single query vectors.
+    SemanticCache* semantic_cache = space_.multi_vector || !weights.empty()
+                                        ? nullptr
+                                        : context_.semantic_cache;
+    size_t params_size = 0;
+    if (result_cache || semantic_cache) {
+      BuildCacheParams(*knn_param, ef, scratch);
+      params_size = scratch.cache_key.size();
+    }
+    if (result_cache) {
+      // The exact cache key is the params followed by the query vector.
+      scratch.cache_key.append(
+          reinterpret_cast<const char*>(query_vector->data()),
+          query_vector->size() * sizeof(float));
+      if (result_cache->Lookup(scratch.cache_key, result)) {
+        return absl::OkStatus();
+      }
+    }
+
+    Deadline deadline(knn_param->timeout, context_.db);
+    const float* query = query_vector->data();
+    // Vectors read from the index and reduced queries are already
+    // normalized.
+    bool normalize = space_.normalize && query_rowids.empty() && !reduced;
+    if (normalize && (space_.multi_vector || !weights.empty())) {
+      knn_param->query_vector.NormalizeEachTo(space_.dimension(),
+                                              scratch.normalized_query);
+      query = scratch.normalized_query.data();
+    } else if (normalize) {
+      knn_param->query_vector.NormalizeTo(scratch.normalized_query);
+      query = scratch.normalized_query.data();
+    }
+
+    std::string_view cache_params(scratch.cache_key.data(), params_size);
+    if (semantic_cache &&
+        semantic_cache->Lookup(cache_params, query, result)) {
+      return absl::OkStatus();
+    }
+
+    SearchStats stats;
+    absl::Status status;
+    const AttributeFilter* attribute_filter = BuildAttributeFilter(scratch);
+    // Searches for the vectors of a multi-vector query aren't grouped, rows
+    // are grouped once scored.
+    scratch.search.grouping = space_.multi_vector ? Grouping() : grouping;
+    if (space_.multi_vector) {
+      status = SearchMultiVector(query, query_dim / space_.dimension(), k,
+                                 ef, attribute_filter, grouping, deadline,
+                                 result, scratch, stats);
+    } else if (!weights.empty()) {
+      status = SearchWeighted(query, weights, k, ef, attribute_filter,
+                              deadline, result, scratch, stats);
+    } else {
+      status = SearchVector(query, k, ef, attribute_filter, deadline, result,
+                            scratch, stats);
+    }
+
+    stats.searches = 1;
+    if (context_.stats) {
+      context_.stats->Add(stats);
+    }
+    if (!status.ok()) {
+      return status;
+    }
+    if (deadline.interrupted()) {
+      return absl::CancelledError("knn_search interrupted");
+    }
+    if (knn_param->exclude_query_rows) {
+      result.erase(std::remove_if(result.begin(), result.end(),
+                                  [&](const auto& r) {
+                                    return std::find(query_rowids.begin(),
+                                                     query_rowids.end(),
+                                                     r.second) !=
+                                           query_rowids.end();
+                                  }),
+                   result.end());
+      if (result.size() > knn_param->k) {
+        result.resize(knn_param->k);
+      }
     }
-    auto result = index_.searchKnnCloserFirst(
-        space_.normalize ? knn_param->query_vector.Normalize().data().data()
-                         : knn_param->query_vector.data().data(),
-        knn_param->k, rowid_filter.get());
-    return result;
+    // Results cut short by a timeout are not cached.
+    if (deadline.reason() == Deadline::Reason::kNotExpired) {
+      if (result_cache) {
+        result_cache->Insert(scratch.cache_key, result);
+      }
+      if (semantic_cache) {
+        semantic_cache->Insert(cache_params, query, result,
+                               stats.distance_computations);
+      }
+    }
+    return absl::OkStatus();
   } else {
-    QueryExecutor::QueryResult result;
+    const AttributeFilter* attribute_filter = BuildAttributeFilter(scratch);
     if (rowid_constraint_) {
       // we are doing a rowid search without using hnsw index
+      VECTORLITE_ASSERT(context_.rowid_map != nullptr);
+      const RowidMap& rowid_map = *context_.rowid_map;
+      auto add = [&](hnswlib::labeltype rowid) {
+        auto id = rowid_map.FindLive(index_, rowid);
+        if (id && (!attribute_filter || (*attribute_filter)(*id))) {
+          result.emplace_back(0.0f, rowid);
+        }
+      };
       absl::visit(absl::Overload(
-                      [&result, this](const RowIdIn* rowid_in) {
+                      [&](const RowIdIn* rowid_in) {
                         for (const auto& rowid : rowid_in->get_rowids()) {
-                          // TODO: IsRowidInIndex takes a lock on
-                          // index.label_lookup_ on each invoke, Lock once in
-                          // the future.
-                          if (IsRowidInIndex(index_, rowid)) {
-                            result.emplace_back(0.0f, rowid);
-                          }
+                          add(rowid);
                         }
                       },
-                      [&result, this](const RowIdEquals* rowid_equals) {
-                        if (IsRowidInIndex(index_, rowid_equals->rowid())) {
-                          result.emplace_back(0.0f, rowid_equals->rowid());
-                        }
+                      [&](const RowIdEquals* rowid_equals) {
+                        add(rowid_equals->rowid());
                       }),
                   *rowid_constraint_);
+    } else if (attribute_filter) {
+      // Only attributes are constrained, so all elements are checked. A row
+      // of a multi-vector table is only returned for its first element.
+      for (hnswlib::tableint id = 0; id < index_.cur_element_count; id++) {
+        if (index_.isMarkedDeleted(id) || !(*attribute_filter)(id)) {
+          continue;
+        }
+        hnswlib::labeltype rowid = index_.getExternalLabel(id);
+        if (space_.multi_vector) {
+          VECTORLITE_ASSERT(context_.rowid_map != nullptr);
+          if (context_.rowid_map->Find(rowid) != id) {
+            continue;
+          }
+        }
+        result.emplace_back(0.0f, rowid);
+      }
+    }
+
+    return absl::OkStatus();
+  }
+}
+
+absl::Status QueryExecutor::ExecuteBatch(const std::vector<Vector>& queries,
+                                         size_t k,
+                                         std::optional<uint32_t> ef_search,
+                                         std::vector<QueryResult>& results,
+                                         BatchSearchBuffers& buffers) const {
+  if (space_.multi_vector) {
+    return absl::InvalidArgumentError(
+        "batch search isn't supported by multi-vector tables");
+  }
+  for (const auto& query : queries) {
+    if (space_.dimension() != query.dim()) {
+      std::string error = absl::StrFormat(
+          "query vector's dimension(%d) doesn't match %s's dimension: %d",
+          query.dim(), space_.vector_name, space_.dimension());
+      return absl::InvalidArgumentError(error);
+    }
+  }
+
+  size_t num_queries = queries.size();
+  results.resize(num_queries);
+  std::vector<Vector> normalized_queries;
+  std::vector<const float*> query_data;
+  for (const auto& query : queries) {
+    if (space_.normalize) {
+      normalized_queries.push_back(query.Normalize());
+      query_data.push_back(normalized_queries.back().data().data());
+    } else {
+      query_data.push_back(query.data().data());
     }
+  }
 
-    return result;
+  Deadline deadline(std::nullopt, context_.db);
+  size_t ef = std::max<size_t>(ef_search.value_or(index_.ef_), k);
+  VECTORLITE_ASSERT(context_.early_abandon_space != nullptr);
+  const EarlyAbandonSpace& space = *context_.early_abandon_space;
+  SearchStats stats;
+  stats.searches = num_queries;
+  stats.batch_searches = num_queries;
+  if (ef >= index_.cur_element_count) {
+    // ef covers the whole index, so scanning it is exact and cheaper.
+    BatchScan(index_, space, query_data, k, deadline, buffers);
+    for (size_t i = 0; i < num_queries; i++) {
+      const SearchBuffers& search = buffers.search[i];
+      QueryResult& result = results[i];
+      result.clear();
+      for (const auto& [distance, id] :
+           search.top_candidates.candidates()) {
+        result.emplace_back(distance, index_.getExternalLabel(id));
+      }
+      AddDistanceStats(space, search.distance_computations,
+                       search.distance_computations * space.dimension(),
+                       stats);
+    }
+    stats.exact_searches = num_queries;
+  } else {
+    // Traverse the graph comparing only vector prefixes if prefix search is
+    // enabled, then rerank the ef candidates found using full vectors.
+    const EarlyAbandonSpace* search_space =
+        space_.prefix_space ? context_.early_abandon_prefix_space
+                            : &space;
+    VECTORLITE_ASSERT(search_space != nullptr);
+    if (buffers.query_suffix_norms.size() < kQueryGroupSize) {
+      buffers.query_suffix_norms.resize(kQueryGroupSize);
+    }
+    std::vector<EarlyAbandonDistance> distances;
+    distances.reserve(kQueryGroupSize);
+    for (size_t group = 0; group < num_queries; group += kQueryGroupSize) {
+      size_t group_size = std::min(kQueryGroupSize, num_queries - group);
+      distances.clear();
+      for (size_t i = 0; i < group_size; i++) {
+        distances.emplace_back(*search_space, query_data[group + i],
+                               buffers.query_suffix_norms[i]);
+      }
+      InterleavedSearchWithDistance(index_, distances, ef, NoFilter(),
+                                    deadline, buffers);
+
+      for (size_t i = 0; i < group_size; i++) {
+        const SearchBuffers& search = buffers.search[i];
+        const auto& candidates = search.top_candidates.candidates();
+        AddDistanceStats(*search_space, search.distance_computations,
+                         distances[i].dimensions_computed(), stats);
+        QueryResult& result = results[group + i];
+        result.clear();
+        if (space_.prefix_space) {
+          EarlyAbandonDistance rerank_distance(space, query_data[group + i],
+                                               buffers.query_suffix_norms[i]);
+          Rerank(index_, rerank_distance, candidates, k, result);
+          AddDistanceStats(space, candidates.size(),
+                           rerank_distance.dimensions_computed(), stats);
+        } else {
+          size_t n = std::min<size_t>(k, candidates.size());
+          for (size_t j = 0; j < n; j++) {
+            result.emplace_back(candidates[j].first,
+                                index_.getExternalLabel(candidates[j].second));
+          }
+        }
+      }
+    }
+  }
+
+  if (context_.stats) {
+    context_.stats->Add(stats);
+  }
+  if (deadline.interrupted()) {
+    return absl::CancelledError("knn_search_batch interrupted");
   }
+  return absl::OkStatus();
 }
 
 std::string ConstraintsToDebugString(
@@ -249,6 +1357,9 @@ ParseConstraintsFromShortNames(std::string_view constraint_str) {
       constraints.push_back(std::make_unique<RowIdEquals>());
     } else if (short_name == KnnSearchConstraint::kShortName) {
       constraints.push_back(std::make_unique<KnnSearchConstraint>());
+    } else if (auto attribute_constraint =
+                   AttributeConstraint::FromShortName(short_name)) {
+      constraints.push_back(std::move(attribute_constraint));
     } else {
       return absl::InvalidArgumentError(
           absl::StrFormat("unknown constraint short name: %s", short_name));
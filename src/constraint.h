@@ -1,26 +1,71 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
 #include "absl/types/variant.h"
+#include "attribute_store.h"
+#include "batch_search.h"
+#include "deadline.h"
+#include "early_abandon.h"
+#include "hnsw_search.h"
 #include "hnswlib/hnswlib.h"
+#include "linear_transform.h"
 #include "macros.h"
+#include "result_cache.h"
+#include "rowid_map.h"
+#include "semantic_cache.h"
 #include "sqlite3.h"
 #include "vector.h"
 #include "vector_space.h"
 
 namespace vectorlite {
 
+// Limits the results of a knn search to limit per group, see
+// knn_group_by().
+struct KnnGroupBy {
+  // Parses group_by, which is either the name of an attribute, whose values
+  // are the groups, or "rowid / <divisor>", e.g. "rowid / 1000" puts rowids
+  // 0-999 in one group.
+  static absl::StatusOr<KnnGroupBy> FromString(std::string_view group_by,
+                                               uint32_t limit);
+
+  // Empty if rows are grouped by rowid / rowid_divisor.
+  std::string attribute;
+  uint64_t rowid_divisor = 1;
+  uint32_t limit = 1;
+};
+
 struct KnnParam {
   Vector query_vector;
   uint32_t k;
   std::optional<uint32_t> ef_search;
+  // If set, the search returns the best results found so far once it runs
+  // longer than timeout.
+  std::optional<std::chrono::milliseconds> timeout;
+  std::optional<KnnGroupBy> group_by;
+  // If not empty, query_vector holds weights.size() query vectors back to
+  // back, and the distance of a row is the sum of its distances to them
+  // multiplied by their weights, see knn_weighted().
+  std::vector<float> weights;
+  // If not empty, query_vector is ignored and the query vectors are those of
+  // these rows, read from the index, see knn_param_rowid(). A query with
+  // several rows and no weights weights each row by 1.
+  std::vector<hnswlib::labeltype> query_rowids;
+  // Whether query_rowids are excluded from the results.
+  bool exclude_query_rows = false;
 };
 
 // Used to identify pointer type for sqlite_result_pointer/sqlite_value_pointer
@@ -29,6 +74,7 @@ constexpr std::string_view kKnnParamType = "vectorlite_knn_param";
 class KnnSearchConstraint;
 class RowIdIn;
 class RowIdEquals;
+class AttributeConstraint;
 
 class ConstraintVisitor {
  public:
@@ -37,23 +83,181 @@ class ConstraintVisitor {
   virtual void Visit(const KnnSearchConstraint& constraint) = 0;
   virtual void Visit(const RowIdIn& constraint) = 0;
   virtual void Visit(const RowIdEquals& constraint) = 0;
+  virtual void Visit(const AttributeConstraint& constraint) = 0;
+};
+
+// Accepts the elements whose attributes satisfy a set of attribute
+// constraints. Attributes are read by internal id, so it can be used as the
+// filter of search routines.
+class AttributeFilter {
+ public:
+  void Clear() { predicates_.clear(); }
+  bool empty() const { return predicates_.empty(); }
+
+  // Adds a materialized constraint on the attribute whose values are values
+  // and whose null bitmap is nulls, indexed by internal id. As in SQL, NULL
+  // satisfies no constraint.
+  void Add(const int64_t* values, const uint64_t* nulls,
+           const AttributeConstraint& constraint);
+
+  bool operator()(hnswlib::tableint id) const {
+    for (const auto& predicate : predicates_) {
+      int64_t value = predicate.values[id];
+      if (AttributeStore::IsNullIn(predicate.nulls, id) ||
+          value < predicate.min || value > predicate.max ||
+          (predicate.has_excluded && value == predicate.excluded) ||
+          (predicate.in && !predicate.in->contains(value))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  // Every constraint is compiled into a range, optionally combined with an
+  // excluded value or a set of values.
+  struct Predicate {
+    const int64_t* values;
+    const uint64_t* nulls;
+    int64_t min = std::numeric_limits<int64_t>::min();
+    int64_t max = std::numeric_limits<int64_t>::max();
+    bool has_excluded = false;
+    int64_t excluded = 0;
+    const absl::flat_hash_set<int64_t>* in = nullptr;
+  };
+  std::vector<Predicate> predicates_;
+};
+
+// Buffers reused by all queries executed on the same cursor, so that
+// steady-state queries don't allocate.
+struct QueryScratch {
+  std::vector<float> normalized_query;
+  std::vector<float> query_suffix_norms;
+  SearchBuffers search;
+  std::string cache_key;
+  std::vector<hnswlib::labeltype> sorted_rowids;
+  std::vector<int64_t> sorted_values;
+  AttributeFilter attribute_filter;
+  // Internal ids of the elements scanned by exact search.
+  std::vector<hnswlib::tableint> ids;
+  std::vector<SearchCandidate> candidates;
+  // Used by multi-vector searches: the vectors found for a query vector,
+  // the candidate rows, the distances from the query vectors to the nearest
+  // vector of a row and the scores of the candidate rows.
+  std::vector<std::pair<float, hnswlib::labeltype>> vector_neighbors;
+  std::vector<hnswlib::labeltype> candidate_rowids;
+  std::vector<float> min_distances;
+  std::vector<std::pair<float, hnswlib::labeltype>> row_scores;
+  // The query vectors reduced by the table's transform.
+  std::vector<float> reduced_query;
+  // The query vectors of a weighted search combined into one.
+  std::vector<float> combined_query;
+  // The vectors of the query rows of a query by rowid and their weights.
+  std::vector<float> rowid_query;
+  std::vector<float> rowid_weights;
+  // Number of rows picked per group by grouped multi-vector searches.
+  absl::flat_hash_map<std::optional<int64_t>, size_t> group_sizes;
+  // Used by searches split across threads, one element per thread.
+  std::vector<SearchBuffers> thread_search;
+  std::vector<std::vector<float>> thread_query_suffix_norms;
+  internal::SharedVisitedTable thread_visited;
+};
+
+// Accumulated statistics of vector searches. Queries served from caches are
+// not counted.
+struct SearchStats {
+  uint64_t searches = 0;
+  // Searches that scanned candidates exhaustively instead of traversing the
+  // graph.
+  uint64_t exact_searches = 0;
+  // Searches split across multiple threads.
+  uint64_t parallel_searches = 0;
+  // Searches run as part of a batch by knn_search_batch().
+  uint64_t batch_searches = 0;
+  // Searches of multi-vector tables scoring rows by MaxSim.
+  uint64_t multi_vector_searches = 0;
+  // Searches combining several weighted query vectors.
+  uint64_t weighted_searches = 0;
+  uint64_t distance_computations = 0;
+  // Floating point operations of distance computations actually done.
+  uint64_t distance_flops = 0;
+  // Floating point operations skipped by early abandoning.
+  uint64_t distance_flops_saved = 0;
+
+  void Add(const SearchStats& other) {
+    searches += other.searches;
+    exact_searches += other.exact_searches;
+    parallel_searches += other.parallel_searches;
+    batch_searches += other.batch_searches;
+    multi_vector_searches += other.multi_vector_searches;
+    weighted_searches += other.weighted_searches;
+    distance_computations += other.distance_computations;
+    distance_flops += other.distance_flops;
+    distance_flops_saved += other.distance_flops_saved;
+  }
+};
+
+// Per-table state used by queries.
+struct QueryContext {
+  // Computes distances of full vectors. Required by vector search.
+  const EarlyAbandonSpace* early_abandon_space = nullptr;
+  // Computes distances of vector prefixes. Required by vector search iff
+  // prefix search is enabled.
+  const EarlyAbandonSpace* early_abandon_prefix_space = nullptr;
+  // If not nullptr, vector search aborts once db is interrupted by
+  // sqlite3_interrupt().
+  sqlite3* db = nullptr;
+  // If not nullptr, vector search results are looked up in and added to
+  // caches. result_cache is looked up first.
+  ResultCache* result_cache = nullptr;
+  SemanticCache* semantic_cache = nullptr;
+  // If not nullptr, statistics of vector searches are accumulated into it.
+  SearchStats* stats = nullptr;
+  // Max number of threads a single vector search can use. Only expensive
+  // searches are split across threads.
+  size_t search_threads = 1;
+  // Maps rowids to elements of the index. Required by rowid constraints.
+  const RowidMap* rowid_map = nullptr;
+  // Attributes of the elements of the index. Required by attribute
+  // constraints.
+  const AttributeStore* attributes = nullptr;
+  // Whether the graph is built for filtered searches(filter_gamma > 1), in
+  // which case filtered graph searches only traverse accepted elements.
+  bool expand_through_rejected = false;
+  // If not nullptr, query vectors are reduced by it before being compared to
+  // the index, like the vectors of rows.
+  const LinearTransform* transform = nullptr;
 };
 
 class QueryExecutor : public ConstraintVisitor {
  public:
   using QueryResult = std::vector<std::pair<float, hnswlib::labeltype>>;
 
-  QueryExecutor(hnswlib::HierarchicalNSW<float>& index,
-                const NamedVectorSpace& space)
-      : index_(index), space_(space) {}
+  QueryExecutor(const hnswlib::HierarchicalNSW<float>& index,
+                const NamedVectorSpace& space, const QueryContext& context)
+      : index_(index), space_(space), context_(context) {}
   virtual ~QueryExecutor() = default;
 
   // Should only be called iff IsOk() returns true.
-  absl::StatusOr<QueryResult> Execute() const;
+  // The previous content of result is discarded. Memory held by result and
+  // scratch is reused.
+  // Returns absl::CancelledError if the query is interrupted.
+  absl::Status Execute(QueryResult& result, QueryScratch& scratch) const;
+
+  // Searches for the k nearest neighbors of each of queries at once, using ef
+  // candidates if ef_search is set. results[i] receives the results of
+  // queries[i]. Constraints visited and caches are ignored. Memory held by
+  // buffers is reused.
+  // Returns absl::CancelledError if the query is interrupted.
+  absl::Status ExecuteBatch(const std::vector<Vector>& queries, size_t k,
+                            std::optional<uint32_t> ef_search,
+                            std::vector<QueryResult>& results,
+                            BatchSearchBuffers& buffers) const;
 
   void Visit(const KnnSearchConstraint& constraint) override;
   void Visit(const RowIdIn& constraint) override;
   void Visit(const RowIdEquals& constraint) override;
+  void Visit(const AttributeConstraint& constraint) override;
 
   bool ok() const { return status_.ok(); }
 
@@ -65,10 +269,97 @@ class QueryExecutor : public ConstraintVisitor {
   }
 
  private:
-  // setting ef when querying the index is allowed. So index_ cannot be marked
-  // as const.
-  hnswlib::HierarchicalNSW<float>& index_;
+  // Encodes everything except the query vector that affects the result of
+  // the knn query into scratch.cache_key.
+  void BuildCacheParams(const KnnParam& knn_param, size_t ef,
+                        QueryScratch& scratch) const;
+
+  // Returns the number of threads to use for a search whose cost is
+  // proportional to work, given that splitting it pays off only if each
+  // thread gets at least min_work_per_thread.
+  size_t NumSearchThreads(size_t work, size_t min_work_per_thread) const;
+
+  // Resolves group_by into grouping.
+  absl::Status MakeGrouping(const KnnGroupBy& group_by,
+                            Grouping& grouping) const;
+
+  // Compiles the attribute constraints into scratch.attribute_filter.
+  // Returns nullptr if there is no attribute constraint.
+  const AttributeFilter* BuildAttributeFilter(QueryScratch& scratch) const;
+
+  // Finds the k nearest neighbors of query by traversing the HNSW graph with
+  // ef candidates, only returning elements accepted by attribute_filter if
+  // it's not nullptr. The work done is accumulated into stats.
+  absl::Status SearchGraph(const float* query, size_t k, size_t ef,
+                           const AttributeFilter* attribute_filter,
+                           Deadline& deadline, QueryResult& result,
+                           QueryScratch& scratch, SearchStats& stats) const;
+
+  // Reduces the query vectors held back to back by query with
+  // context_.transform into reduced, normalizing them if needed.
+  // Returns absl::FailedPreconditionError if the transform isn't trained.
+  absl::Status TransformQuery(const std::vector<float>& query,
+                              std::vector<float>& reduced) const;
+
+  // Copies the vectors of rows into query, all vectors of a row of a
+  // multi-vector table.
+  // Returns absl::NotFoundError if one of rows doesn't exist.
+  absl::Status ReadQueryRows(const std::vector<hnswlib::labeltype>& rowids,
+                             std::vector<float>& query) const;
+
+  // Finds the k nearest neighbors of query, scanning the elements allowed by
+  // the rowid constraint or the whole index if it's cheaper than traversing
+  // the graph with ef candidates.
+  absl::Status SearchVector(const float* query, size_t k, size_t ef,
+                            const AttributeFilter* attribute_filter,
+                            Deadline& deadline, QueryResult& result,
+                            QueryScratch& scratch, SearchStats& stats) const;
+
+  // Finds the k rows minimizing the sum of their distances to the
+  // weights.size() vectors of queries multiplied by weights, in a single
+  // search for the query vectors combined into one. The work done is
+  // accumulated into stats.
+  absl::Status SearchWeighted(const float* queries,
+                              const std::vector<float>& weights, size_t k,
+                              size_t ef,
+                              const AttributeFilter* attribute_filter,
+                              Deadline& deadline, QueryResult& result,
+                              QueryScratch& scratch, SearchStats& stats) const;
+
+  // Finds the k rows of a multi-vector table whose vectors best match the
+  // num_queries vectors of queries, scored by MaxSim: the distance of a row
+  // is the sum over query vectors of their distance to the nearest vector of
+  // the row(for inner product, the number of query vectors minus MaxSim).
+  // Candidate rows are those owning one of the ef nearest vectors of any
+  // query vector, or all rows allowed by the constraints if scanning them is
+  // as cheap. At most grouping.limit rows of each group are returned if
+  // grouping is enabled. The work done is accumulated into stats.
+  absl::Status SearchMultiVector(const float* queries, size_t num_queries,
+                                 size_t k, size_t ef,
+                                 const AttributeFilter* attribute_filter,
+                                 const Grouping& grouping, Deadline& deadline,
+                                 QueryResult& result, QueryScratch& scratch,
+                                 SearchStats& stats) const;
+
+  // If the rowid constraint allows at most max_rows rows, stores the internal
+  // ids of those that are in the index and not deleted into ids and returns
+  // true.
+  bool CollectRowidConstraintIds(size_t max_rows,
+                                 std::vector<hnswlib::tableint>& ids) const;
+
+  // Finds the exact k nearest neighbors of query among elements ids, which
+  // is an array-like type of internal ids, only returning elements accepted
+  // by attribute_filter if it's not nullptr. The work done is accumulated
+  // into stats.
+  template <typename Ids>
+  absl::Status SearchExact(const float* query, size_t k, const Ids& ids,
+                           const AttributeFilter* attribute_filter,
+                           Deadline& deadline, QueryResult& result,
+                           QueryScratch& scratch, SearchStats& stats) const;
+
+  const hnswlib::HierarchicalNSW<float>& index_;
   const NamedVectorSpace& space_;
+  QueryContext context_;
   absl::Status status_;
 
   // there can at most one KnnParam constraint
@@ -77,6 +368,9 @@ class QueryExecutor : public ConstraintVisitor {
   // there can be at most one vector constraint
   std::optional<absl::variant<const RowIdIn*, const RowIdEquals*>>
       rowid_constraint_;
+
+  // All of them must be satisfied.
+  std::vector<const AttributeConstraint*> attribute_constraints_;
 };
 
 class Constraint {
@@ -99,6 +393,13 @@ class Constraint {
     return absl::OkStatus();
   }
 
+  // Makes the constraint ready to be materialized again, so that it can be
+  // reused across xFilter calls.
+  void Reset() {
+    materialized_ = false;
+    DoReset();
+  }
+
   virtual void Accept(ConstraintVisitor* visitor) = 0;
 
   virtual std::string ToDebugString() const = 0;
@@ -108,6 +409,7 @@ class Constraint {
  private:
   virtual absl::Status DoMaterialize(const sqlite3_api_routines* sqlite3_api,
                                      sqlite3_value* arg) = 0;
+  virtual void DoReset() {}
   bool materialized_ = false;
 };
 
@@ -135,6 +437,7 @@ class KnnSearchConstraint : public Constraint {
  private:
   absl::Status DoMaterialize(const sqlite3_api_routines* sqlite3_api,
                              sqlite3_value* arg) override;
+  void DoReset() override { knn_param_ = nullptr; }
   const KnnParam* knn_param_;
 };
 
@@ -155,6 +458,8 @@ class RowIdIn : public Constraint {
  private:
   virtual absl::Status DoMaterialize(const sqlite3_api_routines* sqlite3_api,
                                      sqlite3_value* arg) override;
+  // clear() keeps the memory of small sets.
+  void DoReset() override { rowids_.clear(); }
 
   std::string ToDebugString() const override {
     if (materialized()) {
@@ -193,6 +498,53 @@ class RowIdEquals : public Constraint {
   hnswlib::labeltype rowid_;
 };
 
+// A comparison between an attribute column and a value, e.g. category = ?,
+// or a set of values for attribute IN (...).
+class AttributeConstraint : public Constraint {
+ public:
+  enum class Op : char {
+    kEq = '=',
+    kIn = 'i',
+    kNe = '!',
+    kLt = '<',
+    kLe = 'l',
+    kGt = '>',
+    kGe = 'g',
+  };
+
+  // Name used in idxStr: a letter identifying the attribute('A' for the first
+  // one) followed by op, e.g. "B<" for "2nd attribute < ?".
+  static std::string ShortName(size_t attribute, Op op);
+
+  // Returns nullptr if short_name is not the name of an attribute constraint.
+  static std::unique_ptr<AttributeConstraint> FromShortName(
+      std::string_view short_name);
+
+  AttributeConstraint(size_t attribute, Op op)
+      : attribute_(attribute), op_(op), value_(0) {}
+
+  void Accept(ConstraintVisitor* visitor) override { visitor->Visit(*this); }
+
+  size_t attribute() const { return attribute_; }
+  Op op() const { return op_; }
+  // The value compared to, unless op is kIn.
+  int64_t value() const { return value_; }
+  // The set of values if op is kIn.
+  const absl::flat_hash_set<int64_t>& values() const { return values_; }
+
+  std::string ToDebugString() const override;
+
+ private:
+  absl::Status DoMaterialize(const sqlite3_api_routines* sqlite3_api,
+                             sqlite3_value* arg) override;
+  void DoReset() override { values_.clear(); }
+
+  size_t attribute_;
+  Op op_;
+  int64_t value_;
+  absl::flat_hash_set<int64_t> values_;
+};
+
 std::string ConstraintsToDebugString(
     const std::vector<std::unique_ptr<Constraint>>& constraints);
 
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string_view>
+
+#include "absl/crc/crc32c.h"
+
+namespace vectorlite {
+
+// Wraps a file being written, keeping a crc32c of everything written so far.
+// Files written with it usually end with the crc32c, which is checked by
+// CrcReader when they are read back.
+class CrcWriter {
+ public:
+  explicit CrcWriter(std::ofstream& file) : file_(file) {}
+
+  template <typename T>
+  void Write(const T& value) {
+    Write(&value, sizeof(value));
+  }
+
+  void Write(const void* data, size_t size) {
+    std::string_view bytes(static_cast<const char*>(data), size);
+    crc_ = absl::ExtendCrc32c(crc_, bytes);
+    file_.write(bytes.data(), bytes.size());
+  }
+
+  absl::crc32c_t crc() const { return crc_; }
+
+ private:
+  std::ofstream& file_;
+  absl::crc32c_t crc_{0};
+};
+
+// Wraps a file being read, keeping a crc32c of everything read so far.
+class CrcReader {
+ public:
+  explicit CrcReader(std::ifstream& file) : file_(file) {}
+
+  template <typename T>
+  bool Read(T& value) {
+    return Read(&value, sizeof(value));
+  }
+
+  // Returns false if the file is shorter than size.
+  bool Read(void* data, size_t size) {
+    if (!file_.read(static_cast<char*>(data), size)) {
+      return false;
+    }
+    crc_ = absl::ExtendCrc32c(
+        crc_, std::string_view(static_cast<const char*>(data), size));
+    return true;
+  }
+
+  absl::crc32c_t crc() const { return crc_; }
+
+ private:
+  std::ifstream& file_;
+  absl::crc32c_t crc_{0};
+};
+
+}  // namespace vectorlite
@@ -0,0 +1,37 @@
+#include "deadline.h"
+
+#include <chrono>
+#include <optional>
+
+#include "sqlite3ext.h"
+
+// Defined in vectorlite.cpp
+extern const sqlite3_api_routines* sqlite3_api;
+
+namespace vectorlite {
+
+// sqlite3_is_interrupted() is only available since sqlite 3.41.0.
+static bool IsInterruptCheckSupported() {
+  return sqlite3_libversion_number() >= 3041000;
+}
+
+Deadline::Deadline(std::optional<std::chrono::milliseconds> timeout,
+                   sqlite3* db) {
+  if (timeout) {
+    expires_at_ = Clock::now() + *timeout;
+  }
+  if (db != nullptr && IsInterruptCheckSupported()) {
+    db_ = db;
+  }
+}
+
+bool Deadline::Poll() {
+  if (db_ != nullptr && sqlite3_is_interrupted(db_)) {
+    reason_ = Reason::kInterrupted;
+  } else if (expires_at_ && Clock::now() >= *expires_at_) {
+    reason_ = Reason::kTimeout;
+  }
+  return reason_ != Reason::kNotExpired;
+}
+
+}  // namespace vectorlite
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "sqlite3.h"
+
+namespace vectorlite {
+
+// Deadline tells a long running operation(e.g. knn search) when to give up.
+// It expires either because the time budget is used up or because the sqlite3
+// connection that runs the operation is interrupted by sqlite3_interrupt().
+// Expired() is designed to be called in hot loops: the clock and the interrupt
+// flag are only polled once every kPollInterval calls.
+class Deadline {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Reason {
+    kNotExpired,
+    kTimeout,
+    kInterrupted,
+  };
+
+  // A deadline that never expires.
+  Deadline() = default;
+
+  // If timeout is set, the deadline expires `timeout` after construction.
+  // If db is not nullptr, the deadline expires once db is interrupted.
+  Deadline(std::optional<std::chrono::milliseconds> timeout, sqlite3* db);
+
+  bool Expired() {
+    if (reason_ != Reason::kNotExpired) {
+      return true;
+    }
+    if (++calls_ % kPollInterval != 0) {
+      return false;
+    }
+    return Poll();
+  }
+
+  // Same as Expired(), but polls right away. Meant for loops whose iterations
+  // take long enough that polling on each of them costs nothing.
+  bool ExpiredNow() {
+    if (reason_ != Reason::kNotExpired) {
+      return true;
+    }
+    return Poll();
+  }
+
+  // Why the deadline expired. Returns kNotExpired if it hasn't expired yet.
+  Reason reason() const { return reason_; }
+
+  bool timed_out() const { return reason_ == Reason::kTimeout; }
+
+  bool interrupted() const { return reason_ == Reason::kInterrupted; }
+
+  // Expires this deadline for the same reason as other if other has expired
+  // but this one hasn't. Copies of a deadline poll independently, so each
+  // thread of a parallel operation polls its own copy, which are merged back
+  // once the threads are done.
+  void Merge(const Deadline& other) {
+    if (reason_ == Reason::kNotExpired) {
+      reason_ = other.reason_;
+    }
+  }
+
+ private:
+  static constexpr uint32_t kPollInterval = 64;
+
+  bool Poll();
+
+  std::optional<Clock::time_point> expires_at_;
+  // nullptr if interrupt checking is disabled or not supported by the sqlite3
+  // library that loads vectorlite.
+  sqlite3* db_ = nullptr;
+  uint32_t calls_ = 0;
+  Reason reason_ = Reason::kNotExpired;
+};
+
+}  // namespace vectorlite
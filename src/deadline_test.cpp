@@ -0,0 +1,42 @@
+#include "deadline.h"
+
+#include <chrono>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+TEST(Deadline, ShouldNeverExpireByDefault) {
+  vectorlite::Deadline deadline;
+  for (int i = 0; i < 10000; i++) {
+    EXPECT_FALSE(deadline.Expired());
+  }
+  EXPECT_EQ(deadline.reason(), vectorlite::Deadline::Reason::kNotExpired);
+}
+
+TEST(Deadline, ShouldExpireAfterTimeout) {
+  vectorlite::Deadline deadline(std::chrono::milliseconds(1), nullptr);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  bool expired = false;
+  // The clock is polled periodically, so it may take a few calls to notice.
+  for (int i = 0; i < 1000 && !expired; i++) {
+    expired = deadline.Expired();
+  }
+  EXPECT_TRUE(expired);
+  EXPECT_TRUE(deadline.timed_out());
+  EXPECT_FALSE(deadline.interrupted());
+  // Once expired, a deadline stays expired.
+  EXPECT_TRUE(deadline.Expired());
+}
+
+TEST(Deadline, ShouldNotExpireBeforeTimeout) {
+  vectorlite::Deadline deadline(std::chrono::hours(1), nullptr);
+  for (int i = 0; i < 10000; i++) {
+    EXPECT_FALSE(deadline.Expired());
+  }
+}
+
+TEST(Deadline, ShouldPollRightAwayWithExpiredNow) {
+  vectorlite::Deadline deadline(std::chrono::milliseconds(0), nullptr);
+  EXPECT_TRUE(deadline.ExpiredNow());
+  EXPECT_TRUE(deadline.timed_out());
+}
@@ -0,0 +1,204 @@
+#include "early_abandon.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "hnswlib/hnswlib.h"
+#include "macros.h"
+#include "vector_space.h"
+
+namespace vectorlite {
+
+namespace {
+
+// The block order is rebuilt once this many vectors are added, then each time
+// the number of vectors added doubles.
+constexpr size_t kMinVectorsToRebuild = 1024;
+
+// Partial sums are accumulated in independent lanes, so that the loops can be
+// vectorized without reassociating floating point additions.
+constexpr size_t kLanes = 8;
+
+float SquaredL2(const float* a, const float* b, size_t n) {
+  float lanes[kLanes] = {};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (size_t j = 0; j < kLanes; j++) {
+      float diff = a[i + j] - b[i + j];
+      lanes[j] += diff * diff;
+    }
+  }
+  float sum = 0;
+  for (; i < n; i++) {
+    float diff = a[i] - b[i];
+    sum += diff * diff;
+  }
+  for (size_t j = 0; j < kLanes; j++) {
+    sum += lanes[j];
+  }
+  return sum;
+}
+
+float Dot(const float* a, const float* b, size_t n) {
+  float lanes[kLanes] = {};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (size_t j = 0; j < kLanes; j++) {
+      lanes[j] += a[i + j] * b[i + j];
+    }
+  }
+  float sum = 0;
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  for (size_t j = 0; j < kLanes; j++) {
+    sum += lanes[j];
+  }
+  return sum;
+}
+
+}  // namespace
+
+EarlyAbandonSpace::EarlyAbandonSpace(DistanceType distance_type, size_t dim)
+    : is_l2_(distance_type == DistanceType::L2), dim_(dim) {
+  VECTORLITE_ASSERT(dim_ > 0);
+  for (size_t begin = 0; begin < dim_; begin += kBlockSize) {
+    block_begin_.push_back(static_cast<uint32_t>(begin));
+  }
+  block_order_.resize(num_blocks());
+  std::iota(block_order_.begin(), block_order_.end(), 0);
+  if (!is_l2_) {
+    max_suffix_norms_.resize(num_blocks() + 1, 0.0f);
+    sums_.resize(dim_, 0.0);
+    square_sums_.resize(dim_, 0.0);
+  }
+}
+
+void EarlyAbandonSpace::SuffixNorms(const float* vector,
+                                    std::vector<float>& norms) const {
+  norms.resize(num_blocks() + 1);
+  norms[num_blocks()] = 0.0f;
+  float square_sum = 0.0f;
+  for (size_t i = num_blocks(); i-- > 0;) {
+    size_t block = block_order_[i];
+    size_t begin = block_begin_[block];
+    size_t end = std::min(begin + kBlockSize, dim_);
+    square_sum += Dot(vector + begin, vector + begin, end - begin);
+    norms[i] = std::sqrt(square_sum);
+  }
+}
+
+void EarlyAbandonSpace::Add(const float* vector,
+                            const hnswlib::HierarchicalNSW<float>& index) {
+  if (is_l2_) {
+    return;
+  }
+
+  num_added_++;
+  if (num_added_ >= std::max(2 * num_added_at_rebuild_, kMinVectorsToRebuild)) {
+    Rebuild(index);
+    return;
+  }
+
+  for (size_t i = 0; i < dim_; i++) {
+    sums_[i] += vector[i];
+    square_sums_[i] += static_cast<double>(vector[i]) * vector[i];
+  }
+  SuffixNorms(vector, suffix_norms_);
+  for (size_t i = 0; i < max_suffix_norms_.size(); i++) {
+    max_suffix_norms_[i] = std::max(max_suffix_norms_[i], suffix_norms_[i]);
+  }
+}
+
+void EarlyAbandonSpace::Rebuild(const hnswlib::HierarchicalNSW<float>& index) {
+  if (is_l2_) {
+    return;
+  }
+
+  size_t num_elements = index.cur_element_count;
+  std::fill(sums_.begin(), sums_.end(), 0.0);
+  std::fill(square_sums_.begin(), square_sums_.end(), 0.0);
+  for (hnswlib::tableint id = 0; id < num_elements; id++) {
+    const float* vector =
+        reinterpret_cast<const float*>(index.getDataByInternalId(id));
+    for (size_t i = 0; i < dim_; i++) {
+      sums_[i] += vector[i];
+      square_sums_[i] += static_cast<double>(vector[i]) * vector[i];
+    }
+  }
+
+  std::vector<double> block_variances(num_blocks(), 0.0);
+  if (num_elements > 0) {
+    for (size_t i = 0; i < dim_; i++) {
+      double mean = sums_[i] / num_elements;
+      block_variances[i / kBlockSize] +=
+          square_sums_[i] / num_elements - mean * mean;
+    }
+  }
+  std::iota(block_order_.begin(), block_order_.end(), 0);
+  std::stable_sort(block_order_.begin(), block_order_.end(),
+                   [&block_variances](uint32_t a, uint32_t b) {
+                     return block_variances[a] > block_variances[b];
+                   });
+
+  std::fill(max_suffix_norms_.begin(), max_suffix_norms_.end(), 0.0f);
+  for (hnswlib::tableint id = 0; id < num_elements; id++) {
+    SuffixNorms(reinterpret_cast<const float*>(index.getDataByInternalId(id)),
+                suffix_norms_);
+    for (size_t i = 0; i < max_suffix_norms_.size(); i++) {
+      max_suffix_norms_[i] = std::max(max_suffix_norms_[i], suffix_norms_[i]);
+    }
+  }
+
+  num_added_ = num_elements;
+  num_added_at_rebuild_ = num_elements;
+}
+
+EarlyAbandonDistance::EarlyAbandonDistance(
+    const EarlyAbandonSpace& space, const float* query,
+    std::vector<float>& query_suffix_norms)
+    : space_(space), query_(query), query_suffix_norms_(query_suffix_norms) {
+  if (!space_.is_l2()) {
+    space_.SuffixNorms(query_, query_suffix_norms);
+  }
+}
+
+float EarlyAbandonDistance::operator()(const void* data, float bound) {
+  const float* vector = static_cast<const float*>(data);
+  const size_t num_blocks = space_.num_blocks();
+  if (space_.is_l2()) {
+    float sum = 0.0f;
+    for (size_t block = 0; block < num_blocks; block++) {
+      size_t begin = space_.block_begin_[block];
+      size_t end = std::min(begin + EarlyAbandonSpace::kBlockSize, space_.dim_);
+      sum += SquaredL2(query_ + begin, vector + begin, end - begin);
+      dimensions_computed_ += end - begin;
+      if (sum > bound) {
+        return sum;
+      }
+    }
+    return sum;
+  }
+
+  float dot = 0.0f;
+  for (size_t i = 0; i < num_blocks; i++) {
+    size_t begin = space_.block_begin_[space_.block_order_[i]];
+    size_t end = std::min(begin + EarlyAbandonSpace::kBlockSize, space_.dim_);
+    dot += Dot(query_ + begin, vector + begin, end - begin);
+    dimensions_computed_ += end - begin;
+    // The distance can't be less than min_distance.
+    float min_distance = 1.0f - dot -
+                         query_suffix_norms_[i + 1] *
+                             space_.max_suffix_norms_[i + 1];
+    if (min_distance > bound) {
+      return min_distance;
+    }
+  }
+  return 1.0f - dot;
+}
+
+}  // namespace vectorlite
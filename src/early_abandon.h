@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "hnswlib/hnswlib.h"
+#include "vector_space.h"
+
+namespace vectorlite {
+
+// Computes L2 or inner product distances block by block, so that a distance
+// computation can stop as soon as the distance is known to exceed a bound.
+// e.g. a neighbor further than the furthest of the ef best candidates found
+// so far is discarded by HNSW search, so its exact distance is not needed.
+//
+// For L2, the partial sum of squared differences only grows, so it is
+// compared to the bound directly.
+// For inner product(and cosine, whose vectors are normalized), the
+// contribution of the remaining blocks is bounded by Cauchy-Schwarz: the norm
+// of the query's remaining blocks times the max norm of the remaining blocks
+// of all stored vectors. Blocks are visited in descending order of variance
+// across stored vectors, so that the remaining norms shrink fast.
+//
+// An EarlyAbandonSpace holds per-table state, while queries use
+// EarlyAbandonDistance.
+class EarlyAbandonSpace {
+ public:
+  // Number of dimensions computed between two bound checks.
+  static constexpr size_t kBlockSize = 32;
+
+  // Distances are computed on the first dim elements of vectors.
+  // Cosine is treated as inner product, as its vectors are normalized.
+  EarlyAbandonSpace(DistanceType distance_type, size_t dim);
+
+  bool is_l2() const { return is_l2_; }
+  size_t dimension() const { return dim_; }
+  size_t num_blocks() const { return block_begin_.size(); }
+
+  // Floating point operations per dimension of a distance computation.
+  size_t flops_per_dimension() const { return is_l2_ ? 3 : 2; }
+
+  // Updates the norm bounds with a vector newly stored in index. For inner
+  // product, the block order is rebuilt from index each time the number of
+  // vectors added doubles. No-op for L2.
+  void Add(const float* vector, const hnswlib::HierarchicalNSW<float>& index);
+
+  // Recomputes the block order and the norm bounds from all vectors stored in
+  // index. No-op for L2.
+  void Rebuild(const hnswlib::HierarchicalNSW<float>& index);
+
+  // Blocks in the order they are visited. Blocks are identified by their
+  // index in dimension order.
+  const std::vector<uint32_t>& block_order() const { return block_order_; }
+
+ private:
+  friend class EarlyAbandonDistance;
+
+  // Computes norms[i], the norm of blocks block_order_[i..] of vector.
+  void SuffixNorms(const float* vector, std::vector<float>& norms) const;
+
+  bool is_l2_;
+  size_t dim_;
+  // block_begin_[i] is the first dimension of the i-th block in dimension
+  // order. The last block might be shorter than kBlockSize.
+  std::vector<uint32_t> block_begin_;
+  std::vector<uint32_t> block_order_;
+  // Only used for inner product.
+  // max_suffix_norms_[i] is the max norm of blocks block_order_[i..] of all
+  // stored vectors. It has num_blocks() + 1 elements, the last one being 0.
+  std::vector<float> max_suffix_norms_;
+  // Per dimension sums and sums of squares of stored vectors, used to
+  // estimate variances.
+  std::vector<double> sums_;
+  std::vector<double> square_sums_;
+  size_t num_added_ = 0;
+  size_t num_added_at_rebuild_ = 0;
+  // Buffer used by Add().
+  std::vector<float> suffix_norms_;
+};
+
+// Distance from a query to stored vectors, computed with early abandoning.
+// Not thread-safe.
+class EarlyAbandonDistance {
+ public:
+  // query must have at least space.dimension() elements. Both space and query
+  // must outlive the object. query_suffix_norms is used as a buffer, so that
+  // its memory is reused across queries.
+  EarlyAbandonDistance(const EarlyAbandonSpace& space, const float* query,
+                       std::vector<float>& query_suffix_norms);
+
+  // Returns the exact distance to data.
+  float operator()(const void* data) {
+    return (*this)(data, std::numeric_limits<float>::infinity());
+  }
+
+  // Returns the exact distance to data if it is at most bound. Otherwise,
+  // returns a value greater than bound which might be less than the distance.
+  float operator()(const void* data, float bound);
+
+  // Number of vector dimensions actually computed so far.
+  uint64_t dimensions_computed() const { return dimensions_computed_; }
+
+ private:
+  const EarlyAbandonSpace& space_;
+  const float* query_;
+  const std::vector<float>& query_suffix_norms_;
+  uint64_t dimensions_computed_ = 0;
+};
+
+}  // namespace vectorlite
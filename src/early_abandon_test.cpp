@@ -0,0 +1,101 @@
+#include "early_abandon.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hnswlib/hnswlib.h"
+#include "vector_space.h"
+
+namespace {
+
+std::vector<float> RandomVector(size_t dim, std::mt19937& rng,
+                                bool normalize = false) {
+  std::normal_distribution<float> dist;
+  std::vector<float> v(dim);
+  for (auto& x : v) {
+    x = dist(rng);
+  }
+  if (normalize) {
+    float norm = 0;
+    for (float x : v) {
+      norm += x * x;
+    }
+    norm = std::sqrt(norm);
+    for (auto& x : v) {
+      x /= norm;
+    }
+  }
+  return v;
+}
+
+}  // namespace
+
+TEST(EarlyAbandonDistance, ShouldMatchHnswlibL2) {
+  constexpr size_t kDim = 100;
+  std::mt19937 rng(1);
+  hnswlib::L2Space space(kDim);
+  vectorlite::EarlyAbandonSpace early_abandon_space(
+      vectorlite::DistanceType::L2, kDim);
+  std::vector<float> norms;
+  for (int i = 0; i < 20; i++) {
+    auto query = RandomVector(kDim, rng);
+    auto v = RandomVector(kDim, rng);
+    float expected = space.get_dist_func()(query.data(), v.data(),
+                                           space.get_dist_func_param());
+    vectorlite::EarlyAbandonDistance distance(early_abandon_space,
+                                              query.data(), norms);
+    EXPECT_NEAR(expected, distance(v.data()), 1e-3);
+    EXPECT_NEAR(expected, distance(v.data(), expected + 1), 1e-3);
+
+    // Abandoned before computing all dimensions.
+    float bound = expected / 2;
+    uint64_t computed = distance.dimensions_computed();
+    EXPECT_GT(distance(v.data(), bound), bound);
+    EXPECT_LT(distance.dimensions_computed() - computed, kDim);
+  }
+}
+
+TEST(EarlyAbandonDistance, ShouldBoundInnerProduct) {
+  constexpr size_t kDim = 128;
+  constexpr size_t kNumVectors = 200;
+  constexpr size_t kBlockSize = vectorlite::EarlyAbandonSpace::kBlockSize;
+  std::mt19937 rng(2);
+  hnswlib::InnerProductSpace space(kDim);
+  hnswlib::HierarchicalNSW<float> index(&space, kNumVectors);
+  vectorlite::EarlyAbandonSpace early_abandon_space(
+      vectorlite::DistanceType::Cosine, kDim);
+  std::vector<std::vector<float>> vectors;
+  for (size_t i = 0; i < kNumVectors; i++) {
+    vectors.push_back(RandomVector(kDim, rng, true));
+    // Makes the last block have the largest variance.
+    for (size_t j = kDim - kBlockSize; j < kDim; j++) {
+      vectors.back()[j] *= 4;
+    }
+    index.addPoint(vectors.back().data(), i);
+    early_abandon_space.Add(vectors.back().data(), index);
+  }
+  early_abandon_space.Rebuild(index);
+  EXPECT_EQ(kDim / kBlockSize - 1, early_abandon_space.block_order()[0]);
+
+  std::vector<float> norms;
+  auto query = vectors[0];
+  vectorlite::EarlyAbandonDistance distance(early_abandon_space, query.data(),
+                                            norms);
+  for (const auto& v : vectors) {
+    float expected = space.get_dist_func()(query.data(), v.data(),
+                                           space.get_dist_func_param());
+    EXPECT_NEAR(expected, distance(v.data()), 1e-3);
+    // Results are exact if the distance is within the bound, and greater than
+    // the bound otherwise.
+    for (float bound : {expected - 1.0f, expected - 0.1f, expected + 0.1f}) {
+      float result = distance(v.data(), bound);
+      if (expected <= bound) {
+        EXPECT_NEAR(expected, result, 1e-3);
+      } else {
+        EXPECT_GT(result, bound);
+      }
+    }
+  }
+}
@@ -0,0 +1,763 @@
+#include "hnsw_build.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "hnsw_search.h"
+#include "hnswlib/hnswlib.h"
+#include "parallel.h"
+
+namespace vectorlite {
+
+namespace {
+
+using Index = hnswlib::HierarchicalNSW<float>;
+using hnswlib::tableint;
+using Candidate = std::pair<float, tableint>;
+// Max heap of candidates by distance, as expected by hnswlib's
+// getNeighborsByHeuristic2().
+using CandidateQueue =
+    std::priority_queue<Candidate, std::vector<Candidate>,
+                        Index::CompareByFirst>;
+
+// A batch inserts at most 1/kBatchDivisor of the elements already in the
+// index, and at least 1.
+constexpr size_t kBatchDivisor = 16;
+// Threads are only worth starting for this many elements each.
+constexpr size_t kMinBatchSizePerThread = 64;
+// Reverse links are split into this many partitions per thread, so that
+// threads stay busy even if partitions are uneven.
+constexpr size_t kPartitionsPerThread = 4;
+// Elements refined per chunk and thread by RefineLinks().
+constexpr size_t kRefineChunkSizePerThread = 256;
+
+float Distance(const Index& index, const void* data, tableint id) {
+  return index.fstdistfunc_(data, index.getDataByInternalId(id),
+                            index.dist_func_param_);
+}
+
+// Greedily moves from entry_point to the element nearest to data on level.
+tableint SearchGreedy(const Index& index, const void* data,
+                      tableint entry_point, int level) {
+  tableint current = entry_point;
+  float current_dist = Distance(index, data, current);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    hnswlib::linklistsizeint* links = index.get_linklist(current, level);
+    size_t size = index.getListCount(links);
+    tableint* neighbors = reinterpret_cast<tableint*>(links + 1);
+    for (size_t i = 0; i < size; i++) {
+      float dist = Distance(index, data, neighbors[i]);
+      if (dist < current_dist) {
+        current_dist = dist;
+        current = neighbors[i];
+        changed = true;
+      }
+    }
+  }
+  return current;
+}
+
+// Same as hnswlib's searchBaseLayer(), which searches level for the ef
+// elements nearest to data that are not deleted, except that link lists are
+// not locked.
+CandidateQueue SearchLevel(const Index& index, const void* data,
+                           tableint entry_point, int level, size_t ef) {
+  internal::VisitedTable& visited =
+      internal::VisitedTable::ForNewSearch(index.cur_element_count);
+  CandidateQueue top_candidates;
+  // Min heap of candidates to expand, distances are negated.
+  std::priority_queue<Candidate> candidates;
+
+  float bound = std::numeric_limits<float>::max();
+  if (!index.isMarkedDeleted(entry_point)) {
+    bound = Distance(index, data, entry_point);
+    top_candidates.emplace(bound, entry_point);
+  }
+  candidates.emplace(-bound, entry_point);
+  visited.Visit(entry_point);
+
+  while (!candidates.empty()) {
+    auto [negated_dist, current] = candidates.top();
+    if (-negated_dist > bound && top_candidates.size() == ef) {
+      break;
+    }
+    candidates.pop();
+
+    hnswlib::linklistsizeint* links =
+        index.get_linklist_at_level(current, level);
+    size_t size = index.getListCount(links);
+    tableint* neighbors = reinterpret_cast<tableint*>(links + 1);
+    for (size_t i = 0; i < size; i++) {
+      tableint neighbor = neighbors[i];
+      if (!visited.Visit(neighbor)) {
+        continue;
+      }
+      float dist = Distance(index, data, neighbor);
+      if (top_candidates.size() < ef || dist < bound) {
+        candidates.emplace(-dist, neighbor);
+        if (!index.isMarkedDeleted(neighbor)) {
+          top_candidates.emplace(dist, neighbor);
+        }
+        if (top_candidates.size() > ef) {
+          top_candidates.pop();
+        }
+        if (!top_candidates.empty()) {
+          bound = top_candidates.top().first;
+        }
+      }
+    }
+  }
+  return top_candidates;
+}
+
+// Selects up to max_links links of an element on level among candidates,
+// sorted by ascending distance, for filter_gamma > 1. The num_nearest nearest
+// candidates are kept, further ones only if no kept candidate links to them.
+// The kept ones are stored in links in ascending order of distance.
+void SelectLinksForFilters(const Index& index, int level,
+                           const std::vector<Candidate>& candidates,
+                           size_t num_nearest, size_t max_links,
+                           std::vector<tableint>& links) {
+  links.clear();
+  absl::flat_hash_set<tableint> reachable;
+  for (const auto& [_, candidate] : candidates) {
+    if (links.size() >= max_links) {
+      break;
+    }
+    if (links.size() >= num_nearest && reachable.contains(candidate)) {
+      continue;
+    }
+    links.push_back(candidate);
+    hnswlib::linklistsizeint* list =
+        index.get_linklist_at_level(candidate, level);
+    size_t size = index.getListCount(list);
+    tableint* neighbors = reinterpret_cast<tableint*>(list + 1);
+    for (size_t i = 0; i < size; i++) {
+      reachable.insert(neighbors[i]);
+    }
+  }
+}
+
+// Selects the links of an element on level among candidates, which must not
+// hold duplicates, with the same heuristic as addPoint(), or with
+// SelectLinksForFilters() if filter_gamma > 1. Links are stored in ascending
+// order of distance. candidates are left unspecified.
+void PruneLinks(Index& index, int level, std::vector<Candidate>& candidates,
+                size_t filter_gamma, std::vector<tableint>& links) {
+  size_t max_links = level == 0 ? index.maxM0_ : index.maxM_;
+  if (filter_gamma > 1) {
+    std::sort(candidates.begin(), candidates.end());
+    SelectLinksForFilters(index, level, candidates, max_links / filter_gamma,
+                          max_links, links);
+    return;
+  }
+  CandidateQueue queue(Index::CompareByFirst(), std::move(candidates));
+  index.getNeighborsByHeuristic2(queue, max_links);
+  // Popped from the furthest to the nearest.
+  links.resize(queue.size());
+  for (size_t i = queue.size(); i > 0; i--) {
+    links[i - 1] = queue.top().second;
+    queue.pop();
+  }
+}
+
+// Sorts candidates popped from queue by ascending distance.
+void SortCandidates(CandidateQueue& queue, std::vector<Candidate>& candidates) {
+  candidates.resize(queue.size());
+  for (size_t i = queue.size(); i > 0; i--) {
+    candidates[i - 1] = queue.top();
+    queue.pop();
+  }
+}
+
+// Phase 1 of a batch: links the new element id to its neighbors found in the
+// graph built so far, without adding the reverse links.
+void LinkNewElement(Index& index, tableint id, tableint entry_point,
+                    int max_level, size_t filter_gamma) {
+  const char* data = index.getDataByInternalId(id);
+  int element_level = index.element_levels_[id];
+  tableint current = entry_point;
+  for (int level = max_level; level > element_level; level--) {
+    current = SearchGreedy(index, data, current, level);
+  }
+
+  for (int level = std::min(element_level, max_level); level >= 0; level--) {
+    CandidateQueue candidates =
+        SearchLevel(index, data, current, level, index.ef_construction_);
+    if (index.isMarkedDeleted(entry_point)) {
+      // Like addPoint(), keep the deleted entry point reachable.
+      candidates.emplace(Distance(index, data, entry_point), entry_point);
+      if (candidates.size() > index.ef_construction_) {
+        candidates.pop();
+      }
+    }
+    if (candidates.empty()) {
+      continue;
+    }
+    hnswlib::linklistsizeint* links = index.get_linklist_at_level(id, level);
+    tableint* neighbors = reinterpret_cast<tableint*>(links + 1);
+    if (filter_gamma > 1) {
+      std::vector<Candidate> sorted;
+      SortCandidates(candidates, sorted);
+      std::vector<tableint> selected;
+      SelectLinksForFilters(index, level, sorted, index.M_ / filter_gamma,
+                            index.M_, selected);
+      std::copy(selected.begin(), selected.end(), neighbors);
+      index.setListCount(links, selected.size());
+      current = selected.front();
+      continue;
+    }
+    index.getNeighborsByHeuristic2(candidates, index.M_);
+
+    // Neighbors are popped from the furthest to the nearest, which is the
+    // entry point of the next level.
+    index.setListCount(links, candidates.size());
+    for (size_t i = 0; candidates.size() > 0; i++) {
+      neighbors[i] = candidates.top().second;
+      current = neighbors[i];
+      candidates.pop();
+    }
+  }
+}
+
+// Selects new links of id on every level into links[level] among the ef
+// nearest elements found and its current links, ignoring deleted elements.
+void SelectLinks(Index& index, tableint id, size_t ef, size_t filter_gamma,
+                 std::vector<std::vector<tableint>>& links) {
+  const char* data = index.getDataByInternalId(id);
+  int element_level = index.element_levels_[id];
+  links.resize(element_level + 1);
+  tableint current = index.enterpoint_node_;
+  for (int level = index.maxlevel_; level > element_level; level--) {
+    current = SearchGreedy(index, data, current, level);
+  }
+
+  std::vector<Candidate> candidates;
+  for (int level = element_level; level >= 0; level--) {
+    CandidateQueue found = SearchLevel(index, data, current, level, ef);
+    candidates.clear();
+    for (; !found.empty(); found.pop()) {
+      if (found.top().second != id) {
+        candidates.push_back(found.top());
+      }
+    }
+    hnswlib::linklistsizeint* list = index.get_linklist_at_level(id, level);
+    size_t size = index.getListCount(list);
+    tableint* neighbors = reinterpret_cast<tableint*>(list + 1);
+    for (size_t i = 0; i < size; i++) {
+      if (!index.isMarkedDeleted(neighbors[i])) {
+        candidates.emplace_back(Distance(index, data, neighbors[i]),
+                                neighbors[i]);
+      }
+    }
+    // Current links are likely found by the search too.
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) {
+                return a.second < b.second;
+              });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(),
+                                 [](const Candidate& a, const Candidate& b) {
+                                   return a.second == b.second;
+                                 }),
+                     candidates.end());
+    PruneLinks(index, level, candidates, filter_gamma, links[level]);
+    // The nearest link is the entry point of the next level.
+    if (!links[level].empty()) {
+      current = links[level].front();
+    }
+  }
+}
+
+// Selects new links of id on every level into links[level] among its current
+// links and their own links, ignoring deleted elements. Only the ef nearest
+// of them are pruned. Unlike SelectLinks(), it doesn't search the graph, which
+// makes it cheap enough to repair the neighbors of updated elements, like
+// updatePoint() does.
+void SelectLinksAmongNeighbors(Index& index, tableint id, size_t ef,
+                               size_t filter_gamma,
+                               std::vector<std::vector<tableint>>& links) {
+  const char* data = index.getDataByInternalId(id);
+  int element_level = index.element_levels_[id];
+  links.resize(element_level + 1);
+  std::vector<tableint> ids;
+  std::vector<Candidate> candidates;
+  for (int level = 0; level <= element_level; level++) {
+    ids.clear();
+    hnswlib::linklistsizeint* list = index.get_linklist_at_level(id, level);
+    size_t size = index.getListCount(list);
+    tableint* neighbors = reinterpret_cast<tableint*>(list + 1);
+    for (size_t i = 0; i < size; i++) {
+      ids.push_back(neighbors[i]);
+      hnswlib::linklistsizeint* next_list =
+          index.get_linklist_at_level(neighbors[i], level);
+      size_t next_size = index.getListCount(next_list);
+      tableint* next_neighbors = reinterpret_cast<tableint*>(next_list + 1);
+      ids.insert(ids.end(), next_neighbors, next_neighbors + next_size);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    candidates.clear();
+    for (tableint candidate : ids) {
+      if (candidate != id && !index.isMarkedDeleted(candidate)) {
+        candidates.emplace_back(Distance(index, data, candidate), candidate);
+      }
+    }
+    if (candidates.size() > ef) {
+      std::nth_element(candidates.begin(), candidates.begin() + ef,
+                       candidates.end());
+      candidates.resize(ef);
+    }
+    PruneLinks(index, level, candidates, filter_gamma, links[level]);
+  }
+}
+
+// Replaces the links of id with links[level] on every level. Returns whether
+// any of them changed.
+bool ReplaceLinks(Index& index, tableint id,
+                  const std::vector<std::vector<tableint>>& links) {
+  bool changed = false;
+  for (size_t level = 0; level < links.size(); level++) {
+    hnswlib::linklistsizeint* list =
+        index.get_linklist_at_level(id, static_cast<int>(level));
+    size_t size = index.getListCount(list);
+    tableint* neighbors = reinterpret_cast<tableint*>(list + 1);
+    changed = changed || size != links[level].size() ||
+              !std::is_permutation(neighbors, neighbors + size,
+                                   links[level].begin());
+    std::copy(links[level].begin(), links[level].end(), neighbors);
+    index.setListCount(list, links[level].size());
+  }
+  return changed;
+}
+
+// A link from source to target on level, whose reverse link is yet to be
+// added.
+struct ReverseLink {
+  tableint target;
+  int level;
+  tableint source;
+
+  bool operator<(const ReverseLink& other) const {
+    return std::tie(target, level) < std::tie(other.target, other.level);
+  }
+};
+
+// Adds links from target to sources[0..n) on level, unless target links to
+// them already. If target ends up with too many links, they are pruned with
+// the same heuristic as addPoint(), once for all sources. If filter_gamma > 1,
+// the nearest ones are kept instead, as the links of other targets can't be
+// read while they are being written.
+void AddReverseLinks(Index& index, tableint target, int level,
+                     const ReverseLink* sources, size_t n,
+                     size_t filter_gamma) {
+  size_t max_links = level == 0 ? index.maxM0_ : index.maxM_;
+  hnswlib::linklistsizeint* links = index.get_linklist_at_level(target, level);
+  size_t size = index.getListCount(links);
+  tableint* neighbors = reinterpret_cast<tableint*>(links + 1);
+  std::vector<tableint> new_neighbors;
+  for (size_t i = 0; i < n; i++) {
+    if (std::find(neighbors, neighbors + size, sources[i].source) ==
+        neighbors + size) {
+      new_neighbors.push_back(sources[i].source);
+    }
+  }
+  if (size + new_neighbors.size() <= max_links) {
+    std::copy(new_neighbors.begin(), new_neighbors.end(), neighbors + size);
+    index.setListCount(links, size + new_neighbors.size());
+    return;
+  }
+
+  const char* data = index.getDataByInternalId(target);
+  CandidateQueue candidates;
+  for (size_t i = 0; i < size; i++) {
+    candidates.emplace(Distance(index, data, neighbors[i]), neighbors[i]);
+  }
+  for (tableint neighbor : new_neighbors) {
+    candidates.emplace(Distance(index, data, neighbor), neighbor);
+  }
+  if (filter_gamma > 1) {
+    while (candidates.size() > max_links) {
+      candidates.pop();
+    }
+  } else {
+    index.getNeighborsByHeuristic2(candidates, max_links);
+  }
+  index.setListCount(links, candidates.size());
+  for (size_t i = 0; candidates.size() > 0; i++) {
+    neighbors[i] = candidates.top().second;
+    candidates.pop();
+  }
+}
+
+// Reverse links are split into partitions by target, so that each target is
+// updated by a single thread.
+class ReverseLinkPartitions {
+ public:
+  // Partitions for up to num_threads threads.
+  explicit ReverseLinkPartitions(size_t num_threads)
+      : partitions_(num_threads * kPartitionsPerThread) {}
+
+  // Collects the reverse links of the links of id on levels
+  // [0, min(max_level, id's level)].
+  void Collect(const Index& index, tableint id, int max_level) {
+    int top_level = std::min(index.element_levels_[id], max_level);
+    for (int level = top_level; level >= 0; level--) {
+      hnswlib::linklistsizeint* links = index.get_linklist_at_level(id, level);
+      size_t size = index.getListCount(links);
+      tableint* neighbors = reinterpret_cast<tableint*>(links + 1);
+      for (size_t i = 0; i < size; i++) {
+        partitions_[neighbors[i] % partitions_.size()].push_back(
+            {neighbors[i], level, id});
+      }
+    }
+  }
+
+  // Adds the reverse links collected so far using up to num_threads threads,
+  // then forgets them.
+  absl::Status AddAll(Index& index, size_t num_threads, size_t filter_gamma) {
+    return ParallelFor(partitions_.size(), num_threads, [&](size_t i) {
+      std::vector<ReverseLink>& links = partitions_[i];
+      std::sort(links.begin(), links.end());
+      for (size_t j = 0; j < links.size();) {
+        size_t k = j + 1;
+        while (k < links.size() && !(links[j] < links[k])) {
+          k++;
+        }
+        AddReverseLinks(index, links[j].target, links[j].level, &links[j],
+                        k - j, filter_gamma);
+        j = k;
+      }
+      links.clear();
+      return absl::OkStatus();
+    });
+  }
+
+ private:
+  std::vector<std::vector<ReverseLink>> partitions_;
+};
+
+// Selects the links of elements ids[0..n) again like RefineGraph() does, or
+// of elements [0, n) if ids is nullptr. Deleted elements are skipped. Returns
+// the number of elements whose links changed.
+absl::StatusOr<size_t> RefineLinks(Index& index, const tableint* ids,
+                                   size_t n, size_t ef, size_t num_threads,
+                                   Deadline& deadline, size_t filter_gamma) {
+  if (num_threads == 0) {
+    num_threads = DefaultNumThreads();
+  }
+  auto id_at = [ids](size_t i) {
+    return ids ? ids[i] : static_cast<tableint>(i);
+  };
+  size_t chunk_size = kRefineChunkSizePerThread * num_threads;
+  // new_links[i][level] are the new links of the i-th element of a chunk.
+  std::vector<std::vector<std::vector<tableint>>> new_links(chunk_size);
+  std::vector<char> changed(chunk_size);
+  ReverseLinkPartitions reverse_links(num_threads);
+  size_t num_changed = 0;
+  for (size_t begin = 0; begin < n && !deadline.Expired();
+       begin += chunk_size) {
+    size_t end = std::min(begin + chunk_size, n);
+    absl::Status status = ParallelFor(end - begin, num_threads, [&](size_t i) {
+      tableint id = id_at(begin + i);
+      new_links[i].clear();
+      if (!index.isMarkedDeleted(id)) {
+        SelectLinks(index, id, ef, filter_gamma, new_links[i]);
+      }
+      return absl::OkStatus();
+    });
+    if (!status.ok()) {
+      return status;
+    }
+
+    status = ParallelFor(end - begin, num_threads, [&](size_t i) {
+      changed[i] = ReplaceLinks(index, id_at(begin + i), new_links[i]);
+      return absl::OkStatus();
+    });
+    if (!status.ok()) {
+      return status;
+    }
+
+    for (size_t i = 0; i < end - begin; i++) {
+      // Polls the deadline once per element, as Expired() is meant to be
+      // called in hot loops.
+      deadline.Expired();
+      if (changed[i]) {
+        num_changed++;
+        reverse_links.Collect(index, id_at(begin + i), index.maxlevel_);
+      }
+    }
+    status = reverse_links.AddAll(index, num_threads, filter_gamma);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return num_changed;
+}
+
+// Collects the links of id on every level into neighbors.
+void CollectNeighbors(const Index& index, tableint id,
+                      std::vector<tableint>& neighbors) {
+  for (int level = index.element_levels_[id]; level >= 0; level--) {
+    hnswlib::linklistsizeint* list = index.get_linklist_at_level(id, level);
+    size_t size = index.getListCount(list);
+    tableint* links = reinterpret_cast<tableint*>(list + 1);
+    neighbors.insert(neighbors.end(), links, links + size);
+  }
+}
+
+// Selects the links of neighbors again with SelectLinksAmongNeighbors(), once
+// per element, using up to num_threads threads, then adds the reverse links of
+// the changed ones, as elements near an updated one lose the links it had to
+// them. Deleted elements are skipped. Links are selected before any of them is
+// replaced, so that threads don't read links being written.
+absl::Status RepairNeighbors(Index& index, std::vector<tableint>& neighbors,
+                             size_t ef, size_t num_threads,
+                             size_t filter_gamma) {
+  std::sort(neighbors.begin(), neighbors.end());
+  neighbors.erase(std::unique(neighbors.begin(), neighbors.end()),
+                  neighbors.end());
+  neighbors.erase(std::remove_if(neighbors.begin(), neighbors.end(),
+                                 [&](tableint id) {
+                                   return index.isMarkedDeleted(id);
+                                 }),
+                  neighbors.end());
+
+  std::vector<std::vector<std::vector<tableint>>> new_links(neighbors.size());
+  absl::Status status =
+      ParallelFor(neighbors.size(), num_threads, [&](size_t i) {
+        SelectLinksAmongNeighbors(index, neighbors[i], ef, filter_gamma,
+                                  new_links[i]);
+        return absl::OkStatus();
+      });
+  if (!status.ok()) {
+    return status;
+  }
+  std::vector<char> changed(neighbors.size());
+  status = ParallelFor(neighbors.size(), num_threads, [&](size_t i) {
+    changed[i] = ReplaceLinks(index, neighbors[i], new_links[i]);
+    return absl::OkStatus();
+  });
+  if (!status.ok()) {
+    return status;
+  }
+  ReverseLinkPartitions reverse_links(num_threads);
+  for (size_t i = 0; i < neighbors.size(); i++) {
+    if (changed[i]) {
+      reverse_links.Collect(index, neighbors[i], index.maxlevel_);
+    }
+  }
+  return reverse_links.AddAll(index, num_threads, filter_gamma);
+}
+
+}  // namespace
+
+absl::Status BulkInsert(Index& index, const float* vectors,
+                        const hnswlib::labeltype* labels, size_t n,
+                        size_t num_threads, Deadline& deadline,
+                        size_t filter_gamma) {
+  if (n == 0) {
+    return absl::OkStatus();
+  }
+  if (index.cur_element_count + n > index.max_elements_) {
+    return absl::ResourceExhaustedError(
+        "The number of elements exceeds the specified limit");
+  }
+
+  // Levels are drawn and upper level link lists allocated upfront, so that
+  // index is left untouched if allocation fails.
+  tableint first_id = static_cast<tableint>(index.cur_element_count);
+  std::vector<int> levels(n);
+  std::vector<char*> upper_links(n, nullptr);
+  for (size_t i = 0; i < n; i++) {
+    levels[i] = index.getRandomLevel(index.mult_);
+    if (levels[i] > 0) {
+      size_t size = index.size_links_per_element_ * levels[i] + 1;
+      upper_links[i] = static_cast<char*>(std::calloc(size, 1));
+      if (upper_links[i] == nullptr) {
+        for (char* links : upper_links) {
+          std::free(links);
+        }
+        return absl::ResourceExhaustedError(
+            "Not enough memory: failed to allocate linklist");
+      }
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    tableint id = first_id + i;
+    index.element_levels_[id] = levels[i];
+    index.linkLists_[id] = upper_links[i];
+    std::memset(index.data_level0_memory_ + id * index.size_data_per_element_ +
+                    index.offsetLevel0_,
+                0, index.size_data_per_element_);
+    index.setExternalLabel(id, labels[i]);
+    std::memcpy(index.getDataByInternalId(id),
+                vectors + i * (index.data_size_ / sizeof(float)),
+                index.data_size_);
+  }
+
+  if (num_threads == 0) {
+    num_threads = DefaultNumThreads();
+  }
+  ReverseLinkPartitions reverse_links(num_threads);
+  size_t begin = 0;
+  if (index.cur_element_count == 0) {
+    // The first element becomes the entry point.
+    index.enterpoint_node_ = first_id;
+    index.maxlevel_ = levels[0];
+    index.cur_element_count = 1;
+    begin = 1;
+  }
+
+  while (begin < n && !deadline.Expired()) {
+    // An element above the top level becomes the new entry point, so it is
+    // inserted in a batch of its own for every later element to find it.
+    size_t batch_size =
+        std::max<size_t>(index.cur_element_count / kBatchDivisor, 1);
+    size_t end = begin + 1;
+    if (levels[begin] <= index.maxlevel_) {
+      while (end < std::min(n, begin + batch_size) &&
+             levels[end] <= index.maxlevel_) {
+        end++;
+      }
+    }
+    size_t batch_threads = std::clamp<size_t>(
+        (end - begin) / kMinBatchSizePerThread, 1, num_threads);
+
+    tableint entry_point = index.enterpoint_node_;
+    int max_level = index.maxlevel_;
+    absl::Status status =
+        ParallelFor(end - begin, batch_threads, [&](size_t i) {
+          LinkNewElement(index, first_id + begin + i, entry_point, max_level,
+                         filter_gamma);
+          return absl::OkStatus();
+        });
+    if (!status.ok()) {
+      return status;
+    }
+
+    for (size_t i = begin; i < end; i++) {
+      // Polls the deadline once per element, as Expired() is meant to be
+      // called in hot loops.
+      deadline.Expired();
+      reverse_links.Collect(index, first_id + i, max_level);
+    }
+    status = reverse_links.AddAll(index, batch_threads, filter_gamma);
+    if (!status.ok()) {
+      return status;
+    }
+
+    index.cur_element_count = first_id + end;
+    if (levels[begin] > index.maxlevel_) {
+      index.enterpoint_node_ = first_id + begin;
+      index.maxlevel_ = levels[begin];
+    }
+    begin = end;
+  }
+
+  // Elements that are not inserted once the deadline expired are dropped.
+  for (size_t i = begin; i < n; i++) {
+    std::free(index.linkLists_[first_id + i]);
+    index.linkLists_[first_id + i] = nullptr;
+    index.element_levels_[first_id + i] = 0;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<size_t> RefineGraph(Index& index, size_t ef,
+                                   size_t num_threads, Deadline& deadline,
+                                   size_t filter_gamma) {
+  return RefineLinks(index, nullptr, index.cur_element_count, ef, num_threads,
+                     deadline, filter_gamma);
+}
+
+absl::StatusOr<size_t> BulkUpdate(Index& index, const tableint* ids,
+                                  const float* vectors, size_t n, size_t ef,
+                                  size_t num_threads, Deadline& deadline,
+                                  size_t filter_gamma) {
+  for (size_t i = 0; i < n; i++) {
+    if (ids[i] >= index.cur_element_count || index.isMarkedDeleted(ids[i])) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("element %d can't be updated", ids[i]));
+    }
+  }
+  if (num_threads == 0) {
+    num_threads = DefaultNumThreads();
+  }
+  // A chunk whose vectors are written gets its links refined even if the
+  // deadline expires meanwhile, so that every element keeps links selected
+  // for its vector.
+  size_t chunk_size = kRefineChunkSizePerThread * num_threads;
+  Deadline no_deadline;
+  // Neighbors of the updated elements, whose links were selected for the old
+  // vectors.
+  std::vector<tableint> neighbors;
+  size_t num_updated = 0;
+  while (num_updated < n &&
+         deadline.reason() == Deadline::Reason::kNotExpired) {
+    size_t end = std::min(num_updated + chunk_size, n);
+    for (size_t i = num_updated; i < end; i++) {
+      deadline.Expired();
+      std::memcpy(index.getDataByInternalId(ids[i]),
+                  vectors + i * (index.data_size_ / sizeof(float)),
+                  index.data_size_);
+      CollectNeighbors(index, ids[i], neighbors);
+    }
+    auto num_changed =
+        RefineLinks(index, ids + num_updated, end - num_updated, ef,
+                    num_threads, no_deadline, filter_gamma);
+    if (!num_changed.ok()) {
+      return num_changed.status();
+    }
+    num_updated = end;
+  }
+  // Like updatePoint(), the neighbors of the updated elements get their links
+  // selected again, but in a single pass once all vectors are written, as
+  // neighbors are shared by many updated elements. Updated elements that are
+  // neighbors of others are repaired too, as their links were selected while
+  // the rest of their chunk was moving.
+  absl::Status status =
+      RepairNeighbors(index, neighbors, ef, num_threads, filter_gamma);
+  if (!status.ok()) {
+    return status;
+  }
+  return num_updated;
+}
+
+absl::Status CompactInto(const Index& index, Index& compacted,
+                         size_t num_threads, Deadline& deadline,
+                         size_t filter_gamma) {
+  if (compacted.cur_element_count != 0) {
+    return absl::InvalidArgumentError("compacted index should be empty");
+  }
+  size_t dim = index.data_size_ / sizeof(float);
+  std::vector<float> vectors;
+  std::vector<hnswlib::labeltype> labels;
+  size_t num_live = index.cur_element_count - index.num_deleted_;
+  vectors.reserve(num_live * dim);
+  labels.reserve(num_live);
+  for (tableint id = 0; id < index.cur_element_count; id++) {
+    if (index.isMarkedDeleted(id)) {
+      continue;
+    }
+    auto vector = reinterpret_cast<const float*>(index.getDataByInternalId(id));
+    vectors.insert(vectors.end(), vector, vector + dim);
+    labels.push_back(index.getExternalLabel(id));
+  }
+  return BulkInsert(compacted, vectors.data(), labels.data(), labels.size(),
+                    num_threads, deadline, filter_gamma);
+}
+
+}  // namespace vectorlite
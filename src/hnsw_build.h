@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "deadline.h"
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+// Functions below take filter_gamma, which is 1 for regular HNSW graphs. A
+// larger value builds the graph for filtered searches like ACORN-γ: index must
+// be created with M * filter_gamma, and links are selected without hnswlib's
+// heuristic. Every element keeps links to its M nearest candidates(2 * M on
+// level 0), then to further ones unless they are linked from a kept link
+// already. The heuristic drops links to elements that are reachable through
+// nearer ones, which disconnects elements accepted by a selective filter once
+// the nearer ones are filtered out. Searches expanding through rejected
+// elements(see ExpandThroughRejected) reach the pruned links in two hops.
+
+// Inserts n vectors into index, vectors[i * dim..(i + 1) * dim) labeled
+// labels[i]. It builds the same graph as calling addPoint() for each vector
+// would, except that vectors are inserted in batches using up to num_threads
+// threads(0 means DefaultNumThreads()):
+// 1. Each vector of a batch searches the graph built by previous batches for
+//    its neighbors and links to them. The graph is only read in this phase,
+//    so no lock is taken.
+// 2. Reverse links are grouped by the element they are added to, and each
+//    group is added by one thread, pruning the element's links once if they
+//    overflow. Threads never write the same link list, so no lock is taken
+//    either.
+// Vectors of a batch don't see each other in phase 1, so batches are kept
+// small relative to the size of the index to preserve the graph's quality.
+// Deleted elements are not replaced. Vectors get consecutive ids starting from
+// index.cur_element_count. Labels are stored in their elements but not added
+// to index.label_lookup_: callers map labels to ids themselves(see RowidMap)
+// and must make sure they are unique. The deadline is checked between
+// batches. If it expires, the vectors inserted so far, which are a prefix of
+// vectors, stay in index and the rest are dropped, which callers tell by
+// index.cur_element_count. index must not be accessed concurrently.
+absl::Status BulkInsert(hnswlib::HierarchicalNSW<float>& index,
+                        const float* vectors, const hnswlib::labeltype* labels,
+                        size_t n, size_t num_threads, Deadline& deadline,
+                        size_t filter_gamma = 1);
+
+// Selects the links of every element of index that is not deleted again, to
+// improve a graph built with a low ef_construction. On each level, links are
+// selected among the ef nearest elements found in the current graph and the
+// current links, with the same heuristic as addPoint(). Missing reverse links
+// are then added like BulkInsert() does.
+// Elements are refined in chunks using up to num_threads threads(0 means
+// DefaultNumThreads()): new links of a chunk are selected while the graph is
+// only read, then written. Later chunks search the graph improved by earlier
+// ones. The deadline is checked between chunks. If it expires, elements
+// refined so far keep their new links, and the graph stays consistent.
+// Returns the number of elements whose links changed. index must not be
+// accessed concurrently.
+absl::StatusOr<size_t> RefineGraph(hnswlib::HierarchicalNSW<float>& index,
+                                   size_t ef, size_t num_threads,
+                                   Deadline& deadline, size_t filter_gamma = 1);
+
+// Replaces the vectors of the n elements ids[0..n) of index, ids[i] getting
+// vectors[i * dim..(i + 1) * dim), which is much faster than calling
+// updatePoint() for each of them. Elements are updated in chunks: vectors of a
+// chunk are written, then the links of its elements are selected again among
+// the ef nearest elements, like RefineGraph() does using up to num_threads
+// threads(0 means DefaultNumThreads()). Reverse links are added to the new
+// neighbors, each of which is written by a single thread. Then, like
+// updatePoint() does, the former neighbors of the updated elements get their
+// links selected again among their neighbors and the neighbors of those, in a
+// single pass that repairs each of them once. The deadline is checked between
+// chunks. If it expires, the elements updated so far keep their new vectors
+// and links, and the rest are left untouched.
+// Returns the number of updated elements, which are a prefix of ids. ids must
+// be unique and not deleted. index must not be accessed concurrently.
+absl::StatusOr<size_t> BulkUpdate(hnswlib::HierarchicalNSW<float>& index,
+                                  const hnswlib::tableint* ids,
+                                  const float* vectors, size_t n, size_t ef,
+                                  size_t num_threads, Deadline& deadline,
+                                  size_t filter_gamma = 1);
+
+// Inserts the elements of index that are not deleted into compacted, which
+// must be empty, with BulkInsert(). Unlike reusing deleted elements, it gets
+// rid of them at once, e.g. after a range of rows expired. Elements get new
+// ids, in the order of their old ids. If the deadline expires, compacted only
+// holds some of the elements and should be discarded.
+absl::Status CompactInto(const hnswlib::HierarchicalNSW<float>& index,
+                         hnswlib::HierarchicalNSW<float>& compacted,
+                         size_t num_threads, Deadline& deadline,
+                         size_t filter_gamma = 1);
+
+}  // namespace vectorlite
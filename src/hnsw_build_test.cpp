@@ -0,0 +1,310 @@
+#include "hnsw_build.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "deadline.h"
+#include "gtest/gtest.h"
+#include "hnswlib/hnswlib.h"
+
+namespace {
+
+class HnswBuildTest : public testing::Test {
+ protected:
+  static constexpr size_t kDim = 16;
+  static constexpr size_t kNumElements = 4000;
+
+  HnswBuildTest()
+      : space_(kDim),
+        index_(std::make_unique<hnswlib::HierarchicalNSW<float>>(
+            &space_, kNumElements)),
+        data_(kNumElements * kDim),
+        labels_(kNumElements) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist;
+    for (auto& v : data_) {
+      v = dist(rng);
+    }
+    std::iota(labels_.begin(), labels_.end(), 0);
+  }
+
+  const float* Vector(size_t i) const { return data_.data() + i * kDim; }
+
+  // Returns the fraction of the 10 nearest neighbors found by the index for
+  // the first 100 vectors.
+  float Recall() {
+    index_->setEf(64);
+    size_t found = 0;
+    for (size_t i = 0; i < 100; i++) {
+      std::vector<std::pair<float, size_t>> all;
+      for (size_t j = 0; j < index_->cur_element_count; j++) {
+        all.emplace_back(space_.get_dist_func()(Vector(i), Vector(j),
+                                                space_.get_dist_func_param()),
+                         j);
+      }
+      std::sort(all.begin(), all.end());
+      auto result = index_->searchKnn(Vector(i), 10);
+      while (!result.empty()) {
+        for (size_t j = 0; j < 10; j++) {
+          found += all[j].second == result.top().second;
+        }
+        result.pop();
+      }
+    }
+    return found / 1000.0f;
+  }
+
+  // Checks that link lists are within bounds and only link existing elements.
+  void ExpectValidLinks() {
+    for (hnswlib::tableint id = 0; id < index_->cur_element_count; id++) {
+      for (int level = 0; level <= index_->element_levels_[id]; level++) {
+        auto links = index_->get_linklist_at_level(id, level);
+        size_t size = index_->getListCount(links);
+        EXPECT_LE(size, level == 0 ? index_->maxM0_ : index_->maxM_);
+        auto neighbors = reinterpret_cast<hnswlib::tableint*>(links + 1);
+        for (size_t i = 0; i < size; i++) {
+          EXPECT_NE(id, neighbors[i]);
+          EXPECT_LT(neighbors[i], index_->cur_element_count);
+          EXPECT_GE(index_->element_levels_[neighbors[i]], level);
+        }
+      }
+    }
+    EXPECT_EQ(index_->maxlevel_,
+              index_->element_levels_[index_->enterpoint_node_]);
+  }
+
+  hnswlib::L2Space space_;
+  std::unique_ptr<hnswlib::HierarchicalNSW<float>> index_;
+  std::vector<float> data_;
+  std::vector<hnswlib::labeltype> labels_;
+};
+
+}  // namespace
+
+TEST_F(HnswBuildTest, BulkInsertShouldBuildSearchableIndex) {
+  vectorlite::Deadline deadline;
+  EXPECT_TRUE(vectorlite::BulkInsert(*index_, data_.data(), labels_.data(),
+                                     kNumElements, 4, deadline)
+                  .ok());
+  EXPECT_EQ(kNumElements, index_->cur_element_count);
+  ExpectValidLinks();
+  for (hnswlib::tableint id = 0; id < kNumElements; id += 100) {
+    EXPECT_EQ(labels_[id], index_->getExternalLabel(id));
+    auto data = reinterpret_cast<float*>(index_->getDataByInternalId(id));
+    EXPECT_EQ(std::vector<float>(Vector(id), Vector(id) + kDim),
+              std::vector<float>(data, data + kDim));
+  }
+  EXPECT_GE(Recall(), 0.95f);
+}
+
+TEST_F(HnswBuildTest, BulkInsertWithFilterGammaShouldBuildDenseGraph) {
+  constexpr size_t kFilterGamma = 4;
+  index_ = std::make_unique<hnswlib::HierarchicalNSW<float>>(
+      &space_, kNumElements, 8 * kFilterGamma);
+  vectorlite::Deadline deadline;
+  EXPECT_TRUE(vectorlite::BulkInsert(*index_, data_.data(), labels_.data(),
+                                     kNumElements, 4, deadline, kFilterGamma)
+                  .ok());
+  ExpectValidLinks();
+  size_t num_links = 0;
+  for (hnswlib::tableint id = 0; id < kNumElements; id++) {
+    num_links += index_->getListCount(index_->get_linklist0(id));
+  }
+  // Far more links than the 2 * 8 a heuristic-pruned graph would keep.
+  EXPECT_GT(num_links, kNumElements * 2 * 8);
+  EXPECT_GE(Recall(), 0.95f);
+
+  ASSERT_TRUE(
+      vectorlite::RefineGraph(*index_, 100, 4, deadline, kFilterGamma).ok());
+  ExpectValidLinks();
+  EXPECT_GE(Recall(), 0.95f);
+}
+
+TEST_F(HnswBuildTest, BulkInsertShouldInsertIntoNonEmptyIndex) {
+  for (size_t i = 0; i < 1000; i++) {
+    index_->addPoint(Vector(i), i);
+  }
+  index_->markDelete(index_->enterpoint_node_);
+  vectorlite::Deadline deadline;
+  EXPECT_TRUE(vectorlite::BulkInsert(*index_, Vector(1000),
+                                     labels_.data() + 1000,
+                                     kNumElements - 1000, 4, deadline)
+                  .ok());
+  EXPECT_EQ(kNumElements, index_->cur_element_count);
+  ExpectValidLinks();
+  EXPECT_GE(Recall(), 0.9f);
+}
+
+TEST_F(HnswBuildTest, BulkInsertShouldRejectTooManyVectors) {
+  for (size_t i = 0; i < 10; i++) {
+    index_->addPoint(Vector(i), i);
+  }
+  std::vector<hnswlib::labeltype> labels(kNumElements);
+  std::iota(labels.begin(), labels.end(), kNumElements);
+  vectorlite::Deadline deadline;
+  auto status = vectorlite::BulkInsert(*index_, Vector(0), labels.data(),
+                                       kNumElements, 4, deadline);
+  EXPECT_EQ(absl::StatusCode::kResourceExhausted, status.code());
+
+  // The index is left untouched.
+  EXPECT_EQ(10, index_->cur_element_count);
+}
+
+TEST_F(HnswBuildTest, BulkInsertShouldStopOnceDeadlineExpires) {
+  vectorlite::Deadline deadline(std::chrono::milliseconds(0), nullptr);
+  ASSERT_TRUE(vectorlite::BulkInsert(*index_, data_.data(), labels_.data(),
+                                     kNumElements, 1, deadline)
+                  .ok());
+  EXPECT_TRUE(deadline.timed_out());
+  // Only the first batches are inserted, the rest can be inserted later.
+  size_t num_inserted = index_->cur_element_count;
+  EXPECT_GT(num_inserted, 0);
+  EXPECT_LT(num_inserted, kNumElements / 2);
+  ExpectValidLinks();
+  vectorlite::Deadline no_deadline;
+  ASSERT_TRUE(vectorlite::BulkInsert(*index_, Vector(num_inserted),
+                                     labels_.data() + num_inserted,
+                                     kNumElements - num_inserted, 4,
+                                     no_deadline)
+                  .ok());
+  ExpectValidLinks();
+  EXPECT_GE(Recall(), 0.95f);
+}
+
+TEST_F(HnswBuildTest, CompactIntoShouldDropDeletedElements) {
+  for (size_t i = 0; i < kNumElements; i++) {
+    index_->addPoint(Vector(i), i);
+  }
+  for (size_t i = 0; i < kNumElements; i += 2) {
+    index_->markDelete(i);
+  }
+  hnswlib::HierarchicalNSW<float> compacted(&space_, kNumElements);
+  vectorlite::Deadline deadline;
+  EXPECT_TRUE(vectorlite::CompactInto(*index_, compacted, 4, deadline).ok());
+  EXPECT_EQ(kNumElements / 2, compacted.cur_element_count);
+  EXPECT_EQ(0, compacted.getDeletedCount());
+  for (hnswlib::tableint id = 0; id < compacted.cur_element_count; id++) {
+    hnswlib::labeltype label = compacted.getExternalLabel(id);
+    EXPECT_EQ(2 * id + 1, label);
+    auto data = reinterpret_cast<float*>(compacted.getDataByInternalId(id));
+    EXPECT_EQ(std::vector<float>(Vector(label), Vector(label) + kDim),
+              std::vector<float>(data, data + kDim));
+  }
+
+  // Only empty indexes can be compacted into.
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            vectorlite::CompactInto(*index_, compacted, 4, deadline).code());
+
+  hnswlib::HierarchicalNSW<float> interrupted(&space_, kNumElements);
+  vectorlite::Deadline expired(std::chrono::milliseconds(0), nullptr);
+  EXPECT_TRUE(vectorlite::CompactInto(*index_, interrupted, 4, expired).ok());
+  EXPECT_TRUE(expired.timed_out());
+  EXPECT_LT(interrupted.cur_element_count, kNumElements / 2);
+}
+
+TEST_F(HnswBuildTest, RefineGraphShouldImproveRecall) {
+  index_ = std::make_unique<hnswlib::HierarchicalNSW<float>>(
+      &space_, kNumElements, 8, 8);
+  for (size_t i = 0; i < kNumElements; i++) {
+    index_->addPoint(Vector(i), i);
+  }
+  index_->markDelete(100);
+  float recall = Recall();
+
+  vectorlite::Deadline deadline;
+  auto num_changed = vectorlite::RefineGraph(*index_, 100, 4, deadline);
+  ASSERT_TRUE(num_changed.ok());
+  EXPECT_GT(*num_changed, kNumElements / 2);
+  ExpectValidLinks();
+  float refined_recall = Recall();
+  EXPECT_GT(refined_recall, recall);
+  EXPECT_GE(refined_recall, 0.95f);
+}
+
+TEST_F(HnswBuildTest, RefineGraphShouldStopOnceDeadlineExpires) {
+  for (size_t i = 0; i < kNumElements; i++) {
+    index_->addPoint(Vector(i), i);
+  }
+  vectorlite::Deadline deadline(std::chrono::milliseconds(0), nullptr);
+  auto num_changed = vectorlite::RefineGraph(*index_, 100, 1, deadline);
+  ASSERT_TRUE(num_changed.ok());
+  EXPECT_TRUE(deadline.timed_out());
+  // Only the first chunk is refined.
+  EXPECT_LT(*num_changed, kNumElements / 2);
+  ExpectValidLinks();
+}
+
+TEST_F(HnswBuildTest, BulkUpdateShouldKeepIndexSearchable) {
+  vectorlite::Deadline deadline;
+  ASSERT_TRUE(vectorlite::BulkInsert(*index_, data_.data(), labels_.data(),
+                                     kNumElements, 4, deadline)
+                  .ok());
+  // Every other element gets a new vector.
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist;
+  std::vector<hnswlib::tableint> ids;
+  for (hnswlib::tableint id = 0; id < kNumElements; id += 2) {
+    ids.push_back(id);
+  }
+  std::vector<float> vectors(ids.size() * kDim);
+  for (size_t i = 0; i < ids.size(); i++) {
+    for (size_t j = 0; j < kDim; j++) {
+      vectors[i * kDim + j] = dist(rng);
+      data_[ids[i] * kDim + j] = vectors[i * kDim + j];
+    }
+  }
+  auto num_updated = vectorlite::BulkUpdate(*index_, ids.data(), vectors.data(),
+                                            ids.size(), 100, 4, deadline);
+  ASSERT_TRUE(num_updated.ok());
+  EXPECT_EQ(ids.size(), *num_updated);
+  ExpectValidLinks();
+  EXPECT_GE(Recall(), 0.95f);
+  for (size_t i = 0; i < ids.size(); i++) {
+    EXPECT_EQ(0, std::memcmp(index_->getDataByInternalId(ids[i]),
+                             vectors.data() + i * kDim, kDim * sizeof(float)));
+  }
+
+  hnswlib::tableint missing = kNumElements;
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            vectorlite::BulkUpdate(*index_, &missing, vectors.data(), 1, 100, 1,
+                                   deadline)
+                .status()
+                .code());
+  index_->markDeletedInternal(ids[0]);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            vectorlite::BulkUpdate(*index_, ids.data(), vectors.data(), 1, 100,
+                                   1, deadline)
+                .status()
+                .code());
+}
+
+TEST_F(HnswBuildTest, BulkUpdateShouldStopOnceDeadlineExpires) {
+  vectorlite::Deadline no_deadline;
+  ASSERT_TRUE(vectorlite::BulkInsert(*index_, data_.data(), labels_.data(),
+                                     kNumElements, 4, no_deadline)
+                  .ok());
+  std::vector<hnswlib::tableint> ids(kNumElements);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::vector<float> vectors(kNumElements * kDim, 0.5f);
+  vectorlite::Deadline deadline(std::chrono::milliseconds(0), nullptr);
+  auto num_updated = vectorlite::BulkUpdate(*index_, ids.data(), vectors.data(),
+                                            kNumElements, 100, 1, deadline);
+  ASSERT_TRUE(num_updated.ok());
+  EXPECT_TRUE(deadline.timed_out());
+  // Only the first chunk is updated, the rest keep their vectors.
+  EXPECT_GT(*num_updated, 0);
+  EXPECT_LT(*num_updated, kNumElements / 2);
+  for (hnswlib::tableint id = 0; id < kNumElements; id++) {
+    const void* expected =
+        id < *num_updated ? vectors.data() + id * kDim : Vector(id);
+    EXPECT_EQ(0, std::memcmp(index_->getDataByInternalId(id), expected,
+                             kDim * sizeof(float)));
+  }
+  ExpectValidLinks();
+}
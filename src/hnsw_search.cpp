@@ -0,0 +1,54 @@
+#include "hnsw_search.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+namespace internal {
+
+VisitedTable& VisitedTable::ForNewSearch(size_t num_elements) {
+  thread_local VisitedTable table;
+  table.Reset(num_elements);
+  return table;
+}
+
+void VisitedTable::Reset(size_t num_elements) {
+  if (tags_.size() < num_elements) {
+    tags_.resize(num_elements);
+  }
+  tag_++;
+  if (tag_ == 0) {
+    // The tag wrapped around, stale tags have to be cleared.
+    std::fill(tags_.begin(), tags_.end(), 0);
+    tag_ = 1;
+  }
+}
+
+void VisitedTable::Grow(hnswlib::tableint id) {
+  tags_.resize(std::max<size_t>(id + 1, tags_.size() * 2));
+}
+
+void SharedVisitedTable::Reset(size_t max_elements) {
+  if (size_ < max_elements) {
+    // Value-initialized, i.e. all tags are 0.
+    tags_ = std::make_unique<std::atomic<uint16_t>[]>(max_elements);
+    size_ = max_elements;
+  }
+  tag_++;
+  if (tag_ == 0) {
+    // The tag wrapped around, stale tags have to be cleared.
+    for (size_t i = 0; i < size_; i++) {
+      tags_[i].store(0, std::memory_order_relaxed);
+    }
+    tag_ = 1;
+  }
+}
+
+}  // namespace internal
+
+}  // namespace vectorlite
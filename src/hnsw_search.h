@@ -0,0 +1,666 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "attribute_store.h"
+#include "deadline.h"
+#include "hnswlib/hnswlib.h"
+#include "macros.h"
+
+namespace vectorlite {
+
+// (distance, internal id)
+using SearchCandidate = std::pair<float, hnswlib::tableint>;
+
+// Groups elements by an attribute, values[id] being the group of element id
+// and the elements whose attribute is NULL making one group, or by rowid, the
+// group of an element being its label divided by rowid_divisor. e.g. chunks
+// of the same document, so that a search returns at most limit chunks per
+// document.
+struct Grouping {
+  // Grouping is disabled if limit is 0.
+  size_t limit = 0;
+  // nullptr if elements are grouped by rowid.
+  const int64_t* values = nullptr;
+  // Null bitmap of the attribute, required along with values.
+  const uint64_t* nulls = nullptr;
+  // Required if elements are grouped by rowid.
+  const hnswlib::HierarchicalNSW<float>* index = nullptr;
+  uint64_t rowid_divisor = 1;
+
+  bool enabled() const { return limit > 0; }
+
+  // Returns std::nullopt for the group of NULLs.
+  std::optional<int64_t> GroupOf(hnswlib::tableint id) const {
+    if (values) {
+      if (AttributeStore::IsNullIn(nulls, id)) {
+        return std::nullopt;
+      }
+      return values[id];
+    }
+    return static_cast<int64_t>(index->getExternalLabel(id) / rowid_divisor);
+  }
+};
+
+// A sorted array holding at most capacity candidates. Candidates are kept in
+// descending order of distance, so that the nearest one can be popped in O(1).
+// Memory is kept across Reset() calls, so that it doesn't allocate once warmed
+// up.
+class CandidateList {
+ public:
+  // Removes all candidates and sets the capacity, which must be positive.
+  // If grouping is not nullptr and enabled, at most grouping->limit candidates
+  // of each group are kept. It must outlive the list's use until the next
+  // Reset().
+  void Reset(size_t capacity, const Grouping* grouping = nullptr) {
+    capacity_ = capacity;
+    candidates_.clear();
+    grouping_ = grouping && grouping->enabled() ? grouping : nullptr;
+    if (grouping_) {
+      group_sizes_.clear();
+    }
+  }
+
+  // Inserts candidate if the list is not full or candidate is nearer than the
+  // furthest one, which is dropped to make room. If the group of candidate
+  // already has its limit of candidates, candidate replaces the furthest of
+  // them instead, if it's nearer.
+  // Returns true if candidate is inserted.
+  bool Insert(const SearchCandidate& candidate) {
+    if (grouping_) {
+      return InsertGrouped(candidate);
+    }
+    if (full()) {
+      if (!(candidate < candidates_.front())) {
+        return false;
+      }
+      candidates_.erase(candidates_.begin());
+    }
+    InsertSorted(candidate);
+    return true;
+  }
+
+  // Should not be called on an empty list.
+  const SearchCandidate& nearest() const { return candidates_.back(); }
+  const SearchCandidate& furthest() const { return candidates_.front(); }
+  void PopNearest() { candidates_.pop_back(); }
+
+  bool empty() const { return candidates_.empty(); }
+  bool full() const { return candidates_.size() >= capacity_; }
+  size_t size() const { return candidates_.size(); }
+
+  // Candidates in descending order of distance.
+  std::vector<SearchCandidate>& candidates() { return candidates_; }
+  const std::vector<SearchCandidate>& candidates() const { return candidates_; }
+
+ private:
+  void InsertSorted(const SearchCandidate& candidate) {
+    auto pos = std::upper_bound(candidates_.begin(), candidates_.end(),
+                                candidate, std::greater<SearchCandidate>());
+    candidates_.insert(pos, candidate);
+  }
+
+  bool InsertGrouped(const SearchCandidate& candidate) {
+    std::optional<int64_t> group = grouping_->GroupOf(candidate.second);
+    auto it = group_sizes_.find(group);
+    if (it != group_sizes_.end() && it->second >= grouping_->limit) {
+      // Candidates are in descending order of distance, so the first one of
+      // the group is its furthest.
+      auto furthest = std::find_if(
+          candidates_.begin(), candidates_.end(),
+          [&](const SearchCandidate& c) {
+            return grouping_->GroupOf(c.second) == group;
+          });
+      VECTORLITE_ASSERT(furthest != candidates_.end());
+      if (!(candidate < *furthest)) {
+        return false;
+      }
+      candidates_.erase(furthest);
+      InsertSorted(candidate);
+      return true;
+    }
+    if (full()) {
+      if (!(candidate < candidates_.front())) {
+        return false;
+      }
+      group_sizes_[grouping_->GroupOf(candidates_.front().second)]--;
+      candidates_.erase(candidates_.begin());
+    }
+    group_sizes_[group]++;
+    InsertSorted(candidate);
+    return true;
+  }
+
+  size_t capacity_ = 0;
+  std::vector<SearchCandidate> candidates_;
+  // Not nullptr if grouping is enabled, in which case group_sizes_ counts the
+  // candidates of each group.
+  const Grouping* grouping_ = nullptr;
+  absl::flat_hash_map<std::optional<int64_t>, size_t> group_sizes_;
+};
+
+// A binary min-heap holding at most capacity candidates, used as the frontier
+// of a search, which pops the nearest candidate and inserts far more than it
+// keeps. Once full, the furthest half of the candidates is dropped at once,
+// which costs O(1) amortized per insert, unlike keeping candidates sorted.
+// Memory is kept across Reset() calls.
+class CandidateHeap {
+ public:
+  // Removes all candidates and sets the capacity, which must be at least 2.
+  void Reset(size_t capacity) {
+    capacity_ = capacity;
+    candidates_.clear();
+  }
+
+  void Insert(const SearchCandidate& candidate) {
+    if (candidates_.size() >= capacity_) {
+      DropFurthestHalf();
+    }
+    candidates_.push_back(candidate);
+    std::push_heap(candidates_.begin(), candidates_.end(),
+                   std::greater<SearchCandidate>());
+  }
+
+  // Should not be called on an empty heap.
+  const SearchCandidate& nearest() const { return candidates_.front(); }
+  void PopNearest() {
+    std::pop_heap(candidates_.begin(), candidates_.end(),
+                  std::greater<SearchCandidate>());
+    candidates_.pop_back();
+  }
+
+  bool empty() const { return candidates_.empty(); }
+  size_t size() const { return candidates_.size(); }
+
+ private:
+  void DropFurthestHalf() {
+    auto middle = candidates_.begin() + capacity_ / 2;
+    std::nth_element(candidates_.begin(), middle, candidates_.end());
+    candidates_.erase(middle, candidates_.end());
+    std::make_heap(candidates_.begin(), candidates_.end(),
+                   std::greater<SearchCandidate>());
+  }
+
+  size_t capacity_ = 0;
+  std::vector<SearchCandidate> candidates_;
+};
+
+// Buffers used by SearchWithDistance(). They keep their capacity between
+// searches, so that a search doesn't allocate once they are warmed up.
+struct SearchBuffers {
+  // The best candidates found so far.
+  CandidateList top_candidates;
+  // Candidates to be expanded.
+  CandidateHeap candidates;
+  // Unvisited neighbors of the candidate being expanded.
+  std::vector<hnswlib::tableint> neighbors;
+  // Number of distance computations done by the last search.
+  uint64_t distance_computations = 0;
+  // Limits the candidates returned per group if enabled. Set by the caller,
+  // it applies to all following searches using the buffers.
+  Grouping grouping;
+};
+
+// Accepts all elements.
+struct NoFilter {
+  bool operator()(hnswlib::tableint) const { return true; }
+};
+
+// Accepts the same elements as filter, but makes graph searches only traverse
+// accepted elements, like ACORN's search: a rejected neighbor is not evaluated,
+// its accepted neighbors are instead. Distances are only computed for accepted
+// elements, so that selective filters don't waste the search's budget on
+// elements that can't be returned. Meant for graphs built with filter_gamma > 1
+// (see BulkInsert()), whose accepted elements stay connected within two hops.
+template <typename Filter>
+struct ExpandThroughRejected {
+  const Filter& filter;
+
+  bool operator()(hnswlib::tableint id) const { return filter(id); }
+};
+
+namespace internal {
+
+template <typename Filter>
+struct IsExpandThroughRejected : std::false_type {};
+
+template <typename Filter>
+struct IsExpandThroughRejected<ExpandThroughRejected<Filter>>
+    : std::true_type {};
+
+// Tracks visited elements of a search. Each thread has its own table, which
+// grows to the largest number of elements searched on that thread, not to the
+// capacity of the index.
+class VisitedTable {
+ public:
+  // Returns the table of the calling thread, reset for a new search on an
+  // index of num_elements elements.
+  static VisitedTable& ForNewSearch(size_t num_elements);
+
+  // Resets the table for a new search on an index of num_elements elements.
+  // Used by searches that need more than one table per thread.
+  void Reset(size_t num_elements);
+
+  // Marks id as visited. Returns false if id was visited already. ids beyond
+  // num_elements grow the table, as elements inserted concurrently with the
+  // search may be linked to.
+  bool Visit(hnswlib::tableint id) {
+    if (id >= tags_.size()) {
+      Grow(id);
+    }
+    if (tags_[id] == tag_) {
+      return false;
+    }
+    tags_[id] = tag_;
+    return true;
+  }
+
+ private:
+  void Grow(hnswlib::tableint id);
+
+  // tags_[id] == tag_ iff id is visited in the current search.
+  std::vector<uint16_t> tags_;
+  uint16_t tag_ = 0;
+};
+
+// Greedily descends from the entry point to level 1 and returns the closest
+// element found, which is used as the entry point of the base layer.
+template <typename Distance>
+hnswlib::tableint SearchUpperLayers(
+    const hnswlib::HierarchicalNSW<float>& index, Distance& distance,
+    uint64_t& distance_computations) {
+  hnswlib::tableint current = index.enterpoint_node_;
+  float current_dist = distance(index.getDataByInternalId(current));
+  distance_computations++;
+  for (int level = index.maxlevel_; level > 0; level--) {
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      hnswlib::linklistsizeint* links = index.get_linklist(current, level);
+      int size = index.getListCount(links);
+      hnswlib::tableint* neighbors =
+          reinterpret_cast<hnswlib::tableint*>(links + 1);
+      distance_computations += size;
+      for (int i = 0; i < size; i++) {
+        hnswlib::tableint neighbor = neighbors[i];
+        float dist =
+            distance(index.getDataByInternalId(neighbor), current_dist);
+        if (dist < current_dist) {
+          current_dist = dist;
+          current = neighbor;
+          changed = true;
+        }
+      }
+    }
+  }
+  return current;
+}
+
+// Visited table shared by the threads of a parallel search. Like
+// VisitedTable, elements are tagged by the search that visited them, so that
+// a table is reset in O(1) and reused by all the searches of a cursor.
+class SharedVisitedTable {
+ public:
+  // Resets the table for a new search on an index of capacity max_elements.
+  // The table covers the capacity rather than the number of elements, as
+  // threads can't grow it when they reach elements inserted concurrently.
+  void Reset(size_t max_elements);
+
+  // Marks id as visited. Returns false if id was visited already, possibly by
+  // another thread.
+  bool Visit(hnswlib::tableint id) {
+    if (tags_[id].load(std::memory_order_relaxed) == tag_) {
+      return false;
+    }
+    return tags_[id].exchange(tag_, std::memory_order_relaxed) != tag_;
+  }
+
+ private:
+  // tags_[id] == tag_ iff id is visited in the current search.
+  std::unique_ptr<std::atomic<uint16_t>[]> tags_;
+  size_t size_ = 0;
+  uint16_t tag_ = 0;
+};
+
+// Distance bound shared by the threads of a parallel search. Each thread keeps
+// its own ef nearest candidates, so the ef-th nearest candidate of all threads
+// is at most as far as the furthest candidate of any full list. Candidates
+// further than that can't be returned by any thread.
+class SharedBound {
+ public:
+  float Get() const { return bound_.load(std::memory_order_relaxed); }
+
+  // Lowers the bound to bound if it is lower.
+  void Update(float bound) {
+    float current = Get();
+    while (bound < current &&
+           !bound_.compare_exchange_weak(current, bound,
+                                         std::memory_order_relaxed)) {
+    }
+  }
+
+ private:
+  std::atomic<float> bound_{std::numeric_limits<float>::infinity()};
+};
+
+// Used by single-threaded searches.
+struct NoSharedBound {
+  float Get() const { return std::numeric_limits<float>::infinity(); }
+  void Update(float) {}
+};
+
+// Beam search on the base layer, split into steps so that the searches of
+// multiple queries can be interleaved. Each expansion of a candidate is done
+// in two phases: Expand() collects the unvisited neighbors of the nearest
+// candidate and prefetches their vectors, then Evaluate() computes their
+// distances. Between the two phases of a search, other searches can run while
+// the vectors are being loaded.
+// The ef nearest elements found that are not deleted and accepted by filter
+// are kept in buffers.top_candidates in descending order of distance.
+// Distance computations are added to buffers.distance_computations.
+// Candidates further than shared_bound are discarded, and the bound is lowered
+// once top candidates are full.
+// If Filter is ExpandThroughRejected, only entry points and accepted elements
+// are evaluated.
+template <typename Distance, typename Filter, typename Visited, typename Bound>
+class BaseLayerSearch {
+ public:
+  BaseLayerSearch(const hnswlib::HierarchicalNSW<float>& index,
+                  Distance& distance, size_t ef, const Filter& filter,
+                  Visited& visited, Bound& shared_bound,
+                  SearchBuffers& buffers)
+      : index_(index),
+        distance_(distance),
+        filter_(filter),
+        visited_(visited),
+        shared_bound_(shared_bound),
+        buffers_(buffers) {
+    // Candidates further than the ef-th nearest element found are never
+    // expanded. If every element can be returned, or only accepted elements
+    // are traversed, at most ef of them are nearer than that, so keeping the
+    // nearest ef candidates once the frontier is full loses none.
+    // Otherwise many more candidates can be nearer, as elements that are
+    // rejected, or belong to a full group, are expanded but not returned.
+    // They are bounded much more loosely, as bounding them tightly hurts the
+    // recall of selective filters.
+    constexpr bool kHasFilter = !std::is_same_v<Filter, NoFilter>;
+    buffers_.top_candidates.Reset(ef, &buffers_.grouping);
+    size_t expansion =
+        (!kExpandThroughRejected && (kHasFilter || index.num_deleted_ > 0)) ||
+                buffers_.grouping.enabled()
+            ? kFilteredFrontierExpansion
+            : 2;
+    buffers_.candidates.Reset(expansion * std::max<size_t>(ef, 1));
+    buffers_.neighbors.clear();
+  }
+
+  // Starts the search from entry_points[0..n), which must be marked visited
+  // already.
+  void Start(const hnswlib::tableint* entry_points, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      hnswlib::tableint entry_point = entry_points[i];
+      float entry_dist = distance_(index_.getDataByInternalId(entry_point));
+      buffers_.distance_computations++;
+      if (IsAllowed(entry_point)) {
+        InsertTopCandidate({entry_dist, entry_point});
+      }
+      buffers_.candidates.Insert({entry_dist, entry_point});
+    }
+  }
+
+  // Pops the nearest candidate, then collects its unvisited neighbors and
+  // prefetches their vectors. Returns false once no candidate is worth
+  // expanding, i.e. the search is done.
+  bool Expand() {
+    CandidateHeap& candidates = buffers_.candidates;
+    if (candidates.empty() || candidates.nearest().first > MaxDistance()) {
+      return false;
+    }
+    hnswlib::tableint current = candidates.nearest().second;
+    candidates.PopNearest();
+
+    hnswlib::linklistsizeint* links = index_.get_linklist0(current);
+    size_t size = index_.getListCount(links);
+    hnswlib::tableint* neighbors =
+        reinterpret_cast<hnswlib::tableint*>(links + 1);
+    buffers_.neighbors.clear();
+    for (size_t i = 0; i < size; i++) {
+      hnswlib::tableint neighbor = neighbors[i];
+      if (!visited_.Visit(neighbor)) {
+        continue;
+      }
+      if constexpr (kExpandThroughRejected) {
+        if (!IsAllowed(neighbor)) {
+          CollectAllowedNeighbors(neighbor);
+          continue;
+        }
+      }
+      VECTORLITE_PREFETCH(index_.getDataByInternalId(neighbor));
+      buffers_.neighbors.push_back(neighbor);
+    }
+    return true;
+  }
+
+  // Computes the distances of the neighbors collected by Expand().
+  void Evaluate() {
+    for (hnswlib::tableint neighbor : buffers_.neighbors) {
+      // Neighbors further than the bound are discarded, so their exact
+      // distances are not needed.
+      float max_dist = MaxDistance();
+      float dist = distance_(index_.getDataByInternalId(neighbor), max_dist);
+      buffers_.distance_computations++;
+      if (dist < max_dist) {
+        buffers_.candidates.Insert({dist, neighbor});
+        if (IsAllowed(neighbor)) {
+          InsertTopCandidate({dist, neighbor});
+        }
+      }
+    }
+  }
+
+ private:
+  // The frontier of a search whose candidates may be expanded without being
+  // returned keeps up to this many times ef candidates.
+  static constexpr size_t kFilteredFrontierExpansion = 32;
+
+  bool IsAllowed(hnswlib::tableint id) const {
+    return !index_.isMarkedDeleted(id) && filter_(id);
+  }
+
+  static constexpr bool kExpandThroughRejected =
+      IsExpandThroughRejected<Filter>::value;
+
+  // Collects the unvisited neighbors of rejected that are allowed. Its
+  // rejected neighbors are left unvisited, as they may be reached from an
+  // accepted element later.
+  void CollectAllowedNeighbors(hnswlib::tableint rejected) {
+    hnswlib::linklistsizeint* links = index_.get_linklist0(rejected);
+    size_t size = index_.getListCount(links);
+    hnswlib::tableint* neighbors =
+        reinterpret_cast<hnswlib::tableint*>(links + 1);
+    for (size_t i = 0; i < size; i++) {
+      hnswlib::tableint neighbor = neighbors[i];
+      if (IsAllowed(neighbor) && visited_.Visit(neighbor)) {
+        VECTORLITE_PREFETCH(index_.getDataByInternalId(neighbor));
+        buffers_.neighbors.push_back(neighbor);
+      }
+    }
+  }
+
+  // Candidates further than the returned bound are discarded.
+  float MaxDistance() const {
+    const CandidateList& top_candidates = buffers_.top_candidates;
+    float shared = shared_bound_.Get();
+    return top_candidates.full()
+               ? std::min(top_candidates.furthest().first, shared)
+               : shared;
+  }
+
+  void InsertTopCandidate(const SearchCandidate& candidate) {
+    CandidateList& top_candidates = buffers_.top_candidates;
+    top_candidates.Insert(candidate);
+    if (top_candidates.full()) {
+      shared_bound_.Update(top_candidates.furthest().first);
+    }
+  }
+
+  const hnswlib::HierarchicalNSW<float>& index_;
+  Distance& distance_;
+  const Filter& filter_;
+  Visited& visited_;
+  Bound& shared_bound_;
+  SearchBuffers& buffers_;
+};
+
+// Beam search on the base layer starting from entry_points[0..n), which must
+// be marked visited already. See BaseLayerSearch for details.
+template <typename Distance, typename Filter, typename Visited, typename Bound>
+void SearchBaseLayer(const hnswlib::HierarchicalNSW<float>& index,
+                     Distance& distance, const hnswlib::tableint* entry_points,
+                     size_t n, size_t ef, const Filter& filter,
+                     Visited& visited, Bound& shared_bound, Deadline& deadline,
+                     SearchBuffers& buffers) {
+  BaseLayerSearch search(index, distance, ef, filter, visited, shared_bound,
+                         buffers);
+  search.Start(entry_points, n);
+  while (!deadline.Expired() && search.Expand()) {
+    search.Evaluate();
+  }
+}
+
+}  // namespace internal
+
+// Searches index for the ef nearest neighbors of a query. It follows the same
+// algorithm as hnswlib's searchKnn(), except that:
+// 1. distances to the query are computed by distance instead of the index's
+//    own distance function. e.g. traversing the graph using only a prefix of
+//    each vector. distance(data) returns the distance to data, and
+//    distance(data, bound) can return any value greater than bound once the
+//    distance is known to exceed bound, like EarlyAbandonDistance.
+// 2. candidates are kept in bounded sorted arrays instead of heaps, and the
+//    visited table is thread-local instead of taken from a locked pool.
+// 3. filter is a functor taking an internal id, called without virtual
+//    dispatch. It can read whatever is stored by internal id, e.g. labels or
+//    attributes.
+// Deleted elements and elements rejected by filter are not returned. At most
+// buffers.grouping.limit elements of each group are returned if grouping is
+// enabled, the search going on until ef elements are found.
+// If the deadline expires, the best candidates found so far are returned.
+// Returned candidates are stored in buffers.top_candidates, sorted by distance
+// in ascending order.
+template <typename Distance, typename Filter>
+const std::vector<SearchCandidate>& SearchWithDistance(
+    const hnswlib::HierarchicalNSW<float>& index, Distance& distance,
+    size_t ef, const Filter& filter, Deadline& deadline,
+    SearchBuffers& buffers) {
+  buffers.top_candidates.Reset(ef, &buffers.grouping);
+  buffers.distance_computations = 0;
+  if (index.cur_element_count == 0) {
+    return buffers.top_candidates.candidates();
+  }
+
+  hnswlib::tableint entry_point = internal::SearchUpperLayers(
+      index, distance, buffers.distance_computations);
+  internal::VisitedTable& visited =
+      internal::VisitedTable::ForNewSearch(index.cur_element_count);
+  visited.Visit(entry_point);
+  internal::NoSharedBound no_shared_bound;
+  internal::SearchBaseLayer(index, distance, &entry_point, 1, ef, filter,
+                            visited, no_shared_bound, deadline, buffers);
+
+  auto& result = buffers.top_candidates.candidates();
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
+// Internal ids of all elements of an index, for ScanWithDistance().
+class AllElements {
+ public:
+  explicit AllElements(const hnswlib::HierarchicalNSW<float>& index)
+      : size_(index.cur_element_count) {}
+
+  size_t size() const { return size_; }
+  hnswlib::tableint operator[](size_t i) const {
+    return static_cast<hnswlib::tableint>(i);
+  }
+
+ private:
+  size_t size_;
+};
+
+// Exact search for the k nearest neighbors of a query among elements
+// ids[begin..end) that are not deleted and accepted by filter, by computing
+// the distance to each of them. Ids is an array-like type of internal ids,
+// e.g. std::vector<hnswlib::tableint> or AllElements.
+// If the deadline expires, the best candidates found so far are returned.
+// Returned candidates are stored in buffers.top_candidates, sorted by distance
+// in ascending order.
+template <typename Distance, typename Ids, typename Filter>
+const std::vector<SearchCandidate>& ScanWithDistance(
+    const hnswlib::HierarchicalNSW<float>& index, Distance& distance,
+    const Ids& ids, size_t begin, size_t end, size_t k, const Filter& filter,
+    Deadline& deadline, SearchBuffers& buffers) {
+  CandidateList& top_candidates = buffers.top_candidates;
+  top_candidates.Reset(k, &buffers.grouping);
+  buffers.distance_computations = 0;
+  for (size_t i = begin; i < end && k > 0 && !deadline.Expired(); i++) {
+    hnswlib::tableint id = ids[i];
+    if (index.isMarkedDeleted(id) || !filter(id)) {
+      continue;
+    }
+    float bound = top_candidates.full()
+                      ? top_candidates.furthest().first
+                      : std::numeric_limits<float>::infinity();
+    float dist = distance(index.getDataByInternalId(id), bound);
+    buffers.distance_computations++;
+    if (dist < bound) {
+      top_candidates.Insert({dist, id});
+    }
+  }
+
+  auto& result = top_candidates.candidates();
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
+// Computes the distances from a query to candidates using distance, then
+// stores the k nearest ones as (distance, label) sorted by distance in
+// ascending order in result.
+template <typename Distance>
+void Rerank(const hnswlib::HierarchicalNSW<float>& index, Distance& distance,
+            const std::vector<SearchCandidate>& candidates, size_t k,
+            std::vector<std::pair<float, hnswlib::labeltype>>& result) {
+  result.clear();
+  if (k == 0) {
+    return;
+  }
+  // result is a max heap of the k nearest candidates found so far.
+  for (const auto& [_, id] : candidates) {
+    float bound = result.size() == k ? result.front().first
+                                     : std::numeric_limits<float>::infinity();
+    float dist = distance(index.getDataByInternalId(id), bound);
+    if (dist >= bound) {
+      continue;
+    }
+    if (result.size() == k) {
+      std::pop_heap(result.begin(), result.end());
+      result.pop_back();
+    }
+    result.emplace_back(dist, index.getExternalLabel(id));
+    std::push_heap(result.begin(), result.end());
+  }
+  std::sort_heap(result.begin(), result.end());
+}
+
+}  // namespace vectorlite
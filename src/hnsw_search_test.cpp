@@ -0,0 +1,252 @@
+#include "hnsw_search.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "deadline.h"
+#include "early_abandon.h"
+#include "gtest/gtest.h"
+#include "hnswlib/hnswlib.h"
+
+TEST(CandidateList, ShouldKeepNearestCandidatesUpToCapacity) {
+  vectorlite::CandidateList list;
+  list.Reset(3);
+  EXPECT_TRUE(list.Insert({3.0f, 3}));
+  EXPECT_TRUE(list.Insert({1.0f, 1}));
+  EXPECT_TRUE(list.Insert({4.0f, 4}));
+  EXPECT_TRUE(list.full());
+  // Further than all candidates in a full list.
+  EXPECT_FALSE(list.Insert({5.0f, 5}));
+  // Replaces the furthest one.
+  EXPECT_TRUE(list.Insert({2.0f, 2}));
+
+  EXPECT_EQ(3, list.size());
+  EXPECT_EQ(1, list.nearest().second);
+  EXPECT_EQ(3, list.furthest().second);
+  list.PopNearest();
+  EXPECT_EQ(2, list.nearest().second);
+
+  list.Reset(1);
+  EXPECT_TRUE(list.empty());
+}
+
+TEST(CandidateHeap, ShouldPopNearestAndDropFurthestHalfOnceFull) {
+  vectorlite::CandidateHeap heap;
+  heap.Reset(4);
+  for (hnswlib::tableint id : {5, 2, 7, 1}) {
+    heap.Insert({static_cast<float>(id), id});
+  }
+  EXPECT_EQ(4, heap.size());
+  EXPECT_EQ(1, heap.nearest().second);
+  // Drops 5 and 7 to make room.
+  heap.Insert({3.0f, 3});
+  EXPECT_EQ(3, heap.size());
+  for (hnswlib::tableint id : {1, 2, 3}) {
+    ASSERT_FALSE(heap.empty());
+    EXPECT_EQ(id, heap.nearest().second);
+    heap.PopNearest();
+  }
+  EXPECT_TRUE(heap.empty());
+
+  heap.Insert({1.0f, 1});
+  heap.Reset(2);
+  EXPECT_TRUE(heap.empty());
+}
+
+TEST(SharedVisitedTable, ShouldForgetVisitsOnReset) {
+  vectorlite::internal::SharedVisitedTable visited;
+  visited.Reset(10);
+  EXPECT_TRUE(visited.Visit(3));
+  EXPECT_FALSE(visited.Visit(3));
+  EXPECT_TRUE(visited.Visit(9));
+
+  // Enough resets for the tag to wrap around.
+  for (int i = 0; i < 70000; i++) {
+    visited.Reset(10);
+    EXPECT_TRUE(visited.Visit(3)) << i;
+  }
+  visited.Reset(20);
+  EXPECT_TRUE(visited.Visit(3));
+  EXPECT_TRUE(visited.Visit(19));
+  EXPECT_FALSE(visited.Visit(19));
+}
+
+TEST(CandidateList, ShouldKeepAtMostLimitCandidatesPerGroup) {
+  // Groups of ids 0-5.
+  const int64_t groups[] = {0, 0, 0, 1, 1, 2};
+  const uint64_t nulls[] = {0};
+  vectorlite::Grouping grouping;
+  grouping.limit = 2;
+  grouping.values = groups;
+  grouping.nulls = nulls;
+  vectorlite::CandidateList list;
+  list.Reset(3, &grouping);
+  EXPECT_TRUE(list.Insert({2.0f, 0}));
+  EXPECT_TRUE(list.Insert({3.0f, 1}));
+  // Group 0 is full, so it replaces the furthest candidate of group 0.
+  EXPECT_TRUE(list.Insert({1.0f, 2}));
+  EXPECT_FALSE(list.Insert({5.0f, 1}));
+  EXPECT_EQ(2, list.size());
+  EXPECT_EQ(0, list.furthest().second);
+
+  EXPECT_TRUE(list.Insert({4.0f, 3}));
+  EXPECT_TRUE(list.full());
+  // Evicts the candidate of group 1, making room for id 4 of the same group.
+  EXPECT_TRUE(list.Insert({0.5f, 5}));
+  EXPECT_EQ(0, list.furthest().second);
+  EXPECT_TRUE(list.Insert({0.1f, 4}));
+  EXPECT_EQ(4, list.nearest().second);
+  EXPECT_EQ(2, list.furthest().second);
+
+  // Grouping is disabled by Reset() without it.
+  list.Reset(3);
+  EXPECT_TRUE(list.Insert({1.0f, 0}));
+  EXPECT_TRUE(list.Insert({1.0f, 1}));
+  EXPECT_TRUE(list.Insert({1.0f, 2}));
+}
+
+namespace {
+
+class SearchWithDistanceTest : public testing::Test {
+ protected:
+  static constexpr size_t kDim = 8;
+  static constexpr size_t kNumElements = 1000;
+
+  SearchWithDistanceTest()
+      : space_(kDim),
+        index_(&space_, kNumElements),
+        data_(kNumElements),
+        early_abandon_space_(vectorlite::DistanceType::L2, kDim) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist;
+    for (size_t i = 0; i < kNumElements; i++) {
+      data_[i].resize(kDim);
+      for (auto& v : data_[i]) {
+        v = dist(rng);
+      }
+      index_.addPoint(data_[i].data(), i);
+    }
+  }
+
+  // Returns labels of the k nearest neighbors of query accepted by filter,
+  // at most group_limit of them per label / group_size if group_limit is
+  // positive.
+  template <typename Filter>
+  std::vector<hnswlib::labeltype> BruteForce(const std::vector<float>& query,
+                                             size_t k, const Filter& filter,
+                                             size_t group_size = 1,
+                                             size_t group_limit = 0) {
+    std::vector<std::pair<float, hnswlib::labeltype>> all;
+    for (size_t i = 0; i < kNumElements; i++) {
+      if (filter(i)) {
+        all.emplace_back(space_.get_dist_func()(query.data(), data_[i].data(),
+                                                space_.get_dist_func_param()),
+                         i);
+      }
+    }
+    std::sort(all.begin(), all.end());
+    std::vector<hnswlib::labeltype> labels;
+    std::vector<size_t> group_sizes(kNumElements);
+    for (size_t i = 0; i < all.size() && labels.size() < k; i++) {
+      size_t& group_size_i = group_sizes[all[i].second / group_size];
+      if (group_limit == 0 || group_size_i++ < group_limit) {
+        labels.push_back(all[i].second);
+      }
+    }
+    return labels;
+  }
+
+  template <typename Filter>
+  std::vector<hnswlib::labeltype> Search(const std::vector<float>& query,
+                                         size_t k, const Filter& filter) {
+    vectorlite::Deadline deadline;
+    vectorlite::EarlyAbandonDistance distance(early_abandon_space_,
+                                              query.data(), query_norms_);
+    const auto& candidates = vectorlite::SearchWithDistance(
+        index_, distance, 64, filter, deadline, buffers_);
+    EXPECT_TRUE(std::is_sorted(candidates.begin(), candidates.end()));
+    std::vector<hnswlib::labeltype> labels;
+    for (size_t i = 0; i < std::min(k, candidates.size()); i++) {
+      labels.push_back(index_.getExternalLabel(candidates[i].second));
+    }
+    return labels;
+  }
+
+  hnswlib::L2Space space_;
+  hnswlib::HierarchicalNSW<float> index_;
+  std::vector<std::vector<float>> data_;
+  vectorlite::EarlyAbandonSpace early_abandon_space_;
+  std::vector<float> query_norms_;
+  vectorlite::SearchBuffers buffers_;
+};
+
+}  // namespace
+
+TEST_F(SearchWithDistanceTest, ShouldFindNearestNeighbors) {
+  vectorlite::NoFilter no_filter;
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_EQ(BruteForce(data_[i], 10, no_filter),
+              Search(data_[i], 10, no_filter));
+    EXPECT_GT(buffers_.distance_computations, 0);
+  }
+}
+
+TEST_F(SearchWithDistanceTest, ShouldOnlyReturnElementsAcceptedByFilter) {
+  // Accepts 1% of elements.
+  auto filter = [](hnswlib::tableint id) { return id % 100 == 7; };
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_EQ(BruteForce(data_[i], 5, filter), Search(data_[i], 5, filter));
+  }
+}
+
+TEST_F(SearchWithDistanceTest, ShouldOnlyEvaluateAcceptedElements) {
+  auto filter = [](hnswlib::tableint id) { return id % 4 == 1; };
+  vectorlite::ExpandThroughRejected<decltype(filter)> expand{filter};
+  for (size_t i = 0; i < 10; i++) {
+    Search(data_[i], 5, filter);
+    uint64_t distance_computations = buffers_.distance_computations;
+    EXPECT_EQ(BruteForce(data_[i], 5, filter), Search(data_[i], 5, expand));
+    EXPECT_LT(buffers_.distance_computations, distance_computations);
+  }
+}
+
+TEST_F(SearchWithDistanceTest, ShouldSkipDeletedElements) {
+  index_.markDelete(0);
+  auto labels = Search(data_[0], 10, vectorlite::NoFilter());
+  EXPECT_EQ(10, labels.size());
+  EXPECT_EQ(labels.end(), std::find(labels.begin(), labels.end(), 0));
+}
+
+TEST_F(SearchWithDistanceTest, ShouldReturnAtMostLimitElementsPerGroup) {
+  // Groups of 10 consecutive rowids, e.g. chunks of a document.
+  buffers_.grouping.limit = 2;
+  buffers_.grouping.index = &index_;
+  buffers_.grouping.rowid_divisor = 10;
+  vectorlite::NoFilter no_filter;
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_EQ(BruteForce(data_[i], 10, no_filter, 10, 2),
+              Search(data_[i], 10, no_filter));
+  }
+}
+
+TEST_F(SearchWithDistanceTest, ScanShouldFindExactNearestNeighborsAmongIds) {
+  std::vector<hnswlib::tableint> ids;
+  for (hnswlib::tableint id = 0; id < kNumElements; id += 3) {
+    ids.push_back(id);
+  }
+  auto filter = [](hnswlib::tableint id) { return id % 3 == 0; };
+  vectorlite::Deadline deadline;
+  vectorlite::EarlyAbandonDistance distance(early_abandon_space_,
+                                            data_[1].data(), query_norms_);
+  const auto& candidates = vectorlite::ScanWithDistance(
+      index_, distance, ids, 0, ids.size(), 5, vectorlite::NoFilter(),
+      deadline, buffers_);
+  ASSERT_TRUE(std::is_sorted(candidates.begin(), candidates.end()));
+  std::vector<hnswlib::labeltype> labels;
+  for (const auto& [_, id] : candidates) {
+    labels.push_back(index_.getExternalLabel(id));
+  }
+  EXPECT_EQ(BruteForce(data_[1], 5, filter), labels);
+  EXPECT_EQ(ids.size(), buffers_.distance_computations);
+}
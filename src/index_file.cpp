@@ -0,0 +1,405 @@
+#include "index_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "absl/crc/crc32c.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "hnswlib/hnswlib.h"
+#include "parallel.h"
+
+namespace vectorlite {
+
+namespace {
+
+constexpr char kMagic[8] = {'V', 'L', 'I', 'N', 'D', 'E', 'X', '\0'};
+constexpr uint32_t kFormatVersion = 1;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_chunks;
+  uint64_t max_elements;
+  uint64_t element_count;
+  uint64_t size_data_per_element;
+  uint64_t label_offset;
+  uint64_t offset_data;
+  uint64_t max_m;
+  uint64_t max_m0;
+  uint64_t m;
+  uint64_t ef_construction;
+  double mult;
+  int32_t max_level;
+  uint32_t enterpoint_node;
+  // crc32c of the header(with this field set to 0) followed by the chunk
+  // table.
+  uint32_t crc;
+  uint32_t reserved;
+};
+
+struct ChunkEntry {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t first_element;
+  uint64_t num_elements;
+  uint32_t crc;
+  uint32_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader>);
+static_assert(std::is_trivially_copyable_v<ChunkEntry>);
+// Element levels are stored as int32_t.
+static_assert(sizeof(int) == sizeof(int32_t));
+
+using Index = hnswlib::HierarchicalNSW<float>;
+
+size_t LinkListSize(const Index& index, int level) {
+  return level > 0 ? index.size_links_per_element_ * level : 0;
+}
+
+uint32_t HeaderCrc(FileHeader header, const std::vector<ChunkEntry>& chunks) {
+  header.crc = 0;
+  absl::crc32c_t crc = absl::ComputeCrc32c(std::string_view(
+      reinterpret_cast<const char*>(&header), sizeof(header)));
+  crc = absl::ExtendCrc32c(
+      crc, std::string_view(reinterpret_cast<const char*>(chunks.data()),
+                            chunks.size() * sizeof(ChunkEntry)));
+  return static_cast<uint32_t>(crc);
+}
+
+// Each chunk is written with its own stream, so that chunks can be written
+// concurrently at their own offsets.
+absl::Status WriteChunk(const Index& index, const std::filesystem::path& path,
+                        size_t chunk_index, ChunkEntry& chunk) {
+  std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+  if (!file) {
+    return absl::InternalError(
+        absl::StrFormat("Cannot open %s for writing", path.string()));
+  }
+  file.seekp(chunk.offset);
+
+  absl::crc32c_t crc{0};
+  auto write = [&file, &crc](const char* data, size_t size) {
+    file.write(data, size);
+    crc = absl::ExtendCrc32c(crc, std::string_view(data, size));
+  };
+
+  size_t first = chunk.first_element;
+  write(reinterpret_cast<const char*>(index.element_levels_.data() + first),
+        chunk.num_elements * sizeof(int32_t));
+  write(index.data_level0_memory_ + first * index.size_data_per_element_,
+        chunk.num_elements * index.size_data_per_element_);
+  for (size_t i = first; i < first + chunk.num_elements; i++) {
+    size_t size = LinkListSize(index, index.element_levels_[i]);
+    if (size > 0) {
+      write(index.linkLists_[i], size);
+    }
+  }
+
+  file.flush();
+  if (!file) {
+    return absl::InternalError(absl::StrFormat(
+        "Failed to write chunk %d to %s", chunk_index, path.string()));
+  }
+  chunk.crc = static_cast<uint32_t>(crc);
+  return absl::OkStatus();
+}
+
+// Reads a chunk, verifies its checksum and copies its elements into index.
+absl::Status ReadChunk(const std::filesystem::path& path, size_t chunk_index,
+                       const ChunkEntry& chunk, Index& index) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return absl::InternalError(
+        absl::StrFormat("Cannot open %s for reading", path.string()));
+  }
+  file.seekg(chunk.offset);
+  std::vector<char> buffer(chunk.size);
+  file.read(buffer.data(), buffer.size());
+  if (!file) {
+    return absl::DataLossError(
+        absl::StrFormat("Failed to read chunk %d", chunk_index));
+  }
+
+  uint32_t crc = static_cast<uint32_t>(
+      absl::ComputeCrc32c(std::string_view(buffer.data(), buffer.size())));
+  if (crc != chunk.crc) {
+    return absl::DataLossError(
+        absl::StrFormat("Checksum mismatch in chunk %d", chunk_index));
+  }
+
+  size_t first = chunk.first_element;
+  size_t levels_size = chunk.num_elements * sizeof(int32_t);
+  size_t level0_size = chunk.num_elements * index.size_data_per_element_;
+  if (levels_size + level0_size > buffer.size()) {
+    return absl::DataLossError(
+        absl::StrFormat("Chunk %d is too small", chunk_index));
+  }
+  std::memcpy(index.element_levels_.data() + first, buffer.data(),
+              levels_size);
+  std::memcpy(index.data_level0_memory_ + first * index.size_data_per_element_,
+              buffer.data() + levels_size, level0_size);
+
+  const char* links = buffer.data() + levels_size + level0_size;
+  const char* end = buffer.data() + buffer.size();
+  for (size_t i = first; i < first + chunk.num_elements; i++) {
+    int level = index.element_levels_[i];
+    if (level < 0 || level > index.maxlevel_) {
+      return absl::DataLossError(absl::StrFormat(
+          "Invalid level %d of element %d in chunk %d", level, i, chunk_index));
+    }
+    size_t size = LinkListSize(index, level);
+    if (size == 0) {
+      index.linkLists_[i] = nullptr;
+      continue;
+    }
+    if (static_cast<size_t>(end - links) < size) {
+      return absl::DataLossError(
+          absl::StrFormat("Chunk %d is too small", chunk_index));
+    }
+    index.linkLists_[i] = static_cast<char*>(std::malloc(size));
+    if (index.linkLists_[i] == nullptr) {
+      return absl::ResourceExhaustedError(
+          "Not enough memory: failed to allocate linklist");
+    }
+    std::memcpy(index.linkLists_[i], links, size);
+    links += size;
+  }
+  if (links != end) {
+    return absl::DataLossError(
+        absl::StrFormat("Chunk %d has trailing bytes", chunk_index));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LoadLegacyIndex(const std::filesystem::path& path,
+                             hnswlib::SpaceInterface<float>* space,
+                             size_t max_elements, Index& index) {
+  try {
+    index.loadIndex(path.string(), space, max_elements);
+  } catch (const std::runtime_error& ex) {
+    return absl::InternalError(ex.what());
+  } catch (const std::exception& ex) {
+    return absl::UnknownError(ex.what());
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status SaveIndex(const Index& index, const std::filesystem::path& path,
+                       size_t max_chunk_bytes) {
+  size_t element_count = index.cur_element_count;
+
+  // Split elements into chunks of at most max_chunk_bytes.
+  std::vector<ChunkEntry> chunks;
+  ChunkEntry current = {};
+  for (size_t i = 0; i < element_count; i++) {
+    size_t element_size = sizeof(int32_t) + index.size_data_per_element_ +
+                          LinkListSize(index, index.element_levels_[i]);
+    if (current.num_elements > 0 &&
+        current.size + element_size > max_chunk_bytes) {
+      chunks.push_back(current);
+      current = {};
+      current.first_element = i;
+    }
+    current.num_elements++;
+    current.size += element_size;
+  }
+  if (current.num_elements > 0) {
+    chunks.push_back(current);
+  }
+
+  uint64_t offset = sizeof(FileHeader) + chunks.size() * sizeof(ChunkEntry);
+  for (auto& chunk : chunks) {
+    chunk.offset = offset;
+    offset += chunk.size;
+  }
+
+  // Create the file with its final size first, so that chunks can be written
+  // independently.
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      return absl::InternalError(
+          absl::StrFormat("Cannot open %s for writing", path.string()));
+    }
+  }
+  std::error_code ec;
+  std::filesystem::resize_file(path, offset, ec);
+  if (ec) {
+    return absl::InternalError(absl::StrFormat(
+        "Failed to resize %s: %s", path.string(), ec.message()));
+  }
+
+  absl::Status status = ParallelFor(chunks.size(), 0, [&](size_t i) {
+    return WriteChunk(index, path, i, chunks[i]);
+  });
+  if (!status.ok()) {
+    return status;
+  }
+
+  FileHeader header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.num_chunks = chunks.size();
+  header.max_elements = index.max_elements_;
+  header.element_count = element_count;
+  header.size_data_per_element = index.size_data_per_element_;
+  header.label_offset = index.label_offset_;
+  header.offset_data = index.offsetData_;
+  header.max_m = index.maxM_;
+  header.max_m0 = index.maxM0_;
+  header.m = index.M_;
+  header.ef_construction = index.ef_construction_;
+  header.mult = index.mult_;
+  header.max_level = index.maxlevel_;
+  header.enterpoint_node = index.enterpoint_node_;
+  header.crc = HeaderCrc(header, chunks);
+
+  std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(chunks.data()),
+             chunks.size() * sizeof(ChunkEntry));
+  file.flush();
+  if (!file) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to write header to %s", path.string()));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LoadIndex(const std::filesystem::path& path,
+                       hnswlib::SpaceInterface<float>* space,
+                       size_t max_elements, Index& index) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return absl::InternalError(
+        absl::StrFormat("Cannot open %s for reading", path.string()));
+  }
+
+  FileHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    // Not in the chunked format, the file might be written by hnswlib's
+    // saveIndex().
+    file.close();
+    return LoadLegacyIndex(path, space, max_elements, index);
+  }
+
+  if (header.version != kFormatVersion) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "Unsupported index file version: %d", header.version));
+  }
+
+  std::vector<ChunkEntry> chunks(header.num_chunks);
+  file.read(reinterpret_cast<char*>(chunks.data()),
+            chunks.size() * sizeof(ChunkEntry));
+  if (!file || HeaderCrc(header, chunks) != header.crc) {
+    return absl::DataLossError("Index file header is corrupted");
+  }
+  file.close();
+
+  if (header.label_offset - header.offset_data != space->get_data_size()) {
+    return absl::InvalidArgumentError(
+        "Vector size of the index file doesn't match the vector space");
+  }
+
+  std::error_code ec;
+  uint64_t file_size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return absl::InternalError(absl::StrFormat(
+        "Failed to get the size of %s: %s", path.string(), ec.message()));
+  }
+  uint64_t next_element = 0;
+  for (const auto& chunk : chunks) {
+    if (chunk.first_element != next_element ||
+        chunk.offset + chunk.size > file_size) {
+      return absl::DataLossError("Index file chunk table is corrupted");
+    }
+    next_element += chunk.num_elements;
+  }
+  if (next_element != header.element_count) {
+    return absl::DataLossError("Index file chunk table is corrupted");
+  }
+
+  // Initialize the index the same way as hnswlib's loadIndex() does.
+  size_t element_count = header.element_count;
+  size_t capacity =
+      max_elements < element_count ? header.max_elements : max_elements;
+  index.clear();
+  index.max_elements_ = capacity;
+  index.size_data_per_element_ = header.size_data_per_element;
+  index.label_offset_ = header.label_offset;
+  index.offsetData_ = header.offset_data;
+  index.offsetLevel0_ = 0;
+  index.maxlevel_ = header.max_level;
+  index.enterpoint_node_ = header.enterpoint_node;
+  index.maxM_ = header.max_m;
+  index.maxM0_ = header.max_m0;
+  index.M_ = header.m;
+  index.mult_ = header.mult;
+  index.revSize_ = 1.0 / index.mult_;
+  index.ef_construction_ = header.ef_construction;
+  index.ef_ = 10;
+  index.data_size_ = space->get_data_size();
+  index.fstdistfunc_ = space->get_dist_func();
+  index.dist_func_param_ = space->get_dist_func_param();
+  index.size_links_per_element_ =
+      index.maxM_ * sizeof(hnswlib::tableint) +
+      sizeof(hnswlib::linklistsizeint);
+  index.size_links_level0_ = index.maxM0_ * sizeof(hnswlib::tableint) +
+                             sizeof(hnswlib::linklistsizeint);
+
+  index.data_level0_memory_ =
+      static_cast<char*>(std::malloc(capacity * index.size_data_per_element_));
+  // calloc-ed, so that clear() is safe even if loading fails halfway.
+  index.linkLists_ = static_cast<char**>(std::calloc(capacity, sizeof(char*)));
+  if (index.data_level0_memory_ == nullptr || index.linkLists_ == nullptr) {
+    return absl::ResourceExhaustedError(
+        "Not enough memory: failed to load index");
+  }
+  index.element_levels_ = std::vector<int>(capacity);
+  std::vector<std::mutex>(capacity).swap(index.link_list_locks_);
+  std::vector<std::mutex>(Index::MAX_LABEL_OPERATION_LOCKS)
+      .swap(index.label_op_locks_);
+  index.visited_list_pool_ =
+      std::make_unique<hnswlib::VisitedListPool>(1, capacity);
+  index.cur_element_count = element_count;
+
+  absl::Status status = ParallelFor(chunks.size(), 0, [&](size_t i) {
+    return ReadChunk(path, i, chunks[i], index);
+  });
+  if (!status.ok()) {
+    return status;
+  }
+
+  index.label_lookup_.clear();
+  index.label_lookup_.reserve(element_count);
+  index.num_deleted_ = 0;
+  index.deleted_elements.clear();
+  for (hnswlib::tableint i = 0; i < element_count; i++) {
+    index.label_lookup_[index.getExternalLabel(i)] = i;
+    if (index.isMarkedDeleted(i)) {
+      index.num_deleted_ += 1;
+      if (index.allow_replace_deleted_) {
+        index.deleted_elements.insert(i);
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace vectorlite
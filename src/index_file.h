@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+#include "absl/status/status.h"
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+// Index files are written in a chunked format so that they can be saved and
+// loaded using multiple threads. The layout is:
+//   1. A fixed size header, including the hnsw parameters.
+//   2. A chunk table. Each entry records the offset, size and crc32c of a
+//      chunk.
+//   3. Chunks. A chunk covers a contiguous range of elements and contains
+//      their levels, level 0 data and upper level link lists.
+// Chunks are written, read and verified in parallel.
+
+// Chunks are split so that each one is at most this large, unless a single
+// element is larger.
+constexpr size_t kDefaultMaxChunkBytes = 64 << 20;
+
+// Saves index to path in the chunked format. index must not be modified
+// concurrently.
+absl::Status SaveIndex(const hnswlib::HierarchicalNSW<float>& index,
+                       const std::filesystem::path& path,
+                       size_t max_chunk_bytes = kDefaultMaxChunkBytes);
+
+// Loads the index file at path into index, which should be freshly created
+// with `space`. max_elements has the same meaning as in hnswlib's
+// loadIndex(). Files written by hnswlib's saveIndex() are loaded with
+// loadIndex(). Returns DataLossError if a chunk's checksum doesn't match.
+absl::Status LoadIndex(const std::filesystem::path& path,
+                       hnswlib::SpaceInterface<float>* space,
+                       size_t max_elements,
+                       hnswlib::HierarchicalNSW<float>& index);
+
+}  // namespace vectorlite
@@ -0,0 +1,118 @@
+#include "index_file.h"
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "gtest/gtest.h"
+#include "hnswlib/hnswlib.h"
+
+namespace {
+
+constexpr size_t kDim = 16;
+constexpr size_t kNumElements = 1000;
+
+class IndexFileTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path() /
+            "vectorlite_index_file_test.bin";
+    index_ = std::make_unique<hnswlib::HierarchicalNSW<float>>(
+        &space_, kNumElements, 16, 100);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist;
+    vectors_.resize(kNumElements * kDim);
+    for (auto& x : vectors_) {
+      x = dist(rng);
+    }
+    for (size_t i = 0; i < kNumElements; i++) {
+      index_->addPoint(vectors_.data() + i * kDim, i * 2);
+    }
+    index_->markDelete(0);
+  }
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  // Checks that loaded has the same content as index_.
+  void ExpectSameIndex(hnswlib::HierarchicalNSW<float>& loaded) {
+    ASSERT_EQ(index_->cur_element_count, loaded.cur_element_count);
+    EXPECT_EQ(index_->maxlevel_, loaded.maxlevel_);
+    EXPECT_EQ(index_->enterpoint_node_, loaded.enterpoint_node_);
+    EXPECT_EQ(1, loaded.getDeletedCount());
+    for (size_t i = 1; i < kNumElements; i++) {
+      EXPECT_EQ(index_->getDataByLabel<float>(i * 2),
+                loaded.getDataByLabel<float>(i * 2));
+    }
+    for (size_t i = 0; i < 10; i++) {
+      const float* query = vectors_.data() + i * kDim;
+      EXPECT_EQ(index_->searchKnnCloserFirst(query, 10),
+                loaded.searchKnnCloserFirst(query, 10));
+    }
+  }
+
+  hnswlib::L2Space space_{kDim};
+  std::unique_ptr<hnswlib::HierarchicalNSW<float>> index_;
+  std::vector<float> vectors_;
+  std::filesystem::path path_;
+};
+
+TEST_F(IndexFileTest, ShouldSaveAndLoadInChunks) {
+  // Small chunks to make sure the index is split into many chunks.
+  ASSERT_TRUE(vectorlite::SaveIndex(*index_, path_, 4096).ok());
+
+  hnswlib::HierarchicalNSW<float> loaded(&space_, kNumElements);
+  auto status =
+      vectorlite::LoadIndex(path_, &space_, kNumElements * 2, loaded);
+  ASSERT_TRUE(status.ok()) << status;
+  EXPECT_EQ(kNumElements * 2, loaded.max_elements_);
+  ExpectSameIndex(loaded);
+}
+
+TEST_F(IndexFileTest, ShouldLoadFilesSavedByHnswlib) {
+  index_->saveIndex(path_.string());
+
+  hnswlib::HierarchicalNSW<float> loaded(&space_, kNumElements);
+  auto status = vectorlite::LoadIndex(path_, &space_, kNumElements, loaded);
+  ASSERT_TRUE(status.ok()) << status;
+  ExpectSameIndex(loaded);
+}
+
+TEST_F(IndexFileTest, ShouldSaveAndLoadEmptyIndex) {
+  hnswlib::HierarchicalNSW<float> empty(&space_, kNumElements);
+  ASSERT_TRUE(vectorlite::SaveIndex(empty, path_).ok());
+
+  hnswlib::HierarchicalNSW<float> loaded(&space_, kNumElements);
+  ASSERT_TRUE(vectorlite::LoadIndex(path_, &space_, kNumElements, loaded).ok());
+  EXPECT_EQ(0, loaded.cur_element_count);
+}
+
+TEST_F(IndexFileTest, ShouldDetectCorruptedChunk) {
+  ASSERT_TRUE(vectorlite::SaveIndex(*index_, path_, 4096).ok());
+  auto size = std::filesystem::file_size(path_);
+  {
+    std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(size - 100);
+    char c = file.get();
+    file.seekp(size - 100);
+    file.put(c ^ 0x1);
+  }
+
+  hnswlib::HierarchicalNSW<float> loaded(&space_, kNumElements);
+  auto status = vectorlite::LoadIndex(path_, &space_, kNumElements, loaded);
+  EXPECT_EQ(absl::StatusCode::kDataLoss, status.code()) << status;
+}
+
+TEST_F(IndexFileTest, ShouldRejectMismatchedDimension) {
+  ASSERT_TRUE(vectorlite::SaveIndex(*index_, path_).ok());
+
+  hnswlib::L2Space other_space(kDim * 2);
+  hnswlib::HierarchicalNSW<float> loaded(&other_space, kNumElements);
+  auto status =
+      vectorlite::LoadIndex(path_, &other_space, kNumElements, loaded);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, status.code()) << status;
+}
+
+}  // namespace
@@ -20,7 +20,8 @@ absl::StatusOr<IndexOptions> IndexOptions::FromString(
   }
 
   IndexOptions options;
-  static const re2::RE2 kv_reg("([\\w]+)=([\\w]+)");
+  // Values can be floating point numbers, e.g. 1e-3 or 0.5
+  static const re2::RE2 kv_reg("([\\w]+)=([\\w.+-]+)");
 
   bool has_max_elements = false;
   std::string_view key;
@@ -58,6 +59,38 @@ absl::StatusOr<IndexOptions> IndexOptions::FromString(
             absl::StrFormat("Cannot parse allow_replace_deleted: %s", value);
         return absl::InvalidArgumentError(error);
       }
+    } else if (key == "result_cache_size") {
+      if (!absl::SimpleAtoi<size_t>(value, &options.result_cache_size)) {
+        std::string error =
+            absl::StrFormat("Cannot parse result_cache_size: %s", value);
+        return absl::InvalidArgumentError(error);
+      }
+    } else if (key == "semantic_cache_size") {
+      if (!absl::SimpleAtoi<size_t>(value, &options.semantic_cache_size)) {
+        std::string error =
+            absl::StrFormat("Cannot parse semantic_cache_size: %s", value);
+        return absl::InvalidArgumentError(error);
+      }
+    } else if (key == "semantic_cache_epsilon") {
+      if (!absl::SimpleAtof(value, &options.semantic_cache_epsilon) ||
+          !(options.semantic_cache_epsilon >= 0)) {
+        std::string error =
+            absl::StrFormat("Cannot parse semantic_cache_epsilon: %s", value);
+        return absl::InvalidArgumentError(error);
+      }
+    } else if (key == "search_threads") {
+      if (!absl::SimpleAtoi<size_t>(value, &options.search_threads)) {
+        std::string error =
+            absl::StrFormat("Cannot parse search_threads: %s", value);
+        return absl::InvalidArgumentError(error);
+      }
+    } else if (key == "filter_gamma") {
+      if (!absl::SimpleAtoi<size_t>(value, &options.filter_gamma) ||
+          options.filter_gamma == 0) {
+        std::string error =
+            absl::StrFormat("Cannot parse filter_gamma: %s", value);
+        return absl::InvalidArgumentError(error);
+      }
     } else {
       std::string error = absl::StrFormat("Invalid index option: %s", key);
       return absl::InvalidArgumentError(error);
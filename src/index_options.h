@@ -12,6 +12,20 @@ struct IndexOptions {
   size_t ef_construction = 200;
   size_t random_seed = 100;
   bool allow_replace_deleted = true;
+  // Max number of knn_search results cached per table. 0 disables the cache.
+  size_t result_cache_size = 0;
+  // Max number of query vectors kept by the semantic cache. 0 disables the
+  // cache.
+  size_t semantic_cache_size = 0;
+  // A query hits the semantic cache if its distance to a cached query vector
+  // is at most semantic_cache_epsilon.
+  float semantic_cache_epsilon = 0.001f;
+  // Max number of threads a single knn_search can use. 0 means the number of
+  // hardware threads.
+  size_t search_threads = 1;
+  // Greater than 1 builds a graph with filter_gamma times more links for
+  // knn_search with selective rowid or attribute filters, see BulkInsert().
+  size_t filter_gamma = 1;
 
   // Parses a string into IndexOptions.
   // This input is usually from the CREATE VIRTUAL TABLE statement.
@@ -21,6 +35,17 @@ struct IndexOptions {
   // The second parameter to vectorlite() is the index options string.
   // All parameters except max_elemnts are optional, default values are used
   // if not specified.
+  // Identical knn_search queries can be served from an LRU cache by setting
+  // result_cache_size, e.g. "hnsw(max_elements=1000,result_cache_size=100)".
+  // Near-identical queries can be served from a semantic cache by setting
+  // semantic_cache_size and optionally semantic_cache_epsilon, e.g.
+  // "hnsw(max_elements=1000,semantic_cache_size=64,semantic_cache_epsilon=0.01)".
+  // Expensive knn_search queries(large ef or exhaustive scans) can be split
+  // across threads by setting search_threads, e.g.
+  // "hnsw(max_elements=1000000,search_threads=8)".
+  // knn_search keeps a high recall with filters matching few rows if the graph
+  // is built for filtered searches by setting filter_gamma, e.g.
+  // "hnsw(max_elements=1000000,filter_gamma=4)".
   static absl::StatusOr<IndexOptions> FromString(
       std::string_view index_options);
 };
@@ -69,4 +69,75 @@ TEST(ParseIndexOptions, ShouldFailWithNonHNSWString) {
       "xxxx(M=16,max_elements=1000,ef_construction=200,random_seed=100,allow_"
       "replace_deleted=false)");
   EXPECT_FALSE(options.ok());
-}
\ No newline at end of file
+}
+
+TEST(ParseIndexOptions, ShouldParseResultCacheSize) {
+  auto options =
+      vectorlite::IndexOptions::FromString("hnsw(max_elements=1000)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(0, options->result_cache_size);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,result_cache_size=64)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(64, options->result_cache_size);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,result_cache_size=abc)");
+  EXPECT_FALSE(options.ok());
+}
+
+TEST(ParseIndexOptions, ShouldParseSemanticCacheOptions) {
+  auto options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,semantic_cache_size=32,semantic_cache_epsilon="
+      "0.05)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(32, options->semantic_cache_size);
+  EXPECT_FLOAT_EQ(0.05f, options->semantic_cache_epsilon);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,semantic_cache_epsilon=1e-4)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(0, options->semantic_cache_size);
+  EXPECT_FLOAT_EQ(1e-4f, options->semantic_cache_epsilon);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,semantic_cache_epsilon=-0.1)");
+  EXPECT_FALSE(options.ok());
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,M=1.5)");
+  EXPECT_FALSE(options.ok());
+}
+
+TEST(ParseIndexOptions, ShouldParseSearchThreads) {
+  auto options =
+      vectorlite::IndexOptions::FromString("hnsw(max_elements=1000)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(1, options->search_threads);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,search_threads=8)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(8, options->search_threads);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,search_threads=-1)");
+  EXPECT_FALSE(options.ok());
+}
+
+TEST(ParseIndexOptions, ShouldParseFilterGamma) {
+  auto options =
+      vectorlite::IndexOptions::FromString("hnsw(max_elements=1000)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(1, options->filter_gamma);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,filter_gamma=4)");
+  ASSERT_TRUE(options.ok());
+  EXPECT_EQ(4, options->filter_gamma);
+
+  options = vectorlite::IndexOptions::FromString(
+      "hnsw(max_elements=1000,filter_gamma=0)");
+  EXPECT_FALSE(options.ok());
+}
@@ -0,0 +1,516 @@
+#include "linear_transform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+#include "crc_stream.h"
+#include "macros.h"
+#include "parallel.h"
+#include "vector_ops.h"
+
+namespace vectorlite {
+
+namespace {
+
+// The file holds, in order: kMagic, kFormatVersion, the input and output
+// dimensions, the matrix and a crc32c of everything before it.
+constexpr char kMagic[8] = {'V', 'L', 'X', 'F', 'O', 'R', 'M', '\0'};
+constexpr uint32_t kFormatVersion = 1;
+
+// Rows of the covariance matrix computed by the same thread, which reads
+// every sample once per block of rows.
+constexpr size_t kCovarianceRowBlock = 32;
+
+// PCA finds the wanted eigenvectors by subspace iteration: a basis is
+// multiplied by the covariance matrix and orthonormalized this many times,
+// after which it spans the eigenvectors with the largest eigenvalues. Extra
+// basis vectors speed up the convergence of the last wanted eigenvectors.
+constexpr size_t kSubspaceIterations = 10;
+constexpr size_t kMinExtraBasisVectors = 16;
+constexpr uint32_t kPcaSeed = 42;
+
+// Like DotProduct() of vector_ops.h, partial sums are accumulated in
+// independent lanes so that the loop is vectorized.
+double Dot(const double* a, const double* b, size_t n) {
+  constexpr size_t kLanes = 4;
+  double lanes[kLanes] = {};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (size_t j = 0; j < kLanes; j++) {
+      lanes[j] += a[i + j] * b[i + j];
+    }
+  }
+  double sum = 0.0;
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  for (size_t j = 0; j < kLanes; j++) {
+    sum += lanes[j];
+  }
+  return sum;
+}
+
+// Returns the dim x dim covariance matrix of samples, or their second moment
+// if center is false. Returns CancelledError if the deadline expires.
+absl::Status Covariance(const float* samples, size_t num_samples, size_t dim,
+                        bool center, size_t num_threads, Deadline& deadline,
+                        std::vector<double>& covariance) {
+  std::vector<double> mean(dim, 0.0);
+  if (center) {
+    for (size_t s = 0; s < num_samples; s++) {
+      for (size_t i = 0; i < dim; i++) {
+        mean[i] += samples[s * dim + i];
+      }
+    }
+    for (auto& value : mean) {
+      value /= num_samples;
+    }
+  }
+
+  covariance.assign(dim * dim, 0.0);
+  size_t num_blocks = (dim + kCovarianceRowBlock - 1) / kCovarianceRowBlock;
+  auto status = ParallelFor(num_blocks, num_threads, [&](size_t block) {
+    size_t begin = block * kCovarianceRowBlock;
+    size_t end = std::min(begin + kCovarianceRowBlock, dim);
+    std::vector<double> centered(dim);
+    // Each thread polls its own copy.
+    Deadline block_deadline = deadline;
+    for (size_t s = 0; s < num_samples; s++) {
+      if (block_deadline.Expired()) {
+        return absl::CancelledError("PCA interrupted");
+      }
+      const float* sample = samples + s * dim;
+      for (size_t j = begin; j < dim; j++) {
+        centered[j] = sample[j] - mean[j];
+      }
+      // Only the upper triangle is accumulated.
+      for (size_t i = begin; i < end; i++) {
+        double x = centered[i];
+        double* row = covariance.data() + i * dim;
+        for (size_t j = i; j < dim; j++) {
+          row[j] += x * centered[j];
+        }
+      }
+    }
+    return absl::OkStatus();
+  });
+  if (!status.ok()) {
+    return status;
+  }
+  for (size_t i = 0; i < dim; i++) {
+    for (size_t j = i; j < dim; j++) {
+      covariance[i * dim + j] /= num_samples;
+      covariance[j * dim + i] = covariance[i * dim + j];
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Makes the num_vectors vectors of dim elements held back to back by vectors
+// orthonormal by modified Gram-Schmidt. A vector that is linearly dependent on
+// the previous ones is replaced by a random vector. num_vectors must not
+// exceed dim.
+void Orthonormalize(std::vector<double>& vectors, size_t num_vectors,
+                    size_t dim, std::mt19937& rng) {
+  VECTORLITE_ASSERT(num_vectors <= dim);
+  std::normal_distribution<double> normal;
+  for (size_t i = 0; i < num_vectors; i++) {
+    double* v = vectors.data() + i * dim;
+    double norm_before = std::sqrt(Dot(v, v, dim));
+    while (true) {
+      for (size_t j = 0; j < i; j++) {
+        const double* u = vectors.data() + j * dim;
+        double dot = Dot(u, v, dim);
+        for (size_t k = 0; k < dim; k++) {
+          v[k] -= dot * u[k];
+        }
+      }
+      double norm = std::sqrt(Dot(v, v, dim));
+      if (norm > 0.0 && norm > 1e-8 * norm_before) {
+        for (size_t k = 0; k < dim; k++) {
+          v[k] /= norm;
+        }
+        break;
+      }
+      for (size_t k = 0; k < dim; k++) {
+        v[k] = normal(rng);
+      }
+      norm_before = std::sqrt(Dot(v, v, dim));
+    }
+  }
+}
+
+// product[j] = matrix * vectors[j] for each of the num_vectors vectors of dim
+// elements held back to back by vectors. matrix is dim x dim.
+absl::Status MultiplyEach(const std::vector<double>& matrix,
+                          const std::vector<double>& vectors,
+                          size_t num_vectors, size_t dim, size_t num_threads,
+                          std::vector<double>& product) {
+  product.resize(num_vectors * dim);
+  return ParallelFor(num_vectors, num_threads, [&](size_t j) {
+    const double* v = vectors.data() + j * dim;
+    for (size_t i = 0; i < dim; i++) {
+      product[j * dim + i] = Dot(matrix.data() + i * dim, v, dim);
+    }
+    return absl::OkStatus();
+  });
+}
+
+// Computes the eigenvalues and eigenvectors of the n x n symmetric matrix a,
+// which is replaced by the eigenvectors as columns. Eigenvalues are not
+// sorted. The matrix is reduced to tridiagonal form by Householder
+// transformations, whose eigenvalues are then found by the QL algorithm with
+// implicit shifts, following tred2 and tql2 of EISPACK.
+void SymmetricEigen(size_t size, std::vector<double>& a,
+                    std::vector<double>& eigenvalues) {
+  int n = static_cast<int>(size);
+  auto v = [&](int i, int j) -> double& { return a[i * size + j]; };
+  std::vector<double>& d = eigenvalues;
+  d.assign(size, 0.0);
+  std::vector<double> e(size, 0.0);
+
+  // Householder reduction to tridiagonal form.
+  for (int j = 0; j < n; j++) {
+    d[j] = v(n - 1, j);
+  }
+  for (int i = n - 1; i > 0; i--) {
+    double scale = 0.0;
+    double h = 0.0;
+    for (int k = 0; k < i; k++) {
+      scale += std::abs(d[k]);
+    }
+    if (scale == 0.0) {
+      e[i] = d[i - 1];
+      for (int j = 0; j < i; j++) {
+        d[j] = v(i - 1, j);
+        v(i, j) = 0.0;
+        v(j, i) = 0.0;
+      }
+    } else {
+      for (int k = 0; k < i; k++) {
+        d[k] /= scale;
+        h += d[k] * d[k];
+      }
+      double f = d[i - 1];
+      double g = std::sqrt(h);
+      if (f > 0) {
+        g = -g;
+      }
+      e[i] = scale * g;
+      h -= f * g;
+      d[i - 1] = f - g;
+      for (int j = 0; j < i; j++) {
+        e[j] = 0.0;
+      }
+      for (int j = 0; j < i; j++) {
+        f = d[j];
+        v(j, i) = f;
+        g = e[j] + v(j, j) * f;
+        for (int k = j + 1; k <= i - 1; k++) {
+          g += v(k, j) * d[k];
+          e[k] += v(k, j) * f;
+        }
+        e[j] = g;
+      }
+      f = 0.0;
+      for (int j = 0; j < i; j++) {
+        e[j] /= h;
+        f += e[j] * d[j];
+      }
+      double hh = f / (h + h);
+      for (int j = 0; j < i; j++) {
+        e[j] -= hh * d[j];
+      }
+      for (int j = 0; j < i; j++) {
+        f = d[j];
+        g = e[j];
+        for (int k = j; k <= i - 1; k++) {
+          v(k, j) -= (f * e[k] + g * d[k]);
+        }
+        d[j] = v(i - 1, j);
+        v(i, j) = 0.0;
+      }
+    }
+    d[i] = h;
+  }
+  // Accumulates the transformations.
+  for (int i = 0; i < n - 1; i++) {
+    v(n - 1, i) = v(i, i);
+    v(i, i) = 1.0;
+    double h = d[i + 1];
+    if (h != 0.0) {
+      for (int k = 0; k <= i; k++) {
+        d[k] = v(k, i + 1) / h;
+      }
+      for (int j = 0; j <= i; j++) {
+        double g = 0.0;
+        for (int k = 0; k <= i; k++) {
+          g += v(k, i + 1) * v(k, j);
+        }
+        for (int k = 0; k <= i; k++) {
+          v(k, j) -= g * d[k];
+        }
+      }
+    }
+    for (int k = 0; k <= i; k++) {
+      v(k, i + 1) = 0.0;
+    }
+  }
+  for (int j = 0; j < n; j++) {
+    d[j] = v(n - 1, j);
+    v(n - 1, j) = 0.0;
+  }
+  v(n - 1, n - 1) = 1.0;
+  e[0] = 0.0;
+
+  // QL algorithm on the tridiagonal matrix.
+  for (int i = 1; i < n; i++) {
+    e[i - 1] = e[i];
+  }
+  e[n - 1] = 0.0;
+  double f = 0.0;
+  double tst1 = 0.0;
+  constexpr double kEpsilon = std::numeric_limits<double>::epsilon();
+  constexpr int kMaxIterations = 64;
+  for (int l = 0; l < n; l++) {
+    tst1 = std::max(tst1, std::abs(d[l]) + std::abs(e[l]));
+    int m = l;
+    while (m < n - 1 && std::abs(e[m]) > kEpsilon * tst1) {
+      m++;
+    }
+    if (m > l) {
+      int iteration = 0;
+      do {
+        double g = d[l];
+        double p = (d[l + 1] - g) / (2.0 * e[l]);
+        double r = std::hypot(p, 1.0);
+        if (p < 0) {
+          r = -r;
+        }
+        d[l] = e[l] / (p + r);
+        d[l + 1] = e[l] * (p + r);
+        double dl1 = d[l + 1];
+        double h = g - d[l];
+        for (int i = l + 2; i < n; i++) {
+          d[i] -= h;
+        }
+        f += h;
+
+        p = d[m];
+        double c = 1.0;
+        double c2 = c;
+        double c3 = c;
+        double el1 = e[l + 1];
+        double s = 0.0;
+        double s2 = 0.0;
+        for (int i = m - 1; i >= l; i--) {
+          c3 = c2;
+          c2 = c;
+          s2 = s;
+          g = c * e[i];
+          h = c * p;
+          r = std::hypot(p, e[i]);
+          e[i + 1] = s * r;
+          s = e[i] / r;
+          c = p / r;
+          p = c * d[i] - s * g;
+          d[i + 1] = h + s * (c * g + s * d[i]);
+          for (int k = 0; k < n; k++) {
+            h = v(k, i + 1);
+            v(k, i + 1) = s * v(k, i) + c * h;
+            v(k, i) = c * v(k, i) - s * h;
+          }
+        }
+        p = -s * s2 * c3 * el1 * e[l] / dl1;
+        e[l] = s * p;
+        d[l] = c * p;
+      } while (std::abs(e[l]) > kEpsilon * tst1 &&
+               ++iteration < kMaxIterations);
+    }
+    d[l] += f;
+    e[l] = 0.0;
+  }
+}
+
+}  // namespace
+
+LinearTransform::LinearTransform(size_t input_dim, size_t output_dim)
+    : input_dim_(input_dim), output_dim_(output_dim) {
+  VECTORLITE_ASSERT(output_dim_ > 0 && output_dim_ <= input_dim_);
+}
+
+absl::Status LinearTransform::FitPca(const float* samples, size_t num_samples,
+                                     bool center, size_t num_threads,
+                                     Deadline& deadline) {
+  if (num_samples == 0) {
+    return absl::InvalidArgumentError("PCA needs at least one sample");
+  }
+  size_t dim = input_dim_;
+  for (size_t i = 0; i < num_samples * dim; i++) {
+    if (!std::isfinite(samples[i])) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("sample %d isn't finite", i / dim));
+    }
+  }
+
+  std::vector<double> covariance;
+  auto status = Covariance(samples, num_samples, dim, center, num_threads,
+                           deadline, covariance);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // The basis is exact without iterations if it spans the whole space.
+  size_t basis_size = std::min(
+      dim, output_dim_ + std::max(kMinExtraBasisVectors, output_dim_ / 4));
+  size_t num_iterations = basis_size == dim ? 0 : kSubspaceIterations;
+  std::mt19937 rng(kPcaSeed);
+  std::normal_distribution<double> normal;
+  std::vector<double> basis(basis_size * dim);
+  for (auto& value : basis) {
+    value = normal(rng);
+  }
+  Orthonormalize(basis, basis_size, dim, rng);
+  std::vector<double> product;
+  for (size_t iteration = 0; iteration < num_iterations; iteration++) {
+    if (deadline.ExpiredNow()) {
+      return absl::CancelledError("PCA interrupted");
+    }
+    status = MultiplyEach(covariance, basis, basis_size, dim, num_threads,
+                          product);
+    if (!status.ok()) {
+      return status;
+    }
+    std::swap(basis, product);
+    Orthonormalize(basis, basis_size, dim, rng);
+  }
+
+  // Rayleigh-Ritz: the eigenvectors of the covariance projected onto the
+  // basis give its eigenvectors in the basis.
+  status =
+      MultiplyEach(covariance, basis, basis_size, dim, num_threads, product);
+  if (!status.ok()) {
+    return status;
+  }
+  std::vector<double> projected(basis_size * basis_size);
+  for (size_t i = 0; i < basis_size; i++) {
+    for (size_t j = i; j < basis_size; j++) {
+      double value =
+          Dot(basis.data() + i * dim, product.data() + j * dim, dim);
+      projected[i * basis_size + j] = value;
+      projected[j * basis_size + i] = value;
+    }
+  }
+  std::vector<double> eigenvalues;
+  SymmetricEigen(basis_size, projected, eigenvalues);
+  std::vector<size_t> order(basis_size);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return eigenvalues[a] > eigenvalues[b];
+  });
+
+  std::vector<float> matrix(output_dim_ * dim);
+  for (size_t row = 0; row < output_dim_; row++) {
+    std::vector<double> eigenvector(dim, 0.0);
+    for (size_t k = 0; k < basis_size; k++) {
+      double weight = projected[k * basis_size + order[row]];
+      const double* v = basis.data() + k * dim;
+      for (size_t i = 0; i < dim; i++) {
+        eigenvector[i] += weight * v[i];
+      }
+    }
+    for (size_t i = 0; i < dim; i++) {
+      matrix[row * dim + i] = static_cast<float>(eigenvector[i]);
+    }
+  }
+  matrix_ = std::move(matrix);
+  return absl::OkStatus();
+}
+
+void LinearTransform::FitRandom(uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> normal;
+  std::vector<double> rows(output_dim_ * input_dim_);
+  for (auto& value : rows) {
+    value = normal(rng);
+  }
+  Orthonormalize(rows, output_dim_, input_dim_, rng);
+  matrix_.assign(rows.begin(), rows.end());
+}
+
+void LinearTransform::Apply(const float* in, float* out) const {
+  VECTORLITE_ASSERT(trained());
+  for (size_t i = 0; i < output_dim_; i++) {
+    out[i] = DotProduct(matrix_.data() + i * input_dim_, in, input_dim_);
+  }
+}
+
+absl::Status LinearTransform::Save(const std::filesystem::path& path) const {
+  VECTORLITE_ASSERT(trained());
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", path.string()));
+  }
+  CrcWriter writer(file);
+  writer.Write(kMagic, sizeof(kMagic));
+  writer.Write(kFormatVersion);
+  writer.Write(static_cast<uint64_t>(input_dim_));
+  writer.Write(static_cast<uint64_t>(output_dim_));
+  writer.Write(matrix_.data(), matrix_.size() * sizeof(float));
+  uint32_t crc = static_cast<uint32_t>(writer.crc());
+  file.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+  if (!file.flush()) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to write %s", path.string()));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LinearTransform::Load(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return absl::NotFoundError(
+        absl::StrFormat("Failed to open %s", path.string()));
+  }
+  CrcReader reader(file);
+  char magic[sizeof(kMagic)];
+  uint32_t version = 0;
+  uint64_t input_dim = 0;
+  uint64_t output_dim = 0;
+  if (!reader.Read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), kMagic) ||
+      !reader.Read(version) || version != kFormatVersion ||
+      !reader.Read(input_dim) || !reader.Read(output_dim)) {
+    return absl::DataLossError(
+        absl::StrFormat("%s is not a valid transform file", path.string()));
+  }
+  if (input_dim != input_dim_ || output_dim != output_dim_) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "%s reduces %d dimensions to %d, but the table reduces %d to %d",
+        path.string(), input_dim, output_dim, input_dim_, output_dim_));
+  }
+  std::vector<float> matrix(output_dim_ * input_dim_);
+  if (!reader.Read(matrix.data(), matrix.size() * sizeof(float))) {
+    return absl::DataLossError(
+        absl::StrFormat("%s is truncated", path.string()));
+  }
+  uint32_t crc = 0;
+  if (!file.read(reinterpret_cast<char*>(&crc), sizeof(crc)) ||
+      crc != static_cast<uint32_t>(reader.crc())) {
+    return absl::DataLossError(
+        absl::StrFormat("Checksum mismatch in %s", path.string()));
+  }
+  matrix_ = std::move(matrix);
+  return absl::OkStatus();
+}
+
+}  // namespace vectorlite
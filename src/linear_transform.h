@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "deadline.h"
+
+namespace vectorlite {
+
+// Reduces vectors of input_dim() elements to output_dim() elements by
+// multiplying them with a output_dim() x input_dim() matrix whose rows are
+// orthonormal. Distances and inner products in the reduced space approximate
+// those of the input space, so that the index can store the reduced vectors.
+// The transform is untrained until it is fitted or loaded.
+class LinearTransform {
+ public:
+  // output_dim must be in range (0, input_dim].
+  LinearTransform(size_t input_dim, size_t output_dim);
+
+  size_t input_dim() const { return input_dim_; }
+  size_t output_dim() const { return output_dim_; }
+
+  bool trained() const { return !matrix_.empty(); }
+
+  // Row-major. Empty if the transform is untrained.
+  const std::vector<float>& matrix() const { return matrix_; }
+
+  // Fits the transform by principal component analysis of num_samples
+  // vectors held back to back by samples: its rows become the output_dim()
+  // eigenvectors with the largest eigenvalues of the covariance of samples,
+  // in descending order of eigenvalue, so that a prefix of a reduced vector
+  // keeps the most variance. If center is false, the second moment is used
+  // instead of the covariance, which suits inner product distances better.
+  // Uses up to num_threads threads, 0 meaning all hardware threads. Returns
+  // CancelledError, leaving the transform unchanged, if the deadline expires.
+  absl::Status FitPca(const float* samples, size_t num_samples, bool center,
+                      size_t num_threads, Deadline& deadline);
+
+  // Fits the transform to a random rotation followed by a projection to the
+  // first output_dim() dimensions, which needs no samples.
+  void FitRandom(uint32_t seed);
+
+  // Writes the output_dim() elements of the reduced in to out. The transform
+  // must be trained.
+  void Apply(const float* in, float* out) const;
+
+  // The file holds the dimensions and the matrix, followed by a crc32c.
+  absl::Status Save(const std::filesystem::path& path) const;
+
+  // Returns InvalidArgumentError if the file's dimensions don't match the
+  // transform's and DataLossError if the file is corrupted.
+  absl::Status Load(const std::filesystem::path& path);
+
+ private:
+  size_t input_dim_;
+  size_t output_dim_;
+  std::vector<float> matrix_;
+};
+
+}  // namespace vectorlite
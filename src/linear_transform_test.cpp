@@ -0,0 +1,178 @@
+#include "linear_transform.h"
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "deadline.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr size_t kDim = 24;
+constexpr size_t kNumSamples = 500;
+
+// Samples lie close to the subspace spanned by the first 3 axes rotated,
+// with decreasing variance along them.
+std::vector<float> MakeSamples(std::vector<std::vector<float>>& axes) {
+  std::mt19937 rng(7);
+  std::normal_distribution<float> normal;
+  vectorlite::LinearTransform rotation(kDim, 3);
+  rotation.FitRandom(11);
+  axes.assign(3, std::vector<float>(kDim));
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < kDim; j++) {
+      axes[i][j] = rotation.matrix()[i * kDim + j];
+    }
+  }
+  std::vector<float> samples(kNumSamples * kDim);
+  for (size_t s = 0; s < kNumSamples; s++) {
+    float* sample = samples.data() + s * kDim;
+    for (size_t j = 0; j < kDim; j++) {
+      sample[j] = 5.0f + 0.01f * normal(rng);
+    }
+    for (size_t i = 0; i < 3; i++) {
+      float coefficient = (3.0f - i) * normal(rng);
+      for (size_t j = 0; j < kDim; j++) {
+        sample[j] += coefficient * axes[i][j];
+      }
+    }
+  }
+  return samples;
+}
+
+float Dot(const float* a, const float* b) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < kDim; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+void ExpectOrthonormalRows(const vectorlite::LinearTransform& transform) {
+  const float* matrix = transform.matrix().data();
+  for (size_t i = 0; i < transform.output_dim(); i++) {
+    for (size_t j = 0; j < transform.output_dim(); j++) {
+      EXPECT_NEAR(i == j ? 1.0f : 0.0f,
+                  Dot(matrix + i * kDim, matrix + j * kDim), 1e-4);
+    }
+  }
+}
+
+}  // namespace
+
+TEST(LinearTransform, RandomShouldHaveOrthonormalRows) {
+  vectorlite::LinearTransform transform(kDim, 8);
+  EXPECT_FALSE(transform.trained());
+  transform.FitRandom(42);
+  ASSERT_TRUE(transform.trained());
+  ExpectOrthonormalRows(transform);
+}
+
+TEST(LinearTransform, PcaShouldFindPrincipalComponentsInOrder) {
+  std::vector<std::vector<float>> axes;
+  auto samples = MakeSamples(axes);
+  vectorlite::LinearTransform transform(kDim, 3);
+  vectorlite::Deadline deadline;
+  ASSERT_TRUE(
+      transform.FitPca(samples.data(), kNumSamples, true, 4, deadline).ok());
+  ExpectOrthonormalRows(transform);
+  // Components are only defined up to their sign.
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_NEAR(1.0f,
+                std::abs(Dot(transform.matrix().data() + i * kDim,
+                             axes[i].data())),
+                1e-2);
+  }
+
+  // Without centering, the mean of the samples dominates.
+  ASSERT_TRUE(
+      transform.FitPca(samples.data(), kNumSamples, false, 1, deadline).ok());
+  ExpectOrthonormalRows(transform);
+  std::vector<float> mean_direction(kDim, 1.0f / std::sqrt(float(kDim)));
+  EXPECT_NEAR(
+      1.0f,
+      std::abs(Dot(transform.matrix().data(), mean_direction.data())), 1e-2);
+}
+
+TEST(LinearTransform, PcaShouldKeepDistancesOfSamples) {
+  std::vector<std::vector<float>> axes;
+  auto samples = MakeSamples(axes);
+  // Wider than needed, so that the basis spans the whole space.
+  vectorlite::LinearTransform transform(kDim, 12);
+  vectorlite::Deadline deadline;
+  ASSERT_TRUE(
+      transform.FitPca(samples.data(), kNumSamples, true, 0, deadline).ok());
+  std::vector<float> a(12);
+  std::vector<float> b(12);
+  for (size_t s = 1; s < 10; s++) {
+    transform.Apply(samples.data(), a.data());
+    transform.Apply(samples.data() + s * kDim, b.data());
+    float reduced = 0.0f;
+    for (size_t i = 0; i < 12; i++) {
+      reduced += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    float full = 0.0f;
+    for (size_t i = 0; i < kDim; i++) {
+      float diff = samples[i] - samples[s * kDim + i];
+      full += diff * diff;
+    }
+    EXPECT_NEAR(full, reduced, 1e-2 * full + 1e-3);
+  }
+}
+
+TEST(LinearTransform, PcaShouldRejectInvalidSamples) {
+  vectorlite::LinearTransform transform(kDim, 3);
+  vectorlite::Deadline deadline;
+  std::vector<float> samples(kDim, 1.0f);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            transform.FitPca(samples.data(), 0, true, 1, deadline).code());
+  samples[5] = NAN;
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument,
+            transform.FitPca(samples.data(), 1, true, 1, deadline).code());
+  EXPECT_FALSE(transform.trained());
+  // Fewer samples than output dimensions still give orthonormal rows.
+  samples[5] = 2.0f;
+  ASSERT_TRUE(transform.FitPca(samples.data(), 1, false, 1, deadline).ok());
+  ExpectOrthonormalRows(transform);
+}
+
+TEST(LinearTransform, PcaShouldStopOnceDeadlineExpires) {
+  std::vector<std::vector<float>> axes;
+  auto samples = MakeSamples(axes);
+  vectorlite::LinearTransform transform(kDim, 3);
+  vectorlite::Deadline deadline(std::chrono::milliseconds(0), nullptr);
+  EXPECT_EQ(absl::StatusCode::kCancelled,
+            transform.FitPca(samples.data(), kNumSamples, true, 4, deadline)
+                .code());
+  EXPECT_FALSE(transform.trained());
+}
+
+TEST(LinearTransform, LoadShouldRestoreSavedTransform) {
+  auto path = std::filesystem::temp_directory_path() /
+              "vectorlite_linear_transform_test.transform";
+  vectorlite::LinearTransform transform(kDim, 8);
+  transform.FitRandom(42);
+  ASSERT_TRUE(transform.Save(path).ok());
+
+  vectorlite::LinearTransform loaded(kDim, 8);
+  ASSERT_TRUE(loaded.Load(path).ok());
+  EXPECT_EQ(transform.matrix(), loaded.matrix());
+
+  vectorlite::LinearTransform narrower(kDim, 4);
+  EXPECT_EQ(absl::StatusCode::kInvalidArgument, narrower.Load(path).code());
+
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(-8, std::ios::end);
+    file.put('\x7f');
+  }
+  EXPECT_EQ(absl::StatusCode::kDataLoss, loaded.Load(path).code());
+  std::filesystem::resize_file(path, 20);
+  EXPECT_EQ(absl::StatusCode::kDataLoss, loaded.Load(path).code());
+  std::filesystem::remove(path);
+}
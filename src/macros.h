@@ -11,3 +11,14 @@
 #include <cassert>
 #define VECTORLITE_ASSERT(x) assert(x)
 #endif
+
+// Hints the CPU to load the cache line at addr, which is about to be read.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define VECTORLITE_PREFETCH(addr) \
+  _mm_prefetch(reinterpret_cast<const char*>(addr), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define VECTORLITE_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define VECTORLITE_PREFETCH(addr) ((void)(addr))
+#endif
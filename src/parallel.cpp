@@ -0,0 +1,162 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+
+namespace vectorlite {
+
+namespace {
+
+// Threads that help ParallelFor() calls. Threads outlive the calls so that
+// neither their startup nor the thread_local state of searches, e.g.
+// VisitedTables, is paid for by each call. The pool keeps as many threads as
+// the largest call asked for, they exit when vectorlite is unloaded.
+class WorkerPool {
+ public:
+  static WorkerPool& Get() {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  ~WorkerPool();
+
+  // Runs work on the calling thread and on up to num_helpers pool threads.
+  // Returns once all of them returned. work must return once there's nothing
+  // left to do, so helpers that haven't started by then are not waited for,
+  // which also lets work call Run() itself.
+  void Run(size_t num_helpers, const std::function<void()>& work);
+
+ private:
+  struct Job {
+    const std::function<void()>* work;
+    // Number of helpers yet to start work.
+    size_t num_unstarted;
+    // Number of helpers running work.
+    size_t num_running;
+  };
+
+  void Loop();
+
+  std::mutex mutex_;
+  std::condition_variable job_added_;
+  std::condition_variable job_done_;
+  std::deque<Job*> jobs_;
+  std::vector<std::thread> threads_;
+  bool stopping_ = false;
+};
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_added_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::Run(size_t num_helpers, const std::function<void()>& work) {
+  Job job{&work, num_helpers, 0};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (threads_.size() < num_helpers) {
+      threads_.emplace_back(&WorkerPool::Loop, this);
+    }
+    jobs_.push_back(&job);
+  }
+  job_added_.notify_all();
+
+  work();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (job.num_unstarted > 0) {
+    jobs_.erase(std::find(jobs_.begin(), jobs_.end(), &job));
+    job.num_unstarted = 0;
+  }
+  job_done_.wait(lock, [&job]() { return job.num_running == 0; });
+}
+
+void WorkerPool::Loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_added_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    Job* job = jobs_.front();
+    if (--job->num_unstarted == 0) {
+      jobs_.pop_front();
+    }
+    job->num_running++;
+    lock.unlock();
+    (*job->work)();
+    lock.lock();
+    if (--job->num_running == 0) {
+      job_done_.notify_all();
+    }
+  }
+}
+
+}  // namespace
+
+size_t DefaultNumThreads() {
+  return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+absl::Status ParallelFor(size_t n, size_t num_threads,
+                         const std::function<absl::Status(size_t)>& fn) {
+  if (num_threads == 0) {
+    num_threads = DefaultNumThreads();
+  }
+  num_threads = std::min(num_threads, n);
+
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::mutex status_mutex;
+  absl::Status status;
+
+  auto worker = [&]() {
+    while (!failed.load(std::memory_order_relaxed)) {
+      size_t i = next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= n) {
+        return;
+      }
+
+      absl::Status s;
+      try {
+        s = fn(i);
+      } catch (const std::exception& ex) {
+        s = absl::InternalError(ex.what());
+      }
+
+      if (!s.ok()) {
+        std::lock_guard<std::mutex> lock(status_mutex);
+        if (status.ok()) {
+          status = std::move(s);
+        }
+        failed.store(true, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  if (num_threads <= 1) {
+    worker();
+    return status;
+  }
+
+  // The calling thread works too.
+  WorkerPool::Get().Run(num_threads - 1, worker);
+  return status;
+}
+
+}  // namespace vectorlite
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+#include "absl/status/status.h"
+
+namespace vectorlite {
+
+// Returns the number of threads to use when num_threads is 0, which is the
+// number of hardware threads(at least 1).
+size_t DefaultNumThreads();
+
+// Runs fn(i) for every i in [0, n) using up to num_threads threads: the calling
+// thread and threads of a pool shared by all calls, which may be nested. If
+// num_threads is 0, DefaultNumThreads() is used. fn must be thread-safe.
+// Once fn returns a non-ok status or throws, no more work is started and the
+// first error is returned.
+absl::Status ParallelFor(size_t n, size_t num_threads,
+                         const std::function<absl::Status(size_t)>& fn);
+
+}  // namespace vectorlite
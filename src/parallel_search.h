@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "deadline.h"
+#include "hnsw_search.h"
+#include "hnswlib/hnswlib.h"
+#include "macros.h"
+#include "parallel.h"
+
+// Vector searches that split the work of a single query across the threads of
+// ParallelFor(). They pay off for expensive queries only, e.g. a large ef or a
+// scan over many elements, as handing work to threads has a fixed cost.
+//
+// Each thread uses its own distance functor, buffers and copy of the deadline.
+// Thread i uses distances[i] and buffers[i], so the number of threads is
+// distances.size() and buffers must have at least as many elements. Buffers
+// are meant to be kept across queries, so that queries don't allocate.
+// Candidates found by all threads are merged into result, sorted by distance
+// in ascending order. The distance computations of thread i are stored in
+// buffers[i].distance_computations.
+
+namespace vectorlite {
+
+namespace internal {
+
+// Merges the candidates found by the first n buffers into result, keeping the
+// limit nearest ones sorted by distance in ascending order.
+inline void MergeCandidates(std::vector<SearchBuffers>& buffers, size_t n,
+                            size_t limit,
+                            std::vector<SearchCandidate>& result) {
+  result.clear();
+  for (size_t i = 0; i < n; i++) {
+    const auto& candidates = buffers[i].top_candidates.candidates();
+    result.insert(result.end(), candidates.begin(), candidates.end());
+  }
+  std::sort(result.begin(), result.end());
+  if (result.size() > limit) {
+    result.resize(limit);
+  }
+}
+
+}  // namespace internal
+
+// Like SearchWithDistance(), except that the base layer is searched by
+// multiple threads at once. After descending the upper layers, the element
+// found and its neighbors are dealt out to the threads as entry points. Each
+// thread runs its own beam search keeping its own ef nearest candidates, but
+// all threads share a visited table, so that every element is evaluated by
+// one thread only and the threads spread out instead of repeating each
+// other's work. visited is reset for the search. Threads also share a
+// distance bound, so that none of them expands candidates that can't make it
+// into the merged result. The ef nearest candidates of all threads are
+// returned.
+template <typename Distance, typename Filter>
+absl::Status ParallelSearchWithDistance(
+    const hnswlib::HierarchicalNSW<float>& index,
+    std::vector<Distance>& distances, size_t ef, const Filter& filter,
+    Deadline& deadline, internal::SharedVisitedTable& visited,
+    std::vector<SearchBuffers>& buffers,
+    std::vector<SearchCandidate>& result) {
+  size_t num_threads = distances.size();
+  VECTORLITE_ASSERT(num_threads > 0 && buffers.size() >= num_threads);
+  result.clear();
+  for (size_t i = 0; i < num_threads; i++) {
+    buffers[i].top_candidates.Reset(ef);
+    buffers[i].distance_computations = 0;
+  }
+  if (index.cur_element_count == 0) {
+    return absl::OkStatus();
+  }
+
+  hnswlib::tableint entry_point = internal::SearchUpperLayers(
+      index, distances[0], buffers[0].distance_computations);
+  std::vector<hnswlib::tableint> entry_points = {entry_point};
+  hnswlib::linklistsizeint* links = index.get_linklist0(entry_point);
+  hnswlib::tableint* neighbors =
+      reinterpret_cast<hnswlib::tableint*>(links + 1);
+  entry_points.insert(entry_points.end(), neighbors,
+                      neighbors + index.getListCount(links));
+
+  visited.Reset(index.max_elements_);
+  for (hnswlib::tableint id : entry_points) {
+    visited.Visit(id);
+  }
+  // Entry points are sorted by thread, thread i gets entry points i,
+  // i + num_threads, i + 2 * num_threads...
+  std::vector<hnswlib::tableint> sorted_entry_points;
+  std::vector<size_t> offsets = {0};
+  for (size_t i = 0; i < num_threads; i++) {
+    for (size_t j = i; j < entry_points.size(); j += num_threads) {
+      sorted_entry_points.push_back(entry_points[j]);
+    }
+    offsets.push_back(sorted_entry_points.size());
+  }
+
+  internal::SharedBound shared_bound;
+  std::vector<Deadline> deadlines(num_threads, deadline);
+  absl::Status status =
+      ParallelFor(num_threads, num_threads, [&](size_t i) -> absl::Status {
+        internal::SearchBaseLayer(
+            index, distances[i], sorted_entry_points.data() + offsets[i],
+            offsets[i + 1] - offsets[i], ef, filter, visited, shared_bound,
+            deadlines[i], buffers[i]);
+        return absl::OkStatus();
+      });
+  for (const auto& thread_deadline : deadlines) {
+    deadline.Merge(thread_deadline);
+  }
+  internal::MergeCandidates(buffers, num_threads, ef, result);
+  return status;
+}
+
+// Like ScanWithDistance(), except that ids is split into contiguous
+// partitions, one per thread. Each thread keeps the k nearest candidates of
+// its partition, and the k nearest of all threads are returned.
+template <typename Distance, typename Ids, typename Filter>
+absl::Status ParallelScanWithDistance(
+    const hnswlib::HierarchicalNSW<float>& index,
+    std::vector<Distance>& distances, const Ids& ids, size_t k,
+    const Filter& filter, Deadline& deadline,
+    std::vector<SearchBuffers>& buffers, std::vector<SearchCandidate>& result) {
+  size_t num_threads = distances.size();
+  VECTORLITE_ASSERT(num_threads > 0 && buffers.size() >= num_threads);
+  std::vector<Deadline> deadlines(num_threads, deadline);
+  absl::Status status =
+      ParallelFor(num_threads, num_threads, [&](size_t i) -> absl::Status {
+        ScanWithDistance(index, distances[i], ids,
+                         ids.size() * i / num_threads,
+                         ids.size() * (i + 1) / num_threads, k, filter,
+                         deadlines[i], buffers[i]);
+        return absl::OkStatus();
+      });
+  for (const auto& thread_deadline : deadlines) {
+    deadline.Merge(thread_deadline);
+  }
+  internal::MergeCandidates(buffers, num_threads, k, result);
+  return status;
+}
+
+}  // namespace vectorlite
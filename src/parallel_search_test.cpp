@@ -0,0 +1,165 @@
+#include "parallel_search.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "deadline.h"
+#include "early_abandon.h"
+#include "gtest/gtest.h"
+#include "hnsw_search.h"
+#include "hnswlib/hnswlib.h"
+
+namespace {
+
+class ParallelSearchTest : public testing::Test {
+ protected:
+  static constexpr size_t kDim = 8;
+  static constexpr size_t kNumElements = 2000;
+  static constexpr size_t kNumThreads = 4;
+
+  ParallelSearchTest()
+      : space_(kDim),
+        index_(&space_, kNumElements),
+        data_(kNumElements),
+        early_abandon_space_(vectorlite::DistanceType::L2, kDim),
+        query_norms_(kNumThreads),
+        buffers_(kNumThreads) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist;
+    for (size_t i = 0; i < kNumElements; i++) {
+      data_[i].resize(kDim);
+      for (auto& v : data_[i]) {
+        v = dist(rng);
+      }
+      index_.addPoint(data_[i].data(), i);
+    }
+  }
+
+  // Returns labels of the k nearest neighbors of query accepted by filter.
+  template <typename Filter>
+  std::vector<hnswlib::labeltype> BruteForce(const std::vector<float>& query,
+                                             size_t k, const Filter& filter) {
+    std::vector<std::pair<float, hnswlib::labeltype>> all;
+    for (size_t i = 0; i < kNumElements; i++) {
+      if (filter(i)) {
+        all.emplace_back(space_.get_dist_func()(query.data(), data_[i].data(),
+                                                space_.get_dist_func_param()),
+                         i);
+      }
+    }
+    std::sort(all.begin(), all.end());
+    std::vector<hnswlib::labeltype> labels;
+    for (size_t i = 0; i < std::min(k, all.size()); i++) {
+      labels.push_back(all[i].second);
+    }
+    return labels;
+  }
+
+  std::vector<vectorlite::EarlyAbandonDistance> Distances(
+      const std::vector<float>& query) {
+    std::vector<vectorlite::EarlyAbandonDistance> distances;
+    for (size_t i = 0; i < kNumThreads; i++) {
+      distances.emplace_back(early_abandon_space_, query.data(),
+                             query_norms_[i]);
+    }
+    return distances;
+  }
+
+  std::vector<hnswlib::labeltype> Labels(size_t k) {
+    EXPECT_TRUE(std::is_sorted(candidates_.begin(), candidates_.end()));
+    std::vector<hnswlib::labeltype> labels;
+    for (size_t i = 0; i < std::min(k, candidates_.size()); i++) {
+      labels.push_back(index_.getExternalLabel(candidates_[i].second));
+    }
+    return labels;
+  }
+
+  template <typename Filter>
+  std::vector<hnswlib::labeltype> Search(const std::vector<float>& query,
+                                         size_t k, size_t ef,
+                                         const Filter& filter) {
+    vectorlite::Deadline deadline;
+    auto distances = Distances(query);
+    EXPECT_TRUE(vectorlite::ParallelSearchWithDistance(
+                    index_, distances, ef, filter, deadline, visited_,
+                    buffers_, candidates_)
+                    .ok());
+    return Labels(k);
+  }
+
+  template <typename Filter>
+  std::vector<hnswlib::labeltype> Scan(const std::vector<float>& query,
+                                       size_t k, const Filter& filter) {
+    vectorlite::Deadline deadline;
+    auto distances = Distances(query);
+    EXPECT_TRUE(vectorlite::ParallelScanWithDistance(
+                    index_, distances, vectorlite::AllElements(index_), k,
+                    filter, deadline, buffers_, candidates_)
+                    .ok());
+    return Labels(k);
+  }
+
+  hnswlib::L2Space space_;
+  hnswlib::HierarchicalNSW<float> index_;
+  std::vector<std::vector<float>> data_;
+  vectorlite::EarlyAbandonSpace early_abandon_space_;
+  std::vector<std::vector<float>> query_norms_;
+  vectorlite::internal::SharedVisitedTable visited_;
+  std::vector<vectorlite::SearchBuffers> buffers_;
+  std::vector<vectorlite::SearchCandidate> candidates_;
+};
+
+}  // namespace
+
+TEST_F(ParallelSearchTest, SearchShouldFindNearestNeighbors) {
+  vectorlite::NoFilter no_filter;
+  // Threads race for elements, so results are not deterministic.
+  size_t found = 0;
+  for (size_t i = 0; i < 20; i++) {
+    auto expected = BruteForce(data_[i], 10, no_filter);
+    auto labels = Search(data_[i], 10, 128, no_filter);
+    EXPECT_EQ(10, labels.size());
+    for (auto label : labels) {
+      found += std::count(expected.begin(), expected.end(), label);
+    }
+  }
+  EXPECT_GE(found, 190);
+}
+
+TEST_F(ParallelSearchTest, SearchShouldOnlyReturnElementsAcceptedByFilter) {
+  auto filter = [](hnswlib::tableint id) { return id % 10 == 3; };
+  for (size_t i = 0; i < 10; i++) {
+    auto labels = Search(data_[i], 10, 128, filter);
+    EXPECT_EQ(10, labels.size());
+    for (auto label : labels) {
+      EXPECT_TRUE(filter(label));
+    }
+  }
+}
+
+TEST_F(ParallelSearchTest, SearchShouldReturnEfCandidates) {
+  Search(data_[0], 10, 300, vectorlite::NoFilter());
+  EXPECT_EQ(300, candidates_.size());
+  // Each element is evaluated by one thread only.
+  std::vector<vectorlite::SearchCandidate> unique = candidates_;
+  unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+  EXPECT_EQ(candidates_.size(), unique.size());
+}
+
+TEST_F(ParallelSearchTest, ScanShouldFindExactNearestNeighbors) {
+  vectorlite::NoFilter no_filter;
+  auto filter = [](hnswlib::tableint id) { return id % 100 == 7; };
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_EQ(BruteForce(data_[i], 10, no_filter),
+              Scan(data_[i], 10, no_filter));
+    EXPECT_EQ(BruteForce(data_[i], 30, filter), Scan(data_[i], 30, filter));
+  }
+}
+
+TEST_F(ParallelSearchTest, ScanShouldSkipDeletedElements) {
+  index_.markDelete(0);
+  auto labels = Scan(data_[0], 10, vectorlite::NoFilter());
+  EXPECT_EQ(10, labels.size());
+  EXPECT_EQ(labels.end(), std::find(labels.begin(), labels.end(), 0));
+}
@@ -0,0 +1,87 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "gtest/gtest.h"
+
+TEST(ParallelFor, ShouldRunEveryIndexOnce) {
+  for (size_t num_threads : {0, 1, 4, 64}) {
+    std::vector<std::atomic<int>> counts(1000);
+    auto status = vectorlite::ParallelFor(counts.size(), num_threads,
+                                          [&counts](size_t i) {
+                                            counts[i]++;
+                                            return absl::OkStatus();
+                                          });
+    EXPECT_TRUE(status.ok());
+    for (const auto& count : counts) {
+      EXPECT_EQ(1, count);
+    }
+  }
+}
+
+TEST(ParallelFor, ShouldReturnError) {
+  auto status = vectorlite::ParallelFor(100, 4, [](size_t i) {
+    return i == 42 ? absl::InternalError("failed") : absl::OkStatus();
+  });
+  EXPECT_EQ(absl::StatusCode::kInternal, status.code());
+
+  status = vectorlite::ParallelFor(100, 4, [](size_t i) -> absl::Status {
+    throw std::runtime_error("thrown");
+  });
+  EXPECT_EQ(absl::StatusCode::kInternal, status.code());
+  EXPECT_EQ("thrown", status.message());
+}
+
+TEST(ParallelFor, ShouldReuseThreadsAcrossCalls) {
+  // Each call runs on 4 threads, which wait for each other, so on 3 helper
+  // threads. A thread has seen an earlier call iff it was reused, which must
+  // happen once there were more helpers than the pool can hold, which is at
+  // most the largest num_threads of any test.
+  thread_local bool seen_earlier_call = false;
+  const std::thread::id caller = std::this_thread::get_id();
+  size_t num_calls =
+      std::max<size_t>(vectorlite::DefaultNumThreads(), 64) / 3 + 1;
+  bool reused = false;
+  for (size_t call = 0; call < num_calls; call++) {
+    std::mutex mutex;
+    std::condition_variable all_started;
+    int num_started = 0;
+    auto status = vectorlite::ParallelFor(4, 4, [&](size_t) {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (++num_started == 4) {
+        all_started.notify_all();
+      }
+      all_started.wait(lock, [&num_started]() { return num_started == 4; });
+      if (std::this_thread::get_id() != caller) {
+        reused |= seen_earlier_call;
+        seen_earlier_call = true;
+      }
+      return absl::OkStatus();
+    });
+    EXPECT_TRUE(status.ok());
+  }
+  EXPECT_TRUE(reused);
+}
+
+TEST(ParallelFor, ShouldRunNestedAndConcurrentCalls) {
+  std::atomic<int> count{0};
+  auto run = [&count]() {
+    return vectorlite::ParallelFor(8, 4, [&count](size_t) {
+      return vectorlite::ParallelFor(100, 4, [&count](size_t) {
+        count++;
+        return absl::OkStatus();
+      });
+    });
+  };
+  std::thread other([&run]() { EXPECT_TRUE(run().ok()); });
+  EXPECT_TRUE(run().ok());
+  other.join();
+  EXPECT_EQ(2 * 8 * 100, count);
+}
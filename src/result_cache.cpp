@@ -0,0 +1,60 @@
+#include "result_cache.h"
+
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "macros.h"
+
+namespace vectorlite {
+
+ResultCache::ResultCache(size_t capacity) : capacity_(capacity) {
+  VECTORLITE_ASSERT(capacity_ > 0);
+  index_.reserve(capacity_);
+}
+
+bool ResultCache::Lookup(std::string_view key, Result& result) {
+  auto it = index_.find(key);
+  if (it == index_.end() || it->second->generation != generation_) {
+    stats_.misses++;
+    return false;
+  }
+
+  entries_.splice(entries_.begin(), entries_, it->second);
+  result.assign(it->second->result.begin(), it->second->result.end());
+  stats_.hits++;
+  return true;
+}
+
+void ResultCache::Insert(std::string_view key, const Result& result) {
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    // Refresh a stale entry.
+    auto entry = it->second;
+    entry->result.assign(result.begin(), result.end());
+    entry->generation = generation_;
+    entries_.splice(entries_.begin(), entries_, entry);
+    return;
+  }
+
+  if (entries_.size() < capacity_) {
+    entries_.push_front(Entry{std::string(key), result, generation_});
+  } else {
+    // Reuse the least recently used entry.
+    auto entry = std::prev(entries_.end());
+    index_.erase(std::string_view(entry->key));
+    entry->key.assign(key.data(), key.size());
+    entry->result.assign(result.begin(), result.end());
+    entry->generation = generation_;
+    entries_.splice(entries_.begin(), entries_, entry);
+    stats_.evictions++;
+  }
+  index_.emplace(std::string_view(entries_.front().key), entries_.begin());
+}
+
+void ResultCache::Invalidate() {
+  generation_++;
+  stats_.invalidations++;
+}
+
+}  // namespace vectorlite
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+// A bounded LRU cache of query results. A key should encode everything that
+// affects the result of a query, e.g. the query vector, k, ef and rowid
+// filters.
+// Writes to the index invalidate all entries by bumping a generation number,
+// so that invalidation is O(1). Stale entries are treated as misses and are
+// overwritten or evicted later.
+// Not thread-safe. A virtual table is only accessed by one thread at a time.
+class ResultCache {
+ public:
+  using Result = std::vector<std::pair<float, hnswlib::labeltype>>;
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t invalidations = 0;
+  };
+
+  // capacity must be greater than 0.
+  explicit ResultCache(size_t capacity);
+
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  // If key is cached and still valid, copies its result into result and
+  // returns true.
+  bool Lookup(std::string_view key, Result& result);
+
+  // Caches result for key. Once the cache is full, the least recently used
+  // entry is evicted and its memory is reused.
+  void Insert(std::string_view key, const Result& result);
+
+  // Invalidates all cached results. Should be called whenever the index
+  // changes.
+  void Invalidate();
+
+  size_t capacity() const { return capacity_; }
+
+  // Number of entries including stale ones.
+  size_t size() const { return entries_.size(); }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Entry {
+    std::string key;
+    Result result;
+    uint64_t generation;
+  };
+
+  size_t capacity_;
+  uint64_t generation_ = 0;
+  // Most recently used entries come first.
+  std::list<Entry> entries_;
+  // Keys are views of Entry::key, which are stable because list nodes never
+  // move.
+  absl::flat_hash_map<std::string_view, std::list<Entry>::iterator> index_;
+  Stats stats_;
+};
+
+}  // namespace vectorlite
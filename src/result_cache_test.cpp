@@ -0,0 +1,50 @@
+#include "result_cache.h"
+
+#include "gtest/gtest.h"
+
+TEST(ResultCache, ShouldReturnCachedResult) {
+  vectorlite::ResultCache cache(2);
+  vectorlite::ResultCache::Result result;
+  EXPECT_FALSE(cache.Lookup("a", result));
+
+  cache.Insert("a", {{0.5f, 1}, {1.0f, 2}});
+  ASSERT_TRUE(cache.Lookup("a", result));
+  vectorlite::ResultCache::Result expected = {{0.5f, 1}, {1.0f, 2}};
+  EXPECT_EQ(expected, result);
+  EXPECT_FALSE(cache.Lookup("b", result));
+
+  EXPECT_EQ(1, cache.stats().hits);
+  EXPECT_EQ(2, cache.stats().misses);
+}
+
+TEST(ResultCache, ShouldEvictLeastRecentlyUsed) {
+  vectorlite::ResultCache cache(2);
+  vectorlite::ResultCache::Result result;
+  cache.Insert("a", {{0.0f, 1}});
+  cache.Insert("b", {{0.0f, 2}});
+  // "a" becomes the most recently used.
+  ASSERT_TRUE(cache.Lookup("a", result));
+  cache.Insert("c", {{0.0f, 3}});
+
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(1, cache.stats().evictions);
+  EXPECT_TRUE(cache.Lookup("a", result));
+  EXPECT_FALSE(cache.Lookup("b", result));
+  ASSERT_TRUE(cache.Lookup("c", result));
+  EXPECT_EQ(3, result[0].second);
+}
+
+TEST(ResultCache, ShouldMissAfterInvalidation) {
+  vectorlite::ResultCache cache(2);
+  vectorlite::ResultCache::Result result;
+  cache.Insert("a", {{0.0f, 1}});
+  cache.Invalidate();
+  EXPECT_FALSE(cache.Lookup("a", result));
+  EXPECT_EQ(1, cache.stats().invalidations);
+
+  // A stale entry is refreshed in place.
+  cache.Insert("a", {{0.0f, 2}});
+  EXPECT_EQ(1, cache.size());
+  ASSERT_TRUE(cache.Lookup("a", result));
+  EXPECT_EQ(2, result[0].second);
+}
@@ -0,0 +1,41 @@
+#include "rowid_map.h"
+
+#include <mutex>
+
+namespace vectorlite {
+
+void RowidMap::Erase(hnswlib::labeltype rowid, hnswlib::tableint id) {
+  auto it = ids_.find(rowid);
+  if (it != ids_.end() && it->second == id) {
+    ids_.erase(it);
+  }
+}
+
+size_t RowidMap::CountRowElements(const Index& index, hnswlib::tableint id) {
+  hnswlib::labeltype rowid = index.getExternalLabel(id);
+  bool deleted = index.isMarkedDeleted(id);
+  size_t end = id + 1;
+  while (end < index.cur_element_count &&
+         index.getExternalLabel(end) == rowid &&
+         index.isMarkedDeleted(end) == deleted) {
+    end++;
+  }
+  return end - id;
+}
+
+void RowidMap::Rebuild(Index& index) {
+  ids_.clear();
+  ids_.reserve(index.cur_element_count);
+  for (hnswlib::tableint id = 0; id < index.cur_element_count; id++) {
+    auto [it, inserted] = ids_.try_emplace(index.getExternalLabel(id), id);
+    if (!inserted && index.isMarkedDeleted(it->second)) {
+      it->second = id;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(index.label_lookup_lock);
+  // clear() would keep the buckets.
+  decltype(index.label_lookup_)().swap(index.label_lookup_);
+}
+
+}  // namespace vectorlite
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+#include "absl/container/flat_hash_map.h"
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+// Maps rowids to the internal ids of the elements of an hnswlib index.
+// It replaces the index's label_lookup_, a std::unordered_map that allocates a
+// node per row and is guarded by a single mutex: entries are stored inline in
+// an open-addressing table and looked up without any lock. Once a RowidMap
+// owns the mapping, label_lookup_ is left empty, so label based methods of
+// the index (addPoint(), markDelete(), getDataByLabel()...) must not be used.
+// Like the virtual table that owns it, it is modified by one thread at a time.
+// Lookups are const and can run concurrently as long as it's not modified.
+class RowidMap {
+ public:
+  using Index = hnswlib::HierarchicalNSW<float>;
+
+  // Returns the id of the element labeled rowid, which might be deleted.
+  std::optional<hnswlib::tableint> Find(hnswlib::labeltype rowid) const {
+    auto it = ids_.find(rowid);
+    if (it == ids_.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  // Returns the id of the element labeled rowid, if it's not deleted.
+  std::optional<hnswlib::tableint> FindLive(const Index& index,
+                                            hnswlib::labeltype rowid) const {
+    auto id = Find(rowid);
+    if (!id || index.isMarkedDeleted(*id)) {
+      return std::nullopt;
+    }
+    return id;
+  }
+
+  void Insert(hnswlib::labeltype rowid, hnswlib::tableint id) {
+    ids_.insert_or_assign(rowid, id);
+  }
+
+  // Removes rowid if it's mapped to id, i.e. when the element id is reused
+  // for another rowid.
+  void Erase(hnswlib::labeltype rowid, hnswlib::tableint id);
+
+  // Maps the label of each element of index to its id, and releases
+  // index.label_lookup_. If several elements have the same label, which
+  // happens when a deleted row is inserted again, the one not deleted wins.
+  void Rebuild(Index& index);
+
+  // Returns the number of elements of the row whose first element is id. The
+  // vectors of a row of a multi-vector table are consecutive elements labeled
+  // with its rowid, and the row is mapped to the first one. A row inserted
+  // again after being deleted gets new elements, which are told apart from
+  // the deleted ones by their deletion mark.
+  static size_t CountRowElements(const Index& index, hnswlib::tableint id);
+
+  size_t size() const { return ids_.size(); }
+
+ private:
+  absl::flat_hash_map<hnswlib::labeltype, hnswlib::tableint> ids_;
+};
+
+}  // namespace vectorlite
@@ -0,0 +1,114 @@
+#include "rowid_map.h"
+
+#include <optional>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hnswlib/hnswlib.h"
+
+namespace {
+
+class RowidMapTest : public testing::Test {
+ protected:
+  static constexpr size_t kDim = 4;
+
+  RowidMapTest() : space_(kDim), index_(&space_, 100, 16, 200, 100, true) {}
+
+  void AddPoint(hnswlib::labeltype rowid) {
+    std::vector<float> data(kDim, static_cast<float>(rowid));
+    index_.addPoint(data.data(), rowid, true);
+  }
+
+  hnswlib::L2Space space_;
+  hnswlib::HierarchicalNSW<float> index_;
+  vectorlite::RowidMap rowid_map_;
+};
+
+}  // namespace
+
+TEST_F(RowidMapTest, ShouldFindInsertedRowids) {
+  rowid_map_.Insert(42, 0);
+  rowid_map_.Insert(1ULL << 40, 1);
+  EXPECT_EQ(0, rowid_map_.Find(42));
+  EXPECT_EQ(1, rowid_map_.Find(1ULL << 40));
+  EXPECT_EQ(std::nullopt, rowid_map_.Find(43));
+
+  rowid_map_.Insert(42, 2);
+  EXPECT_EQ(2, rowid_map_.Find(42));
+  EXPECT_EQ(2, rowid_map_.size());
+}
+
+TEST_F(RowidMapTest, EraseShouldOnlyRemoveRowidMappedToId) {
+  rowid_map_.Insert(42, 0);
+  rowid_map_.Erase(42, 1);
+  EXPECT_EQ(0, rowid_map_.Find(42));
+  rowid_map_.Erase(42, 0);
+  EXPECT_EQ(std::nullopt, rowid_map_.Find(42));
+}
+
+TEST_F(RowidMapTest, FindLiveShouldSkipDeletedElements) {
+  for (hnswlib::labeltype rowid = 10; rowid < 20; rowid++) {
+    AddPoint(rowid);
+  }
+  rowid_map_.Rebuild(index_);
+  index_.markDeletedInternal(*rowid_map_.Find(15));
+  EXPECT_EQ(std::nullopt, rowid_map_.FindLive(index_, 15));
+  EXPECT_EQ(rowid_map_.Find(16), rowid_map_.FindLive(index_, 16));
+}
+
+TEST_F(RowidMapTest, RebuildShouldMapLabelsAndReleaseLabelLookup) {
+  for (hnswlib::labeltype rowid = 10; rowid < 20; rowid++) {
+    AddPoint(rowid);
+  }
+  index_.markDelete(15);
+  // Element 15 is reused for row 20.
+  AddPoint(20);
+  index_.markDelete(16);
+
+  rowid_map_.Rebuild(index_);
+  EXPECT_TRUE(index_.label_lookup_.empty());
+  EXPECT_EQ(10, rowid_map_.size());
+  EXPECT_EQ(std::nullopt, rowid_map_.Find(15));
+  for (hnswlib::labeltype rowid = 10; rowid <= 20; rowid++) {
+    if (rowid != 15) {
+      auto id = rowid_map_.Find(rowid);
+      ASSERT_TRUE(id.has_value());
+      EXPECT_EQ(rowid, index_.getExternalLabel(*id));
+    }
+  }
+  EXPECT_EQ(std::nullopt, rowid_map_.FindLive(index_, 16));
+}
+
+TEST_F(RowidMapTest, RebuildShouldPreferElementsNotDeleted) {
+  // Labels are duplicated when a deleted row is inserted again without
+  // replacing its element.
+  std::vector<float> data(kDim);
+  for (hnswlib::labeltype rowid = 0; rowid < 3; rowid++) {
+    index_.addPoint(data.data(), rowid);
+  }
+  index_.markDeletedInternal(1);
+  index_.setExternalLabel(2, 1);
+  index_.markDeletedInternal(0);
+  index_.setExternalLabel(0, 1);
+
+  rowid_map_.Rebuild(index_);
+  EXPECT_EQ(1, rowid_map_.size());
+  EXPECT_EQ(2, rowid_map_.Find(1));
+}
+
+TEST_F(RowidMapTest, CountRowElementsShouldCountElementsOfTheRow) {
+  for (hnswlib::labeltype rowid = 0; rowid < 6; rowid++) {
+    AddPoint(rowid);
+  }
+  // Row 7 has 3 vectors. Row 8 had 2 vectors, was deleted and then inserted
+  // again with 1 vector.
+  for (hnswlib::tableint id = 0; id < 6; id++) {
+    index_.setExternalLabel(id, id < 3 ? 7 : 8);
+  }
+  index_.markDeletedInternal(3);
+  index_.markDeletedInternal(4);
+  EXPECT_EQ(3, vectorlite::RowidMap::CountRowElements(index_, 0));
+  EXPECT_EQ(2, vectorlite::RowidMap::CountRowElements(index_, 1));
+  EXPECT_EQ(2, vectorlite::RowidMap::CountRowElements(index_, 3));
+  EXPECT_EQ(1, vectorlite::RowidMap::CountRowElements(index_, 5));
+}
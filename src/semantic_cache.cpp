@@ -0,0 +1,85 @@
+#include "semantic_cache.h"
+
+#include <algorithm>
+#include <string_view>
+
+#include "macros.h"
+
+namespace vectorlite {
+
+SemanticCache::SemanticCache(size_t capacity, float epsilon,
+                             hnswlib::SpaceInterface<float>& space)
+    : capacity_(capacity),
+      epsilon_(epsilon),
+      dim_(space.get_data_size() / sizeof(float)),
+      dist_func_(space.get_dist_func()),
+      dist_func_param_(space.get_dist_func_param()) {
+  VECTORLITE_ASSERT(capacity_ > 0);
+  VECTORLITE_ASSERT(epsilon_ >= 0);
+  entries_.reserve(capacity_);
+}
+
+bool SemanticCache::Lookup(std::string_view params, const float* query,
+                           Result& result) {
+  clock_++;
+  Entry* nearest = nullptr;
+  float nearest_dist = epsilon_;
+  for (auto& entry : entries_) {
+    if (entry.generation != generation_ || entry.params != params) {
+      continue;
+    }
+    float dist = dist_func_(query, entry.query.data(), dist_func_param_);
+    stats_.lookup_distance_computations++;
+    if (dist <= nearest_dist) {
+      nearest_dist = dist;
+      nearest = &entry;
+    }
+  }
+
+  if (nearest == nullptr) {
+    stats_.misses++;
+    return false;
+  }
+
+  nearest->last_used = clock_;
+  result.assign(nearest->result.begin(), nearest->result.end());
+  stats_.hits++;
+  stats_.saved_distance_computations += nearest->distance_computations;
+  return true;
+}
+
+void SemanticCache::Insert(std::string_view params, const float* query,
+                           const Result& result,
+                           uint64_t distance_computations) {
+  clock_++;
+  Entry* entry = nullptr;
+  if (entries_.size() < capacity_) {
+    entry = &entries_.emplace_back();
+  } else {
+    // Stale entries are replaced first, then the least recently used one.
+    entry = &*std::min_element(
+        entries_.begin(), entries_.end(),
+        [this](const Entry& a, const Entry& b) {
+          bool a_stale = a.generation != generation_;
+          bool b_stale = b.generation != generation_;
+          if (a_stale != b_stale) {
+            return a_stale;
+          }
+          return a.last_used < b.last_used;
+        });
+  }
+
+  entry->params.assign(params.data(), params.size());
+  entry->query.assign(query, query + dim_);
+  entry->result.assign(result.begin(), result.end());
+  entry->distance_computations = distance_computations;
+  entry->generation = generation_;
+  entry->last_used = clock_;
+}
+
+void SemanticCache::Invalidate() {
+  generation_++;
+  stats_.invalidations++;
+}
+
+}  // namespace vectorlite
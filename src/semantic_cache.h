@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "hnswlib/hnswlib.h"
+
+namespace vectorlite {
+
+// An approximate cache of query results. Unlike ResultCache, a query hits the
+// cache if its vector is within epsilon of a cached query vector, as long as
+// the other query parameters (k, ef, rowid filters, ...) are the same.
+// Cached query vectors are kept in a small flat index which is scanned
+// linearly on lookup, so capacity should be small, e.g. less than 1000.
+// Writes to the index invalidate all entries by bumping a generation number.
+// Not thread-safe. A virtual table is only accessed by one thread at a time.
+class SemanticCache {
+ public:
+  using Result = std::vector<std::pair<float, hnswlib::labeltype>>;
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t invalidations = 0;
+    // Distance computations done by lookups, i.e. the cost of the cache.
+    uint64_t lookup_distance_computations = 0;
+    // Distance computations that the searches served from cache would have
+    // done.
+    uint64_t saved_distance_computations = 0;
+  };
+
+  // capacity must be greater than 0 and epsilon must not be negative.
+  // Query vectors are compared with space's distance function, so epsilon is
+  // in the same unit as the distance returned by knn_search(). space must
+  // outlive the cache.
+  SemanticCache(size_t capacity, float epsilon,
+                hnswlib::SpaceInterface<float>& space);
+
+  SemanticCache(const SemanticCache&) = delete;
+  SemanticCache& operator=(const SemanticCache&) = delete;
+
+  // params encodes all query parameters except the query vector.
+  // If a valid entry with the same params has a query vector within epsilon of
+  // query, copies the result of the nearest such entry into result and returns
+  // true.
+  bool Lookup(std::string_view params, const float* query, Result& result);
+
+  // Caches result for (params, query). distance_computations is the number of
+  // distance computations done to produce result. Once the cache is full, the
+  // least recently used entry is replaced.
+  void Insert(std::string_view params, const float* query,
+              const Result& result, uint64_t distance_computations);
+
+  // Invalidates all cached results. Should be called whenever the index
+  // changes.
+  void Invalidate();
+
+  size_t capacity() const { return capacity_; }
+
+  // Number of entries including stale ones.
+  size_t size() const { return entries_.size(); }
+
+  float epsilon() const { return epsilon_; }
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Entry {
+    std::string params;
+    std::vector<float> query;
+    Result result;
+    uint64_t distance_computations;
+    uint64_t generation;
+    uint64_t last_used;
+  };
+
+  size_t capacity_;
+  float epsilon_;
+  size_t dim_;
+  hnswlib::DISTFUNC<float> dist_func_;
+  void* dist_func_param_;
+  uint64_t generation_ = 0;
+  // Incremented on every lookup and insert to track recency.
+  uint64_t clock_ = 0;
+  std::vector<Entry> entries_;
+  Stats stats_;
+};
+
+}  // namespace vectorlite
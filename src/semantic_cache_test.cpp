@@ -0,0 +1,65 @@
+#include "semantic_cache.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "hnswlib/hnswlib.h"
+
+TEST(SemanticCache, ShouldReturnResultOfNearbyQuery) {
+  hnswlib::L2Space space(2);
+  vectorlite::SemanticCache cache(4, 0.01f, space);
+  vectorlite::SemanticCache::Result result;
+  std::vector<float> query = {1.0f, 1.0f};
+  EXPECT_FALSE(cache.Lookup("k=10", query.data(), result));
+
+  cache.Insert("k=10", query.data(), {{0.5f, 1}}, 100);
+  std::vector<float> nearby = {1.05f, 1.0f};
+  ASSERT_TRUE(cache.Lookup("k=10", nearby.data(), result));
+  EXPECT_EQ(1, result[0].second);
+
+  // Different params or a faraway query miss.
+  EXPECT_FALSE(cache.Lookup("k=5", nearby.data(), result));
+  std::vector<float> faraway = {1.5f, 1.0f};
+  EXPECT_FALSE(cache.Lookup("k=10", faraway.data(), result));
+
+  EXPECT_EQ(1, cache.stats().hits);
+  EXPECT_EQ(3, cache.stats().misses);
+  EXPECT_EQ(100, cache.stats().saved_distance_computations);
+  EXPECT_EQ(2, cache.stats().lookup_distance_computations);
+}
+
+TEST(SemanticCache, ShouldReturnNearestCachedQuery) {
+  hnswlib::L2Space space(1);
+  vectorlite::SemanticCache cache(4, 1.0f, space);
+  vectorlite::SemanticCache::Result result;
+  std::vector<float> a = {0.0f};
+  std::vector<float> b = {0.5f};
+  cache.Insert("", a.data(), {{0.0f, 1}}, 1);
+  cache.Insert("", b.data(), {{0.0f, 2}}, 1);
+
+  std::vector<float> query = {0.4f};
+  ASSERT_TRUE(cache.Lookup("", query.data(), result));
+  EXPECT_EQ(2, result[0].second);
+}
+
+TEST(SemanticCache, ShouldReplaceStaleThenLeastRecentlyUsed) {
+  hnswlib::L2Space space(1);
+  vectorlite::SemanticCache cache(2, 0.0f, space);
+  vectorlite::SemanticCache::Result result;
+  std::vector<float> a = {0.0f};
+  std::vector<float> b = {1.0f};
+  std::vector<float> c = {2.0f};
+  cache.Insert("", a.data(), {{0.0f, 1}}, 1);
+  cache.Insert("", b.data(), {{0.0f, 2}}, 1);
+  ASSERT_TRUE(cache.Lookup("", a.data(), result));
+  cache.Insert("", c.data(), {{0.0f, 3}}, 1);
+
+  EXPECT_EQ(2, cache.size());
+  EXPECT_TRUE(cache.Lookup("", a.data(), result));
+  EXPECT_FALSE(cache.Lookup("", b.data(), result));
+  EXPECT_TRUE(cache.Lookup("", c.data(), result));
+
+  cache.Invalidate();
+  EXPECT_FALSE(cache.Lookup("", a.data(), result));
+  EXPECT_EQ(1, cache.stats().invalidations);
+}
@@ -2,13 +2,21 @@
 
 #include <sqlite3ext.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_format.h"
 #include "util.h"
+#include "macros.h"
+#include "trace.h"
 #include "vector.h"
+#include "vector_ops.h"
 #include "vector_space.h"
 #include "version.h"
 
@@ -154,4 +162,257 @@ void VectorToJson(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
   return;
 }
 
+namespace {
+
+// A float32 vector read from a BLOB argument. It points to the BLOB's memory,
+// unless the BLOB isn't aligned for floats, in which case it's copied.
+class BlobVector {
+ public:
+  // Returns false if arg isn't a BLOB whose size is a multiple of 4.
+  bool Read(sqlite3_value *arg) {
+    if (sqlite3_value_type(arg) != SQLITE_BLOB) {
+      return false;
+    }
+    const void *blob = sqlite3_value_blob(arg);
+    size_t size = sqlite3_value_bytes(arg);
+    if (size % sizeof(float) != 0) {
+      return false;
+    }
+    dim_ = size / sizeof(float);
+    if (reinterpret_cast<uintptr_t>(blob) % alignof(float) == 0) {
+      data_ = static_cast<const float *>(blob);
+    } else {
+      copy_.resize(dim_);
+      std::memcpy(copy_.data(), blob, size);
+      data_ = copy_.data();
+    }
+    return true;
+  }
+
+  const float *data() const { return data_; }
+  size_t dim() const { return dim_; }
+
+ private:
+  const float *data_ = nullptr;
+  size_t dim_ = 0;
+  std::vector<float> copy_;
+};
+
+// Reads the vectors of argv[0..n) into vectors. Reports an error to ctx and
+// returns false if one of them isn't a vector.
+bool ReadVectors(sqlite3_context *ctx, const char *function,
+                 sqlite3_value **argv, size_t n, BlobVector *vectors) {
+  for (size_t i = 0; i < n; i++) {
+    if (!vectors[i].Read(argv[i])) {
+      std::string err = absl::StrFormat(
+          "%s expects vectors of type blob whose size is a multiple of 4",
+          function);
+      sqlite3_result_error(ctx, err.c_str(), -1);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Same as ReadVectors() for 2 vectors of the same dimension.
+bool ReadVectorPair(sqlite3_context *ctx, const char *function,
+                    sqlite3_value **argv, BlobVector *vectors) {
+  if (!ReadVectors(ctx, function, argv, 2, vectors)) {
+    return false;
+  }
+  if (vectors[0].dim() != vectors[1].dim()) {
+    std::string err = absl::StrFormat(
+        "%s expects vectors of the same dimension, got %d and %d", function,
+        vectors[0].dim(), vectors[1].dim());
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return false;
+  }
+  return true;
+}
+
+// Allocates the result of a function returning a vector of size bytes,
+// which must be passed to SetResultVector(). Reports an error to ctx and
+// returns nullptr if out of memory.
+void *AllocResultVector(sqlite3_context *ctx, size_t size) {
+  // sqlite3_malloc64(0) returns nullptr.
+  void *result = sqlite3_malloc64(std::max<size_t>(size, 1));
+  if (!result) {
+    sqlite3_result_error_nomem(ctx);
+  }
+  return result;
+}
+
+// Hands result over to SQLite, which frees it.
+void SetResultVector(sqlite3_context *ctx, void *result, size_t size) {
+  sqlite3_result_blob64(ctx, result, size, sqlite3_free);
+}
+
+void VectorBinaryOp(sqlite3_context *ctx, sqlite3_value **argv,
+                    const char *function,
+                    void (*op)(const float *, const float *, size_t, float *)) {
+  BlobVector vectors[2];
+  if (!ReadVectorPair(ctx, function, argv, vectors)) {
+    return;
+  }
+  size_t size = vectors[0].dim() * sizeof(float);
+  float *result = static_cast<float *>(AllocResultVector(ctx, size));
+  if (!result) {
+    return;
+  }
+  op(vectors[0].data(), vectors[1].data(), vectors[0].dim(), result);
+  SetResultVector(ctx, result, size);
+}
+
+}  // namespace
+
+void VectorAdd(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  VECTORLITE_ASSERT(argc == 2);
+  VectorBinaryOp(ctx, argv, "vector_add", AddVectors);
+}
+
+void VectorSub(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  VECTORLITE_ASSERT(argc == 2);
+  VectorBinaryOp(ctx, argv, "vector_sub", SubtractVectors);
+}
+
+void VectorScale(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  VECTORLITE_ASSERT(argc == 2);
+  BlobVector vector;
+  if (!ReadVectors(ctx, "vector_scale", argv, 1, &vector)) {
+    return;
+  }
+  if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER &&
+      sqlite3_value_type(argv[1]) != SQLITE_FLOAT) {
+    sqlite3_result_error(ctx, "vector_scale expects a numeric factor", -1);
+    return;
+  }
+  float factor = static_cast<float>(sqlite3_value_double(argv[1]));
+  size_t size = vector.dim() * sizeof(float);
+  float *result = static_cast<float *>(AllocResultVector(ctx, size));
+  if (!result) {
+    return;
+  }
+  ScaleVector(vector.data(), factor, vector.dim(), result);
+  SetResultVector(ctx, result, size);
+}
+
+void VectorDot(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  VECTORLITE_ASSERT(argc == 2);
+  BlobVector vectors[2];
+  if (!ReadVectorPair(ctx, "vector_dot", argv, vectors)) {
+    return;
+  }
+  sqlite3_result_double(ctx, DotProduct(vectors[0].data(), vectors[1].data(),
+                                        vectors[0].dim()));
+}
+
+void VectorNorm(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  VECTORLITE_ASSERT(argc == 1);
+  BlobVector vector;
+  if (!ReadVectors(ctx, "vector_norm", argv, 1, &vector)) {
+    return;
+  }
+  sqlite3_result_double(ctx, L2Norm(vector.data(), vector.dim()));
+}
+
+void VectorSlice(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  if (argc != 2 && argc != 3) {
+    std::string err = absl::StrFormat(
+        "vector_slice expects 2 or 3 arguments but %d provided", argc);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  BlobVector vector;
+  if (!ReadVectors(ctx, "vector_slice", argv, 1, &vector)) {
+    return;
+  }
+  if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER ||
+      (argc == 3 && sqlite3_value_type(argv[2]) != SQLITE_INTEGER)) {
+    sqlite3_result_error(ctx, "vector_slice expects start and end of type int",
+                         -1);
+    return;
+  }
+  sqlite3_int64 dim = static_cast<sqlite3_int64>(vector.dim());
+  sqlite3_int64 start = sqlite3_value_int64(argv[1]);
+  sqlite3_int64 end = argc == 3 ? sqlite3_value_int64(argv[2]) : dim;
+  if (start < 0 || start > end || end > dim) {
+    std::string err = absl::StrFormat(
+        "vector_slice expects 0 <= start <= end <= dimension(%d), got start "
+        "%d and end %d",
+        dim, start, end);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  size_t size = (end - start) * sizeof(float);
+  void *result = AllocResultVector(ctx, size);
+  if (!result) {
+    return;
+  }
+  if (size > 0) {
+    std::memcpy(result, vector.data() + start, size);
+  }
+  SetResultVector(ctx, result, size);
+}
+
+void VectorConcat(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  if (argc < 1) {
+    sqlite3_result_error(ctx, "vector_concat expects at least 1 argument", -1);
+    return;
+  }
+  // The BLOBs are copied byte by byte, so they don't need to be aligned.
+  size_t size = 0;
+  for (int i = 0; i < argc; i++) {
+    if (sqlite3_value_type(argv[i]) != SQLITE_BLOB ||
+        sqlite3_value_bytes(argv[i]) % sizeof(float) != 0) {
+      sqlite3_result_error(ctx,
+                           "vector_concat expects vectors of type blob whose "
+                           "size is a multiple of 4",
+                           -1);
+      return;
+    }
+    size += sqlite3_value_bytes(argv[i]);
+  }
+  char *result = static_cast<char *>(AllocResultVector(ctx, size));
+  if (!result) {
+    return;
+  }
+  size_t offset = 0;
+  for (int i = 0; i < argc; i++) {
+    size_t bytes = sqlite3_value_bytes(argv[i]);
+    if (bytes > 0) {
+      std::memcpy(result + offset, sqlite3_value_blob(argv[i]), bytes);
+    }
+    offset += bytes;
+  }
+  SetResultVector(ctx, result, size);
+}
+
+void ConfigureTrace(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  VECTORLITE_ASSERT(argc == 1);
+#ifndef VECTORLITE_ENABLE_TRACING
+  sqlite3_result_error(
+      ctx, "vectorlite_trace is unavailable: built without tracing", -1);
+#else
+  int type = sqlite3_value_type(argv[0]);
+  if (type != SQLITE_TEXT && type != SQLITE_NULL) {
+    sqlite3_result_error(ctx, "vectorlite_trace expects a path or NULL", -1);
+    return;
+  }
+  size_t num_written = StopTrace();
+  if (type == SQLITE_TEXT) {
+    std::string path(
+        reinterpret_cast<const char *>(sqlite3_value_text(argv[0])),
+        sqlite3_value_bytes(argv[0]));
+    auto status = StartTrace(path);
+    if (!status.ok()) {
+      std::string err = absl::StrFormat("Failed to start trace: %s",
+                                        status.message());
+      sqlite3_result_error(ctx, err.c_str(), -1);
+      return;
+    }
+  }
+  sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(num_written));
+#endif
+}
+
 }  // namespace vectorlite
\ No newline at end of file
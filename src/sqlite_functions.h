@@ -16,4 +16,32 @@ void VectorFromJson(sqlite3_context* ctx, int argc, sqlite3_value** argv);
 
 void VectorToJson(sqlite3_context* ctx, int argc, sqlite3_value** argv);
 
+// Arithmetic on float32 vector BLOBs, computed on the BLOBs' memory without
+// parsing them into Vectors. Vectors returned are written into a single buffer
+// handed over to SQLite.
+// vector_add(a, b) and vector_sub(a, b) return a + b and a - b.
+void VectorAdd(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+void VectorSub(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+
+// vector_scale(v, factor) returns v * factor.
+void VectorScale(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+
+// vector_dot(a, b) returns the dot product of a and b.
+void VectorDot(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+
+// vector_norm(v) returns the L2 norm of v.
+void VectorNorm(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+
+// vector_slice(v, start, end) returns elements [start, end) of v. end is
+// optional and defaults to the dimension of v.
+void VectorSlice(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+
+// vector_concat(v1, v2, ...) returns the elements of all vectors in order.
+void VectorConcat(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+
+// vectorlite_trace(path) starts tracing vectorlite to the file at path, see
+// StartTrace(). vectorlite_trace(NULL) stops tracing. Either way the running
+// trace is stopped first and the number of spans written to it is returned.
+void ConfigureTrace(sqlite3_context* ctx, int argc, sqlite3_value** argv);
+
 }  // namespace vectorlite
\ No newline at end of file
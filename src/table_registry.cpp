@@ -0,0 +1,40 @@
+#include "table_registry.h"
+
+#include <string>
+#include <string_view>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+
+namespace vectorlite {
+
+static std::string MakeKey(std::string_view schema, std::string_view table) {
+  return absl::AsciiStrToLower(absl::StrCat(schema, ".", table));
+}
+
+void TableRegistry::Register(std::string_view schema, std::string_view table,
+                             VirtualTable* vtab) {
+  tables_[MakeKey(schema, table)] = vtab;
+}
+
+void TableRegistry::Unregister(std::string_view schema,
+                               std::string_view table) {
+  tables_.erase(MakeKey(schema, table));
+}
+
+VirtualTable* TableRegistry::Find(std::string_view name) const {
+  if (name.find('.') != std::string_view::npos) {
+    auto it = tables_.find(absl::AsciiStrToLower(name));
+    return it == tables_.end() ? nullptr : it->second;
+  }
+
+  for (std::string_view schema : {"main", "temp"}) {
+    auto it = tables_.find(MakeKey(schema, name));
+    if (it != tables_.end()) {
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace vectorlite
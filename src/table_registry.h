@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace vectorlite {
+
+class VirtualTable;
+
+// Tracks the vectorlite virtual tables of a database connection by name, so
+// that SQL functions like vectorlite_stats() can find them.
+// Each connection that loads vectorlite has its own registry. Like the
+// connection itself, it is used by one thread at a time.
+class TableRegistry {
+ public:
+  // schema is the name of the database that holds the table, e.g. "main".
+  void Register(std::string_view schema, std::string_view table,
+                VirtualTable* vtab);
+
+  void Unregister(std::string_view schema, std::string_view table);
+
+  // name is either "table" or "schema.table". A table without schema is
+  // looked up in "main" first, then in "temp".
+  // Returns nullptr if not found.
+  VirtualTable* Find(std::string_view name) const;
+
+ private:
+  // Keyed by lower-cased "schema.table", because sqlite table names are
+  // case-insensitive.
+  absl::flat_hash_map<std::string, VirtualTable*> tables_;
+};
+
+}  // namespace vectorlite
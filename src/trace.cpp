@@ -0,0 +1,256 @@
+#include "trace.h"
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_format.h"
+
+namespace vectorlite {
+
+namespace internal {
+std::atomic<bool> trace_enabled{false};
+}  // namespace internal
+
+TraceRing::TraceRing(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  slots_ = std::make_unique<Slot[]>(size);
+  mask_ = size - 1;
+  for (size_t i = 0; i < size; i++) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool TraceRing::TryPush(const TraceEvent& event) {
+  size_t pos = push_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot& slot = slots_[pos & mask_];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<std::ptrdiff_t>(sequence) -
+                static_cast<std::ptrdiff_t>(pos);
+    if (diff == 0) {
+      // The slot is free, claim it.
+      if (push_pos_.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        slot.event = event;
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // The slot still holds the event pushed one lap ago.
+      return false;
+    } else {
+      // Another thread claimed the slot first.
+      pos = push_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool TraceRing::TryPop(TraceEvent* event) {
+  Slot& slot = slots_[pop_pos_ & mask_];
+  if (slot.sequence.load(std::memory_order_acquire) != pop_pos_ + 1) {
+    return false;
+  }
+  *event = slot.event;
+  // Frees the slot for the push one lap later.
+  slot.sequence.store(pop_pos_ + mask_ + 1, std::memory_order_release);
+  pop_pos_++;
+  return true;
+}
+
+namespace {
+
+// About 2.5MB, which holds the spans of 50ms even at a million spans/second.
+constexpr size_t kRingCapacity = 1 << 16;
+constexpr auto kFlushInterval = std::chrono::milliseconds(50);
+
+void AppendInt(int64_t value, std::string& out) {
+  char digits[20];
+  auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+  out.append(digits, end);
+}
+
+// Chrome's trace event format counts in microseconds. Formats by hand, as
+// formatting floats is several times slower, which matters when the writer
+// shares a core with the traced threads.
+void AppendMicroseconds(int64_t ns, std::string& out) {
+  AppendInt(ns / 1000, out);
+  int64_t fraction = ns % 1000;
+  char decimals[4] = {'.', static_cast<char>('0' + fraction / 100),
+                      static_cast<char>('0' + fraction / 10 % 10),
+                      static_cast<char>('0' + fraction % 10)};
+  out.append(decimals, sizeof(decimals));
+}
+
+uint32_t CurrentThreadId() {
+  static std::atomic<uint32_t> next_thread_id{1};
+  thread_local uint32_t thread_id =
+      next_thread_id.fetch_add(1, std::memory_order_relaxed);
+  return thread_id;
+}
+
+// A running trace, whose spans are written to file by writer.
+struct TraceFile {
+  std::ofstream file;
+  int64_t start_ns = 0;
+  size_t num_written = 0;
+  std::mutex mutex;
+  std::condition_variable stop_requested;
+  bool stopping = false;
+  std::thread writer;
+};
+
+class Tracer {
+ public:
+  static Tracer& Get() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  ~Tracer() { Stop(); }
+
+  absl::Status Start(const std::filesystem::path& path, int64_t now_ns);
+
+  size_t Stop();
+
+  void Push(const TraceEvent& event) {
+    if (!ring_.TryPush(event)) {
+      num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  // Writes the spans in ring_ to trace_.
+  void Drain();
+
+  void Write();
+
+  TraceRing ring_{kRingCapacity};
+  std::atomic<size_t> num_dropped_{0};
+  // Serializes Start() and Stop().
+  std::mutex control_mutex_;
+  std::unique_ptr<TraceFile> trace_;
+};
+
+absl::Status Tracer::Start(const std::filesystem::path& path, int64_t now_ns) {
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  auto trace = std::make_unique<TraceFile>();
+  trace->file.open(path, std::ios::trunc);
+  if (!trace->file) {
+    return absl::InternalError(
+        absl::StrFormat("Failed to open %s for writing", path.string()));
+  }
+  trace->file << "[";
+  trace->start_ns = now_ns;
+
+  // Spans of a previous trace that ended after it stopped are discarded.
+  TraceEvent event;
+  while (ring_.TryPop(&event)) {
+  }
+  num_dropped_.store(0, std::memory_order_relaxed);
+
+  trace_ = std::move(trace);
+  trace_->writer = std::thread(&Tracer::Write, this);
+  internal::trace_enabled.store(true, std::memory_order_relaxed);
+  return absl::OkStatus();
+}
+
+size_t Tracer::Stop() {
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  if (!trace_) {
+    return 0;
+  }
+  internal::trace_enabled.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> trace_lock(trace_->mutex);
+    trace_->stopping = true;
+  }
+  trace_->stop_requested.notify_one();
+  trace_->writer.join();
+
+  size_t num_dropped = num_dropped_.load(std::memory_order_relaxed);
+  if (num_dropped > 0) {
+    trace_->file << absl::StrFormat(
+        "%s\n{\"name\":\"dropped_spans\",\"ph\":\"C\",\"pid\":1,\"ts\":0,"
+        "\"args\":{\"count\":%d}}",
+        trace_->num_written > 0 ? "," : "", num_dropped);
+  }
+  trace_->file << "\n]\n";
+  trace_->file.close();
+  size_t num_written = trace_->num_written;
+  trace_.reset();
+  return num_written;
+}
+
+void Tracer::Drain() {
+  std::string buffer;
+  TraceEvent event;
+  while (ring_.TryPop(&event)) {
+    if (event.start_ns < trace_->start_ns) {
+      continue;
+    }
+    buffer += trace_->num_written > 0 ? ",\n{\"name\":\"" : "\n{\"name\":\"";
+    buffer += event.name;
+    buffer += "\",\"cat\":\"vectorlite\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+    AppendInt(event.thread_id, buffer);
+    buffer += ",\"ts\":";
+    AppendMicroseconds(event.start_ns - trace_->start_ns, buffer);
+    buffer += ",\"dur\":";
+    AppendMicroseconds(event.duration_ns, buffer);
+    buffer += "}";
+    trace_->num_written++;
+  }
+  trace_->file << buffer;
+}
+
+void Tracer::Write() {
+  std::unique_lock<std::mutex> lock(trace_->mutex);
+  while (true) {
+    bool stopping = trace_->stopping;
+    lock.unlock();
+    Drain();
+    lock.lock();
+    if (stopping) {
+      return;
+    }
+    trace_->stop_requested.wait_for(lock, kFlushInterval,
+                                    [this] { return trace_->stopping; });
+  }
+}
+
+}  // namespace
+
+absl::Status StartTrace(const std::filesystem::path& path) {
+  Tracer& tracer = Tracer::Get();
+  tracer.Stop();
+  return tracer.Start(path, TraceSpan::Now());
+}
+
+size_t StopTrace() { return Tracer::Get().Stop(); }
+
+int64_t TraceSpan::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void TraceSpan::End() {
+  int64_t end_ns = Now();
+  Tracer::Get().Push(
+      TraceEvent{name_, start_ns_, end_ns - start_ns_, CurrentThreadId()});
+}
+
+}  // namespace vectorlite
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+#include "absl/status/status.h"
+
+namespace vectorlite {
+
+// A span of time spent by one thread in a named part of vectorlite.
+struct TraceEvent {
+  // Must point to a string with static storage duration.
+  const char* name;
+  int64_t start_ns;
+  int64_t duration_ns;
+  uint32_t thread_id;
+};
+
+// A bounded lock-free queue of TraceEvents that any number of threads push to
+// and a single thread pops from. Pushing to a full ring fails instead of
+// waiting, so that tracing never blocks the traced code.
+class TraceRing {
+ public:
+  // capacity is rounded up to a power of 2.
+  explicit TraceRing(size_t capacity);
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Returns false if the ring is full. Thread-safe.
+  bool TryPush(const TraceEvent& event);
+
+  // Returns false if the ring is empty. Must only be called by one thread at a
+  // time.
+  bool TryPop(TraceEvent* event);
+
+ private:
+  struct Slot {
+    // Equals the position that may be pushed to the slot next while the slot
+    // is free, and that position + 1 once the event is pushed.
+    std::atomic<size_t> sequence;
+    TraceEvent event;
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> push_pos_{0};
+  alignas(64) size_t pop_pos_ = 0;
+};
+
+// Starts writing the TraceSpans of all threads to the file at path, in the
+// JSON array format of Chrome's trace event format, which can be viewed in
+// chrome://tracing or https://ui.perfetto.dev. A running trace is stopped
+// first. Spans are written by a background thread, spans that end while its
+// buffer is full are dropped.
+absl::Status StartTrace(const std::filesystem::path& path);
+
+// Stops the running trace, waits for its spans to be written and closes its
+// file. Returns the number of spans written, 0 if no trace is running.
+size_t StopTrace();
+
+namespace internal {
+extern std::atomic<bool> trace_enabled;
+}  // namespace internal
+
+inline bool TraceEnabled() {
+  return internal::trace_enabled.load(std::memory_order_relaxed);
+}
+
+// Records the time from its construction to its destruction as a span named
+// name, if a trace is running when it's constructed. Otherwise it costs a
+// relaxed atomic load.
+class TraceSpan {
+ public:
+  // name must point to a string with static storage duration.
+  explicit TraceSpan(const char* name)
+      : name_(name), start_ns_(TraceEnabled() ? Now() : -1) {}
+
+  ~TraceSpan() {
+    if (start_ns_ >= 0) {
+      End();
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  // Nanoseconds since the epoch of a steady clock.
+  static int64_t Now();
+
+ private:
+  void End();
+
+  const char* name_;
+  int64_t start_ns_;
+};
+
+}  // namespace vectorlite
+
+// Traces the rest of the enclosing scope as a span named name. Compiles to
+// nothing unless vectorlite is built with VECTORLITE_ENABLE_TRACING.
+#ifdef VECTORLITE_ENABLE_TRACING
+#define VECTORLITE_TRACE_CONCAT_INNER(a, b) a##b
+#define VECTORLITE_TRACE_CONCAT(a, b) VECTORLITE_TRACE_CONCAT_INNER(a, b)
+#define VECTORLITE_TRACE_SPAN(name)                                       \
+  ::vectorlite::TraceSpan VECTORLITE_TRACE_CONCAT(vectorlite_trace_span_, \
+                                                  __LINE__)(name)
+#else
+#define VECTORLITE_TRACE_SPAN(name) ((void)0)
+#endif
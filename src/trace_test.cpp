@@ -0,0 +1,100 @@
+#include "trace.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(TraceRing, ShouldPopEventsInPushOrder) {
+  vectorlite::TraceRing ring(3);
+  EXPECT_EQ(4, ring.capacity());
+  vectorlite::TraceEvent event;
+  EXPECT_FALSE(ring.TryPop(&event));
+
+  // Go around the ring a few times.
+  for (int64_t lap = 0; lap < 3; lap++) {
+    for (int64_t i = 0; i < 4; i++) {
+      EXPECT_TRUE(ring.TryPush({"span", lap * 4 + i, 0, 0}));
+    }
+    EXPECT_FALSE(ring.TryPush({"span", 0, 0, 0}));
+    for (int64_t i = 0; i < 4; i++) {
+      ASSERT_TRUE(ring.TryPop(&event));
+      EXPECT_EQ(lap * 4 + i, event.start_ns);
+    }
+    EXPECT_FALSE(ring.TryPop(&event));
+  }
+}
+
+TEST(TraceRing, ShouldNotLoseEventsOfConcurrentPushes) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumEventsPerThread = 10000;
+  vectorlite::TraceRing ring(256);
+  std::vector<std::thread> producers;
+  for (int t = 0; t < kNumThreads; t++) {
+    producers.emplace_back([&ring, t]() {
+      for (int i = 0; i < kNumEventsPerThread; i++) {
+        while (!ring.TryPush({"span", i, 0, static_cast<uint32_t>(t)})) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // Events of each thread arrive in the order they were pushed.
+  std::vector<int64_t> next(kNumThreads, 0);
+  int num_popped = 0;
+  vectorlite::TraceEvent event;
+  while (num_popped < kNumThreads * kNumEventsPerThread) {
+    if (ring.TryPop(&event)) {
+      ASSERT_EQ(next[event.thread_id]++, event.start_ns);
+      num_popped++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_FALSE(ring.TryPop(&event));
+}
+
+TEST(Trace, ShouldWriteSpansOfRunningTraceOnly) {
+  auto path = std::filesystem::temp_directory_path() /
+              "vectorlite_trace_test.json";
+  { vectorlite::TraceSpan span("before"); }
+  EXPECT_EQ(0, vectorlite::StopTrace());
+
+  ASSERT_TRUE(vectorlite::StartTrace(path).ok());
+  EXPECT_TRUE(vectorlite::TraceEnabled());
+  {
+    vectorlite::TraceSpan outer("outer");
+    std::thread([]() { vectorlite::TraceSpan inner("inner"); }).join();
+  }
+  EXPECT_EQ(2, vectorlite::StopTrace());
+  EXPECT_FALSE(vectorlite::TraceEnabled());
+  { vectorlite::TraceSpan span("after"); }
+  EXPECT_EQ(0, vectorlite::StopTrace());
+
+  std::ifstream file(path);
+  std::string json((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  EXPECT_EQ('[', json.front());
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"outer\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"inner\""));
+  EXPECT_EQ(std::string::npos, json.find("before"));
+  EXPECT_EQ(std::string::npos, json.find("after"));
+  EXPECT_EQ("]\n", json.substr(json.size() - 2));
+  std::filesystem::remove(path);
+}
+
+TEST(Trace, ShouldFailToStartWithUnwritablePath) {
+  auto path = std::filesystem::temp_directory_path() /
+              "vectorlite_missing_dir" / "trace.json";
+  EXPECT_EQ(absl::StatusCode::kInternal,
+            vectorlite::StartTrace(path).code());
+  EXPECT_FALSE(vectorlite::TraceEnabled());
+}
@@ -4,8 +4,6 @@
 #include <string_view>
 #include <utility>
 
-#include "hnswlib/hnswlib.h"
-
 namespace vectorlite {
 
 // Tests whether the given string is a valid column name in SQLite.
@@ -22,7 +20,4 @@ bool IsValidColumnName(std::string_view name);
 // e.g. SSE, AVX, AVX512
 std::optional<std::string_view> DetectSIMD();
 
-bool IsRowidInIndex(const hnswlib::HierarchicalNSW<float>& index,
-                    hnswlib::labeltype rowid);
-
 }  // end namespace vectorlite
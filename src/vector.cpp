@@ -94,10 +94,16 @@ std::string_view Vector::ToBlob() const {
                           data_.size() * sizeof(float));
 }
 
+Vector Vector::Normalize() const {
+  std::vector<float> normalized;
+  NormalizeTo(normalized);
+  return Vector(std::move(normalized));
+}
+
 // Implementation follows
 // https://github.com/nmslib/hnswlib/blob/v0.8.0/python_bindings/bindings.cpp#L241
-Vector Vector::Normalize() const {
-  std::vector<float> normalized(data_.size());
+void Vector::NormalizeTo(std::vector<float>& normalized) const {
+  normalized.resize(data_.size());
   float norm = 0.0f;
   for (float data : data_) {
     norm += data * data;
@@ -106,7 +112,21 @@ Vector Vector::Normalize() const {
   for (int i = 0; i < data_.size(); i++) {
     normalized[i] = data_[i] * norm;
   }
-  return Vector(std::move(normalized));
+}
+
+void Vector::NormalizeEachTo(size_t dim, std::vector<float>& normalized) const {
+  VECTORLITE_ASSERT(dim > 0 && data_.size() % dim == 0);
+  normalized.resize(data_.size());
+  for (size_t begin = 0; begin < data_.size(); begin += dim) {
+    float norm = 0.0f;
+    for (size_t i = begin; i < begin + dim; i++) {
+      norm += data_[i] * data_[i];
+    }
+    norm = 1.0f / (sqrtf(norm) + 1e-30f);
+    for (size_t i = begin; i < begin + dim; i++) {
+      normalized[i] = data_[i] * norm;
+    }
+  }
 }
 
 }  // namespace vectorlite
\ No newline at end of file
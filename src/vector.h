@@ -36,6 +36,14 @@ class Vector {
 
   Vector Normalize() const;
 
+  // Same as Normalize() but writes the normalized data to normalized, reusing
+  // its memory.
+  void NormalizeTo(std::vector<float>& normalized) const;
+
+  // Like NormalizeTo(), but treats the vector as consecutive vectors of dim
+  // elements and normalizes each of them. dim must divide dim().
+  void NormalizeEachTo(size_t dim, std::vector<float>& normalized) const;
+
  private:
   std::vector<float> data_;
 };
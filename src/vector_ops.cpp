@@ -0,0 +1,56 @@
+#include "vector_ops.h"
+
+#include <cmath>
+#include <cstddef>
+
+namespace vectorlite {
+
+namespace {
+
+// Partial sums are accumulated in independent lanes, so that the loops can be
+// vectorized without reassociating floating point additions.
+constexpr size_t kLanes = 8;
+
+}  // namespace
+
+void AddVectors(const float* a, const float* b, size_t n, float* out) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+void SubtractVectors(const float* a, const float* b, size_t n, float* out) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = a[i] - b[i];
+  }
+}
+
+void ScaleVector(const float* a, float factor, size_t n, float* out) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = a[i] * factor;
+  }
+}
+
+float DotProduct(const float* a, const float* b, size_t n) {
+  float lanes[kLanes] = {};
+  size_t i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (size_t j = 0; j < kLanes; j++) {
+      lanes[j] += a[i + j] * b[i + j];
+    }
+  }
+  float sum = 0.0f;
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  for (size_t j = 0; j < kLanes; j++) {
+    sum += lanes[j];
+  }
+  return sum;
+}
+
+float L2Norm(const float* a, size_t n) {
+  return std::sqrt(DotProduct(a, a, n));
+}
+
+}  // namespace vectorlite
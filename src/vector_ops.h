@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+// Arithmetic on float32 vectors of n elements, used by the vector_* SQL
+// functions. Loops accumulate into independent lanes so that the compiler
+// vectorizes them with the SIMD instruction set enabled at build time.
+
+namespace vectorlite {
+
+// out[i] = a[i] + b[i]. out may alias a or b.
+void AddVectors(const float* a, const float* b, size_t n, float* out);
+
+// out[i] = a[i] - b[i]. out may alias a or b.
+void SubtractVectors(const float* a, const float* b, size_t n, float* out);
+
+// out[i] = a[i] * factor. out may alias a.
+void ScaleVector(const float* a, float factor, size_t n, float* out);
+
+float DotProduct(const float* a, const float* b, size_t n);
+
+// Returns the L2 norm of a.
+float L2Norm(const float* a, size_t n);
+
+}  // namespace vectorlite
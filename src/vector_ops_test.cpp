@@ -0,0 +1,54 @@
+#include "vector_ops.h"
+
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Not a multiple of the lanes of the kernels.
+constexpr size_t kDim = 19;
+
+std::vector<float> Iota(float start) {
+  std::vector<float> v(kDim);
+  for (size_t i = 0; i < kDim; i++) {
+    v[i] = start + i;
+  }
+  return v;
+}
+
+}  // namespace
+
+TEST(VectorOps, ElementwiseOpsShouldMatchScalarLoops) {
+  auto a = Iota(1.0f);
+  auto b = Iota(-3.0f);
+  std::vector<float> out(kDim);
+  vectorlite::AddVectors(a.data(), b.data(), kDim, out.data());
+  for (size_t i = 0; i < kDim; i++) {
+    EXPECT_FLOAT_EQ(a[i] + b[i], out[i]);
+  }
+  vectorlite::SubtractVectors(a.data(), b.data(), kDim, out.data());
+  for (size_t i = 0; i < kDim; i++) {
+    EXPECT_FLOAT_EQ(a[i] - b[i], out[i]);
+  }
+  // In place.
+  vectorlite::ScaleVector(a.data(), -0.5f, kDim, a.data());
+  for (size_t i = 0; i < kDim; i++) {
+    EXPECT_FLOAT_EQ(-0.5f * (1.0f + i), a[i]);
+  }
+}
+
+TEST(VectorOps, DotAndNormShouldMatchScalarLoops) {
+  auto a = Iota(1.0f);
+  auto b = Iota(-3.0f);
+  float dot = 0.0f;
+  float norm = 0.0f;
+  for (size_t i = 0; i < kDim; i++) {
+    dot += a[i] * b[i];
+    norm += a[i] * a[i];
+  }
+  EXPECT_FLOAT_EQ(dot, vectorlite::DotProduct(a.data(), b.data(), kDim));
+  EXPECT_FLOAT_EQ(std::sqrt(norm), vectorlite::L2Norm(a.data(), kDim));
+  EXPECT_EQ(0.0f, vectorlite::DotProduct(a.data(), b.data(), 0));
+}
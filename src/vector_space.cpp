@@ -59,6 +59,36 @@ absl::StatusOr<VectorSpace> VectorSpace::Create(size_t dim,
   return result;
 }
 
+// Creates a hnswlib space of dim that computes distance_type.
+static std::unique_ptr<hnswlib::SpaceInterface<float>> CreateHnswSpace(
+    size_t dim, DistanceType distance_type) {
+  switch (distance_type) {
+    case DistanceType::L2:
+      return std::make_unique<hnswlib::L2Space>(dim);
+    case DistanceType::InnerProduct:
+    case DistanceType::Cosine:
+      return std::make_unique<hnswlib::InnerProductSpace>(dim);
+  }
+  return nullptr;
+}
+
+absl::Status VectorSpace::EnablePrefixSearch(size_t prefix_dim) {
+  if (prefix_dim == 0 || prefix_dim >= dimension()) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Prefix dimension must be in range (0, %d), got %d", dimension(),
+        prefix_dim));
+  }
+  prefix_space = CreateHnswSpace(prefix_dim, distance_type);
+  return absl::OkStatus();
+}
+
+size_t VectorSpace::prefix_dimension() const {
+  if (!prefix_space) {
+    return 0;
+  }
+  return *reinterpret_cast<size_t*>(prefix_space->get_dist_func_param());
+}
+
 absl::StatusOr<NamedVectorSpace> CreateNamedVectorSpace(
     size_t dim, DistanceType distance_type, std::string_view vector_name,
     VectorType vector_type) {
@@ -76,16 +106,21 @@ absl::StatusOr<NamedVectorSpace> CreateNamedVectorSpace(
 absl::StatusOr<NamedVectorSpace> NamedVectorSpace::FromString(
     std::string_view space_str) {
   static const re2::RE2 reg(
-      "^(?<vector_name>\\w+)\\s+(?<vector_type>\\w+)\\[(?<dim>\\d+)\\]\\s*(?<"
-      "distance_type>\\w+)?\\s*$");
+      "^(?<vector_name>\\w+)\\s+(?<vector_type>\\w+)\\[(?<dim>\\d+)"
+      "(?:->(?<reduced_dim>\\d+))?(?::(?<prefix_dim>\\d+))?\\]\\s*"
+      "(?<distance_type>\\w+)?(?:\\s+(?<multi>multi))?\\s*$");
   VECTORLITE_ASSERT(reg.ok());
 
   std::string_view vector_name;
   std::string_view vector_type_str;
   size_t dim = 0;
+  std::optional<size_t> reduced_dim;
+  std::optional<size_t> prefix_dim;
   std::optional<std::string_view> distance_type_str;
+  std::optional<std::string_view> multi;
   if (re2::RE2::FullMatch(space_str, reg, &vector_name, &vector_type_str, &dim,
-                          &distance_type_str)) {
+                          &reduced_dim, &prefix_dim, &distance_type_str,
+                          &multi)) {
     if (!IsValidColumnName(vector_name)) {
       std::string error =
           absl::StrFormat("Invalid vector name: %s", vector_name);
@@ -99,6 +134,12 @@ absl::StatusOr<NamedVectorSpace> NamedVectorSpace::FromString(
       return absl::InvalidArgumentError(error);
     }
 
+    // `multi` is matched as the distance type if there is none.
+    if (distance_type_str == "multi" && !multi) {
+      multi = distance_type_str;
+      distance_type_str.reset();
+    }
+
     DistanceType distance_type = DistanceType::L2;
     if (distance_type_str) {
       auto maybe_distance_type = ParseDistanceType(*distance_type_str);
@@ -110,8 +151,28 @@ absl::StatusOr<NamedVectorSpace> NamedVectorSpace::FromString(
       distance_type = *maybe_distance_type;
     }
 
-    return CreateNamedVectorSpace(dim, distance_type, vector_name,
-                                  *vector_type);
+    if (reduced_dim && (*reduced_dim == 0 || *reduced_dim >= dim)) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Reduced dimension must be in range (0, %d), got %d", dim,
+          *reduced_dim));
+    }
+
+    auto space = CreateNamedVectorSpace(reduced_dim.value_or(dim),
+                                        distance_type, vector_name,
+                                        *vector_type);
+    if (space.ok() && reduced_dim) {
+      space->transform_input_dimension = dim;
+    }
+    if (space.ok() && prefix_dim) {
+      auto status = space->EnablePrefixSearch(*prefix_dim);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    if (space.ok()) {
+      space->multi_vector = multi.has_value();
+    }
+    return space;
   }
   return absl::InvalidArgumentError("Unable to parse vector space");
 }
@@ -28,9 +28,34 @@ struct VectorSpace {
   bool normalize;
   std::unique_ptr<hnswlib::SpaceInterface<float>> space;
   VectorType vector_type;
+  // Only set if prefix search is enabled. It compares only the first
+  // prefix_dimension() elements of vectors. It is used to traverse the HNSW
+  // graph cheaply for embeddings supporting Matryoshka truncation. Candidates
+  // found are then reranked with `space` which uses the full dimension.
+  std::unique_ptr<hnswlib::SpaceInterface<float>> prefix_space;
+  // Whether a row holds several vectors(e.g. one per token of a document),
+  // which are compared to several query vectors by MaxSim.
+  bool multi_vector = false;
+  // Only set if vectors are reduced by a trained linear transform before
+  // reaching the index. Vectors given in SQL have this dimension, while
+  // dimension() is the reduced dimension stored in the index.
+  size_t transform_input_dimension = 0;
 
   size_t dimension() const;
 
+  // Returns the dimension of vectors given in SQL.
+  size_t input_dimension() const {
+    return transform_input_dimension ? transform_input_dimension
+                                     : dimension();
+  }
+
+  // Returns 0 if prefix search is not enabled.
+  size_t prefix_dimension() const;
+
+  // Enables prefix search on the first prefix_dim elements of vectors.
+  // prefix_dim must be in range (0, dimension()).
+  absl::Status EnablePrefixSearch(size_t prefix_dim);
+
   static absl::StatusOr<VectorSpace> Create(size_t dim,
                                             DistanceType distance_type,
                                             VectorType vector_type);
@@ -46,6 +71,15 @@ struct NamedVectorSpace : public VectorSpace {
   // e.g. CREATE VIRTUAL TABLE my_vectors using vectorlite(my_vector(384,
   // "l2"), "hnsw(max_elements=1000)") The `vector(384, "l2")` is the vector
   // space string. Supported space type are "l2", "cos", "ip"
+  // Prefix search can be enabled by appending the prefix dimension to the
+  // dimension, e.g. `my_vector float32[1024:256] l2` traverses the index using
+  // the first 256 elements and reranks results using all 1024 elements.
+  // Vectors can be reduced by a linear transform trained with
+  // vectorlite_train_transform(), e.g. `my_vector float32[1536->512] l2`
+  // stores 512 dimensional vectors. A prefix dimension is then relative to the
+  // reduced dimension.
+  // Rows can hold several vectors if `multi` follows the distance type, e.g.
+  // `tokens float32[128] cosine multi`.
   static absl::StatusOr<NamedVectorSpace> FromString(
       std::string_view space_str);
 };
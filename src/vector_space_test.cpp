@@ -123,3 +123,74 @@ TEST(NamedVectorSpace_FromString, ShouldWorkWithValidInput) {
   EXPECT_EQ("my_vec", space->vector_name);
   EXPECT_EQ(vectorlite::VectorType::Float32, space->vector_type);
 }
+
+TEST(NamedVectorSpace_FromString, ShouldSupportPrefixDimension) {
+  auto space =
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[1024:256] l2");
+  ASSERT_TRUE(space.ok());
+  EXPECT_EQ(1024, space->dimension());
+  EXPECT_EQ(256, space->prefix_dimension());
+  EXPECT_NE(space->prefix_space, nullptr);
+  EXPECT_EQ(256, *reinterpret_cast<size_t*>(
+                     space->prefix_space->get_dist_func_param()));
+
+  space = vectorlite::NamedVectorSpace::FromString("my_vec float32[1024]");
+  ASSERT_TRUE(space.ok());
+  EXPECT_EQ(0, space->prefix_dimension());
+  EXPECT_EQ(space->prefix_space, nullptr);
+}
+
+TEST(NamedVectorSpace_FromString, ShouldReturnErrorForInvalidPrefixDimension) {
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[1024:0]").ok());
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[1024:1024]")
+          .ok());
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[1024:2048]")
+          .ok());
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[1024:]").ok());
+}
+
+TEST(NamedVectorSpace_FromString, ShouldSupportMultiVector) {
+  auto space =
+      vectorlite::NamedVectorSpace::FromString("tokens float32[128] ip multi");
+  ASSERT_TRUE(space.ok());
+  EXPECT_TRUE(space->multi_vector);
+  EXPECT_EQ(space->distance_type, vectorlite::DistanceType::InnerProduct);
+
+  space = vectorlite::NamedVectorSpace::FromString("tokens float32[128] multi");
+  ASSERT_TRUE(space.ok());
+  EXPECT_TRUE(space->multi_vector);
+  EXPECT_EQ(space->distance_type, vectorlite::DistanceType::L2);
+
+  space = vectorlite::NamedVectorSpace::FromString("tokens float32[128] l2");
+  ASSERT_TRUE(space.ok());
+  EXPECT_FALSE(space->multi_vector);
+
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("tokens float32[128] multi l2")
+          .ok());
+}
+
+TEST(NamedVectorSpace_FromString, ShouldSupportReducedDimension) {
+  auto space = vectorlite::NamedVectorSpace::FromString(
+      "my_vec float32[1536->512:128] cosine");
+  ASSERT_TRUE(space.ok());
+  EXPECT_EQ(512, space->dimension());
+  EXPECT_EQ(1536, space->input_dimension());
+  EXPECT_EQ(128, space->prefix_dimension());
+
+  space = vectorlite::NamedVectorSpace::FromString("my_vec float32[1536]");
+  ASSERT_TRUE(space.ok());
+  EXPECT_EQ(0, space->transform_input_dimension);
+  EXPECT_EQ(1536, space->input_dimension());
+
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[16->0]").ok());
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[16->16]").ok());
+  EXPECT_FALSE(
+      vectorlite::NamedVectorSpace::FromString("my_vec float32[16->]").ok());
+}
@@ -1,6 +1,7 @@
 #include "vector.h"
 
 #include <iostream>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "vector_space.h"
@@ -101,3 +102,16 @@ TEST(VectorTest, Normalize) {
   EXPECT_FLOAT_EQ(normalized.data()[1], 0.53452247);
   EXPECT_FLOAT_EQ(normalized.data()[2], 0.8017837);
 }
+
+TEST(VectorTest, NormalizeEach) {
+  vectorlite::Vector v({1.0, 2.0, 3.0, 0.0, 0.0, 2.0});
+  std::vector<float> normalized;
+  v.NormalizeEachTo(3, normalized);
+  ASSERT_EQ(6, normalized.size());
+  EXPECT_FLOAT_EQ(normalized[0], 0.26726124);
+  EXPECT_FLOAT_EQ(normalized[1], 0.53452247);
+  EXPECT_FLOAT_EQ(normalized[2], 0.8017837);
+  EXPECT_FLOAT_EQ(normalized[3], 0.0);
+  EXPECT_FLOAT_EQ(normalized[4], 0.0);
+  EXPECT_FLOAT_EQ(normalized[5], 1.0);
+}
@@ -1,3 +1,4 @@
+#include <memory>
 #include <string>
 #include <string_view>
 
@@ -7,6 +8,7 @@
 #include "sqlite3.h"
 #include "sqlite3ext.h"
 #include "sqlite_functions.h"
+#include "table_registry.h"
 #include "util.h"
 #include "vector.h"
 #include "vector_space.h"
@@ -14,8 +16,13 @@
 
 SQLITE_EXTENSION_INIT1;
 
+using vectorlite::TableRegistry;
 using vectorlite::VirtualTable;
 
+static void DeleteTableRegistry(void *registry) {
+  delete static_cast<std::shared_ptr<TableRegistry> *>(registry);
+}
+
 static sqlite3_module vector_search_module = {
     /* iVersion    */ 3,
     /* xCreate     */ VirtualTable::Create,
@@ -75,6 +82,70 @@ VECTORLITE_EXPORT int sqlite3_extension_init(sqlite3 *db, char **pzErrMsg,
     return rc;
   }
 
+  rc = sqlite3_create_function(db, "vector_add", 2, SQLITE_UTF8, nullptr,
+                               vectorlite::VectorAdd, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create function vector_add: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "vector_sub", 2, SQLITE_UTF8, nullptr,
+                               vectorlite::VectorSub, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create function vector_sub: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "vector_scale", 2, SQLITE_UTF8, nullptr,
+                               vectorlite::VectorScale, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create function vector_scale: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "vector_dot", 2, SQLITE_UTF8, nullptr,
+                               vectorlite::VectorDot, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create function vector_dot: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "vector_norm", 1, SQLITE_UTF8, nullptr,
+                               vectorlite::VectorNorm, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create function vector_norm: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "vector_slice", -1, SQLITE_UTF8, nullptr,
+                               vectorlite::VectorSlice, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create function vector_slice: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "vector_concat", -1, SQLITE_UTF8, nullptr,
+                               vectorlite::VectorConcat, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create function vector_concat: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "vectorlite_trace", 1, SQLITE_UTF8, nullptr,
+                               vectorlite::ConfigureTrace, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf(
+        "Failed to create function vectorlite_trace: %s", sqlite3_errstr(rc));
+    return rc;
+  }
+
   rc = sqlite3_create_function(db, "knn_search", 2, SQLITE_UTF8, nullptr,
                                vectorlite::KnnSearch, nullptr, nullptr);
   if (rc != SQLITE_OK) {
@@ -91,6 +162,30 @@ VECTORLITE_EXPORT int sqlite3_extension_init(sqlite3 *db, char **pzErrMsg,
     return rc;
   }
 
+  rc = sqlite3_create_function(db, "knn_param_rowid", -1, SQLITE_UTF8, nullptr,
+                               vectorlite::KnnParamRowidFunc, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf(
+        "Failed to create knn_param_rowid function: %s", sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "knn_group_by", -1, SQLITE_UTF8, nullptr,
+                               vectorlite::KnnGroupByFunc, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create knn_group_by function: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function(db, "knn_weighted", 2, SQLITE_UTF8, nullptr,
+                               vectorlite::KnnWeightedFunc, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Failed to create knn_weighted function: %s",
+                                sqlite3_errstr(rc));
+    return rc;
+  }
+
   rc = sqlite3_create_function(db, "vectorlite_info", 0, SQLITE_UTF8, nullptr,
                                vectorlite::ShowInfo, nullptr, nullptr);
   if (rc != SQLITE_OK) {
@@ -99,7 +194,100 @@ VECTORLITE_EXPORT int sqlite3_extension_init(sqlite3 *db, char **pzErrMsg,
     return rc;
   }
 
-  rc = sqlite3_create_module(db, "vectorlite", &vector_search_module, nullptr);
+  // Tables created by the module register themselves here, so that the
+  // functions below can find them by name. The module and the functions each
+  // own a reference to the registry.
+  auto registry = std::make_shared<TableRegistry>();
+
+  rc = sqlite3_create_function_v2(
+      db, "vectorlite_stats", 1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry), vectorlite::StatsFunc,
+      nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf(
+        "Failed to create vectorlite_stats function: %s", sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function_v2(
+      db, "knn_search_batch", -1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry), vectorlite::BatchSearchFunc,
+      nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf(
+        "Failed to create knn_search_batch function: %s", sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function_v2(
+      db, "vectorlite_bulk_insert", -1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry), vectorlite::BulkInsertFunc,
+      nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg =
+        sqlite3_mprintf("Failed to create vectorlite_bulk_insert function: %s",
+                        sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function_v2(
+      db, "vectorlite_bulk_update", -1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry), vectorlite::BulkUpdateFunc,
+      nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg =
+        sqlite3_mprintf("Failed to create vectorlite_bulk_update function: %s",
+                        sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function_v2(
+      db, "vectorlite_optimize", -1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry), vectorlite::OptimizeFunc,
+      nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg =
+        sqlite3_mprintf("Failed to create vectorlite_optimize function: %s",
+                        sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function_v2(
+      db, "vectorlite_delete_range", -1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry), vectorlite::DeleteRangeFunc,
+      nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg =
+        sqlite3_mprintf("Failed to create vectorlite_delete_range function: %s",
+                        sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function_v2(
+      db, "vectorlite_compact", -1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry), vectorlite::CompactFunc,
+      nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg =
+        sqlite3_mprintf("Failed to create vectorlite_compact function: %s",
+                        sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_function_v2(
+      db, "vectorlite_train_transform", -1, SQLITE_UTF8,
+      new std::shared_ptr<TableRegistry>(registry),
+      vectorlite::TrainTransformFunc, nullptr, nullptr, DeleteTableRegistry);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf(
+        "Failed to create vectorlite_train_transform function: %s",
+        sqlite3_errstr(rc));
+    return rc;
+  }
+
+  rc = sqlite3_create_module_v2(db, "vectorlite", &vector_search_module,
+                                new std::shared_ptr<TableRegistry>(registry),
+                                DeleteTableRegistry);
   if (rc != SQLITE_OK) {
     *pzErrMsg = sqlite3_mprintf("Failed to create module vector_search: %s",
                                 sqlite3_errstr(rc));
@@ -2,26 +2,42 @@
 
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <exception>
 #include <filesystem>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 #include <vector>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
+#include "attribute_store.h"
 #include "constraint.h"
+#include "deadline.h"
+#include "early_abandon.h"
+#include "hnsw_build.h"
 #include "hnswlib/hnswlib.h"
+#include "index_file.h"
 #include "index_options.h"
 #include "macros.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "result_cache.h"
+#include "semantic_cache.h"
 #include "sqlite3ext.h"
-#include "util.h"
+#include "table_registry.h"
+#include "trace.h"
 #include "vector_space.h"
 
 extern const sqlite3_api_routines* sqlite3_api;
@@ -31,6 +47,8 @@ namespace vectorlite {
 enum ColumnIndexInTable {
   kColumnIndexVector,
   kColumnIndexDistance,
+  // Attribute columns, if any, follow the hidden distance column.
+  kColumnIndexAttributes,
 };
 
 enum IndexConstraintUsage {
@@ -43,6 +61,9 @@ enum FunctionConstraint {
   kFunctionConstraintVectorMatch = SQLITE_INDEX_CONSTRAINT_FUNCTION + 1,
 };
 
+// Transforms trained by the random method are reproducible.
+constexpr uint32_t kRandomTransformSeed = 42;
+
 // A helper function to reduce boilerplate code when setting zErrMsg.
 static void SetZErrMsg(char** pzErr, const char* fmt, ...) {
   va_list args;
@@ -78,9 +99,24 @@ static int InitVirtualTable(bool load_from_file, sqlite3* db, void* pAux,
   // VIRTUAL TABLE statement.
   constexpr int kModuleParamOffset = 3;
 
-  if (argc != 2 + kModuleParamOffset && argc != 3 + kModuleParamOffset) {
-    *pzErr = sqlite3_mprintf("vectorlite expects 2 or 3 arguments, got %d",
-                             argc - kModuleParamOffset);
+  // Attribute columns, e.g. "category integer", are declared between the
+  // vector space and the index options.
+  int index_options_offset = 1 + kModuleParamOffset;
+  while (index_options_offset < argc &&
+         !absl::StartsWith(argv[index_options_offset], "hnsw(")) {
+    index_options_offset++;
+  }
+  int num_attributes = index_options_offset - 1 - kModuleParamOffset;
+  if (index_options_offset == argc || index_options_offset + 2 < argc) {
+    *pzErr = sqlite3_mprintf(
+        "vectorlite expects a vector space, attribute columns, index options "
+        "and an optional index file path, got %d arguments",
+        argc - kModuleParamOffset);
+    return SQLITE_ERROR;
+  }
+  if (static_cast<size_t>(num_attributes) > AttributeStore::kMaxAttributes) {
+    *pzErr = sqlite3_mprintf("vectorlite supports at most %d attributes",
+                             static_cast<int>(AttributeStore::kMaxAttributes));
     return SQLITE_ERROR;
   }
 
@@ -94,19 +130,39 @@ static int InitVirtualTable(bool load_from_file, sqlite3* db, void* pAux,
     return SQLITE_ERROR;
   }
 
-  std::string_view index_options_str = argv[1 + kModuleParamOffset];
+  std::vector<std::string> attribute_names;
+  std::string columns = vector_space->vector_name + ", distance REAL hidden";
+  for (int i = 1 + kModuleParamOffset; i < index_options_offset; i++) {
+    auto name = AttributeStore::ParseColumn(argv[i]);
+    if (!name.ok()) {
+      *pzErr = sqlite3_mprintf("Invalid attribute column: %s. Reason: %s",
+                               argv[i],
+                               absl::StatusMessageAsCStr(name.status()));
+      return SQLITE_ERROR;
+    }
+    if (*name == vector_space->vector_name || *name == "distance" ||
+        std::find(attribute_names.begin(), attribute_names.end(), *name) !=
+            attribute_names.end()) {
+      *pzErr = sqlite3_mprintf("Duplicate column name: %s", name->c_str());
+      return SQLITE_ERROR;
+    }
+    absl::StrAppend(&columns, ", ", *name, " INTEGER");
+    attribute_names.push_back(*std::move(name));
+  }
+
+  std::string_view index_options_str = argv[index_options_offset];
   DLOG(INFO) << "index_options_str: " << index_options_str;
   auto index_options = IndexOptions::FromString(index_options_str);
   if (!index_options.ok()) {
     *pzErr = sqlite3_mprintf("Invalid index_options %s. Reason: %s",
-                             argv[1 + kModuleParamOffset],
+                             argv[index_options_offset],
                              absl::StatusMessageAsCStr(index_options.status()));
     return SQLITE_ERROR;
   }
 
   std::string_view index_file_path;
-  if (argc == 3 + kModuleParamOffset) {
-    index_file_path = argv[2 + kModuleParamOffset];
+  if (index_options_offset + 1 < argc) {
+    index_file_path = argv[index_options_offset + 1];
     int size = index_file_path.size();
     // Handle cases where the index_file_path is enclosed in double/single
     // quotes. It is necessary for windows paths, because they contain ':', that
@@ -119,8 +175,7 @@ static int InitVirtualTable(bool load_from_file, sqlite3* db, void* pAux,
     }
   }
 
-  std::string sql = absl::StrFormat("CREATE TABLE X(%s, distance REAL hidden)",
-                                    vector_space->vector_name);
+  std::string sql = absl::StrFormat("CREATE TABLE X(%s)", columns);
   rc = sqlite3_declare_vtab(db, sql.c_str());
   DLOG(INFO) << "vtab declared: " << sql.c_str() << ", rc=" << rc;
   if (rc != SQLITE_OK) {
@@ -128,8 +183,11 @@ static int InitVirtualTable(bool load_from_file, sqlite3* db, void* pAux,
   }
 
   try {
-    auto vtab = new VirtualTable(std::move(*vector_space), *index_options,
-                                 index_file_path);
+    VECTORLITE_ASSERT(pAux != nullptr);
+    auto registry = *static_cast<std::shared_ptr<TableRegistry>*>(pAux);
+    auto vtab = new VirtualTable(db, std::move(registry), argv[1], argv[2],
+                                 std::move(*vector_space), *index_options,
+                                 std::move(attribute_names), index_file_path);
     *ppVTab = vtab;
 
     if (load_from_file) {
@@ -150,24 +208,231 @@ static int InitVirtualTable(bool load_from_file, sqlite3* db, void* pAux,
 
 absl::Status VirtualTable::LoadIndexFromFile() {
   VECTORLITE_ASSERT(index_ != nullptr);
+  VECTORLITE_TRACE_SPAN("LoadIndex");
   if (!file_path_.empty() && std::filesystem::exists(file_path_)) {
-    try {
-      index_->loadIndex(file_path_.string(), space_.space.get(),
-                        index_->max_elements_);
-    } catch (const std::runtime_error& ex) {
-      return absl::Status(absl::StatusCode::kInternal, ex.what());
-    } catch (const std::exception& ex) {
-      return absl::Status(absl::StatusCode::kUnknown, ex.what());
+    auto status = LoadIndex(file_path_, space_.space.get(),
+                            index_->max_elements_, *index_);
+    if (!status.ok()) {
+      return status;
+    }
+    rowid_map_.Rebuild(*index_);
+    early_abandon_space_.Rebuild(*index_);
+    if (early_abandon_prefix_space_) {
+      early_abandon_prefix_space_->Rebuild(*index_);
+    }
+    // The index file might hold more elements than the table was created
+    // with. Without an attribute file, all attributes are 0.
+    attributes_.Reserve(index_->max_elements_);
+    if (attributes_.size() > 0 &&
+        std::filesystem::exists(AttributesFilePath())) {
+      status = attributes_.Load(AttributesFilePath());
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    if (transform_ && std::filesystem::exists(TransformFilePath())) {
+      return transform_->Load(TransformFilePath());
+    }
+  }
+
+  return absl::OkStatus();
+}
+
+std::filesystem::path VirtualTable::AttributesFilePath() const {
+  return std::filesystem::path(file_path_) += ".attrs";
+}
+
+std::filesystem::path VirtualTable::TransformFilePath() const {
+  return std::filesystem::path(file_path_) += ".transform";
+}
+
+hnswlib::tableint VirtualTable::AddPoint(const Vector& vector,
+                                         Cursor::Rowid rowid) {
+  Vector normalized;
+  const float* data = vector.data().data();
+  if (space_.normalize) {
+    normalized = vector.Normalize();
+    data = normalized.data().data();
+  }
+  hnswlib::tableint id;
+  if (index_->allow_replace_deleted_ && !index_->deleted_elements.empty()) {
+    // Same as addPoint(data, rowid, true), which can't be used because it
+    // looks labels up in label_lookup_.
+    id = *index_->deleted_elements.begin();
+    rowid_map_.Erase(index_->getExternalLabel(id), id);
+    index_->setExternalLabel(id, rowid);
+    index_->unmarkDeletedInternal(id);
+    index_->updatePoint(data, id, 1.0);
+  } else if (filter_gamma_ > 1) {
+    // addPoint() selects links with hnswlib's heuristic.
+    id = static_cast<hnswlib::tableint>(index_->cur_element_count);
+    Deadline deadline;
+    auto status = vectorlite::BulkInsert(*index_, data, &rowid, 1, 1,
+                                         deadline, filter_gamma_);
+    if (!status.ok()) {
+      throw std::runtime_error(std::string(status.message()));
+    }
+  } else {
+    id = index_->addPoint(data, rowid, -1);
+    // addPoint() records rowid in label_lookup_, which rowid_map_ replaces.
+    std::unique_lock<std::mutex> lock(index_->label_lookup_lock);
+    index_->label_lookup_.erase(rowid);
+  }
+  rowid_map_.Insert(rowid, id);
+  attributes_.Clear(id);
+  early_abandon_space_.Add(data, *index_);
+  if (early_abandon_prefix_space_) {
+    early_abandon_prefix_space_->Add(data, *index_);
+  }
+  return id;
+}
+
+hnswlib::tableint VirtualTable::AddRow(const Vector& vectors,
+                                       Cursor::Rowid rowid) {
+  VECTORLITE_ASSERT(space_.multi_vector);
+  size_t dim = dimension();
+  std::vector<float> normalized;
+  const float* data = vectors.data().data();
+  if (space_.normalize) {
+    vectors.NormalizeEachTo(dim, normalized);
+    data = normalized.data();
+  }
+  size_t num_vectors = vectors.dim() / dim;
+  hnswlib::tableint first =
+      static_cast<hnswlib::tableint>(index_->cur_element_count);
+  std::vector<Cursor::Rowid> labels(num_vectors, rowid);
+  Deadline deadline;
+  auto status = vectorlite::BulkInsert(*index_, data, labels.data(),
+                                       num_vectors, 1, deadline, filter_gamma_);
+  if (!status.ok()) {
+    throw std::runtime_error(std::string(status.message()));
+  }
+  rowid_map_.Insert(rowid, first);
+  for (size_t i = 0; i < num_vectors; i++) {
+    attributes_.Clear(first + i);
+    early_abandon_space_.Add(data + i * dim, *index_);
+    if (early_abandon_prefix_space_) {
+      early_abandon_prefix_space_->Add(data + i * dim, *index_);
+    }
+  }
+  return first;
+}
+
+absl::Status VirtualTable::CheckDimension(const Vector& vector) const {
+  size_t dim = input_dimension();
+  if (space_.multi_vector) {
+    if (vector.dim() == 0 || vector.dim() % dim != 0) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Dimension mismatch: vectors' dimension %d isn't a multiple of "
+          "table's dimension %d",
+          vector.dim(), dim));
     }
+  } else if (vector.dim() != dim) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "Dimension mismatch: vector's dimension %d, table's dimension %d",
+        vector.dim(), dim));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status VirtualTable::Transform(Vector& vectors) const {
+  if (!transform_) {
+    return absl::OkStatus();
+  }
+  if (!transform_->trained()) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "The transform of %s isn't trained yet, see "
+        "vectorlite_train_transform()",
+        name_));
+  }
+  size_t input_dim = transform_->input_dim();
+  size_t num_vectors = vectors.dim() / input_dim;
+  std::vector<float> reduced(num_vectors * dimension());
+  for (size_t i = 0; i < num_vectors; i++) {
+    transform_->Apply(vectors.data().data() + i * input_dim,
+                      reduced.data() + i * dimension());
   }
+  vectors = Vector(std::move(reduced));
+  return absl::OkStatus();
+}
+
+absl::Status VirtualTable::TrainTransform(std::string_view method,
+                                          const float* samples,
+                                          size_t num_samples,
+                                          size_t num_threads) {
+  if (!transform_) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "%s doesn't reduce vectors. Declare its vector column with a reduced "
+        "dimension, e.g. float32[1536->512]",
+        name_));
+  }
+  // Vectors already in the index were reduced by the previous transform.
+  if (index_->cur_element_count > 0) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "The transform of %s can only be trained while it is empty", name_));
+  }
+  if (method == "pca") {
+    // L2 distances don't depend on the mean, so only the variance around it
+    // needs to be kept. Inner products do depend on it.
+    Deadline deadline(std::nullopt, db_);
+    return transform_->FitPca(samples, num_samples,
+                              space_.distance_type == DistanceType::L2,
+                              num_threads, deadline);
+  } else if (method == "random") {
+    transform_->FitRandom(kRandomTransformSeed);
+    return absl::OkStatus();
+  }
+  return absl::InvalidArgumentError(absl::StrFormat(
+      "Unknown transform method: %s. Expected pca or random", method));
+}
+
+void VirtualTable::UpdatePoint(const Vector& vector, hnswlib::tableint id) {
+  Vector normalized;
+  const float* data = vector.data().data();
+  if (space_.normalize) {
+    normalized = vector.Normalize();
+    data = normalized.data().data();
+  }
+  index_->updatePoint(data, id, 1.0);
+  early_abandon_space_.Add(data, *index_);
+  if (early_abandon_prefix_space_) {
+    early_abandon_prefix_space_->Add(data, *index_);
+  }
+}
 
+absl::Status VirtualTable::CheckAttributes(sqlite3_value** values) const {
+  for (size_t i = 0; i < attributes_.size(); i++) {
+    int type = sqlite3_value_type(values[i]);
+    if (type != SQLITE_INTEGER && type != SQLITE_NULL) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "%s must be of type INTEGER", attributes_.names()[i]));
+    }
+  }
   return absl::OkStatus();
 }
 
+void VirtualTable::SetAttributes(hnswlib::tableint id,
+                                 sqlite3_value** values) {
+  size_t num_vectors = CountRowVectors(id);
+  for (size_t i = 0; i < attributes_.size(); i++) {
+    bool is_null = sqlite3_value_type(values[i]) == SQLITE_NULL;
+    int64_t value = sqlite3_value_int64(values[i]);
+    for (size_t j = 0; j < num_vectors; j++) {
+      if (is_null) {
+        attributes_.SetNull(i, id + j);
+      } else {
+        attributes_.Set(i, id + j, value);
+      }
+    }
+  }
+}
+
 absl::Status VirtualTable::DeleteIndexFile() {
   if (!file_path_.empty()) {
     try {
       std::filesystem::remove(file_path_);
+      std::filesystem::remove(AttributesFilePath());
+      std::filesystem::remove(TransformFilePath());
     } catch (const std::filesystem::filesystem_error& ex) {
       return absl::Status(absl::StatusCode::kInternal, ex.what());
     }
@@ -177,12 +442,16 @@ absl::Status VirtualTable::DeleteIndexFile() {
 
 absl::Status VirtualTable::SaveIndexToFile() {
   VECTORLITE_ASSERT(index_ != nullptr);
+  VECTORLITE_TRACE_SPAN("SaveIndex");
   if (!file_path_.empty()) {
-    try {
-      index_->saveIndex(file_path_.string());
-    } catch (const std::runtime_error& ex) {
-      return absl::Status(absl::StatusCode::kInternal, ex.what());
+    auto status = SaveIndex(*index_, file_path_);
+    if (status.ok() && transform_ && transform_->trained()) {
+      status = transform_->Save(TransformFilePath());
+    }
+    if (!status.ok() || attributes_.size() == 0) {
+      return status;
     }
+    return attributes_.Save(AttributesFilePath(), index_->cur_element_count);
   }
 
   return absl::OkStatus();
@@ -195,11 +464,190 @@ int VirtualTable::Create(sqlite3* db, void* pAux, int argc,
 }
 
 VirtualTable::~VirtualTable() {
+  registry_->Unregister(schema_, name_);
   if (zErrMsg) {
     sqlite3_free(zErrMsg);
   }
 }
 
+void VirtualTable::InvalidateCaches() {
+  if (result_cache_) {
+    result_cache_->Invalidate();
+  }
+  if (semantic_cache_) {
+    semantic_cache_->Invalidate();
+  }
+}
+
+QueryContext VirtualTable::MakeQueryContext() {
+  QueryContext context;
+  context.early_abandon_space = &early_abandon_space_;
+  context.early_abandon_prefix_space = early_abandon_prefix_space_.get();
+  context.db = db_;
+  context.result_cache = result_cache_.get();
+  context.semantic_cache = semantic_cache_.get();
+  context.stats = &search_stats_;
+  context.search_threads = search_threads_;
+  context.rowid_map = &rowid_map_;
+  context.attributes = &attributes_;
+  context.expand_through_rejected = filter_gamma_ > 1;
+  context.transform = transform_.get();
+  return context;
+}
+
+absl::StatusOr<std::string> VirtualTable::BatchSearchToJson(
+    const std::vector<Vector>& queries, size_t k,
+    std::optional<uint32_t> ef_search) {
+  VECTORLITE_TRACE_SPAN("BatchSearch");
+  // Queries are reduced like the vectors of rows.
+  std::vector<Vector> reduced_queries;
+  if (transform_) {
+    reduced_queries = queries;
+    for (auto& query : reduced_queries) {
+      auto status = Transform(query);
+      if (!status.ok()) {
+        return status;
+      }
+    }
+  }
+  QueryExecutor executor(*index_, space_, MakeQueryContext());
+  std::vector<QueryExecutor::QueryResult> results;
+  auto status = executor.ExecuteBatch(transform_ ? reduced_queries : queries,
+                                      k, ef_search, results, batch_buffers_);
+  if (!status.ok()) {
+    return status;
+  }
+
+  rapidjson::StringBuffer buf;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+  writer.StartArray();
+  for (const auto& result : results) {
+    writer.StartArray();
+    for (const auto& [distance, rowid] : result) {
+      writer.StartObject();
+      writer.Key("rowid");
+      writer.Int64(static_cast<int64_t>(rowid));
+      writer.Key("distance");
+      writer.Double(distance);
+      writer.EndObject();
+    }
+    writer.EndArray();
+  }
+  writer.EndArray();
+  return buf.GetString();
+}
+
+std::string VirtualTable::StatsToJson() const {
+  rapidjson::StringBuffer buf;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+  writer.StartObject();
+  writer.Key("table");
+  writer.String(name_.c_str());
+  writer.Key("dimension");
+  writer.Uint64(dimension());
+  writer.Key("vector_count");
+  writer.Uint64(index_->getCurrentElementCount() - index_->getDeletedCount());
+  writer.Key("deleted_count");
+  writer.Uint64(index_->getDeletedCount());
+  writer.Key("max_elements");
+  writer.Uint64(index_->getMaxElements());
+  writer.Key("M");
+  writer.Uint64(index_->M_ / filter_gamma_);
+  writer.Key("ef_construction");
+  writer.Uint64(index_->ef_construction_);
+  writer.Key("filter_gamma");
+  writer.Uint64(filter_gamma_);
+  writer.Key("multi_vector");
+  writer.Bool(space_.multi_vector);
+  if (transform_) {
+    writer.Key("input_dimension");
+    writer.Uint64(input_dimension());
+    writer.Key("transform_trained");
+    writer.Bool(transform_->trained());
+  }
+
+  writer.Key("search");
+  writer.StartObject();
+  writer.Key("threads");
+  writer.Uint64(search_threads_);
+  writer.Key("searches");
+  writer.Uint64(search_stats_.searches);
+  writer.Key("exact_searches");
+  writer.Uint64(search_stats_.exact_searches);
+  writer.Key("parallel_searches");
+  writer.Uint64(search_stats_.parallel_searches);
+  writer.Key("batch_searches");
+  writer.Uint64(search_stats_.batch_searches);
+  writer.Key("multi_vector_searches");
+  writer.Uint64(search_stats_.multi_vector_searches);
+  writer.Key("weighted_searches");
+  writer.Uint64(search_stats_.weighted_searches);
+  writer.Key("distance_computations");
+  writer.Uint64(search_stats_.distance_computations);
+  writer.Key("distance_flops");
+  writer.Uint64(search_stats_.distance_flops);
+  writer.Key("distance_flops_saved");
+  writer.Uint64(search_stats_.distance_flops_saved);
+  writer.EndObject();
+
+  writer.Key("result_cache");
+  if (result_cache_) {
+    const auto& stats = result_cache_->stats();
+    uint64_t lookups = stats.hits + stats.misses;
+    writer.StartObject();
+    writer.Key("capacity");
+    writer.Uint64(result_cache_->capacity());
+    writer.Key("size");
+    writer.Uint64(result_cache_->size());
+    writer.Key("hits");
+    writer.Uint64(stats.hits);
+    writer.Key("misses");
+    writer.Uint64(stats.misses);
+    writer.Key("hit_rate");
+    writer.Double(lookups > 0 ? static_cast<double>(stats.hits) / lookups
+                              : 0.0);
+    writer.Key("evictions");
+    writer.Uint64(stats.evictions);
+    writer.Key("invalidations");
+    writer.Uint64(stats.invalidations);
+    writer.EndObject();
+  } else {
+    writer.Null();
+  }
+
+  writer.Key("semantic_cache");
+  if (semantic_cache_) {
+    const auto& stats = semantic_cache_->stats();
+    uint64_t lookups = stats.hits + stats.misses;
+    writer.StartObject();
+    writer.Key("capacity");
+    writer.Uint64(semantic_cache_->capacity());
+    writer.Key("size");
+    writer.Uint64(semantic_cache_->size());
+    writer.Key("epsilon");
+    writer.Double(semantic_cache_->epsilon());
+    writer.Key("hits");
+    writer.Uint64(stats.hits);
+    writer.Key("misses");
+    writer.Uint64(stats.misses);
+    writer.Key("hit_rate");
+    writer.Double(lookups > 0 ? static_cast<double>(stats.hits) / lookups
+                              : 0.0);
+    writer.Key("invalidations");
+    writer.Uint64(stats.invalidations);
+    writer.Key("lookup_distance_computations");
+    writer.Uint64(stats.lookup_distance_computations);
+    writer.Key("saved_distance_computations");
+    writer.Uint64(stats.saved_distance_computations);
+    writer.EndObject();
+  } else {
+    writer.Null();
+  }
+
+  writer.EndObject();
+  return buf.GetString();
+}
+
 int VirtualTable::Destroy(sqlite3_vtab* pVTab) {
   DLOG(INFO) << "Destroy called";
   VECTORLITE_ASSERT(pVTab != nullptr);
@@ -238,7 +686,13 @@ int VirtualTable::Open(sqlite3_vtab* pVtab, sqlite3_vtab_cursor** ppCursor) {
   DLOG(INFO) << "Open called";
   VECTORLITE_ASSERT(pVtab != nullptr);
   VECTORLITE_ASSERT(ppCursor != nullptr);
-  *ppCursor = new Cursor(static_cast<VirtualTable*>(pVtab));
+  VirtualTable* vtab = static_cast<VirtualTable*>(pVtab);
+  if (!vtab->idle_cursors_.empty()) {
+    *ppCursor = vtab->idle_cursors_.back().release();
+    vtab->idle_cursors_.pop_back();
+  } else {
+    *ppCursor = new Cursor(vtab);
+  }
   DLOG(INFO) << "Open end";
   return SQLITE_OK;
 }
@@ -246,7 +700,15 @@ int VirtualTable::Open(sqlite3_vtab* pVtab, sqlite3_vtab_cursor** ppCursor) {
 int VirtualTable::Close(sqlite3_vtab_cursor* pCursor) {
   DLOG(INFO) << "Close called";
   VECTORLITE_ASSERT(pCursor != nullptr);
-  delete static_cast<Cursor*>(pCursor);
+  Cursor* cursor = static_cast<Cursor*>(pCursor);
+  VirtualTable* vtab = static_cast<VirtualTable*>(cursor->pVtab);
+  if (vtab->idle_cursors_.size() < kMaxIdleCursors) {
+    cursor->result.clear();
+    cursor->current_row = cursor->result.cend();
+    vtab->idle_cursors_.emplace_back(cursor);
+  } else {
+    delete cursor;
+  }
   return SQLITE_OK;
 }
 
@@ -285,21 +747,29 @@ int VirtualTable::Next(sqlite3_vtab_cursor* pCur) {
 }
 
 absl::StatusOr<Vector> VirtualTable::GetVectorByRowid(int64_t rowid) const {
-  try {
-    // TODO: handle cases where sizeof(rowid) != sizeof(hnswlib::labeltype)
-    std::vector<float> vec =
-        index_->getDataByLabel<float>(static_cast<hnswlib::labeltype>(rowid));
-    VECTORLITE_ASSERT(vec.size() == dimension());
-    return Vector(std::move(vec));
-  } catch (const std::runtime_error& ex) {
-    return absl::Status(absl::StatusCode::kNotFound, ex.what());
+  // TODO: handle cases where sizeof(rowid) != sizeof(hnswlib::labeltype)
+  auto id =
+      rowid_map_.FindLive(*index_, static_cast<hnswlib::labeltype>(rowid));
+  if (!id) {
+    return absl::NotFoundError("Label not found");
   }
+  // The vectors of a row of a multi-vector table are returned back to back.
+  size_t num_vectors = CountRowVectors(*id);
+  std::vector<float> vectors;
+  vectors.reserve(num_vectors * dimension());
+  for (size_t i = 0; i < num_vectors; i++) {
+    const float* data =
+        reinterpret_cast<const float*>(index_->getDataByInternalId(*id + i));
+    vectors.insert(vectors.end(), data, data + dimension());
+  }
+  return Vector(std::move(vectors));
 }
 
 int VirtualTable::Column(sqlite3_vtab_cursor* pCur, sqlite3_context* pCtx,
                          int N) {
   VECTORLITE_ASSERT(pCur != nullptr);
   VECTORLITE_ASSERT(pCtx != nullptr);
+  VECTORLITE_TRACE_SPAN("Column");
   DLOG(INFO) << "Column called with N=" << N;
 
   Cursor* cursor = static_cast<Cursor*>(pCur);
@@ -312,6 +782,11 @@ int VirtualTable::Column(sqlite3_vtab_cursor* pCur, sqlite3_context* pCtx,
                           static_cast<double>(cursor->current_row->first));
     return SQLITE_OK;
   } else if (kColumnIndexVector == N) {
+    // An UPDATE that doesn't set the vector, e.g. one only changing
+    // attributes, doesn't need it.
+    if (sqlite3_vtab_nochange(pCtx)) {
+      return SQLITE_OK;
+    }
     Cursor::Rowid rowid = cursor->current_row->second;
     VirtualTable* vtab = static_cast<VirtualTable*>(pCur->pVtab);
     auto vector = vtab->GetVectorByRowid(rowid);
@@ -325,6 +800,22 @@ int VirtualTable::Column(sqlite3_vtab_cursor* pCur, sqlite3_context* pCtx,
       sqlite3_result_text(pCtx, err.c_str(), err.size(), SQLITE_TRANSIENT);
       return SQLITE_NOTFOUND;
     }
+  } else if (N >= kColumnIndexAttributes) {
+    size_t attribute = N - kColumnIndexAttributes;
+    Cursor::Rowid rowid = cursor->current_row->second;
+    VirtualTable* vtab = static_cast<VirtualTable*>(pCur->pVtab);
+    auto id = vtab->rowid_map_.Find(rowid);
+    if (attribute < vtab->attributes_.size() && id) {
+      if (vtab->attributes_.IsNull(attribute, *id)) {
+        sqlite3_result_null(pCtx);
+      } else {
+        sqlite3_result_int64(pCtx, vtab->attributes_.Get(attribute, *id));
+      }
+      return SQLITE_OK;
+    }
+    std::string err = absl::StrFormat("Invalid column index: %d", N);
+    sqlite3_result_text(pCtx, err.c_str(), err.size(), SQLITE_TRANSIENT);
+    return SQLITE_ERROR;
   } else {
     std::string err = absl::StrFormat("Invalid column index: %d", N);
     sqlite3_result_text(pCtx, err.c_str(), err.size(), SQLITE_TRANSIENT);
@@ -346,15 +837,37 @@ static std::pair<int, std::string_view> IsMinimumSqlite3VersionMet() {
 
 using Constraints = std::vector<std::unique_ptr<Constraint>>;
 
+// Returns the operator of an attribute constraint, or std::nullopt if op can't
+// be pushed down to the table.
+static std::optional<AttributeConstraint::Op> ToAttributeOp(unsigned char op) {
+  switch (op) {
+    case SQLITE_INDEX_CONSTRAINT_EQ:
+      return AttributeConstraint::Op::kEq;
+    case SQLITE_INDEX_CONSTRAINT_NE:
+      return AttributeConstraint::Op::kNe;
+    case SQLITE_INDEX_CONSTRAINT_LT:
+      return AttributeConstraint::Op::kLt;
+    case SQLITE_INDEX_CONSTRAINT_LE:
+      return AttributeConstraint::Op::kLe;
+    case SQLITE_INDEX_CONSTRAINT_GT:
+      return AttributeConstraint::Op::kGt;
+    case SQLITE_INDEX_CONSTRAINT_GE:
+      return AttributeConstraint::Op::kGe;
+    default:
+      return std::nullopt;
+  }
+}
+
 int VirtualTable::BestIndex(sqlite3_vtab* vtab,
                             sqlite3_index_info* index_info) {
   VECTORLITE_ASSERT(vtab != nullptr);
-  // VirtualTable* virtual_table = static_cast<VirtualTable*>(vtab);
+  VirtualTable* virtual_table = static_cast<VirtualTable*>(vtab);
   VECTORLITE_ASSERT(index_info != nullptr);
 
   int argvIndex = 0;
 
-  std::vector<std::string_view> constraint_short_names;
+  std::vector<std::string> constraint_short_names;
+  bool only_attributes = true;
   constraint_short_names.reserve(index_info->nConstraint);
 
   DLOG(INFO) << "BestIndex called with " << index_info->nConstraint
@@ -374,7 +887,8 @@ int VirtualTable::BestIndex(sqlite3_vtab* vtab,
       DLOG(INFO) << "Found knn_search constraint";
       index_info->aConstraintUsage[i].argvIndex = ++argvIndex;
       index_info->aConstraintUsage[i].omit = 1;
-      constraint_short_names.push_back(KnnSearchConstraint::kShortName);
+      constraint_short_names.emplace_back(KnnSearchConstraint::kShortName);
+      only_attributes = false;
       index_info->estimatedCost = 100;
     } else if (column == -1) {
       // in this case the constraint is on rowid
@@ -390,20 +904,38 @@ int VirtualTable::BestIndex(sqlite3_vtab* vtab,
       DLOG(INFO) << "sqlite3 version check passed: " << version;
 
       if (constraint.op == SQLITE_INDEX_CONSTRAINT_EQ) {
+        only_attributes = false;
         // For more details, check https://sqlite.org/c3ref/vtab_in.html
         bool can_be_processed_vtab_in = sqlite3_vtab_in(index_info, i, 1);
         index_info->aConstraintUsage[i].argvIndex = ++argvIndex;
         index_info->aConstraintUsage[i].omit = 1;
         if (can_be_processed_vtab_in) {
           DLOG(INFO) << i << "-th constraint can be processed with vtab in";
-          constraint_short_names.push_back(RowIdIn::kShortName);
+          constraint_short_names.emplace_back(RowIdIn::kShortName);
           index_info->estimatedCost = 200;
         } else {
           DLOG(INFO) << i << "-th constraint cannot be processed with vtab in";
-          constraint_short_names.push_back(RowIdEquals::kShortName);
+          constraint_short_names.emplace_back(RowIdEquals::kShortName);
           index_info->estimatedCost = 100;
         }
       }
+    } else if (column >= kColumnIndexAttributes &&
+               static_cast<size_t>(column - kColumnIndexAttributes) <
+                   virtual_table->attributes_.size() &&
+               ToAttributeOp(constraint.op)) {
+      // Attribute constraints are checked while searching, so that only rows
+      // satisfying them are returned.
+      size_t attribute = column - kColumnIndexAttributes;
+      AttributeConstraint::Op op = *ToAttributeOp(constraint.op);
+      if (op == AttributeConstraint::Op::kEq &&
+          sqlite3_vtab_in(index_info, i, 1)) {
+        op = AttributeConstraint::Op::kIn;
+      }
+      DLOG(INFO) << "attribute constraint found: " << attribute;
+      index_info->aConstraintUsage[i].argvIndex = ++argvIndex;
+      index_info->aConstraintUsage[i].omit = 1;
+      constraint_short_names.push_back(
+          AttributeConstraint::ShortName(attribute, op));
     } else {
       DLOG(INFO) << "Unknown constraint iColumn=" << column
                  << ", op=" << static_cast<int>(constraint.op);
@@ -412,6 +944,11 @@ int VirtualTable::BestIndex(sqlite3_vtab* vtab,
 
   DLOG(INFO) << "Picked " << constraint_short_names.size() << " constraints";
 
+  if (only_attributes && !constraint_short_names.empty()) {
+    // Only attributes are constrained, which requires a scan of all rows.
+    index_info->estimatedCost = virtual_table->index_->cur_element_count + 1;
+  }
+
   if (constraint_short_names.empty()) {
     SetZErrMsg(&vtab->zErrMsg, "No valid constraint found in where clause");
     return SQLITE_CONSTRAINT;
@@ -436,6 +973,7 @@ int VirtualTable::BestIndex(sqlite3_vtab* vtab,
 
 int VirtualTable::Filter(sqlite3_vtab_cursor* pCur, int idxNum,
                          const char* idxStr, int argc, sqlite3_value** argv) {
+  VECTORLITE_TRACE_SPAN("Filter");
   DLOG(INFO) << "Filter begins: " << (int*)(idxStr);
   VECTORLITE_ASSERT(pCur != nullptr);
   Cursor* cursor = static_cast<Cursor*>(pCur);
@@ -449,32 +987,44 @@ int VirtualTable::Filter(sqlite3_vtab_cursor* pCur, int idxNum,
   DLOG(INFO) << "Filter called with idxNum=" << idxNum
              << ", idxStr=" << index_str << ", argc=" << argc;
 
-  auto constraints = ParseConstraintsFromShortNames(index_str);
-
-  if (!constraints.ok()) {
-    SetZErrMsg(&vtab->zErrMsg, "Failed to parse constraints: %s",
-               absl::StatusMessageAsCStr(constraints.status()));
-    return SQLITE_ERROR;
-  }
-
-  DLOG(INFO) << "constraints: " << ConstraintsToDebugString(*constraints);
-  auto executor = QueryExecutor(*vtab->index_, vtab->space_);
-  int n = constraints->size();
-  for (int i = 0; i < n; i++) {
-    auto status = (*constraints)[i]->Materialize(sqlite3_api, argv[i]);
-    if (status.ok()) {
-      (*constraints)[i]->Accept(&executor);
-    } else {
-      SetZErrMsg(&vtab->zErrMsg,
-                 "Failed to materialize constraint %s due to %s",
-                 (*constraints)[i]->ToDebugString().c_str(),
-                 absl::StatusMessageAsCStr(status));
+  if (cursor->constraint_str == index_str) {
+    for (auto& constraint : cursor->constraints) {
+      constraint->Reset();
+    }
+  } else {
+    auto constraints = ParseConstraintsFromShortNames(index_str);
+    if (!constraints.ok()) {
+      SetZErrMsg(&vtab->zErrMsg, "Failed to parse constraints: %s",
+                 absl::StatusMessageAsCStr(constraints.status()));
       return SQLITE_ERROR;
     }
+    cursor->constraints = std::move(*constraints);
+    cursor->constraint_str = index_str;
+  }
+  auto& constraints = cursor->constraints;
+
+  DLOG(INFO) << "constraints: " << ConstraintsToDebugString(constraints);
+  auto executor =
+      QueryExecutor(*vtab->index_, vtab->space_, vtab->MakeQueryContext());
+  int n = constraints.size();
+  {
+    VECTORLITE_TRACE_SPAN("MaterializeConstraints");
+    for (int i = 0; i < n; i++) {
+      auto status = constraints[i]->Materialize(sqlite3_api, argv[i]);
+      if (status.ok()) {
+        constraints[i]->Accept(&executor);
+      } else {
+        SetZErrMsg(&vtab->zErrMsg,
+                   "Failed to materialize constraint %s due to %s",
+                   constraints[i]->ToDebugString().c_str(),
+                   absl::StatusMessageAsCStr(status));
+        return SQLITE_ERROR;
+      }
+    }
   }
 
   DLOG(INFO) << "Materialized constraints: "
-             << ConstraintsToDebugString(*constraints);
+             << ConstraintsToDebugString(constraints);
 
   if (!executor.ok()) {
     SetZErrMsg(&vtab->zErrMsg, "Failed to execute query due to: %s",
@@ -482,16 +1032,21 @@ int VirtualTable::Filter(sqlite3_vtab_cursor* pCur, int idxNum,
     return SQLITE_ERROR;
   }
 
-  auto result = executor.Execute();
+  absl::Status status;
+  {
+    VECTORLITE_TRACE_SPAN("Search");
+    status = executor.Execute(cursor->result, cursor->scratch);
+  }
+  cursor->current_row = cursor->result.cbegin();
 
-  if (result.ok()) {
-    cursor->result = std::move(*result);
-    cursor->current_row = cursor->result.cbegin();
+  if (status.ok()) {
     DLOG(INFO) << "Found " << cursor->result.size() << " rows";
     return SQLITE_OK;
+  } else if (absl::IsCancelled(status)) {
+    return SQLITE_INTERRUPT;
   } else {
     SetZErrMsg(&vtab->zErrMsg, "Failed to execute query due to: %s",
-               absl::StatusMessageAsCStr(result.status()));
+               absl::StatusMessageAsCStr(status));
     return SQLITE_ERROR;
   }
 }
@@ -505,9 +1060,10 @@ void KnnParamDeleter(void* param) {
 }
 
 void KnnParamFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-  if (argc != 2 && argc != 3) {
+  if (argc < 2 || argc > 4) {
     sqlite3_result_error(
-        ctx, "invalid number of paramters to knn_param(). 2 or 3 is expected",
+        ctx,
+        "invalid number of paramters to knn_param(). 2, 3 or 4 is expected",
         -1);
     return;
   }
@@ -524,12 +1080,21 @@ void KnnParamFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
     return;
   }
 
-  if (argc == 3 && sqlite3_value_type(argv[2]) != SQLITE_INTEGER) {
+  // ef can be NULL if only timeout_ms is specified.
+  if (argc >= 3 && sqlite3_value_type(argv[2]) != SQLITE_INTEGER &&
+      !(argc == 4 && sqlite3_value_type(argv[2]) == SQLITE_NULL)) {
     sqlite3_result_error(
         ctx, "ef(3rd param of knn_param) should be of type INTEGER", -1);
     return;
   }
 
+  if (argc == 4 && sqlite3_value_type(argv[3]) != SQLITE_INTEGER) {
+    sqlite3_result_error(
+        ctx, "timeout_ms(4th param of knn_param) should be of type INTEGER",
+        -1);
+    return;
+  }
+
   std::string_view vector_blob(
       reinterpret_cast<const char*>(sqlite3_value_blob(argv[0])),
       sqlite3_value_bytes(argv[0]));
@@ -548,7 +1113,7 @@ void KnnParamFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
   }
 
   std::optional<uint32_t> ef_search;
-  if (argc == 3) {
+  if (argc >= 3 && sqlite3_value_type(argv[2]) != SQLITE_NULL) {
     int32_t ef = sqlite3_value_int(argv[2]);
     if (ef <= 0) {
       sqlite3_result_error(ctx, "ef should be greater than 0", -1);
@@ -557,106 +1122,1198 @@ void KnnParamFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
     ef_search = ef;
   }
 
+  std::optional<std::chrono::milliseconds> timeout;
+  if (argc == 4) {
+    sqlite3_int64 timeout_ms = sqlite3_value_int64(argv[3]);
+    if (timeout_ms <= 0) {
+      sqlite3_result_error(ctx, "timeout_ms should be greater than 0", -1);
+      return;
+    }
+    timeout = std::chrono::milliseconds(timeout_ms);
+  }
+
   KnnParam* param = new KnnParam();
   param->query_vector = std::move(*vec);
   param->k = static_cast<uint32_t>(k);
   param->ef_search = std::move(ef_search);
+  param->timeout = std::move(timeout);
 
   sqlite3_result_pointer(ctx, param, kKnnParamType.data(), KnnParamDeleter);
   return;
 }
 
-int VirtualTable::FindFunction(sqlite3_vtab* pVtab, int nArg, const char* zName,
-                               void (**pxFunc)(sqlite3_context*, int,
-                                               sqlite3_value**),
-                               void** ppArg) {
-  VECTORLITE_ASSERT(pVtab != nullptr);
-  if (std::string_view(zName) == "knn_search") {
-    *pxFunc = KnnSearch;
-    *ppArg = nullptr;
-    return kFunctionConstraintVectorSearchKnn;
+void KnnParamRowidFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  if (argc < 2 || argc > 4) {
+    sqlite3_result_error(
+        ctx,
+        "invalid number of paramters to knn_param_rowid(). 2, 3 or 4 is "
+        "expected",
+        -1);
+    return;
   }
 
-  return 0;
-}
+  if (sqlite3_value_type(argv[0]) != SQLITE_INTEGER &&
+      sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+    sqlite3_result_error(ctx,
+                         "rowid(1st param of knn_param_rowid) should be of "
+                         "type INTEGER or Blob",
+                         -1);
+    return;
+  }
 
-constexpr bool IsRowidOutOfRange(sqlite3_int64 rowid) {
-  // VirtualTable::Cursor::Rowid is hnswlib::labeltype which is size_t(4 bytes
-  // or 8 bytes) Check the invariant here for future proof in case one day it is
-  // changed in hnswlib.
-  static_assert(sizeof(VirtualTable::Cursor::Rowid) <= sizeof(rowid));
+  if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER) {
+    sqlite3_result_error(
+        ctx, "k(2nd param of knn_param_rowid) should be of type INTEGER", -1);
+    return;
+  }
 
-  // VirtualTable::Cursor::Rowid is also 8 bytes
-  if constexpr (sizeof(VirtualTable::Cursor::Rowid) == sizeof(rowid)) {
-    return rowid < static_cast<sqlite3_int64>(
-                       std::numeric_limits<VirtualTable::Cursor::Rowid>::min());
+  // ef can be NULL if only exclude is specified.
+  if (argc >= 3 && sqlite3_value_type(argv[2]) != SQLITE_INTEGER &&
+      !(argc == 4 && sqlite3_value_type(argv[2]) == SQLITE_NULL)) {
+    sqlite3_result_error(
+        ctx, "ef(3rd param of knn_param_rowid) should be of type INTEGER", -1);
+    return;
   }
-  // VirtualTable::Cursor::Rowid is 4 bytes
-  return rowid < static_cast<sqlite3_int64>(
-                     std::numeric_limits<VirtualTable::Cursor::Rowid>::min()) ||
-         rowid > static_cast<sqlite3_int64>(
-                     std::numeric_limits<VirtualTable::Cursor::Rowid>::max());
-}
 
-// Only insert is supported for now
-int VirtualTable::Update(sqlite3_vtab* pVTab, int argc, sqlite3_value** argv,
-                         sqlite_int64* pRowid) {
-  VirtualTable* vtab = static_cast<VirtualTable*>(pVTab);
-  auto argv0_type = sqlite3_value_type(argv[0]);
-  if (argc > 1 && argv0_type == SQLITE_NULL) {
-    // Insert with a new row
-    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) {
-      SetZErrMsg(&vtab->zErrMsg, "rowid must be specified during insertion");
-      return SQLITE_ERROR;
-    }
-    sqlite3_int64 raw_rowid = sqlite3_value_int64(argv[1]);
-    // This limitation comes from the fact that rowid is used as the label in
-    // hnswlib(hnswlib::labeltype), whose type is size_t which could be 4 or 8
-    // bytes depending on the platform and the compiler. But rowid in sqlite3
-    // has type int64.
-    if (IsRowidOutOfRange(raw_rowid)) {
-      SetZErrMsg(&vtab->zErrMsg, "rowid %lld out of range", raw_rowid);
-      return SQLITE_ERROR;
+  if (argc == 4 && sqlite3_value_type(argv[3]) != SQLITE_INTEGER) {
+    sqlite3_result_error(
+        ctx, "exclude(4th param of knn_param_rowid) should be of type INTEGER",
+        -1);
+    return;
+  }
+
+  std::vector<hnswlib::labeltype> rowids;
+  if (sqlite3_value_type(argv[0]) == SQLITE_INTEGER) {
+    rowids.push_back(
+        static_cast<hnswlib::labeltype>(sqlite3_value_int64(argv[0])));
+  } else {
+    std::string_view rowid_blob(
+        reinterpret_cast<const char*>(sqlite3_value_blob(argv[0])),
+        sqlite3_value_bytes(argv[0]));
+    if (rowid_blob.empty() || rowid_blob.size() % sizeof(sqlite3_int64) != 0) {
+      std::string err = absl::StrFormat(
+          "rowids' size(%d bytes) should be a positive multiple of %d bytes",
+          rowid_blob.size(), sizeof(sqlite3_int64));
+      sqlite3_result_error(ctx, err.c_str(), -1);
+      return;
     }
+    std::vector<sqlite3_int64> values(rowid_blob.size() /
+                                      sizeof(sqlite3_int64));
+    std::memcpy(values.data(), rowid_blob.data(), rowid_blob.size());
+    rowids.assign(values.begin(), values.end());
+  }
 
-    Cursor::Rowid rowid = static_cast<Cursor::Rowid>(raw_rowid);
-    *pRowid = rowid;
+  int32_t k = sqlite3_value_int(argv[1]);
+  if (k <= 0) {
+    sqlite3_result_error(ctx, "k should be greater than 0", -1);
+    return;
+  }
 
-    if (IsRowidInIndex(*vtab->index_, rowid)) {
-      SetZErrMsg(&vtab->zErrMsg, "row %u already exists", rowid);
-      return SQLITE_ERROR;
+  std::optional<uint32_t> ef_search;
+  if (argc >= 3 && sqlite3_value_type(argv[2]) != SQLITE_NULL) {
+    int32_t ef = sqlite3_value_int(argv[2]);
+    if (ef <= 0) {
+      sqlite3_result_error(ctx, "ef should be greater than 0", -1);
+      return;
     }
+    ef_search = ef;
+  }
 
-    if (sqlite3_value_type(argv[2]) != SQLITE_BLOB) {
-      SetZErrMsg(&vtab->zErrMsg, "vector must be of type Blob");
-      return SQLITE_ERROR;
-    }
+  KnnParam* param = new KnnParam();
+  param->k = static_cast<uint32_t>(k);
+  param->ef_search = std::move(ef_search);
+  param->query_rowids = std::move(rowids);
+  param->exclude_query_rows = argc == 4 && sqlite3_value_int(argv[3]) != 0;
+  sqlite3_result_pointer(ctx, param, kKnnParamType.data(), KnnParamDeleter);
+}
 
-    auto vector = Vector::FromBlob(std::string_view(
-        reinterpret_cast<const char*>(sqlite3_value_blob(argv[2])),
-        sqlite3_value_bytes(argv[2])));
-    if (vector.ok()) {
-      if (vector->dim() != vtab->dimension()) {
-        SetZErrMsg(&vtab->zErrMsg,
-                   "Dimension mismatch: vector's "
-                   "dimension %d, table's "
-                   "dimension %d",
-                   vector->dim(), vtab->dimension());
-        return SQLITE_ERROR;
-      }
+void KnnGroupByFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  if (argc < 2 || argc > 3) {
+    sqlite3_result_error(
+        ctx,
+        "invalid number of paramters to knn_group_by(). 2 or 3 is expected",
+        -1);
+    return;
+  }
 
-      try {
-        vtab->index_->addPoint(vtab->space_.normalize
-                                   ? vector->Normalize().data().data()
-                                   : vector->data().data(),
-                               rowid, true);
+  const KnnParam* knn_param = static_cast<const KnnParam*>(
+      sqlite3_value_pointer(argv[0], kKnnParamType.data()));
+  if (!knn_param) {
+    sqlite3_result_error(ctx,
+                         "knn_param(1st param of knn_group_by) should be "
+                         "created by knn_param()",
+                         -1);
+    return;
+  }
 
-      } catch (const std::runtime_error& e) {
-        SetZErrMsg(&vtab->zErrMsg, "Failed to insert row %lld due to: %s",
-                   rowid, e.what());
-        return SQLITE_ERROR;
-      }
-      return SQLITE_OK;
+  if (sqlite3_value_type(argv[1]) != SQLITE_TEXT) {
+    sqlite3_result_error(
+        ctx, "group_by(2nd param of knn_group_by) should be of type TEXT", -1);
+    return;
+  }
+
+  if (argc == 3 && sqlite3_value_type(argv[2]) != SQLITE_INTEGER) {
+    sqlite3_result_error(
+        ctx, "n(3rd param of knn_group_by) should be of type INTEGER", -1);
+    return;
+  }
+
+  int32_t n = argc == 3 ? sqlite3_value_int(argv[2]) : 1;
+  if (n <= 0) {
+    sqlite3_result_error(ctx, "n should be greater than 0", -1);
+    return;
+  }
+
+  std::string_view group_by(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[1])),
+      sqlite3_value_bytes(argv[1]));
+  auto parsed = KnnGroupBy::FromString(group_by, static_cast<uint32_t>(n));
+  if (!parsed.ok()) {
+    sqlite3_result_error(ctx, absl::StatusMessageAsCStr(parsed.status()), -1);
+    return;
+  }
+
+  KnnParam* param = new KnnParam(*knn_param);
+  param->group_by = std::move(*parsed);
+  sqlite3_result_pointer(ctx, param, kKnnParamType.data(), KnnParamDeleter);
+}
+
+void KnnWeightedFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  VECTORLITE_ASSERT(argc == 2);
+  const KnnParam* knn_param = static_cast<const KnnParam*>(
+      sqlite3_value_pointer(argv[0], kKnnParamType.data()));
+  if (!knn_param) {
+    sqlite3_result_error(ctx,
+                         "knn_param(1st param of knn_weighted) should be "
+                         "created by knn_param()",
+                         -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[1]) != SQLITE_BLOB) {
+    sqlite3_result_error(
+        ctx, "weights(2nd param of knn_weighted) should be of type Blob", -1);
+    return;
+  }
+
+  std::string_view weights_blob(
+      reinterpret_cast<const char*>(sqlite3_value_blob(argv[1])),
+      sqlite3_value_bytes(argv[1]));
+  auto weights = Vector::FromBlob(weights_blob);
+  if (!weights.ok()) {
+    std::string err = absl::StrFormat("Failed to parse weights due to: %s",
+                                      weights.status().message());
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  size_t num_weights = weights->dim();
+  if (!knn_param->query_rowids.empty() &&
+      knn_param->query_rowids.size() != num_weights) {
+    std::string err = absl::StrFormat(
+        "number of query rows(%d) doesn't match the number of weights: %d",
+        knn_param->query_rowids.size(), num_weights);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  if (num_weights == 0 || knn_param->query_vector.dim() % num_weights != 0) {
+    std::string err = absl::StrFormat(
+        "query vectors' dimension(%d) isn't a multiple of the number of "
+        "weights: %d",
+        knn_param->query_vector.dim(), num_weights);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  KnnParam* param = new KnnParam(*knn_param);
+  param->weights = weights->data();
+  sqlite3_result_pointer(ctx, param, kKnnParamType.data(), KnnParamDeleter);
+}
+
+// Finds the vectorlite table named name, which is either "table" or
+// "schema.table", for a SQL function called on ctx. A table only joins the
+// registry once sqlite connects to it, which it does lazily when a statement
+// first uses the table, e.g. after the database is reopened. So the table is
+// connected by preparing a statement that reads it if it isn't registered yet.
+// Returns nullptr if there is no such vectorlite table.
+static VirtualTable* FindTable(sqlite3_context* ctx,
+                               const TableRegistry& registry,
+                               std::string_view name) {
+  VirtualTable* vtab = registry.Find(name);
+  if (vtab != nullptr) {
+    return vtab;
+  }
+  // %w doubles the double quotes of an identifier.
+  size_t dot = name.find('.');
+  char* sql = nullptr;
+  if (dot == std::string_view::npos) {
+    std::string table(name);
+    sql = sqlite3_mprintf("SELECT rowid FROM \"%w\" LIMIT 0", table.c_str());
+  } else {
+    std::string schema(name.substr(0, dot));
+    std::string table(name.substr(dot + 1));
+    sql = sqlite3_mprintf("SELECT rowid FROM \"%w\".\"%w\" LIMIT 0",
+                          schema.c_str(), table.c_str());
+  }
+  if (sql == nullptr) {
+    return nullptr;
+  }
+  // Preparing fails with "no query solution" as vectorlite can't scan a
+  // whole table, but only after the table is connected.
+  sqlite3_stmt* stmt = nullptr;
+  sqlite3_prepare_v2(sqlite3_context_db_handle(ctx), sql, -1, &stmt, nullptr);
+  sqlite3_free(sql);
+  sqlite3_finalize(stmt);
+  return registry.Find(name);
+}
+
+void StatsFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  VECTORLITE_ASSERT(argc == 1);
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+    sqlite3_result_error(
+        ctx, "table_name(1st param of vectorlite_stats) should be of type TEXT",
+        -1);
+    return;
+  }
+
+  auto registry =
+      static_cast<std::shared_ptr<TableRegistry>*>(sqlite3_user_data(ctx));
+  VECTORLITE_ASSERT(registry != nullptr);
+  std::string_view table_name(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+      sqlite3_value_bytes(argv[0]));
+  const VirtualTable* vtab = FindTable(ctx, **registry, table_name);
+  if (vtab == nullptr) {
+    std::string err =
+        absl::StrFormat("%s is not a vectorlite table", table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  std::string json = vtab->StatsToJson();
+  sqlite3_result_text(ctx, json.c_str(), json.size(), SQLITE_TRANSIENT);
+}
+
+void BatchSearchFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  if (argc < 3 || argc > 4) {
+    sqlite3_result_error(ctx,
+                         "invalid number of paramters to knn_search_batch(). "
+                         "3 or 4 is expected",
+                         -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+    sqlite3_result_error(
+        ctx,
+        "table_name(1st param of knn_search_batch) should be of type TEXT", -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[1]) != SQLITE_BLOB) {
+    sqlite3_result_error(
+        ctx, "queries(2nd param of knn_search_batch) should be of type Blob",
+        -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[2]) != SQLITE_INTEGER) {
+    sqlite3_result_error(
+        ctx, "k(3rd param of knn_search_batch) should be of type INTEGER", -1);
+    return;
+  }
+
+  if (argc == 4 && sqlite3_value_type(argv[3]) != SQLITE_INTEGER) {
+    sqlite3_result_error(
+        ctx, "ef(4th param of knn_search_batch) should be of type INTEGER",
+        -1);
+    return;
+  }
+
+  auto registry =
+      static_cast<std::shared_ptr<TableRegistry>*>(sqlite3_user_data(ctx));
+  VECTORLITE_ASSERT(registry != nullptr);
+  std::string_view table_name(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+      sqlite3_value_bytes(argv[0]));
+  VirtualTable* vtab = FindTable(ctx, **registry, table_name);
+  if (vtab == nullptr) {
+    std::string err =
+        absl::StrFormat("%s is not a vectorlite table", table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  int32_t k = sqlite3_value_int(argv[2]);
+  if (k <= 0) {
+    sqlite3_result_error(ctx, "k should be greater than 0", -1);
+    return;
+  }
+
+  std::optional<uint32_t> ef_search;
+  if (argc == 4) {
+    int32_t ef = sqlite3_value_int(argv[3]);
+    if (ef <= 0) {
+      sqlite3_result_error(ctx, "ef should be greater than 0", -1);
+      return;
+    }
+    ef_search = ef;
+  }
+
+  // queries holds vectors of the table's dimension back to back.
+  std::string_view blob(
+      reinterpret_cast<const char*>(sqlite3_value_blob(argv[1])),
+      sqlite3_value_bytes(argv[1]));
+  size_t vector_size = vtab->input_dimension() * sizeof(float);
+  if (blob.empty() || blob.size() % vector_size != 0) {
+    std::string err = absl::StrFormat(
+        "queries' size(%d bytes) should be a positive multiple of %d bytes, "
+        "the size of a vector of %s",
+        blob.size(), vector_size, table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  std::vector<Vector> queries;
+  for (size_t offset = 0; offset < blob.size(); offset += vector_size) {
+    auto query = Vector::FromBlob(blob.substr(offset, vector_size));
+    if (!query.ok()) {
+      std::string err = absl::StrFormat("Failed to parse vector due to: %s",
+                                        query.status().message());
+      sqlite3_result_error(ctx, err.c_str(), -1);
+      return;
+    }
+    queries.push_back(std::move(*query));
+  }
+
+  auto json = vtab->BatchSearchToJson(queries, k, ef_search);
+  if (absl::IsCancelled(json.status())) {
+    sqlite3_result_error_code(ctx, SQLITE_INTERRUPT);
+    return;
+  }
+  if (!json.ok()) {
+    std::string err = absl::StrFormat("Failed to execute query due to: %s",
+                                      json.status().message());
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  sqlite3_result_text(ctx, json->c_str(), json->size(), SQLITE_TRANSIENT);
+}
+
+// Implements vectorlite_bulk_insert() and vectorlite_bulk_update(), which
+// only differ in their name, the verb of their error message and the method
+// of VirtualTable they call.
+static void BulkWriteFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv,
+                          std::string_view function_name,
+                          std::string_view verb,
+                          absl::Status (VirtualTable::*write)(
+                              const std::vector<sqlite3_int64>&,
+                              const std::vector<Vector>&, size_t)) {
+  if (argc < 3 || argc > 4) {
+    std::string err = absl::StrFormat(
+        "invalid number of paramters to %s(). 3 or 4 is expected",
+        function_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+    std::string err = absl::StrFormat(
+        "table_name(1st param of %s) should be of type TEXT", function_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[1]) != SQLITE_BLOB) {
+    std::string err = absl::StrFormat(
+        "rowids(2nd param of %s) should be of type Blob", function_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[2]) != SQLITE_BLOB) {
+    std::string err = absl::StrFormat(
+        "vectors(3rd param of %s) should be of type Blob", function_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  if (argc == 4 && sqlite3_value_type(argv[3]) != SQLITE_INTEGER) {
+    std::string err = absl::StrFormat(
+        "num_threads(4th param of %s) should be of type INTEGER",
+        function_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  auto registry =
+      static_cast<std::shared_ptr<TableRegistry>*>(sqlite3_user_data(ctx));
+  VECTORLITE_ASSERT(registry != nullptr);
+  std::string_view table_name(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+      sqlite3_value_bytes(argv[0]));
+  VirtualTable* vtab = FindTable(ctx, **registry, table_name);
+  if (vtab == nullptr) {
+    std::string err =
+        absl::StrFormat("%s is not a vectorlite table", table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  size_t num_threads = 0;
+  if (argc == 4) {
+    sqlite3_int64 value = sqlite3_value_int64(argv[3]);
+    if (value < 0) {
+      sqlite3_result_error(ctx, "num_threads should not be negative", -1);
+      return;
+    }
+    num_threads = static_cast<size_t>(value);
+  }
+
+  std::string_view rowid_blob(
+      reinterpret_cast<const char*>(sqlite3_value_blob(argv[1])),
+      sqlite3_value_bytes(argv[1]));
+  if (rowid_blob.size() % sizeof(sqlite3_int64) != 0) {
+    std::string err = absl::StrFormat(
+        "rowids' size(%d bytes) should be a multiple of %d bytes",
+        rowid_blob.size(), sizeof(sqlite3_int64));
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  std::vector<sqlite3_int64> rowids(rowid_blob.size() / sizeof(sqlite3_int64));
+  std::memcpy(rowids.data(), rowid_blob.data(), rowid_blob.size());
+
+  // vectors holds vectors of the table's dimension back to back.
+  std::string_view vector_blob(
+      reinterpret_cast<const char*>(sqlite3_value_blob(argv[2])),
+      sqlite3_value_bytes(argv[2]));
+  size_t vector_size = vtab->input_dimension() * sizeof(float);
+  if (vector_blob.size() != rowids.size() * vector_size) {
+    std::string err = absl::StrFormat(
+        "vectors' size(%d bytes) should be %d bytes, the size of %d vectors "
+        "of %s",
+        vector_blob.size(), rowids.size() * vector_size, rowids.size(),
+        table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  std::vector<Vector> vectors;
+  vectors.reserve(rowids.size());
+  for (size_t offset = 0; offset < vector_blob.size(); offset += vector_size) {
+    auto vector = Vector::FromBlob(vector_blob.substr(offset, vector_size));
+    if (!vector.ok()) {
+      std::string err = absl::StrFormat("Failed to parse vector due to: %s",
+                                        vector.status().message());
+      sqlite3_result_error(ctx, err.c_str(), -1);
+      return;
+    }
+    vectors.push_back(std::move(*vector));
+  }
+
+  auto status = (vtab->*write)(rowids, vectors, num_threads);
+  if (absl::IsCancelled(status)) {
+    sqlite3_result_error_code(ctx, SQLITE_INTERRUPT);
+    return;
+  }
+  if (!status.ok()) {
+    std::string err = absl::StrFormat("Failed to %s rows due to: %s", verb,
+                                      status.message());
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(rowids.size()));
+}
+
+void BulkInsertFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  BulkWriteFunc(ctx, argc, argv, "vectorlite_bulk_insert", "insert",
+                &VirtualTable::BulkInsert);
+}
+
+void BulkUpdateFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  BulkWriteFunc(ctx, argc, argv, "vectorlite_bulk_update", "update",
+                &VirtualTable::BulkUpdate);
+}
+
+void OptimizeFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  if (argc < 2 || argc > 3) {
+    sqlite3_result_error(
+        ctx,
+        "invalid number of paramters to vectorlite_optimize(). 2 or 3 is "
+        "expected",
+        -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+    sqlite3_result_error(
+        ctx,
+        "table_name(1st param of vectorlite_optimize) should be of type TEXT",
+        -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER) {
+    sqlite3_result_error(
+        ctx, "ef(2nd param of vectorlite_optimize) should be of type INTEGER",
+        -1);
+    return;
+  }
+
+  if (argc == 3 && sqlite3_value_type(argv[2]) != SQLITE_INTEGER) {
+    sqlite3_result_error(ctx,
+                         "num_threads(3rd param of vectorlite_optimize) should "
+                         "be of type INTEGER",
+                         -1);
+    return;
+  }
+
+  auto registry =
+      static_cast<std::shared_ptr<TableRegistry>*>(sqlite3_user_data(ctx));
+  VECTORLITE_ASSERT(registry != nullptr);
+  std::string_view table_name(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+      sqlite3_value_bytes(argv[0]));
+  VirtualTable* vtab = FindTable(ctx, **registry, table_name);
+  if (vtab == nullptr) {
+    std::string err =
+        absl::StrFormat("%s is not a vectorlite table", table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  int32_t ef = sqlite3_value_int(argv[1]);
+  if (ef <= 0) {
+    sqlite3_result_error(ctx, "ef should be greater than 0", -1);
+    return;
+  }
+
+  size_t num_threads = 0;
+  if (argc == 3) {
+    sqlite3_int64 value = sqlite3_value_int64(argv[2]);
+    if (value < 0) {
+      sqlite3_result_error(ctx, "num_threads should not be negative", -1);
+      return;
+    }
+    num_threads = static_cast<size_t>(value);
+  }
+
+  auto num_changed = vtab->Optimize(ef, num_threads);
+  if (absl::IsCancelled(num_changed.status())) {
+    sqlite3_result_error_code(ctx, SQLITE_INTERRUPT);
+    return;
+  }
+  if (!num_changed.ok()) {
+    std::string err = absl::StrFormat("Failed to optimize %s due to: %s",
+                                      table_name,
+                                      num_changed.status().message());
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(*num_changed));
+}
+
+void DeleteRangeFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  if (argc != 3) {
+    sqlite3_result_error(
+        ctx,
+        "invalid number of paramters to vectorlite_delete_range(). 3 is "
+        "expected",
+        -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+    sqlite3_result_error(ctx,
+                         "table_name(1st param of vectorlite_delete_range) "
+                         "should be of type TEXT",
+                         -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[1]) != SQLITE_INTEGER) {
+    sqlite3_result_error(ctx,
+                         "min_rowid(2nd param of vectorlite_delete_range) "
+                         "should be of type INTEGER",
+                         -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[2]) != SQLITE_INTEGER) {
+    sqlite3_result_error(ctx,
+                         "max_rowid(3rd param of vectorlite_delete_range) "
+                         "should be of type INTEGER",
+                         -1);
+    return;
+  }
+
+  auto registry =
+      static_cast<std::shared_ptr<TableRegistry>*>(sqlite3_user_data(ctx));
+  VECTORLITE_ASSERT(registry != nullptr);
+  std::string_view table_name(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+      sqlite3_value_bytes(argv[0]));
+  VirtualTable* vtab = FindTable(ctx, **registry, table_name);
+  if (vtab == nullptr) {
+    std::string err =
+        absl::StrFormat("%s is not a vectorlite table", table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  size_t num_deleted = vtab->DeleteRange(sqlite3_value_int64(argv[1]),
+                                         sqlite3_value_int64(argv[2]));
+  sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(num_deleted));
+}
+
+void CompactFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  if (argc < 1 || argc > 2) {
+    sqlite3_result_error(
+        ctx,
+        "invalid number of paramters to vectorlite_compact(). 1 or 2 is "
+        "expected",
+        -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+    sqlite3_result_error(
+        ctx,
+        "table_name(1st param of vectorlite_compact) should be of type TEXT",
+        -1);
+    return;
+  }
+
+  if (argc == 2 && sqlite3_value_type(argv[1]) != SQLITE_INTEGER) {
+    sqlite3_result_error(ctx,
+                         "num_threads(2nd param of vectorlite_compact) should "
+                         "be of type INTEGER",
+                         -1);
+    return;
+  }
+
+  auto registry =
+      static_cast<std::shared_ptr<TableRegistry>*>(sqlite3_user_data(ctx));
+  VECTORLITE_ASSERT(registry != nullptr);
+  std::string_view table_name(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+      sqlite3_value_bytes(argv[0]));
+  VirtualTable* vtab = FindTable(ctx, **registry, table_name);
+  if (vtab == nullptr) {
+    std::string err =
+        absl::StrFormat("%s is not a vectorlite table", table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  size_t num_threads = 0;
+  if (argc == 2) {
+    sqlite3_int64 value = sqlite3_value_int64(argv[1]);
+    if (value < 0) {
+      sqlite3_result_error(ctx, "num_threads should not be negative", -1);
+      return;
+    }
+    num_threads = static_cast<size_t>(value);
+  }
+
+  auto num_dropped = vtab->Compact(num_threads);
+  if (absl::IsCancelled(num_dropped.status())) {
+    sqlite3_result_error_code(ctx, SQLITE_INTERRUPT);
+    return;
+  }
+  if (!num_dropped.ok()) {
+    std::string err = absl::StrFormat("Failed to compact %s due to: %s",
+                                      table_name,
+                                      num_dropped.status().message());
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(*num_dropped));
+}
+
+void TrainTransformFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+  if (argc < 2 || argc > 3) {
+    sqlite3_result_error(
+        ctx,
+        "invalid number of paramters to vectorlite_train_transform(). 2 or 3 "
+        "is expected",
+        -1);
+    return;
+  }
+
+  if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+    sqlite3_result_error(ctx,
+                         "table_name(1st param of vectorlite_train_transform) "
+                         "should be of type TEXT",
+                         -1);
+    return;
+  }
+
+  std::string_view method = "pca";
+  if (argc == 3) {
+    if (sqlite3_value_type(argv[2]) != SQLITE_TEXT) {
+      sqlite3_result_error(ctx,
+                           "method(3rd param of vectorlite_train_transform) "
+                           "should be of type TEXT",
+                           -1);
+      return;
+    }
+    method = std::string_view(
+        reinterpret_cast<const char*>(sqlite3_value_text(argv[2])),
+        sqlite3_value_bytes(argv[2]));
+  }
+
+  bool needs_samples = method != "random";
+  if (needs_samples && sqlite3_value_type(argv[1]) != SQLITE_TEXT) {
+    sqlite3_result_error(ctx,
+                         "sample_query(2nd param of "
+                         "vectorlite_train_transform) should be of type TEXT",
+                         -1);
+    return;
+  }
+
+  auto registry =
+      static_cast<std::shared_ptr<TableRegistry>*>(sqlite3_user_data(ctx));
+  VECTORLITE_ASSERT(registry != nullptr);
+  std::string_view table_name(
+      reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+      sqlite3_value_bytes(argv[0]));
+  VirtualTable* vtab = FindTable(ctx, **registry, table_name);
+  if (vtab == nullptr) {
+    std::string err =
+        absl::StrFormat("%s is not a vectorlite table", table_name);
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+
+  // Sample vectors are collected back to back.
+  std::vector<float> samples;
+  if (needs_samples) {
+    sqlite3_stmt* stmt = nullptr;
+    int rc = sqlite3_prepare_v2(
+        sqlite3_context_db_handle(ctx),
+        reinterpret_cast<const char*>(sqlite3_value_text(argv[1])), -1, &stmt,
+        nullptr);
+    if (rc != SQLITE_OK) {
+      std::string err =
+          absl::StrFormat("Failed to prepare sample_query due to: %s",
+                          sqlite3_errmsg(sqlite3_context_db_handle(ctx)));
+      sqlite3_result_error(ctx, err.c_str(), -1);
+      return;
+    }
+    std::unique_ptr<sqlite3_stmt, int (*)(sqlite3_stmt*)> stmt_owner(
+        stmt, sqlite3_finalize);
+    size_t vector_size = vtab->input_dimension() * sizeof(float);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      size_t size = sqlite3_column_bytes(stmt, 0);
+      if (sqlite3_column_type(stmt, 0) != SQLITE_BLOB || size == 0 ||
+          size % vector_size != 0) {
+        std::string err = absl::StrFormat(
+            "sample_query should return BLOBs of vectors of %d bytes, the "
+            "size of a vector of %s",
+            vector_size, table_name);
+        sqlite3_result_error(ctx, err.c_str(), -1);
+        return;
+      }
+      const char* blob =
+          reinterpret_cast<const char*>(sqlite3_column_blob(stmt, 0));
+      size_t offset = samples.size();
+      samples.resize(offset + size / sizeof(float));
+      std::memcpy(samples.data() + offset, blob, size);
+    }
+    if (rc != SQLITE_DONE) {
+      std::string err =
+          absl::StrFormat("Failed to run sample_query due to: %s",
+                          sqlite3_errmsg(sqlite3_context_db_handle(ctx)));
+      sqlite3_result_error(ctx, err.c_str(), -1);
+      return;
+    }
+  }
+
+  size_t num_samples = samples.size() / vtab->input_dimension();
+  auto status = vtab->TrainTransform(method, samples.data(), num_samples, 0);
+  if (absl::IsCancelled(status)) {
+    sqlite3_result_error_code(ctx, SQLITE_INTERRUPT);
+    return;
+  }
+  if (!status.ok()) {
+    std::string err =
+        absl::StrFormat("Failed to train the transform of %s due to: %s",
+                        table_name, status.message());
+    sqlite3_result_error(ctx, err.c_str(), -1);
+    return;
+  }
+  sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(num_samples));
+}
+
+int VirtualTable::FindFunction(sqlite3_vtab* pVtab, int nArg, const char* zName,
+                               void (**pxFunc)(sqlite3_context*, int,
+                                               sqlite3_value**),
+                               void** ppArg) {
+  VECTORLITE_ASSERT(pVtab != nullptr);
+  if (std::string_view(zName) == "knn_search") {
+    *pxFunc = KnnSearch;
+    *ppArg = nullptr;
+    return kFunctionConstraintVectorSearchKnn;
+  }
+
+  return 0;
+}
+
+constexpr bool IsRowidOutOfRange(sqlite3_int64 rowid) {
+  // VirtualTable::Cursor::Rowid is hnswlib::labeltype which is size_t(4 bytes
+  // or 8 bytes) Check the invariant here for future proof in case one day it is
+  // changed in hnswlib.
+  static_assert(sizeof(VirtualTable::Cursor::Rowid) <= sizeof(rowid));
+
+  // VirtualTable::Cursor::Rowid is also 8 bytes
+  if constexpr (sizeof(VirtualTable::Cursor::Rowid) == sizeof(rowid)) {
+    return rowid < static_cast<sqlite3_int64>(
+                       std::numeric_limits<VirtualTable::Cursor::Rowid>::min());
+  }
+  // VirtualTable::Cursor::Rowid is 4 bytes
+  return rowid < static_cast<sqlite3_int64>(
+                     std::numeric_limits<VirtualTable::Cursor::Rowid>::min()) ||
+         rowid > static_cast<sqlite3_int64>(
+                     std::numeric_limits<VirtualTable::Cursor::Rowid>::max());
+}
+
+absl::Status VirtualTable::BulkInsert(const std::vector<sqlite3_int64>& rowids,
+                                      const std::vector<Vector>& vectors,
+                                      size_t num_threads) {
+  VECTORLITE_ASSERT(rowids.size() == vectors.size());
+  if (space_.multi_vector) {
+    return absl::InvalidArgumentError(
+        "bulk insert isn't supported by multi-vector tables");
+  }
+  std::vector<Cursor::Rowid> labels;
+  labels.reserve(rowids.size());
+  for (size_t i = 0; i < rowids.size(); i++) {
+    if (IsRowidOutOfRange(rowids[i])) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("rowid %lld out of range", rowids[i]));
+    }
+    Cursor::Rowid rowid = static_cast<Cursor::Rowid>(rowids[i]);
+    if (rowid_map_.FindLive(*index_, rowid)) {
+      return absl::AlreadyExistsError(
+          absl::StrFormat("row %u already exists", rowid));
+    }
+    if (vectors[i].dim() != input_dimension()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Dimension mismatch: vector's dimension %d, table's dimension %d",
+          vectors[i].dim(), input_dimension()));
+    }
+    labels.push_back(rowid);
+  }
+  std::vector<Cursor::Rowid> sorted_labels = labels;
+  std::sort(sorted_labels.begin(), sorted_labels.end());
+  auto duplicate =
+      std::adjacent_find(sorted_labels.begin(), sorted_labels.end());
+  if (duplicate != sorted_labels.end()) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("row %u is inserted more than once", *duplicate));
+  }
+
+  size_t num_replaced = 0;
+  if (index_->allow_replace_deleted_) {
+    num_replaced = std::min(labels.size(), index_->deleted_elements.size());
+  }
+  if (labels.size() - num_replaced >
+      index_->max_elements_ - index_->cur_element_count) {
+    return absl::ResourceExhaustedError(
+        "The number of elements exceeds the specified limit");
+  }
+
+  // Vectors are reduced before any row is inserted, so that no row is
+  // inserted if the transform isn't trained.
+  std::vector<Vector> reduced;
+  auto status = TransformAll(vectors, num_threads, reduced);
+  if (!status.ok()) {
+    return status;
+  }
+  const std::vector<Vector>& rows = transform_ ? reduced : vectors;
+
+  InvalidateCaches();
+  Deadline deadline(std::nullopt, db_);
+  size_t num_inserted = 0;
+  try {
+    for (; num_inserted < num_replaced && !deadline.Expired(); num_inserted++) {
+      AddPoint(rows[num_inserted], labels[num_inserted]);
+    }
+  } catch (const std::runtime_error& e) {
+    return absl::InternalError(e.what());
+  }
+  if (deadline.interrupted()) {
+    return absl::CancelledError(absl::StrFormat(
+        "vectorlite_bulk_insert interrupted after inserting %d rows",
+        num_inserted));
+  }
+
+  std::vector<float> data;
+  data.reserve((labels.size() - num_replaced) * dimension());
+  std::vector<float> normalized;
+  for (size_t i = num_replaced; i < labels.size(); i++) {
+    const std::vector<float>* vector = &rows[i].data();
+    if (space_.normalize) {
+      rows[i].NormalizeTo(normalized);
+      vector = &normalized;
+    }
+    data.insert(data.end(), vector->begin(), vector->end());
+  }
+  hnswlib::tableint first_id =
+      static_cast<hnswlib::tableint>(index_->cur_element_count);
+  status =
+      vectorlite::BulkInsert(*index_, data.data(), labels.data() + num_replaced,
+                             labels.size() - num_replaced, num_threads,
+                             deadline, filter_gamma_);
+  if (!status.ok()) {
+    return status;
+  }
+  // Rows inserted before the deadline expired are kept.
+  num_inserted += index_->cur_element_count - first_id;
+  for (size_t i = num_replaced; i < num_inserted; i++) {
+    hnswlib::tableint id = first_id + (i - num_replaced);
+    rowid_map_.Insert(labels[i], id);
+    attributes_.Clear(id);
+  }
+  early_abandon_space_.Rebuild(*index_);
+  if (early_abandon_prefix_space_) {
+    early_abandon_prefix_space_->Rebuild(*index_);
+  }
+  if (deadline.interrupted()) {
+    return absl::CancelledError(absl::StrFormat(
+        "vectorlite_bulk_insert interrupted after inserting %d rows",
+        num_inserted));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status VirtualTable::BulkUpdate(const std::vector<sqlite3_int64>& rowids,
+                                      const std::vector<Vector>& vectors,
+                                      size_t num_threads) {
+  VECTORLITE_ASSERT(rowids.size() == vectors.size());
+  if (space_.multi_vector) {
+    return absl::InvalidArgumentError(
+        "bulk update isn't supported by multi-vector tables");
+  }
+  std::vector<hnswlib::tableint> ids;
+  ids.reserve(rowids.size());
+  for (size_t i = 0; i < rowids.size(); i++) {
+    if (IsRowidOutOfRange(rowids[i])) {
+      return absl::InvalidArgumentError(
+          absl::StrFormat("rowid %lld out of range", rowids[i]));
+    }
+    auto id = rowid_map_.FindLive(*index_,
+                                  static_cast<Cursor::Rowid>(rowids[i]));
+    if (!id) {
+      return absl::NotFoundError(
+          absl::StrFormat("rowid %lld not found", rowids[i]));
+    }
+    if (vectors[i].dim() != input_dimension()) {
+      return absl::InvalidArgumentError(absl::StrFormat(
+          "Dimension mismatch: vector's dimension %d, table's dimension %d",
+          vectors[i].dim(), input_dimension()));
+    }
+    ids.push_back(*id);
+  }
+  std::vector<hnswlib::tableint> sorted_ids = ids;
+  std::sort(sorted_ids.begin(), sorted_ids.end());
+  auto duplicate = std::adjacent_find(sorted_ids.begin(), sorted_ids.end());
+  if (duplicate != sorted_ids.end()) {
+    return absl::InvalidArgumentError(
+        absl::StrFormat("row %u is updated more than once",
+                        index_->getExternalLabel(*duplicate)));
+  }
+
+  std::vector<Vector> reduced;
+  auto status = TransformAll(vectors, num_threads, reduced);
+  if (!status.ok()) {
+    return status;
+  }
+  const std::vector<Vector>& rows = transform_ ? reduced : vectors;
+
+  InvalidateCaches();
+  std::vector<float> data;
+  data.reserve(rows.size() * dimension());
+  std::vector<float> normalized;
+  for (const auto& row : rows) {
+    const std::vector<float>* vector = &row.data();
+    if (space_.normalize) {
+      row.NormalizeTo(normalized);
+      vector = &normalized;
+    }
+    data.insert(data.end(), vector->begin(), vector->end());
+  }
+  Deadline deadline(std::nullopt, db_);
+  auto num_updated = vectorlite::BulkUpdate(
+      *index_, ids.data(), data.data(), ids.size(), index_->ef_construction_,
+      num_threads, deadline, filter_gamma_);
+  early_abandon_space_.Rebuild(*index_);
+  if (early_abandon_prefix_space_) {
+    early_abandon_prefix_space_->Rebuild(*index_);
+  }
+  if (!num_updated.ok()) {
+    return num_updated.status();
+  }
+  if (deadline.interrupted()) {
+    return absl::CancelledError(absl::StrFormat(
+        "vectorlite_bulk_update interrupted after updating %d rows",
+        *num_updated));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status VirtualTable::TransformAll(const std::vector<Vector>& vectors,
+                                        size_t num_threads,
+                                        std::vector<Vector>& reduced) const {
+  if (!transform_) {
+    return absl::OkStatus();
+  }
+  reduced = vectors;
+  return ParallelFor(reduced.size(), num_threads,
+                     [&](size_t i) { return Transform(reduced[i]); });
+}
+
+absl::StatusOr<size_t> VirtualTable::Optimize(size_t ef, size_t num_threads) {
+  InvalidateCaches();
+  Deadline deadline(std::nullopt, db_);
+  auto num_changed =
+      RefineGraph(*index_, ef, num_threads, deadline, filter_gamma_);
+  if (num_changed.ok() && deadline.interrupted()) {
+    return absl::CancelledError("vectorlite_optimize interrupted");
+  }
+  return num_changed;
+}
+
+size_t VirtualTable::DeleteRange(sqlite3_int64 min_rowid,
+                                 sqlite3_int64 max_rowid) {
+  // Rowids out of range can't be in the index.
+  min_rowid = std::max<sqlite3_int64>(min_rowid, 0);
+  if (min_rowid > max_rowid) {
+    return 0;
+  }
+  InvalidateCaches();
+  size_t num_deleted = 0;
+  for (hnswlib::tableint id = 0; id < index_->cur_element_count; id++) {
+    Cursor::Rowid rowid = index_->getExternalLabel(id);
+    if (rowid >= static_cast<Cursor::Rowid>(min_rowid) &&
+        rowid <= static_cast<Cursor::Rowid>(max_rowid) &&
+        !index_->isMarkedDeleted(id)) {
+      index_->markDeletedInternal(id);
+      num_deleted++;
+    }
+  }
+  return num_deleted;
+}
+
+absl::StatusOr<size_t> VirtualTable::Compact(size_t num_threads) {
+  size_t num_deleted = index_->getDeletedCount();
+  if (num_deleted == 0) {
+    return 0;
+  }
+  InvalidateCaches();
+  std::unique_ptr<hnswlib::HierarchicalNSW<float>> compacted;
+  try {
+    compacted = std::make_unique<hnswlib::HierarchicalNSW<float>>(
+        space_.space.get(), index_->max_elements_, index_->M_,
+        index_->ef_construction_, 0, index_->allow_replace_deleted_);
+  } catch (const std::exception& e) {
+    return absl::ResourceExhaustedError(e.what());
+  }
+  // Levels keep being drawn from the same sequence.
+  compacted->level_generator_ = index_->level_generator_;
+  compacted->setEf(index_->ef_);
+  Deadline deadline(std::nullopt, db_);
+  auto status =
+      CompactInto(*index_, *compacted, num_threads, deadline, filter_gamma_);
+  if (!status.ok()) {
+    return status;
+  }
+  // The partly compacted index is discarded, leaving the table unchanged.
+  if (deadline.interrupted()) {
+    return absl::CancelledError("vectorlite_compact interrupted");
+  }
+  attributes_.Compact(*index_);
+  index_ = std::move(compacted);
+  rowid_map_.Rebuild(*index_);
+  early_abandon_space_.Rebuild(*index_);
+  if (early_abandon_prefix_space_) {
+    early_abandon_prefix_space_->Rebuild(*index_);
+  }
+  return num_deleted;
+}
+
+// Only insert is supported for now
+int VirtualTable::Update(sqlite3_vtab* pVTab, int argc, sqlite3_value** argv,
+                         sqlite_int64* pRowid) {
+  VECTORLITE_TRACE_SPAN("Update");
+  VirtualTable* vtab = static_cast<VirtualTable*>(pVTab);
+  vtab->InvalidateCaches();
+  auto argv0_type = sqlite3_value_type(argv[0]);
+  // argv[2] is the vector, argv[3] is the hidden distance column and the
+  // attributes follow.
+  VECTORLITE_ASSERT(argc == 1 ||
+                    argc == 2 + kColumnIndexAttributes +
+                                static_cast<int>(vtab->attributes_.size()));
+  sqlite3_value** attributes = argv + 2 + kColumnIndexAttributes;
+  if (argc > 1 && argv0_type == SQLITE_NULL) {
+    // Insert with a new row
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+      SetZErrMsg(&vtab->zErrMsg, "rowid must be specified during insertion");
+      return SQLITE_ERROR;
+    }
+    sqlite3_int64 raw_rowid = sqlite3_value_int64(argv[1]);
+    // This limitation comes from the fact that rowid is used as the label in
+    // hnswlib(hnswlib::labeltype), whose type is size_t which could be 4 or 8
+    // bytes depending on the platform and the compiler. But rowid in sqlite3
+    // has type int64.
+    if (IsRowidOutOfRange(raw_rowid)) {
+      SetZErrMsg(&vtab->zErrMsg, "rowid %lld out of range", raw_rowid);
+      return SQLITE_ERROR;
+    }
+
+    Cursor::Rowid rowid = static_cast<Cursor::Rowid>(raw_rowid);
+    *pRowid = rowid;
+
+    if (vtab->rowid_map_.FindLive(*vtab->index_, rowid)) {
+      SetZErrMsg(&vtab->zErrMsg, "row %u already exists", rowid);
+      return SQLITE_ERROR;
+    }
+
+    if (sqlite3_value_type(argv[2]) != SQLITE_BLOB) {
+      SetZErrMsg(&vtab->zErrMsg, "vector must be of type Blob");
+      return SQLITE_ERROR;
+    }
+
+    auto vector = Vector::FromBlob(std::string_view(
+        reinterpret_cast<const char*>(sqlite3_value_blob(argv[2])),
+        sqlite3_value_bytes(argv[2])));
+    if (vector.ok()) {
+      auto status = vtab->CheckDimension(*vector);
+      if (status.ok()) {
+        status = vtab->Transform(*vector);
+      }
+      if (!status.ok()) {
+        SetZErrMsg(&vtab->zErrMsg, "%s", absl::StatusMessageAsCStr(status));
+        return SQLITE_ERROR;
+      }
+
+      status = vtab->CheckAttributes(attributes);
+      if (!status.ok()) {
+        SetZErrMsg(&vtab->zErrMsg, "Failed to insert row %lld due to: %s",
+                   rowid, absl::StatusMessageAsCStr(status));
+        return SQLITE_ERROR;
+      }
+
+      try {
+        hnswlib::tableint id = vtab->space_.multi_vector
+                                   ? vtab->AddRow(*vector, rowid)
+                                   : vtab->AddPoint(*vector, rowid);
+        vtab->SetAttributes(id, attributes);
+      } catch (const std::runtime_error& e) {
+        SetZErrMsg(&vtab->zErrMsg, "Failed to insert row %lld due to: %s",
+                   rowid, e.what());
+        return SQLITE_ERROR;
+      }
+      return SQLITE_OK;
     } else {
       SetZErrMsg(&vtab->zErrMsg, "Failed to perform insertion due to: %s",
                  absl::StatusMessageAsCStr(vector.status()));
@@ -671,8 +2328,17 @@ int VirtualTable::Update(sqlite3_vtab* pVTab, int argc, sqlite3_value** argv,
       return SQLITE_ERROR;
     }
     Cursor::Rowid rowid = static_cast<Cursor::Rowid>(raw_rowid);
+    auto id = vtab->rowid_map_.Find(rowid);
+    if (!id) {
+      SetZErrMsg(&vtab->zErrMsg, "Delete failed with rowid %lld: %s", raw_rowid,
+                 "Label not found");
+      return SQLITE_ERROR;
+    }
     try {
-      vtab->index_->markDelete(rowid);
+      size_t num_vectors = vtab->CountRowVectors(*id);
+      for (size_t i = 0; i < num_vectors; i++) {
+        vtab->index_->markDeletedInternal(*id + i);
+      }
     } catch (const std::runtime_error& ex) {
       SetZErrMsg(&vtab->zErrMsg, "Delete failed with rowid %lld: %s", raw_rowid,
                  ex.what());
@@ -703,11 +2369,24 @@ int VirtualTable::Update(sqlite3_vtab* pVTab, int argc, sqlite3_value** argv,
     }
 
     Cursor::Rowid rowid = static_cast<Cursor::Rowid>(source_rowid);
-    if (!IsRowidInIndex(*(vtab->index_), rowid)) {
+    auto id = vtab->rowid_map_.FindLive(*vtab->index_, rowid);
+    if (!id) {
       SetZErrMsg(&vtab->zErrMsg, "rowid %lld not found", source_rowid);
       return SQLITE_ERROR;
     }
 
+    auto status = vtab->CheckAttributes(attributes);
+    if (!status.ok()) {
+      SetZErrMsg(&vtab->zErrMsg, "Failed to update row %lld due to: %s", rowid,
+                 absl::StatusMessageAsCStr(status));
+      return SQLITE_ERROR;
+    }
+    // The vector is left as is if only attributes are set.
+    if (sqlite3_value_nochange(argv[2])) {
+      vtab->SetAttributes(*id, attributes);
+      return SQLITE_OK;
+    }
+
     if (sqlite3_value_type(argv[2]) != SQLITE_BLOB) {
       SetZErrMsg(&vtab->zErrMsg, "vector must be of type Blob");
       return SQLITE_ERROR;
@@ -717,21 +2396,29 @@ int VirtualTable::Update(sqlite3_vtab* pVTab, int argc, sqlite3_value** argv,
         sqlite3_value_bytes(argv[2])));
 
     if (vector.ok()) {
-      if (vector->dim() != vtab->dimension()) {
-        SetZErrMsg(&vtab->zErrMsg,
-                   "Dimension mismatch: vector's "
-                   "dimension %d, table's "
-                   "dimension %d",
-                   vector->dim(), vtab->dimension());
+      status = vtab->CheckDimension(*vector);
+      if (status.ok()) {
+        status = vtab->Transform(*vector);
+      }
+      if (!status.ok()) {
+        SetZErrMsg(&vtab->zErrMsg, "%s", absl::StatusMessageAsCStr(status));
         return SQLITE_ERROR;
       }
 
       try {
-        vtab->index_->addPoint(vtab->space_.normalize
-                                   ? vector->Normalize().data().data()
-                                   : vector->data().data(),
-                               rowid, vtab->index_->allow_replace_deleted_);
-
+        if (vtab->space_.multi_vector) {
+          // The number of vectors might change, so the row gets new elements
+          // and the old ones are deleted.
+          size_t num_vectors = vtab->CountRowVectors(*id);
+          hnswlib::tableint new_id = vtab->AddRow(*vector, rowid);
+          for (size_t i = 0; i < num_vectors; i++) {
+            vtab->index_->markDeletedInternal(*id + i);
+          }
+          id = new_id;
+        } else {
+          vtab->UpdatePoint(*vector, *id);
+        }
+        vtab->SetAttributes(*id, attributes);
       } catch (const std::runtime_error& e) {
         SetZErrMsg(&vtab->zErrMsg, "Failed to update row %lld due to: %s",
                    rowid, e.what());
@@ -3,15 +3,28 @@
 #include <cstddef>
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <set>
+#include <string>
 #include <string_view>
 #include <utility>  // std::pair
+#include <vector>
 
 #include "absl/status/statusor.h"
+#include "attribute_store.h"
+#include "batch_search.h"
+#include "constraint.h"
+#include "early_abandon.h"
 #include "hnswlib/hnswlib.h"
 #include "index_options.h"
+#include "linear_transform.h"
 #include "macros.h"
+#include "parallel.h"
+#include "result_cache.h"
+#include "rowid_map.h"
+#include "semantic_cache.h"
 #include "sqlite3ext.h"
+#include "table_registry.h"
 #include "vector.h"
 #include "vector_space.h"
 
@@ -44,24 +57,71 @@ class VirtualTable : public sqlite3_vtab {
     ResultSet result;           // result rowid set, pair is (distance, rowid)
     ResultSetIter current_row;  // points to current row
     Vector query_vector;        // query vector
+
+    // idxStr of the last xFilter call and the constraints parsed from it.
+    // The constraints are reused if the next xFilter call(e.g. the same
+    // statement is run again) has the same idxStr.
+    std::string constraint_str;
+    std::vector<std::unique_ptr<Constraint>> constraints;
+    // Reused across xFilter calls, so that steady-state queries don't
+    // allocate.
+    QueryScratch scratch;
   };
 
   ~VirtualTable();
 
-  VirtualTable(NamedVectorSpace space, const IndexOptions& options,
+  // The table registers itself to registry as schema.name, and unregisters
+  // on destruction. attribute_names are the names of its attribute columns.
+  VirtualTable(sqlite3* db, std::shared_ptr<TableRegistry> registry,
+               std::string_view schema, std::string_view name,
+               NamedVectorSpace space, const IndexOptions& options,
+               std::vector<std::string> attribute_names,
                std::string_view file_path)
-      : space_(std::move(space)),
+      : db_(db),
+        registry_(std::move(registry)),
+        schema_(schema),
+        name_(name),
+        space_(std::move(space)),
+        transform_(space_.transform_input_dimension > 0
+                       ? std::make_unique<LinearTransform>(
+                             space_.transform_input_dimension,
+                             space_.dimension())
+                       : nullptr),
         index_(std::make_unique<hnswlib::HierarchicalNSW<float>>(
-            space_.space.get(), options.max_elements, options.M,
-            options.ef_construction, options.random_seed,
-            options.allow_replace_deleted)),
-        file_path_() {
+            space_.space.get(), options.max_elements,
+            options.M * options.filter_gamma, options.ef_construction,
+            options.random_seed, options.allow_replace_deleted)),
+        filter_gamma_(options.filter_gamma),
+        attributes_(std::move(attribute_names), options.max_elements),
+        file_path_(),
+        search_threads_(options.search_threads > 0 ? options.search_threads
+                                                   : DefaultNumThreads()),
+        early_abandon_space_(space_.distance_type, space_.dimension()),
+        early_abandon_prefix_space_(
+            space_.prefix_space
+                ? std::make_unique<EarlyAbandonSpace>(
+                      space_.distance_type, space_.prefix_dimension())
+                : nullptr),
+        result_cache_(options.result_cache_size > 0
+                          ? std::make_unique<ResultCache>(
+                                options.result_cache_size)
+                          : nullptr),
+        semantic_cache_(options.semantic_cache_size > 0
+                            ? std::make_unique<SemanticCache>(
+                                  options.semantic_cache_size,
+                                  options.semantic_cache_epsilon,
+                                  *space_.space)
+                            : nullptr) {
+    VECTORLITE_ASSERT(db_ != nullptr);
+    VECTORLITE_ASSERT(registry_ != nullptr);
     VECTORLITE_ASSERT(space_.space != nullptr);
     VECTORLITE_ASSERT(index_ != nullptr);
+    idle_cursors_.reserve(kMaxIdleCursors);
     if (!file_path.empty()) {
       // might throw
       file_path_ = file_path;
     }
+    registry_->Register(schema_, name_, this);
   }
 
   // Load index from file_path_.
@@ -73,6 +133,66 @@ class VirtualTable : public sqlite3_vtab {
 
   size_t dimension() const { return space_.dimension(); }
 
+  // Returns the dimension of vectors given in SQL, which differs from
+  // dimension() if the table reduces vectors.
+  size_t input_dimension() const { return space_.input_dimension(); }
+
+  // Returns runtime statistics of the table as a JSON object.
+  std::string StatsToJson() const;
+
+  // Searches for the k nearest neighbors of each of queries as a batch, see
+  // QueryExecutor::ExecuteBatch(). Returns a JSON array holding an array of
+  // {"rowid": rowid, "distance": distance} objects per query.
+  absl::StatusOr<std::string> BatchSearchToJson(
+      const std::vector<Vector>& queries, size_t k,
+      std::optional<uint32_t> ef_search);
+
+  // Inserts vectors[i] as rowids[i] for every i. Rows first take the place of
+  // deleted rows like inserting them one by one does, the rest are inserted
+  // by BulkInsert() using up to num_threads threads, which is much faster.
+  // No row is inserted if any of them is invalid. If the connection is
+  // interrupted, the rows inserted so far, a prefix of rowids, are kept and
+  // CancelledError is returned.
+  absl::Status BulkInsert(const std::vector<sqlite3_int64>& rowids,
+                          const std::vector<Vector>& vectors,
+                          size_t num_threads);
+
+  // Replaces the vectors of rows rowids[i] with vectors[i] for every i. The
+  // vectors are written in chunks and the links of each chunk's rows are
+  // selected again, then their neighbors are repaired in a single pass, by
+  // BulkUpdate() using up to num_threads threads, which is much faster than
+  // updating rows one by one. No row is updated if any of them is invalid. If
+  // the connection is interrupted, the rows updated so far, a prefix of
+  // rowids, keep their new vectors and CancelledError is returned.
+  absl::Status BulkUpdate(const std::vector<sqlite3_int64>& rowids,
+                          const std::vector<Vector>& vectors,
+                          size_t num_threads);
+
+  // Trains the linear transform reducing the vectors of the table, which must
+  // be empty. method is "pca", which fits the transform to num_samples
+  // samples of input_dimension() elements held back to back by samples using
+  // up to num_threads threads, or "random", which needs no samples. Returns
+  // CancelledError, leaving the transform untrained, if the connection is
+  // interrupted.
+  absl::Status TrainTransform(std::string_view method, const float* samples,
+                              size_t num_samples, size_t num_threads);
+
+  // Improves the index's graph by selecting the links of every row again
+  // among the ef nearest rows, see RefineGraph(). Uses up to num_threads
+  // threads. Returns the number of rows whose links changed.
+  absl::StatusOr<size_t> Optimize(size_t ef, size_t num_threads);
+
+  // Deletes the rows whose rowid is in [min_rowid, max_rowid] with a single
+  // pass over the index. Like DELETE, rows are only marked deleted, their
+  // space is reclaimed by Compact(). Returns the number of rows deleted.
+  size_t DeleteRange(sqlite3_int64 min_rowid, sqlite3_int64 max_rowid);
+
+  // Rebuilds the index without its deleted rows, see CompactInto(). Uses up to
+  // num_threads threads. Returns the number of deleted rows dropped, or
+  // CancelledError, leaving the index unchanged, if the connection is
+  // interrupted.
+  absl::StatusOr<size_t> Compact(size_t num_threads);
+
   // Implementation of the virtual table goes below.
   // For more info on what each function does, please check
   // https://www.sqlite.org/vtab.html
@@ -103,16 +223,199 @@ class VirtualTable : public sqlite3_vtab {
  private:
   absl::StatusOr<Vector> GetVectorByRowid(int64_t rowid) const;
 
+  // Returns the per-table state used by queries.
+  QueryContext MakeQueryContext();
+
+  // Drops cached query results, which might be outdated after any change to
+  // the index.
+  void InvalidateCaches();
+
+  // Adds vector to the index as rowid, normalizing it if needed. rowid must
+  // not be in the index, or be deleted. The element of a deleted row is reused
+  // if replacement of deleted elements is enabled. Returns the id of the
+  // element, whose attributes are reset.
+  // Throws std::runtime_error like hnswlib if it fails.
+  hnswlib::tableint AddPoint(const Vector& vector, Cursor::Rowid rowid);
+
+  // Adds the vectors of a row of a multi-vector table, held back to back by
+  // vectors, as consecutive elements labeled rowid. They are normalized if
+  // needed. rowid must not be in the index, or be deleted. Deleted elements
+  // are never reused, so that the elements of a row stay consecutive, see
+  // RowidMap::CountRowElements(). Returns the id of the first element. The
+  // attributes of the elements are reset.
+  // Throws std::runtime_error if it fails.
+  hnswlib::tableint AddRow(const Vector& vectors, Cursor::Rowid rowid);
+
+  // Returns the number of vectors of the row whose first element is id.
+  size_t CountRowVectors(hnswlib::tableint id) const {
+    return space_.multi_vector ? RowidMap::CountRowElements(*index_, id) : 1;
+  }
+
+  // Checks that vector holds a vector of the table's input dimension, or one
+  // or more of them for multi-vector tables.
+  absl::Status CheckDimension(const Vector& vector) const;
+
+  // Reduces the vectors held back to back by vectors, which were checked by
+  // CheckDimension(), with the table's transform. Does nothing if the table
+  // doesn't reduce vectors. Returns FailedPreconditionError if the transform
+  // isn't trained.
+  absl::Status Transform(Vector& vectors) const;
+
+  // Like Transform(), but reduces each of vectors into reduced using up to
+  // num_threads threads. Leaves reduced empty if the table doesn't reduce
+  // vectors.
+  absl::Status TransformAll(const std::vector<Vector>& vectors,
+                            size_t num_threads,
+                            std::vector<Vector>& reduced) const;
+
+  // Replaces the vector of element id, normalizing it if needed.
+  void UpdatePoint(const Vector& vector, hnswlib::tableint id);
+
+  // Checks the values of the attribute columns passed to xUpdate, which must
+  // be integers or NULL.
+  absl::Status CheckAttributes(sqlite3_value** values) const;
+
+  // Sets the attributes of the row whose first element is id to values
+  // checked by CheckAttributes(). NULL is stored as 0.
+  void SetAttributes(hnswlib::tableint id, sqlite3_value** values);
+
+  // Attributes are saved next to the index file, if any.
+  std::filesystem::path AttributesFilePath() const;
+
+  // The transform is saved next to the index file, if any.
+  std::filesystem::path TransformFilePath() const;
+
+  // The database connection that owns this virtual table.
+  sqlite3* db_;
+  std::shared_ptr<TableRegistry> registry_;
+  std::string schema_;
+  std::string name_;
   NamedVectorSpace space_;
+  // nullptr unless the table reduces vectors, in which case vectors given in
+  // SQL are reduced before reaching index_. The vector column returns the
+  // reduced vectors.
+  std::unique_ptr<LinearTransform> transform_;
   std::unique_ptr<hnswlib::HierarchicalNSW<float>> index_;
+  // index_ is built for filtered searches if greater than 1, see BulkInsert().
+  size_t filter_gamma_;
+  // Maps rowids to elements of index_, in place of index_->label_lookup_.
+  RowidMap rowid_map_;
+  // Values of the attribute columns, indexed like index_'s elements.
+  AttributeStore attributes_;
   std::filesystem::path file_path_;
+  // Max number of threads a single vector search can use.
+  size_t search_threads_;
+  // Used by vector search to compute distances with early abandoning.
+  EarlyAbandonSpace early_abandon_space_;
+  // nullptr if prefix search is disabled.
+  std::unique_ptr<EarlyAbandonSpace> early_abandon_prefix_space_;
+  SearchStats search_stats_;
+  // nullptr if result cache is disabled.
+  std::unique_ptr<ResultCache> result_cache_;
+  // nullptr if semantic cache is disabled.
+  std::unique_ptr<SemanticCache> semantic_cache_;
+  // Reused by BatchSearchToJson().
+  BatchSearchBuffers batch_buffers_;
+
+  // sqlite closes cursors whenever a statement is reset. Closed cursors are
+  // kept here and reused by Open(), so that their buffers survive across
+  // statement executions.
+  static constexpr size_t kMaxIdleCursors = 2;
+  std::vector<std::unique_ptr<Cursor>> idle_cursors_;
 };
 
 // Just a marker function that tells BestIndex that this is a vector search
 void KnnSearch(sqlite3_context* context, int argc, sqlite3_value** argv);
 
 // Returns a sqlite3 value pointer that points to KnnSearch's second parameter.
-// including inpupt vector, k
+// including inpupt vector, k, and optionally ef and timeout_ms.
+// e.g. knn_param(vector, k, ef, timeout_ms). ef can be NULL if only timeout_ms
+// is specified.
 void KnnParamFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
 
+// knn_param_rowid(rowid, k, ef, exclude) is like knn_param() but searches for
+// the neighbors of existing rows, whose vectors are read from the index
+// instead of being passed in. rowid is an INTEGER or a BLOB of int64 rowids,
+// several rows being searched for like knn_weighted() with weights of 1. The
+// rows are excluded from the results if exclude is non-zero. ef and exclude
+// are optional, ef can be NULL if only exclude is specified.
+void KnnParamRowidFunc(sqlite3_context* context, int argc,
+                       sqlite3_value** argv);
+
+// knn_group_by(knn_param, group_by, n) returns a copy of knn_param whose
+// search returns at most n rows per group, so that e.g. the k results come
+// from k different documents. group_by is the name of an attribute or
+// "rowid / <divisor>". n is optional and defaults to 1.
+void KnnGroupByFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// knn_weighted(knn_param, weights) returns a copy of knn_param whose vector
+// holds one query vector per weight, concatenated. The distance of a row is
+// the sum of its distances to the query vectors multiplied by their weights,
+// e.g. weights 1 and -1 find rows like the first vector and unlike the
+// second. weights is a float32 vector BLOB.
+void KnnWeightedFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// vectorlite_stats(table_name) returns runtime statistics of a vectorlite
+// table as JSON. The user data of the function must be a
+// std::shared_ptr<TableRegistry>*.
+void StatsFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// knn_search_batch(table_name, queries, k, ef) searches for the k nearest
+// neighbors of each of queries in a vectorlite table at once, which is faster
+// than one knn_search per query. queries is a BLOB of vectors concatenated.
+// ef is optional. Returns the results as JSON, see
+// VirtualTable::BatchSearchToJson(). The user data of the function must be a
+// std::shared_ptr<TableRegistry>*.
+void BatchSearchFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// vectorlite_bulk_insert(table_name, rowids, vectors, num_threads) inserts rows
+// into a vectorlite table at once, see VirtualTable::BulkInsert(). rowids is a
+// BLOB of 64-bit integers and vectors is a BLOB of vectors concatenated.
+// num_threads is optional, 0(the default) means all hardware threads.
+// Returns the number of rows inserted. The user data of the function must be
+// a std::shared_ptr<TableRegistry>*.
+void BulkInsertFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// vectorlite_bulk_update(table_name, rowids, vectors, num_threads) replaces
+// the vectors of existing rows of a vectorlite table at once, see
+// VirtualTable::BulkUpdate(), e.g. to re-embed a table after a model upgrade.
+// Its parameters are the same as vectorlite_bulk_insert()'s. Returns the
+// number of rows updated. The user data of the function must be a
+// std::shared_ptr<TableRegistry>*.
+void BulkUpdateFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// vectorlite_optimize(table_name, ef, num_threads) improves the search quality
+// of a vectorlite table whose rows were inserted with a low ef_construction,
+// see VirtualTable::Optimize(). num_threads is optional, 0(the default) means
+// all hardware threads. Returns the number of rows whose links changed. It can
+// be interrupted by sqlite3_interrupt(), keeping the improvements made so far.
+// The user data of the function must be a std::shared_ptr<TableRegistry>*.
+void OptimizeFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// vectorlite_delete_range(table_name, min_rowid, max_rowid) deletes the rows of
+// a vectorlite table whose rowid is between min_rowid and max_rowid inclusive,
+// e.g. rows that expired when rowids are timestamps. It takes time linear in
+// the size of the table, and the deleted rows stay in the index until
+// vectorlite_compact() is called. Returns the number of rows deleted. The user
+// data of the function must be a std::shared_ptr<TableRegistry>*.
+void DeleteRangeFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// vectorlite_compact(table_name, num_threads) drops the deleted rows of a
+// vectorlite table by rebuilding its index, see VirtualTable::Compact().
+// num_threads is optional, 0(the default) means all hardware threads. Returns
+// the number of deleted rows dropped. The user data of the function must be a
+// std::shared_ptr<TableRegistry>*.
+void CompactFunc(sqlite3_context* context, int argc, sqlite3_value** argv);
+
+// vectorlite_train_transform(table_name, sample_query, method) trains the
+// transform of a vectorlite table reducing vectors, e.g. declared with
+// `float32[1536->512]`, see VirtualTable::TrainTransform(). sample_query is a
+// SELECT statement whose first column holds BLOBs of one or more sample
+// vectors of the table's input dimension concatenated. method is
+// optional and is "pca"(the default) or "random", for which sample_query is
+// ignored and can be NULL. Returns the number of sample vectors used. The
+// user data of the function must be a std::shared_ptr<TableRegistry>*.
+void TrainTransformFunc(sqlite3_context* context, int argc,
+                        sqlite3_value** argv);
+
 }  // end namespace vectorlite
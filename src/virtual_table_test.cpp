@@ -0,0 +1,159 @@
+// virtual_table.h is not included on purpose. It calls sqlite3 APIs through
+// sqlite3_api, which is only set once the extension is loaded. The virtual
+// table is tested through SQL instead.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "constraint.h"
+#include "gtest/gtest.h"
+#include "sqlite3.h"
+#include "vector.h"
+
+extern "C" int sqlite3_extension_init(sqlite3* db, char** pzErrMsg,
+                                      const sqlite3_api_routines* pApi);
+
+// Counts heap allocations made through operator new while enabled.
+static std::atomic<bool> g_count_allocations{false};
+static std::atomic<size_t> g_num_allocations{0};
+
+void* operator new(size_t size) {
+  if (g_count_allocations.load(std::memory_order_relaxed)) {
+    g_num_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr int kDim = 8;
+constexpr int kNumElements = 500;
+
+class VirtualTableTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    sqlite3_auto_extension(
+        reinterpret_cast<void (*)(void)>(sqlite3_extension_init));
+    ASSERT_EQ(SQLITE_OK, sqlite3_open(":memory:", &db_));
+    Exec("create virtual table t using vectorlite(v float32[" +
+         std::to_string(kDim) +
+         "], hnsw(max_elements=" + std::to_string(kNumElements) + "))");
+
+    sqlite3_stmt* insert = Prepare("insert into t(rowid, v) values (?, ?)");
+    for (int i = 0; i < kNumElements; i++) {
+      std::vector<float> v(kDim);
+      for (int j = 0; j < kDim; j++) {
+        v[j] = static_cast<float>((i * 31 + j * 17) % 97);
+      }
+      sqlite3_bind_int64(insert, 1, i);
+      sqlite3_bind_blob(insert, 2, v.data(), v.size() * sizeof(float),
+                        SQLITE_TRANSIENT);
+      ASSERT_EQ(SQLITE_DONE, sqlite3_step(insert));
+      sqlite3_reset(insert);
+    }
+    sqlite3_finalize(insert);
+  }
+
+  void TearDown() override {
+    sqlite3_close(db_);
+    sqlite3_cancel_auto_extension(
+        reinterpret_cast<void (*)(void)>(sqlite3_extension_init));
+  }
+
+  void Exec(const std::string& sql) {
+    char* error = nullptr;
+    ASSERT_EQ(SQLITE_OK, sqlite3_exec(db_, sql.c_str(), nullptr, nullptr,
+                                      &error))
+        << error;
+  }
+
+  sqlite3_stmt* Prepare(const std::string& sql) {
+    sqlite3_stmt* stmt = nullptr;
+    EXPECT_EQ(SQLITE_OK,
+              sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr))
+        << sqlite3_errmsg(db_);
+    return stmt;
+  }
+
+  // Runs stmt to completion and returns the number of rows.
+  int Run(sqlite3_stmt* stmt) {
+    int rows = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      rows++;
+    }
+    EXPECT_EQ(SQLITE_DONE, rc) << sqlite3_errmsg(db_);
+    sqlite3_reset(stmt);
+    return rows;
+  }
+
+  // Returns the number of allocations made by running stmt once, after
+  // running it a few times to warm up the cursor.
+  size_t CountSteadyStateAllocations(sqlite3_stmt* stmt, int expected_rows) {
+    for (int i = 0; i < 3; i++) {
+      EXPECT_EQ(expected_rows, Run(stmt));
+    }
+    g_num_allocations = 0;
+    g_count_allocations = true;
+    int rows = Run(stmt);
+    g_count_allocations = false;
+    EXPECT_EQ(expected_rows, rows);
+    return g_num_allocations;
+  }
+
+  sqlite3* db_ = nullptr;
+};
+
+TEST_F(VirtualTableTest, KnnSearchShouldNotAllocateInSteadyState) {
+#ifndef NDEBUG
+  GTEST_SKIP() << "DLOG allocates in debug builds";
+#endif
+  // knn_param is bound directly, so that only the cost of the virtual table
+  // is measured.
+  vectorlite::KnnParam param;
+  param.query_vector = vectorlite::Vector(std::vector<float>(kDim, 1.0f));
+  param.k = 10;
+  sqlite3_stmt* stmt = Prepare(
+      "select rowid, distance from t where knn_search(v, ?)");
+  sqlite3_bind_pointer(stmt, 1, &param, vectorlite::kKnnParamType.data(),
+                       nullptr);
+  EXPECT_EQ(0, CountSteadyStateAllocations(stmt, 10));
+
+  param.ef_search = 64;
+  EXPECT_EQ(0, CountSteadyStateAllocations(stmt, 10));
+  sqlite3_finalize(stmt);
+
+  stmt = Prepare(
+      "select rowid, distance from t where knn_search(v, ?) and rowid in (1, "
+      "2, 3)");
+  sqlite3_bind_pointer(stmt, 1, &param, vectorlite::kKnnParamType.data(),
+                       nullptr);
+  EXPECT_EQ(0, CountSteadyStateAllocations(stmt, 3));
+  sqlite3_finalize(stmt);
+}
+
+TEST_F(VirtualTableTest, RowidSearchShouldNotAllocateInSteadyState) {
+#ifndef NDEBUG
+  GTEST_SKIP() << "DLOG allocates in debug builds";
+#endif
+  sqlite3_stmt* stmt = Prepare("select rowid from t where rowid = 42");
+  EXPECT_EQ(0, CountSteadyStateAllocations(stmt, 1));
+  sqlite3_finalize(stmt);
+
+  stmt = Prepare("select rowid from t where rowid in (1, 2, 3, 1000)");
+  EXPECT_EQ(0, CountSteadyStateAllocations(stmt, 3));
+  sqlite3_finalize(stmt);
+}
+
+}  // namespace